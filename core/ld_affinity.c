@@ -0,0 +1,361 @@
+#define _GNU_SOURCE
+
+#include "ld_affinity.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+int ld_core_class_parse(const char *s, enum ld_core_class *out) {
+    if (!s) {
+        return -1;
+    }
+    if (strcasecmp(s, "P") == 0) {
+        *out = LD_CLASS_P;
+    } else if (strcasecmp(s, "E") == 0) {
+        *out = LD_CLASS_E;
+    } else if (strcasecmp(s, "favored") == 0) {
+        *out = LD_CLASS_FAVORED;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *ld_core_class_name(enum ld_core_class cls) {
+    switch (cls) {
+    case LD_CLASS_P: return "P";
+    case LD_CLASS_E: return "E";
+    case LD_CLASS_FAVORED: return "favored";
+    }
+    return "unknown";
+}
+
+static long read_long_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    long v = -1;
+    if (fscanf(f, "%ld", &v) != 1) {
+        v = -1;
+    }
+    fclose(f);
+    return v;
+}
+
+/* CPPC highest_perf, or cpuinfo_max_freq where CPPC is not exposed; -1 when neither is readable. */
+static long cpu_rank(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/acpi_cppc/highest_perf", cpu);
+    long v = read_long_file(path);
+    if (v < 0) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+        v = read_long_file(path);
+    }
+    return v;
+}
+
+int ld_core_class_cpus(enum ld_core_class cls, struct ld_cpu_list *out, char *err, size_t err_sz) {
+    struct ld_cpu_list p_list, e_list, u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    int rc = 0;
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "failed to enumerate CPUs");
+        }
+        rc = -1;
+        goto out;
+    }
+
+    const struct ld_cpu_list *src = cls == LD_CLASS_E ? &e_list : &p_list;
+    long best = -1;
+    if (cls == LD_CLASS_FAVORED) {
+        for (size_t i = 0; i < src->count; i++) {
+            long rank = cpu_rank(src->ids[i]);
+            if (rank > best) {
+                best = rank;
+            }
+        }
+    }
+    for (size_t i = 0; i < src->count; i++) {
+        // Without a readable rank every P-core counts as favored.
+        if (best >= 0 && cpu_rank(src->ids[i]) != best) {
+            continue;
+        }
+        if (ld_cpu_list_add(out, src->ids[i]) != 0) {
+            rc = -1;
+            goto out;
+        }
+    }
+    if (out->count == 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "no online %s cores", ld_core_class_name(cls));
+        }
+        rc = -1;
+    }
+out:
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
+    return rc;
+}
+
+void ld_cpu_list_format(const struct ld_cpu_list *list, char *out, size_t out_sz) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < list->count && used < out_sz; i++) {
+        size_t j = i;
+        while (j + 1 < list->count && list->ids[j + 1] == list->ids[j] + 1) {
+            j++;
+        }
+        int n;
+        if (j > i) {
+            n = snprintf(out + used, out_sz - used, "%s%d-%d", used ? "," : "", list->ids[i], list->ids[j]);
+        } else {
+            n = snprintf(out + used, out_sz - used, "%s%d", used ? "," : "", list->ids[i]);
+        }
+        if (n < 0) {
+            break;
+        }
+        used += (size_t)n;
+        i = j;
+    }
+}
+
+int ld_cpu_list_parse(const char *text, struct ld_cpu_list *out) {
+    const char *p = text;
+    while (*p && *p != '\n') {
+        char *end = NULL;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return -1;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (ld_cpu_list_add(out, (int)cpu) != 0) {
+                return -1;
+            }
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p && *p != '\n') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int to_cpu_set(const struct ld_cpu_list *cpus, cpu_set_t *set) {
+    CPU_ZERO(set);
+    for (size_t i = 0; i < cpus->count; i++) {
+        if (cpus->ids[i] < 0 || cpus->ids[i] >= CPU_SETSIZE) {
+            return -1;
+        }
+        CPU_SET(cpus->ids[i], set);
+    }
+    return 0;
+}
+
+int ld_affinity_set_pid(pid_t pid, const struct ld_cpu_list *cpus, size_t *threads, char *err, size_t err_sz) {
+    cpu_set_t set;
+    if (to_cpu_set(cpus, &set) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "CPU number out of range");
+        }
+        return -1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "no such process %d", (int)pid);
+        }
+        return -1;
+    }
+    size_t count = 0;
+    int rc = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (!isdigit((unsigned char)de->d_name[0])) {
+            continue;
+        }
+        pid_t tid = (pid_t)atoi(de->d_name);
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+            // A thread that exited in between is not an error.
+            if (errno == ESRCH) {
+                continue;
+            }
+            if (err && err_sz) {
+                snprintf(err, err_sz, "sched_setaffinity(%d) failed: %s", (int)tid, strerror(errno));
+            }
+            rc = -1;
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+    if (threads) {
+        *threads = count;
+    }
+    return rc;
+}
+
+static int cpuset_enabled(const char *dir) {
+    char path[512];
+    char buf[512] = {0};
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", dir);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 0;
+    }
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    for (char *save = NULL, *tok = strtok_r(buf, " \n", &save); tok; tok = strtok_r(NULL, " \n", &save)) {
+        if (strcmp(tok, "cpuset") == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ld_cgroup_pin(const char *cgroup, const struct ld_cpu_list *cpus, const char **via, size_t *threads, char *err,
+                  size_t err_sz) {
+    char dir[384];
+    char path[512];
+    snprintf(dir, sizeof(dir), "%s/%s", LD_CGROUP_ROOT, cgroup);
+    if (cpuset_enabled(dir)) {
+        char list[1024];
+        ld_cpu_list_format(cpus, list, sizeof(list));
+        snprintf(path, sizeof(path), "%s/cpuset.cpus", dir);
+        if (via) {
+            *via = "cpuset";
+        }
+        if (threads) {
+            *threads = 0;
+        }
+        return ld_write_text_file(path, list, err, err_sz);
+    }
+
+    cpu_set_t set;
+    if (to_cpu_set(cpus, &set) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "CPU number out of range");
+        }
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/cgroup.threads", dir);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "open(%s) failed: %s", path, strerror(errno));
+        }
+        return -1;
+    }
+    if (via) {
+        *via = "affinity";
+    }
+    size_t count = 0;
+    int rc = 0;
+    int tid = 0;
+    while (fscanf(f, "%d", &tid) == 1) {
+        if (sched_setaffinity((pid_t)tid, sizeof(set), &set) != 0 && errno != ESRCH) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "sched_setaffinity(%d) failed: %s", tid, strerror(errno));
+            }
+            rc = -1;
+            break;
+        }
+        count++;
+    }
+    fclose(f);
+    if (threads) {
+        *threads = count;
+    }
+    return rc;
+}
+
+/* Adds cpuset to dir's cgroup.subtree_control unless it is there already. */
+static int delegate_cpuset(const char *dir, char *err, size_t err_sz) {
+    char path[512];
+    char buf[512] = {0};
+    snprintf(path, sizeof(path), "%s/cgroup.subtree_control", dir);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[n] = '\0';
+        for (char *save = NULL, *tok = strtok_r(buf, " \n", &save); tok; tok = strtok_r(NULL, " \n", &save)) {
+            if (strcmp(tok, "cpuset") == 0) {
+                return 0;
+            }
+        }
+    }
+    return ld_write_text_file(path, "+cpuset", err, err_sz);
+}
+
+int ld_cgroup_enter(const char *cgroup, const struct ld_cpu_list *cpus, pid_t pid, char *err, size_t err_sz) {
+    char dir[384];
+    char path[512];
+    snprintf(dir, sizeof(dir), "%s", LD_CGROUP_ROOT);
+    // Walk down one level at a time: each parent has to hand cpuset to its children.
+    const char *p = cgroup;
+    while (*p) {
+        while (*p == '/') {
+            p++;
+        }
+        size_t len = strcspn(p, "/");
+        if (len == 0) {
+            break;
+        }
+        if (delegate_cpuset(dir, err, err_sz) != 0) {
+            return -1;
+        }
+        size_t used = strlen(dir);
+        if (used + 1 + len >= sizeof(dir)) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "cgroup path too long");
+            }
+            return -1;
+        }
+        dir[used] = '/';
+        memcpy(dir + used + 1, p, len);
+        dir[used + 1 + len] = '\0';
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "mkdir(%s) failed: %s", dir, strerror(errno));
+            }
+            return -1;
+        }
+        p += len;
+    }
+
+    char list[1024];
+    ld_cpu_list_format(cpus, list, sizeof(list));
+    snprintf(path, sizeof(path), "%s/cpuset.cpus", dir);
+    if (ld_write_text_file(path, list, err, err_sz) != 0) {
+        return -1;
+    }
+    char pid_text[32];
+    snprintf(pid_text, sizeof(pid_text), "%d", (int)pid);
+    snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+    return ld_write_text_file(path, pid_text, err, err_sz);
+}
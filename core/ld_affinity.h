@@ -0,0 +1,64 @@
+#ifndef LD_AFFINITY_H
+#define LD_AFFINITY_H
+
+/*
+ * Workload placement on a core class: the P or E list from
+ * ld_enumerate_cpus() (CPUID 0x1A), or the favored cores, i.e. the P-cores
+ * with the highest ACPI CPPC highest_perf (Turbo Boost Max 3.0 / ITMT
+ * preferred cores). Needs no MSR access, so it runs as the calling user.
+ *
+ * A class can be applied to every thread of a process (threads inherit
+ * the creator's mask, so later ones follow) or to a cgroup v2 cpuset.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_CGROUP_ROOT "/sys/fs/cgroup"
+
+enum ld_core_class {
+    LD_CLASS_P,
+    LD_CLASS_E,
+    LD_CLASS_FAVORED,
+};
+
+/* "P", "E" or "favored" (case-insensitive); -1 for anything else. */
+int ld_core_class_parse(const char *s, enum ld_core_class *out);
+const char *ld_core_class_name(enum ld_core_class cls);
+
+/* Online CPUs of the class, ascending. Fails when the class is empty (E on a non-hybrid part). */
+int ld_core_class_cpus(enum ld_core_class cls, struct ld_cpu_list *out, char *err, size_t err_sz);
+
+/* cpuset list syntax ("0-3,8,10-11"). */
+void ld_cpu_list_format(const struct ld_cpu_list *list, char *out, size_t out_sz);
+/* Appends the CPUs of a cpuset list to out; -1 on a syntax error. */
+int ld_cpu_list_parse(const char *text, struct ld_cpu_list *out);
+
+/* Sets the affinity of every thread of pid; *threads (may be NULL) gets the number changed. */
+int ld_affinity_set_pid(pid_t pid, const struct ld_cpu_list *cpus, size_t *threads, char *err, size_t err_sz);
+
+/*
+ * Restricts cgroup (relative to LD_CGROUP_ROOT) to cpus. Uses cpuset.cpus
+ * when the cpuset controller is enabled there, otherwise sets the affinity
+ * of every thread in cgroup.threads. *via gets "cpuset" or "affinity".
+ */
+int ld_cgroup_pin(const char *cgroup, const struct ld_cpu_list *cpus, const char **via, size_t *threads, char *err,
+                  size_t err_sz);
+
+/*
+ * Creates cgroup if needed, enables the cpuset controller for it in the
+ * parent, writes cpuset.cpus and moves pid into it.
+ */
+int ld_cgroup_enter(const char *cgroup, const struct ld_cpu_list *cpus, pid_t pid, char *err, size_t err_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+
+#include "ld_budget.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ld_affinity.h"
+
+/* Dead band around the budget, and the smoothing of the measured watts. */
+#define BUDGET_HIGH 1.02
+#define BUDGET_LOW 0.90
+#define BUDGET_EWMA 0.5
+
+int ld_budget_mode_parse(const char *s, enum ld_budget_mode *out) {
+    if (!s) {
+        return -1;
+    }
+    if (strcasecmp(s, "watch") == 0) {
+        *out = LD_BUDGET_WATCH;
+    } else if (strcasecmp(s, "quota") == 0) {
+        *out = LD_BUDGET_QUOTA;
+    } else if (strcasecmp(s, "ratio") == 0) {
+        *out = LD_BUDGET_RATIO;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *ld_budget_mode_name(enum ld_budget_mode mode) {
+    switch (mode) {
+    case LD_BUDGET_WATCH: return "watch";
+    case LD_BUDGET_QUOTA: return "quota";
+    case LD_BUDGET_RATIO: return "ratio";
+    }
+    return "unknown";
+}
+
+void ld_budget_init(struct ld_budget *b, const char *cgroup) {
+    memset(b, 0, sizeof(*b));
+    while (*cgroup == '/') {
+        cgroup++;
+    }
+    snprintf(b->cgroup, sizeof(b->cgroup), "%s", cgroup);
+    ld_cpu_list_init(&b->cpus);
+    b->quota_us = -1;
+    b->period_us = LD_BUDGET_PERIOD_US;
+    b->quota_max_us = -1;
+    ld_budget_quota_load(b);
+}
+
+void ld_budget_free(struct ld_budget *b) {
+    ld_cpu_list_free(&b->cpus);
+}
+
+static FILE *open_cgroup_file(const char *cgroup, const char *file, const char *mode) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", LD_CGROUP_ROOT, cgroup, file);
+    return fopen(path, mode);
+}
+
+int ld_cgroup_usage_usec(const char *cgroup, uint64_t *out) {
+    FILE *f = open_cgroup_file(cgroup, "cpu.stat", "r");
+    if (!f) {
+        return -1;
+    }
+    char key[64];
+    uint64_t value = 0;
+    int rc = -1;
+    while (fscanf(f, "%63s %" SCNu64, key, &value) == 2) {
+        if (strcmp(key, "usage_usec") == 0) {
+            *out = value;
+            rc = 0;
+            break;
+        }
+    }
+    fclose(f);
+    return rc;
+}
+
+int ld_cgroup_effective_cpus(const char *cgroup, struct ld_cpu_list *out) {
+    FILE *f = open_cgroup_file(cgroup, "cpuset.cpus.effective", "r");
+    if (f) {
+        char text[1024] = {0};
+        int ok = fgets(text, sizeof(text), f) != NULL;
+        fclose(f);
+        if (ok && text[0] != '\n' && ld_cpu_list_parse(text, out) == 0 && out->count > 0) {
+            return 0;
+        }
+        out->count = 0;
+    }
+    struct ld_cpu_list e_list, u_list;
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    int rc = ld_enumerate_cpus(out, &e_list, &u_list, NULL);
+    for (size_t i = 0; rc == 0 && i < e_list.count; i++) {
+        rc = ld_cpu_list_add(out, e_list.ids[i]);
+    }
+    for (size_t i = 0; rc == 0 && i < u_list.count; i++) {
+        rc = ld_cpu_list_add(out, u_list.ids[i]);
+    }
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
+    return rc;
+}
+
+int ld_cgroup_quota_read(const char *cgroup, long *quota_us, long *period_us) {
+    FILE *f = open_cgroup_file(cgroup, "cpu.max", "r");
+    if (!f) {
+        return -1;
+    }
+    char quota[32];
+    long period = 0;
+    int n = fscanf(f, "%31s %ld", quota, &period);
+    fclose(f);
+    if (n != 2 || period <= 0) {
+        return -1;
+    }
+    *quota_us = strcmp(quota, "max") == 0 ? -1 : strtol(quota, NULL, 10);
+    *period_us = period;
+    return 0;
+}
+
+int ld_budget_quota_load(struct ld_budget *b) {
+    long quota = 0;
+    long period = 0;
+    if (ld_cgroup_quota_read(b->cgroup, &quota, &period) != 0) {
+        return -1;
+    }
+    b->quota_us = quota;
+    b->period_us = period;
+    b->quota_max_us = quota;
+    if (quota < 0) {
+        snprintf(b->saved_max, sizeof(b->saved_max), "max %ld", period);
+    } else {
+        snprintf(b->saved_max, sizeof(b->saved_max), "%ld %ld", quota, period);
+    }
+    return 0;
+}
+
+int ld_budget_update(struct ld_budget *b, const struct ld_cpu_energy *e, char *err, size_t err_sz) {
+    uint64_t usage = 0;
+    if (ld_cgroup_usage_usec(b->cgroup, &usage) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "%s: no cpu.stat (cgroup gone or not cgroup v2)", b->cgroup);
+        }
+        b->valid = 0;
+        return -1;
+    }
+    b->cpus.count = 0;
+    ld_cgroup_effective_cpus(b->cgroup, &b->cpus);
+
+    int had_usage = b->have_usage;
+    uint64_t delta = had_usage && usage >= b->usage_usec ? usage - b->usage_usec : 0;
+    b->usage_usec = usage;
+    b->have_usage = 1;
+    if (!had_usage || e->dt_s <= 0.0) {
+        return 0;
+    }
+
+    double usage_s = (double)delta / 1e6;
+    double busy_s = 0.0;
+    double joules = ld_cpu_energy_sum(e, &b->cpus, &busy_s);
+    // usage_usec and /proc/stat tick at different granularity; never charge more than the CPUs used.
+    double share = busy_s > 0.0 ? usage_s / busy_s : 0.0;
+    if (share > 1.0) {
+        share = 1.0;
+    }
+    b->watts = joules * share / e->dt_s;
+    b->watts_avg = b->valid ? BUDGET_EWMA * b->watts + (1.0 - BUDGET_EWMA) * b->watts_avg : b->watts;
+    b->cpu_load = usage_s / e->dt_s;
+    b->valid = 1;
+    return 0;
+}
+
+static double clampd(double v, double lo, double hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static int step_quota(struct ld_budget *b) {
+    double ncpus = b->cpus.count > 0 ? (double)b->cpus.count : 1.0;
+    // The cgroup's own quota is the ceiling: a budget only ever lowers what the admin allowed.
+    double ceiling = b->quota_max_us < 0 ? ncpus : (double)b->quota_max_us / (double)b->period_us;
+    if (ceiling > ncpus) {
+        ceiling = ncpus;
+    }
+    double limit = b->quota_us < 0 ? ncpus : (double)b->quota_us / (double)b->period_us;
+    double next;
+    if (b->watts_avg > b->budget_w * BUDGET_HIGH) {
+        // Cut from what the cgroup actually used, not from an unused allowance.
+        double used = clampd(b->cpu_load, 0.01, limit);
+        next = used * clampd(b->budget_w / b->watts_avg, 0.5, 0.95);
+    } else if (b->watts_avg < b->budget_w * BUDGET_LOW && b->quota_us >= 0) {
+        double scale = b->watts_avg > 0.05 ? clampd(b->budget_w / b->watts_avg, 1.05, 1.5) : 1.5;
+        next = limit * scale;
+    } else {
+        return 0;
+    }
+    long quota = b->quota_max_us;
+    if (next < ceiling) {
+        quota = lround(next * (double)b->period_us);
+        if (quota < LD_BUDGET_MIN_QUOTA_US) {
+            quota = LD_BUDGET_MIN_QUOTA_US;
+        }
+    }
+    if (quota == b->quota_us) {
+        return 0;
+    }
+    b->quota_us = quota;
+    return 1;
+}
+
+static int step_ratio(struct ld_budget *b) {
+    int next = b->ratio;
+    if (b->watts_avg > b->budget_w * BUDGET_HIGH) {
+        next -= b->watts_avg > b->budget_w * 1.25 ? 2 : 1;
+        if (next < LD_BUDGET_RATIO_MIN) {
+            next = LD_BUDGET_RATIO_MIN;
+        }
+    } else if (b->watts_avg < b->budget_w * BUDGET_LOW && next < b->ratio_max) {
+        next++;
+    }
+    if (next == b->ratio) {
+        return 0;
+    }
+    b->ratio = next;
+    return 1;
+}
+
+int ld_budget_step(struct ld_budget *b) {
+    if (!b->valid || b->budget_w <= 0.0) {
+        return 0;
+    }
+    switch (b->mode) {
+    case LD_BUDGET_QUOTA: return step_quota(b);
+    case LD_BUDGET_RATIO: return step_ratio(b);
+    case LD_BUDGET_WATCH: break;
+    }
+    return 0;
+}
+
+static int write_cpu_max(const char *cgroup, const char *text, char *err, size_t err_sz) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/cpu.max", LD_CGROUP_ROOT, cgroup);
+    return ld_write_text_file(path, text, err, err_sz);
+}
+
+int ld_budget_write_quota(struct ld_budget *b, char *err, size_t err_sz) {
+    if (!b->saved_max[0] && ld_budget_quota_load(b) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "%s: no cpu.max (enable the cpu controller in the parent)", b->cgroup);
+        }
+        return -1;
+    }
+    char text[64];
+    if (b->quota_us < 0) {
+        snprintf(text, sizeof(text), "max %ld", b->period_us);
+    } else {
+        snprintf(text, sizeof(text), "%ld %ld", b->quota_us, b->period_us);
+    }
+    int rc = write_cpu_max(b->cgroup, text, err, err_sz);
+    if (rc == 0) {
+        b->wrote_max = 1;
+    }
+    return rc;
+}
+
+int ld_budget_restore_quota(struct ld_budget *b, char *err, size_t err_sz) {
+    if (!b->wrote_max) {
+        return 0;
+    }
+    int rc = write_cpu_max(b->cgroup, b->saved_max, err, err_sz);
+    if (rc == 0) {
+        b->wrote_max = 0;
+    }
+    return rc;
+}
@@ -0,0 +1,92 @@
+#ifndef LD_BUDGET_H
+#define LD_BUDGET_H
+
+/*
+ * Per-cgroup power attribution and watt budgets (cgroup v2).
+ *
+ * A cgroup's share of an interval is its cpu.stat usage_usec delta charged
+ * at the energy per busy second of the CPUs it may run on
+ * (cpuset.cpus.effective, see ld_energy.h for the per-CPU split). A cgroup
+ * confined to P-cores therefore pays P-core prices.
+ *
+ * Budgets are held with a feedback step per interval on the smoothed
+ * watts, with a dead band (-10 % .. +2 %) so the limit settles instead of
+ * oscillating:
+ *   quota  scales cpu.max from the CPU time actually used, never above
+ *          the cgroup's own cpu.max from when the budget started, and
+ *          back to that value once the budget allows it.
+ *   ratio  steps the ratio of the cgroup's cpuset cores. Only meaningful
+ *          when the cgroup has the cores to itself.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ld_core.h"
+#include "ld_energy.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_BUDGET_PERIOD_US 100000
+#define LD_BUDGET_MIN_QUOTA_US 1000
+#define LD_BUDGET_RATIO_MIN 8
+
+enum ld_budget_mode {
+    LD_BUDGET_WATCH,
+    LD_BUDGET_QUOTA,
+    LD_BUDGET_RATIO,
+};
+
+struct ld_budget {
+    char cgroup[256];           /* relative to LD_CGROUP_ROOT */
+    enum ld_budget_mode mode;
+    double budget_w;
+    struct ld_cpu_list cpus;    /* cpuset.cpus.effective at the last update */
+    uint64_t usage_usec;
+    int have_usage;
+    int valid;                  /* watts describe a full interval */
+    double watts;               /* last interval */
+    double watts_avg;           /* smoothed; what the controller acts on */
+    double cpu_load;            /* CPUs' worth of time used in the last interval */
+    long quota_us;              /* quota mode: -1 means "max" */
+    long period_us;
+    long quota_max_us;          /* the cgroup's own quota, the ceiling for quota_us; -1 means "max" */
+    char saved_max[64];         /* cpu.max as loaded, written back on release; empty when it had none */
+    int wrote_max;              /* cpu.max was changed by the budget */
+    int ratio;                  /* ratio mode */
+    int ratio_max;
+};
+
+/* "watch", "quota" or "ratio"; -1 for anything else. */
+int ld_budget_mode_parse(const char *s, enum ld_budget_mode *out);
+const char *ld_budget_mode_name(enum ld_budget_mode mode);
+
+/* Loads the cgroup's current cpu.max as its starting quota, ceiling and saved value (when it has one). */
+void ld_budget_init(struct ld_budget *b, const char *cgroup);
+void ld_budget_free(struct ld_budget *b);
+
+int ld_cgroup_usage_usec(const char *cgroup, uint64_t *out);
+/* cpuset.cpus.effective, or every online CPU when the cgroup has no cpuset. */
+int ld_cgroup_effective_cpus(const char *cgroup, struct ld_cpu_list *out);
+int ld_cgroup_quota_read(const char *cgroup, long *quota_us, long *period_us);
+/* (Re)loads quota_us, period_us, quota_max_us and saved_max from cpu.max; -1 when the cgroup has none. */
+int ld_budget_quota_load(struct ld_budget *b);
+
+/* Attributes the last interval of e to b. Fails when the cgroup is gone. */
+int ld_budget_update(struct ld_budget *b, const struct ld_cpu_energy *e, char *err, size_t err_sz);
+
+/* One feedback step toward budget_w; returns 1 when quota_us or ratio changed and has to be applied. */
+int ld_budget_step(struct ld_budget *b);
+
+/* Writes quota_us/period_us to cpu.max. */
+int ld_budget_write_quota(struct ld_budget *b, char *err, size_t err_sz);
+/* Puts back the saved cpu.max; a no-op when the budget never wrote it. */
+int ld_budget_restore_quota(struct ld_budget *b, char *err, size_t err_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
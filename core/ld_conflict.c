@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+
+#include "ld_conflict.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct writer_name {
+    const char *name;
+    const char *comm;
+};
+
+static const struct writer_name writer_names[LD_CONFLICT_WRITER_COUNT] = {
+    [LD_CONFLICT_THERMALD] = { "thermald", "thermald" },
+    [LD_CONFLICT_TUNED] = { "tuned", "tuned" },
+    [LD_CONFLICT_TUNED_PPD] = { "tuned-ppd", "tuned-ppd" },
+    [LD_CONFLICT_PPD] = { "power-profiles-daemon", "power-profiles-" },
+};
+
+void ld_conflict_init(struct ld_conflict_monitor *m, double now_s) {
+    memset(m, 0, sizeof(*m));
+    for (size_t i = 0; i < LD_CONFLICT_WRITER_COUNT; i++) {
+        m->services[i].name = writer_names[i].name;
+        m->services[i].comm = writer_names[i].comm;
+    }
+    m->start_s = now_s;
+}
+
+int ld_conflict_source(struct ld_conflict_monitor *m, const char *name) {
+    for (size_t i = 0; i < m->source_count; i++) {
+        if (strcmp(m->sources[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    if (m->source_count >= LD_CONFLICT_MAX_SOURCES) {
+        return -1;
+    }
+    struct ld_conflict_source *src = &m->sources[m->source_count];
+    memset(src, 0, sizeof(*src));
+    snprintf(src->name, sizeof(src->name), "%s", name);
+    return (int)m->source_count++;
+}
+
+static int read_small(const char *path, char *out, size_t out_sz) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    size_t n = fread(out, 1, out_sz - 1, f);
+    fclose(f);
+    out[n] = '\0';
+    return 0;
+}
+
+/* Sum of the schedstat timeslice counts (third field) over all threads. */
+static uint64_t process_wakeups(int pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return 0;
+    }
+    uint64_t total = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (!isdigit((unsigned char)de->d_name[0])) {
+            continue;
+        }
+        char stat_path[96];
+        char buf[128];
+        snprintf(stat_path, sizeof(stat_path), "/proc/%d/task/%d/schedstat", pid, atoi(de->d_name));
+        uint64_t run_ns = 0;
+        uint64_t wait_ns = 0;
+        uint64_t slices = 0;
+        if (read_small(stat_path, buf, sizeof(buf)) == 0 &&
+            sscanf(buf, "%" SCNu64 " %" SCNu64 " %" SCNu64, &run_ns, &wait_ns, &slices) == 3) {
+            total += slices;
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+static void scan_services(struct ld_conflict_monitor *m, double now_s) {
+    int pids[LD_CONFLICT_WRITER_COUNT] = { 0 };
+    DIR *proc = opendir("/proc");
+    if (proc) {
+        struct dirent *de;
+        while ((de = readdir(proc)) != NULL) {
+            if (!isdigit((unsigned char)de->d_name[0])) {
+                continue;
+            }
+            int pid = atoi(de->d_name);
+            char path[64];
+            char comm[32];
+            snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+            if (read_small(path, comm, sizeof(comm)) != 0) {
+                continue;
+            }
+            comm[strcspn(comm, "\n")] = '\0';
+            for (size_t i = 0; i < LD_CONFLICT_WRITER_COUNT; i++) {
+                if (!pids[i] && strcmp(comm, m->services[i].comm) == 0) {
+                    pids[i] = pid;
+                }
+            }
+        }
+        closedir(proc);
+    }
+
+    for (size_t i = 0; i < LD_CONFLICT_WRITER_COUNT; i++) {
+        struct ld_conflict_service *svc = &m->services[i];
+        uint64_t wakeups = pids[i] ? process_wakeups(pids[i]) : 0;
+        // A (re)start counts as activity: a starting daemon applies its limits.
+        svc->woke = pids[i] && m->samples > 0 && (pids[i] != svc->pid || wakeups > svc->wakeups);
+        if (svc->woke) {
+            svc->last_active_s = now_s;
+        }
+        svc->pid = pids[i];
+        svc->wakeups = wakeups;
+    }
+}
+
+void ld_conflict_begin(struct ld_conflict_monitor *m, double now_s) {
+    m->sample_changed = 0;
+    m->sample_reverted = 0;
+    m->smi.fired = 0;
+    scan_services(m, now_s);
+}
+
+void ld_conflict_observe(struct ld_conflict_monitor *m, int idx, uint64_t value, double now_s) {
+    if (idx < 0 || (size_t)idx >= m->source_count) {
+        return;
+    }
+    struct ld_conflict_source *src = &m->sources[idx];
+    if (!src->valid) {
+        src->valid = 1;
+        src->value = value;
+        return;
+    }
+    if (value == src->value) {
+        return;
+    }
+    src->changes++;
+    src->last_change_s = now_s;
+    m->sample_changed = 1;
+    if (src->has_expected && src->value == src->expected) {
+        src->reverts++;
+        m->sample_reverted = 1;
+    }
+    src->value = value;
+}
+
+void ld_conflict_observe_smi(struct ld_conflict_monitor *m, uint32_t count, double now_s) {
+    struct ld_conflict_smi *smi = &m->smi;
+    if (smi->valid) {
+        // 32-bit counter; unsigned subtraction handles the wrap.
+        smi->last_delta = count - smi->count;
+        smi->total += smi->last_delta;
+        smi->fired = smi->last_delta > 0 && m->samples > 0;
+        if (smi->fired) {
+            smi->last_s = now_s;
+        }
+    }
+    smi->valid = 1;
+    smi->count = count;
+}
+
+void ld_conflict_end(struct ld_conflict_monitor *m, double now_s) {
+    if (m->samples > 0) {
+        m->intervals++;
+        if (m->sample_changed) {
+            m->events++;
+        }
+        if (m->sample_reverted) {
+            m->revert_events++;
+        }
+        for (size_t i = 0; i < LD_CONFLICT_WRITER_COUNT; i++) {
+            struct ld_conflict_service *svc = &m->services[i];
+            if (!svc->woke) {
+                continue;
+            }
+            svc->woke_intervals++;
+            if (m->sample_changed) {
+                svc->correlated++;
+            }
+            if (m->sample_reverted) {
+                svc->reverts++;
+            }
+        }
+        if (m->smi.fired) {
+            m->smi.fired_intervals++;
+            m->smi.correlated += m->sample_changed;
+            m->smi.reverts += m->sample_reverted;
+        }
+    }
+    m->samples++;
+    m->last_sample_s = now_s;
+}
+
+void ld_conflict_expect(struct ld_conflict_monitor *m, int idx, uint64_t value) {
+    if (idx < 0 || (size_t)idx >= m->source_count) {
+        return;
+    }
+    struct ld_conflict_source *src = &m->sources[idx];
+    src->valid = 1;
+    src->value = value;
+    src->has_expected = 1;
+    src->expected = value;
+}
+
+static double lift(const struct ld_conflict_monitor *m, uint32_t active_intervals, uint32_t correlated) {
+    uint32_t quiet = m->intervals - m->events;
+    if (m->events == 0) {
+        return 0.0;
+    }
+    double with_change = (double)correlated / m->events;
+    double without = quiet ? (double)(active_intervals - correlated) / quiet : 0.0;
+    return with_change - without;
+}
+
+double ld_conflict_lift(const struct ld_conflict_monitor *m, const struct ld_conflict_service *svc) {
+    return lift(m, svc->woke_intervals, svc->correlated);
+}
+
+double ld_conflict_smi_lift(const struct ld_conflict_monitor *m) {
+    return lift(m, m->smi.fired_intervals, m->smi.correlated);
+}
+
+const struct ld_conflict_service *ld_conflict_culprit(const struct ld_conflict_monitor *m, double *confidence,
+                                                      int *proven) {
+    const struct ld_conflict_service *best = NULL;
+    double best_lift = 0.0;
+    if (m->events >= 2) {
+        for (size_t i = 0; i < LD_CONFLICT_WRITER_COUNT; i++) {
+            double lift = ld_conflict_lift(m, &m->services[i]);
+            if (m->services[i].correlated > 0 && lift > best_lift) {
+                best = &m->services[i];
+                best_lift = lift;
+            }
+        }
+    }
+    if (confidence) {
+        *confidence = best_lift;
+    }
+    if (proven) {
+        *proven = best && best->reverts >= 2 && best_lift >= 0.5;
+    }
+    return best;
+}
@@ -0,0 +1,123 @@
+#ifndef LD_CONFLICT_H
+#define LD_CONFLICT_H
+
+/*
+ * Detects other daemons rewriting the power limits.
+ *
+ * The caller feeds one value per watched source (MSR 0x610, MCHBAR 0x59A0,
+ * powercap constraint files) on every sample. Between samples the monitor
+ * checks which of the known writer daemons ran, using the per-thread
+ * wakeup counters in /proc/<pid>/task/<tid>/schedstat: a sysfs or MSR
+ * write costs too little CPU time to show up in utime, but every wakeup
+ * bumps the counter. A change that nobody in this process made is
+ * credited to every daemon that woke up in the same interval. A daemon
+ * that wakes up in every interval anyway proves nothing, so services are
+ * ranked by lift: P(woke | change) - P(woke | no change).
+ *
+ * Values this process wrote itself are recorded with ld_conflict_expect();
+ * a later change away from such a value counts as a revert, which is the
+ * evidence that a daemon is actually fighting our limits.
+ *
+ * Firmware rewrites limits from SMM, where no process wakes up. When the
+ * caller also feeds MSR_SMI_COUNT, intervals with SMIs are scored against
+ * the changes the same way, as a writer of their own.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_CONFLICT_MAX_SOURCES 32
+
+enum ld_conflict_writer {
+    LD_CONFLICT_THERMALD,
+    LD_CONFLICT_TUNED,
+    LD_CONFLICT_TUNED_PPD,
+    LD_CONFLICT_PPD,
+    LD_CONFLICT_WRITER_COUNT,
+};
+
+struct ld_conflict_source {
+    char name[112];         /* "msr:0x610", "mchbar:0x59a0" or "<zone id>/<constraint>" */
+    int valid;
+    uint64_t value;
+    int has_expected;
+    uint64_t expected;
+    uint32_t changes;
+    uint32_t reverts;
+    double last_change_s;
+};
+
+struct ld_conflict_service {
+    const char *name;       /* unit name without .service */
+    const char *comm;       /* /proc/<pid>/comm, truncated to 15 chars by the kernel */
+    int pid;                /* 0 when not running */
+    uint64_t wakeups;       /* summed schedstat timeslices of all threads */
+    double last_active_s;   /* last sample where wakeups advanced; 0 = never seen */
+    int woke;               /* wakeups advanced since the previous sample */
+    uint32_t woke_intervals;
+    uint32_t correlated;    /* foreign change events that coincided with a wakeup */
+    uint32_t reverts;       /* ... of which undid a value we wrote */
+};
+
+struct ld_conflict_smi {
+    int valid;
+    uint32_t count;         /* last MSR_SMI_COUNT reading */
+    uint64_t total;         /* SMIs since the first reading */
+    uint32_t last_delta;    /* SMIs in the latest interval */
+    double last_s;          /* last sample with SMIs; 0 = never seen */
+    int fired;
+    uint32_t fired_intervals;
+    uint32_t correlated;
+    uint32_t reverts;
+};
+
+struct ld_conflict_monitor {
+    struct ld_conflict_source sources[LD_CONFLICT_MAX_SOURCES];
+    size_t source_count;
+    struct ld_conflict_service services[LD_CONFLICT_WRITER_COUNT];
+    double start_s;
+    double last_sample_s;
+    uint64_t samples;
+    uint32_t intervals;      /* samples after the first, i.e. with a baseline */
+    uint32_t events;         /* intervals with at least one foreign change */
+    uint32_t revert_events;
+    int sample_changed;
+    int sample_reverted;
+    struct ld_conflict_smi smi;
+};
+
+void ld_conflict_init(struct ld_conflict_monitor *m, double now_s);
+/* Returns the source index (existing or new), -1 when the table is full. */
+int ld_conflict_source(struct ld_conflict_monitor *m, const char *name);
+
+/* One sample: begin, observe each readable source, end. */
+void ld_conflict_begin(struct ld_conflict_monitor *m, double now_s);
+void ld_conflict_observe(struct ld_conflict_monitor *m, int idx, uint64_t value, double now_s);
+void ld_conflict_end(struct ld_conflict_monitor *m, double now_s);
+
+/* MSR_SMI_COUNT for the current sample, between begin and end. */
+void ld_conflict_observe_smi(struct ld_conflict_monitor *m, uint32_t count, double now_s);
+
+/* Records a value this process just wrote; the change to it is not counted. */
+void ld_conflict_expect(struct ld_conflict_monitor *m, int idx, uint64_t value);
+
+/* Lift in [-1, 1]; 0 before the first change event. */
+double ld_conflict_lift(const struct ld_conflict_monitor *m, const struct ld_conflict_service *svc);
+double ld_conflict_smi_lift(const struct ld_conflict_monitor *m);
+/*
+ * Service with the highest positive lift, or NULL before two change events
+ * were seen. *proven is set when it also reverted values we wrote at least
+ * twice with a lift of at least 0.5.
+ */
+const struct ld_conflict_service *ld_conflict_culprit(const struct ld_conflict_monitor *m, double *confidence,
+                                                      int *proven);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
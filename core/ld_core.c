@@ -0,0 +1,631 @@
+#define _GNU_SOURCE
+
+#include "ld_core.h"
+
+#include <cpuid.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../mchbar_base.h"
+#include "ld_cpufreq.h"
+#include "ld_powercap.h"
+
+struct msr_handle {
+    int fd;
+    int writable;
+};
+
+static struct msr_handle *msr_handles = NULL;
+static size_t msr_handle_count = 0;
+
+static struct ld_mmio shared_mmio = { -1, NULL, 0, 0 };
+
+/* Core type per CPU: 0 = not looked up yet, -1 = unknown, else CPUID 0x1A type. */
+static int *core_types = NULL;
+static size_t core_type_count = 0;
+
+int ld_rdmsr(int fd, uint32_t reg, uint64_t *out) {
+    ssize_t n = pread(fd, out, sizeof(*out), reg);
+    if (n != (ssize_t)sizeof(*out)) {
+        return -1;
+    }
+    return 0;
+}
+
+int ld_wrmsr(int fd, uint32_t reg, uint64_t val) {
+    ssize_t n = pwrite(fd, &val, sizeof(val), reg);
+    if (n != (ssize_t)sizeof(val)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int grow_int_table(int **table, size_t *count, size_t need, int fill) {
+    if (need <= *count) {
+        return 0;
+    }
+    size_t next = *count ? *count : 64;
+    while (next < need) {
+        next *= 2;
+    }
+    int *grown = realloc(*table, next * sizeof(*grown));
+    if (!grown) {
+        return -1;
+    }
+    for (size_t i = *count; i < next; i++) {
+        grown[i] = fill;
+    }
+    *table = grown;
+    *count = next;
+    return 0;
+}
+
+static int ensure_msr_handle(int cpu) {
+    if ((size_t)cpu < msr_handle_count) {
+        return 0;
+    }
+    size_t next = msr_handle_count ? msr_handle_count : 64;
+    while (next <= (size_t)cpu) {
+        next *= 2;
+    }
+    struct msr_handle *grown = realloc(msr_handles, next * sizeof(*grown));
+    if (!grown) {
+        return -1;
+    }
+    for (size_t i = msr_handle_count; i < next; i++) {
+        grown[i].fd = -1;
+        grown[i].writable = 0;
+    }
+    msr_handles = grown;
+    msr_handle_count = next;
+    return 0;
+}
+
+int ld_msr_fd(int cpu, int write) {
+    if (cpu < 0 || ensure_msr_handle(cpu) != 0) {
+        errno = cpu < 0 ? EINVAL : ENOMEM;
+        return -1;
+    }
+    struct msr_handle *h = &msr_handles[cpu];
+    if (h->fd >= 0 && (h->writable || !write)) {
+        return h->fd;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
+    int fd = open(path, (write ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (h->fd >= 0) {
+        close(h->fd);
+    }
+    h->fd = fd;
+    h->writable = write ? 1 : 0;
+    return fd;
+}
+
+void ld_msr_forget(int cpu) {
+    if (cpu >= 0 && (size_t)cpu < msr_handle_count && msr_handles[cpu].fd >= 0) {
+        close(msr_handles[cpu].fd);
+        msr_handles[cpu].fd = -1;
+        msr_handles[cpu].writable = 0;
+    }
+}
+
+/*
+ * A CPU that went offline and came back gets a new msr device node, so a
+ * cached handle can go stale. Drop it and retry once on ENXIO/ENODEV.
+ */
+static int stale_handle_error(void) {
+    return errno == ENXIO || errno == ENODEV || errno == EBADF;
+}
+
+int ld_msr_read(int cpu, uint32_t reg, uint64_t *out) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = ld_msr_fd(cpu, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (ld_rdmsr(fd, reg, out) == 0) {
+            return 0;
+        }
+        if (!stale_handle_error()) {
+            return -1;
+        }
+        ld_msr_forget(cpu);
+    }
+    return -1;
+}
+
+int ld_msr_write(int cpu, uint32_t reg, uint64_t val) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = ld_msr_fd(cpu, 1);
+        if (fd < 0) {
+            return -1;
+        }
+        if (ld_wrmsr(fd, reg, val) == 0) {
+            return 0;
+        }
+        if (!stale_handle_error()) {
+            return -1;
+        }
+        ld_msr_forget(cpu);
+    }
+    return -1;
+}
+
+size_t ld_msr_read_batch(struct ld_msr_op *ops, size_t count) {
+    size_t ok = 0;
+    for (size_t i = 0; i < count; i++) {
+        ops[i].ok = ld_msr_read(ops[i].cpu, ops[i].reg, &ops[i].value) == 0;
+        if (!ops[i].ok) {
+            ops[i].value = 0;
+        } else {
+            ok++;
+        }
+    }
+    return ok;
+}
+
+int ld_mmio_open(struct ld_mmio *mmio, int write, char *err, size_t err_sz) {
+    mmio->fd = -1;
+    mmio->base = NULL;
+    mmio->phys = 0;
+    mmio->writable = 0;
+
+    uint64_t mchbar_base = 0;
+    char base_err[256] = {0};
+    if (mchbar_get_base(&mchbar_base, base_err, sizeof(base_err)) != 0) {
+        snprintf(err, err_sz, "MCHBAR base discovery failed: %s", base_err[0] ? base_err : "unknown error");
+        return -1;
+    }
+
+    int fd = open("/dev/mem", (write ? O_RDWR : O_RDONLY) | O_SYNC | O_CLOEXEC);
+    if (fd < 0) {
+        snprintf(err, err_sz, "open(/dev/mem) failed: %s", strerror(errno));
+        return -1;
+    }
+
+    int prot = write ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void *map = mmap(NULL, LD_MCHBAR_MAP_SIZE, prot, MAP_SHARED, fd, (off_t)mchbar_base);
+    if (map == MAP_FAILED) {
+        snprintf(err, err_sz, "mmap MMIO failed: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    mmio->fd = fd;
+    mmio->base = (volatile uint8_t *)map;
+    mmio->phys = mchbar_base;
+    mmio->writable = write ? 1 : 0;
+    return 0;
+}
+
+void ld_mmio_close(struct ld_mmio *mmio) {
+    if (mmio->base) {
+        munmap((void *)mmio->base, LD_MCHBAR_MAP_SIZE);
+        mmio->base = NULL;
+    }
+    if (mmio->fd >= 0) {
+        close(mmio->fd);
+        mmio->fd = -1;
+    }
+    mmio->writable = 0;
+}
+
+struct ld_mmio *ld_mmio_shared(int write, char *err, size_t err_sz) {
+    if (shared_mmio.base && (shared_mmio.writable || !write)) {
+        return &shared_mmio;
+    }
+    struct ld_mmio next;
+    if (ld_mmio_open(&next, write, err, err_sz) != 0) {
+        return NULL;
+    }
+    ld_mmio_close(&shared_mmio);
+    shared_mmio = next;
+    return &shared_mmio;
+}
+
+void ld_rapl_units_decode(uint64_t raw, struct ld_rapl_units *out) {
+    out->power_unit = (int)LD_FIELD_GET(raw, LD_RAPL_POWER_UNIT_POWER);
+    out->energy_unit = (int)LD_FIELD_GET(raw, LD_RAPL_POWER_UNIT_ENERGY);
+    out->time_unit = (int)LD_FIELD_GET(raw, LD_RAPL_POWER_UNIT_TIME);
+    out->unit_watts = 1.0 / (double)(1u << out->power_unit);
+    out->energy_unit_j = 1.0 / (double)(1u << out->energy_unit);
+    out->time_unit_s = 1.0 / (double)(1u << out->time_unit);
+}
+
+int ld_rapl_units_read(struct ld_rapl_units *out) {
+    uint64_t raw = 0;
+    if (ld_msr_read(0, LD_MSR_RAPL_POWER_UNIT, &raw) != 0) {
+        return -1;
+    }
+    ld_rapl_units_decode(raw, out);
+    return 0;
+}
+
+uint64_t ld_pl_set_units(uint64_t cur, uint16_t pl1_units, uint16_t pl2_units) {
+    cur = LD_FIELD_SET(cur, LD_PKG_POWER_LIMIT_PL1, pl1_units);
+    return LD_FIELD_SET(cur, LD_PKG_POWER_LIMIT_PL2, pl2_units);
+}
+
+int ld_watts_to_units(double watts, double unit_watts, uint16_t *out) {
+    if (!(unit_watts > 0.0) || !isfinite(watts)) {
+        return -1;
+    }
+    long long units = llround(watts / unit_watts);
+    if (units <= 0 || (uint64_t)units > LD_FIELD_GET(~0ULL, LD_PKG_POWER_LIMIT_PL1)) {
+        return -1;
+    }
+    *out = (uint16_t)units;
+    return 0;
+}
+
+int ld_write_text_file(const char *path, const char *text, char *err, size_t err_sz) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "open(%s) failed: %s", path, strerror(errno));
+        }
+        return -1;
+    }
+    size_t len = strlen(text);
+    ssize_t n = write(fd, text, len);
+    int saved_errno = errno;
+    close(fd);
+    if (n != (ssize_t)len) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "write(%s) failed: %s", path, strerror(saved_errno));
+        }
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+int ld_write_powercap_uw(uint64_t pl1_uw, uint64_t pl2_uw, char *err, size_t err_sz) {
+    struct ld_powercap *pc = ld_powercap_shared(err, err_sz);
+    if (!pc) {
+        return -1;
+    }
+    struct ld_powercap_zone *pkg = ld_powercap_package(pc);
+    if (!pkg) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "no package powercap zone");
+        }
+        return -1;
+    }
+    int pl1 = ld_powercap_constraint_find(pkg, "long_term");
+    int pl2 = ld_powercap_constraint_find(pkg, "short_term");
+    if (pl1 < 0) {
+        pl1 = 0;
+    }
+    if (pl2 < 0) {
+        pl2 = 1;
+    }
+    if (ld_powercap_set_limit_uw(pkg, (size_t)pl1, pl1_uw, err, err_sz) != 0) {
+        return -1;
+    }
+    return ld_powercap_set_limit_uw(pkg, (size_t)pl2, pl2_uw, err, err_sz);
+}
+
+void ld_cpu_list_init(struct ld_cpu_list *list) {
+    list->ids = NULL;
+    list->count = 0;
+    list->cap = 0;
+}
+
+void ld_cpu_list_free(struct ld_cpu_list *list) {
+    free(list->ids);
+    list->ids = NULL;
+    list->count = 0;
+    list->cap = 0;
+}
+
+int ld_cpu_list_add(struct ld_cpu_list *list, int cpu) {
+    if (list->count == list->cap) {
+        size_t next = list->cap ? list->cap * 2 : 8;
+        int *new_ids = realloc(list->ids, next * sizeof(*new_ids));
+        if (!new_ids) {
+            return -1;
+        }
+        list->ids = new_ids;
+        list->cap = next;
+    }
+    list->ids[list->count++] = cpu;
+    return 0;
+}
+
+int ld_cpu_is_online(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return 1;
+    }
+    int val = 1;
+    if (fscanf(f, "%d", &val) != 1) {
+        val = 1;
+    }
+    fclose(f);
+    return val != 0;
+}
+
+int ld_core_type_supported(void) {
+    static int cached = -1;
+    if (cached >= 0) {
+        return cached;
+    }
+    unsigned int max = __get_cpuid_max(0, NULL);
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    cached = max >= 0x1A && __get_cpuid_count(0x1A, 0, &eax, &ebx, &ecx, &edx) && eax != 0;
+    return cached;
+}
+
+int ld_detect_core_type(int cpu, int *out_type) {
+    if (cpu < 0 || grow_int_table(&core_types, &core_type_count, (size_t)cpu + 1, 0) != 0) {
+        return 0;
+    }
+    if (core_types[cpu] > 0) {
+        *out_type = core_types[cpu];
+        return 1;
+    }
+    if (core_types[cpu] < 0) {
+        return 0;
+    }
+
+    cpu_set_t old_set;
+    if (sched_getaffinity(0, sizeof(old_set), &old_set) != 0) {
+        return 0;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    unsigned int max = __get_cpuid_max(0, NULL);
+    int type = -1;
+
+    if (max >= 0x1A && __get_cpuid_count(0x1A, 0, &eax, &ebx, &ecx, &edx) && eax != 0) {
+        type = (int)((eax >> 24) & 0xFFu);
+    }
+
+    (void)sched_setaffinity(0, sizeof(old_set), &old_set);
+
+    core_types[cpu] = type > 0 ? type : -1;
+    if (type <= 0) {
+        return 0;
+    }
+    *out_type = type;
+    return 1;
+}
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+int ld_enumerate_cpus(struct ld_cpu_list *p_list, struct ld_cpu_list *e_list, struct ld_cpu_list *u_list,
+                      int *supports) {
+    DIR *dir = opendir("/sys/devices/system/cpu");
+    if (!dir) {
+        return -1;
+    }
+
+    int has_core_type = ld_core_type_supported();
+    if (supports) {
+        *supports = has_core_type;
+    }
+
+    struct dirent *de = NULL;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "cpu", 3) != 0) {
+            continue;
+        }
+        const char *suffix = de->d_name + 3;
+        if (*suffix == '\0') {
+            continue;
+        }
+        char *end = NULL;
+        long cpu = strtol(suffix, &end, 10);
+        if (!end || *end != '\0' || cpu < 0) {
+            continue;
+        }
+        if (!ld_cpu_is_online((int)cpu)) {
+            continue;
+        }
+
+        struct ld_cpu_list *target = p_list;
+        if (has_core_type) {
+            int type = 0;
+            if (!ld_detect_core_type((int)cpu, &type)) {
+                target = u_list;
+            } else if (type == LD_CORE_TYPE_CORE) {
+                target = p_list;
+            } else if (type == LD_CORE_TYPE_ATOM) {
+                target = e_list;
+            } else {
+                target = u_list;
+            }
+        }
+        if (ld_cpu_list_add(target, (int)cpu) != 0) {
+            closedir(dir);
+            return -1;
+        }
+    }
+
+    closedir(dir);
+    qsort(p_list->ids, p_list->count, sizeof(int), compare_int);
+    qsort(e_list->ids, e_list->count, sizeof(int), compare_int);
+    qsort(u_list->ids, u_list->count, sizeof(int), compare_int);
+    return 0;
+}
+
+int ld_read_ratio_target(int cpu, uint8_t *ratio_out) {
+    uint64_t val = 0;
+    if (ld_msr_read(cpu, LD_MSR_PERF_CTL, &val) != 0) {
+        return -1;
+    }
+    *ratio_out = (uint8_t)LD_FIELD_GET(val, LD_PERF_CTL_RATIO);
+    return 0;
+}
+
+int ld_read_ratio_current(int cpu, uint8_t *ratio_out) {
+    uint64_t val = 0;
+    if (ld_msr_read(cpu, LD_MSR_PERF_STATUS, &val) != 0) {
+        return -1;
+    }
+    *ratio_out = (uint8_t)LD_FIELD_GET(val, LD_PERF_STATUS_RATIO);
+    return 0;
+}
+
+int ld_set_ratio(int cpu, uint8_t ratio) {
+    uint64_t cur = 0;
+    if (ld_msr_read(cpu, LD_MSR_PERF_CTL, &cur) != 0) {
+        return -1;
+    }
+    // Clear the whole 16-bit target field, then place the ratio in bits 15:8.
+    uint64_t next = LD_FIELD_SET(cur, LD_PERF_CTL_TARGET, 0);
+    next = LD_FIELD_SET(next, LD_PERF_CTL_RATIO, ratio);
+    return ld_msr_write(cpu, LD_MSR_PERF_CTL, next);
+}
+
+int ld_read_thermal_status(int cpu, uint64_t *thermal_out) {
+    return ld_msr_read(cpu, LD_MSR_THERM_STATUS, thermal_out);
+}
+
+uint32_t ld_oc_encode_offset_mv(double mv) {
+    long raw = lround(mv * 1.024);
+    return (uint32_t)LD_FIELD_SET(0, LD_OC_DATA_OFFSET, (uint64_t)raw);
+}
+
+double ld_oc_decode_offset_mv(uint32_t raw) {
+    int32_t val = (int32_t)LD_FIELD_GET(raw, LD_OC_DATA_OFFSET);
+    if (val & 0x400) {
+        val |= ~0x7FF;
+    }
+    return (double)val / 1.024;
+}
+
+static uint64_t oc_request(uint8_t cmd, uint8_t plane, uint32_t data) {
+    uint64_t req = LD_FIELD_SET(0, LD_OC_MAILBOX_BUSY, 1);
+    req = LD_FIELD_SET(req, LD_OC_MAILBOX_CMD, cmd);
+    req = LD_FIELD_SET(req, LD_OC_MAILBOX_PLANE, plane);
+    return LD_FIELD_SET(req, LD_OC_MAILBOX_DATA, data);
+}
+
+int ld_oc_mailbox_read(int cpu, uint8_t plane, uint32_t *data_out) {
+    if (ld_msr_write(cpu, LD_MSR_OC_MAILBOX, oc_request(LD_OC_CMD_READ_VOLTAGE, plane, 0)) != 0) {
+        return -1;
+    }
+    uint64_t resp = 0;
+    if (ld_msr_read(cpu, LD_MSR_OC_MAILBOX, &resp) != 0) {
+        return -1;
+    }
+    *data_out = (uint32_t)LD_FIELD_GET(resp, LD_OC_MAILBOX_DATA);
+    return 0;
+}
+
+int ld_oc_mailbox_write(int cpu, uint8_t plane, uint32_t data) {
+    return ld_msr_write(cpu, LD_MSR_OC_MAILBOX, oc_request(LD_OC_CMD_WRITE_VOLTAGE, plane, data));
+}
+
+int ld_oc_mailbox_call(int cpu, uint8_t cmd, uint8_t plane, uint8_t param, uint32_t data, uint32_t *data_out) {
+    uint64_t req = LD_FIELD_SET(oc_request(cmd, plane, data), LD_OC_MAILBOX_PARAM, param);
+    if (ld_msr_write(cpu, LD_MSR_OC_MAILBOX, req) != 0) {
+        return -1;
+    }
+    uint64_t resp = 0;
+    for (int tries = 0; tries < 100; tries++) {
+        if (ld_msr_read(cpu, LD_MSR_OC_MAILBOX, &resp) != 0) {
+            return -1;
+        }
+        if (!LD_FIELD_GET(resp, LD_OC_MAILBOX_BUSY)) {
+            if (data_out) {
+                *data_out = (uint32_t)LD_FIELD_GET(resp, LD_OC_MAILBOX_DATA);
+            }
+            return (int)LD_FIELD_GET(resp, LD_OC_MAILBOX_STATUS);
+        }
+        usleep(10);
+    }
+    errno = EBUSY;
+    return -1;
+}
+
+int ld_oc_vf_read(int cpu, uint8_t plane, struct ld_oc_vf_point *points, int max_points, int *count_out) {
+    *count_out = 0;
+    uint32_t plane_data = 0;
+    int rc = ld_oc_mailbox_call(cpu, LD_OC_CMD_READ_VOLTAGE, plane, 0, 0, &plane_data);
+    if (rc != 0) {
+        return rc;
+    }
+    int count = 0;
+    int distinct = 0;
+    for (int i = 1; i <= max_points && i <= LD_OC_MAX_VF_POINTS; i++) {
+        uint32_t data = 0;
+        rc = ld_oc_mailbox_call(cpu, LD_OC_CMD_READ_VOLTAGE, plane, (uint8_t)i, 0, &data);
+        if (rc < 0) {
+            return rc;
+        }
+        unsigned int ratio = (unsigned int)LD_FIELD_GET(data, LD_OC_DATA_RATIO);
+        if (rc > 0 || ratio == 0) {
+            break;
+        }
+        points[count].index = i;
+        points[count].ratio = ratio;
+        points[count].offset_mv = ld_oc_decode_offset_mv(data);
+        points[count].raw = data;
+        distinct |= data != plane_data;
+        count++;
+    }
+    // Firmware that ignores the param byte answers every point with the plane setting.
+    *count_out = distinct ? count : 0;
+    return 0;
+}
+
+int ld_oc_vf_write_offset(int cpu, uint8_t plane, int point, double mv, uint32_t *readback_out) {
+    if (point < 1 || point > LD_OC_MAX_VF_POINTS) {
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t data = 0;
+    int rc = ld_oc_mailbox_call(cpu, LD_OC_CMD_READ_VOLTAGE, plane, (uint8_t)point, 0, &data);
+    if (rc != 0) {
+        return rc;
+    }
+    data = (uint32_t)LD_FIELD_SET(data, LD_OC_DATA_OFFSET, LD_FIELD_GET(ld_oc_encode_offset_mv(mv), LD_OC_DATA_OFFSET));
+    rc = ld_oc_mailbox_call(cpu, LD_OC_CMD_WRITE_VOLTAGE, plane, (uint8_t)point, data, NULL);
+    if (rc != 0) {
+        return rc;
+    }
+    return ld_oc_mailbox_call(cpu, LD_OC_CMD_READ_VOLTAGE, plane, (uint8_t)point, 0, readback_out);
+}
+
+void ld_close_all(void) {
+    for (size_t i = 0; i < msr_handle_count; i++) {
+        if (msr_handles[i].fd >= 0) {
+            close(msr_handles[i].fd);
+        }
+    }
+    free(msr_handles);
+    msr_handles = NULL;
+    msr_handle_count = 0;
+    ld_mmio_close(&shared_mmio);
+    ld_powercap_shared_free();
+    ld_cpufreq_shared_free();
+}
@@ -0,0 +1,291 @@
+#ifndef LD_CORE_H
+#define LD_CORE_H
+
+/*
+ * Shared hardware primitives for all Limits_droper binaries: MSR and MCHBAR
+ * access, RAPL unit conversion, register field descriptors, P/E core
+ * enumeration and the OC mailbox.
+ *
+ * MSR file descriptors and the MCHBAR mapping are opened once and cached
+ * for the life of the process, so repeated reads (sensor polling, the
+ * helper's server mode) do not pay open/mmap/close on every sample. Call
+ * ld_close_all() to drop them.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_MSR_SMI_COUNT               0x34
+#define LD_MSR_MPERF                   0xE7
+#define LD_MSR_APERF                   0xE8
+#define LD_MSR_OC_MAILBOX              0x150
+#define LD_MSR_PERF_STATUS             0x198
+#define LD_MSR_PERF_CTL                0x199
+#define LD_MSR_THERM_STATUS            0x19C
+#define LD_MSR_TEMPERATURE_TARGET      0x1A2
+#define LD_MSR_PACKAGE_THERM_STATUS    0x1B1
+#define LD_MSR_RAPL_POWER_UNIT         0x606
+#define LD_MSR_PKG_POWER_LIMIT         0x610
+#define LD_MSR_PKG_ENERGY_STATUS       0x611
+#define LD_MSR_CORE_PERF_LIMIT_REASONS 0x64F
+
+#define LD_MCHBAR_MAP_SIZE             (2 * 1024 * 1024)
+#define LD_MCHBAR_PKG_POWER_LIMIT      0x59A0
+
+/*
+ * Register field descriptors: "shift, width" pairs. Use them through the
+ * LD_FIELD_* macros so every access folds to a constant shift and mask.
+ */
+#define LD_FIELD_MASK(f) LD_FIELD_MASK_(f)
+#define LD_FIELD_GET(v, f) LD_FIELD_GET_((v), f)
+#define LD_FIELD_SET(v, f, x) LD_FIELD_SET_((v), (x), f)
+#define LD_FIELD_MASK_(shift, width) \
+    ((((width) >= 64) ? ~0ULL : ((1ULL << (width)) - 1ULL)) << (shift))
+#define LD_FIELD_GET_(v, shift, width) \
+    (((uint64_t)(v) & LD_FIELD_MASK_(shift, width)) >> (shift))
+#define LD_FIELD_SET_(v, x, shift, width) \
+    (((uint64_t)(v) & ~LD_FIELD_MASK_(shift, width)) | \
+     (((uint64_t)(x) << (shift)) & LD_FIELD_MASK_(shift, width)))
+
+/* MSR_RAPL_POWER_UNIT (0x606) */
+#define LD_RAPL_POWER_UNIT_POWER     0, 4
+#define LD_RAPL_POWER_UNIT_ENERGY    8, 5
+#define LD_RAPL_POWER_UNIT_TIME      16, 4
+
+/* MSR_PKG_POWER_LIMIT (0x610), same layout at MCHBAR 0x59A0 */
+#define LD_PKG_POWER_LIMIT_PL1       0, 15
+#define LD_PKG_POWER_LIMIT_PL1_EN    15, 1
+#define LD_PKG_POWER_LIMIT_PL1_CLAMP 16, 1
+#define LD_PKG_POWER_LIMIT_PL1_TIME  17, 7
+#define LD_PKG_POWER_LIMIT_PL2       32, 15
+#define LD_PKG_POWER_LIMIT_PL2_EN    47, 1
+#define LD_PKG_POWER_LIMIT_PL2_CLAMP 48, 1
+#define LD_PKG_POWER_LIMIT_PL2_TIME  49, 7
+#define LD_PKG_POWER_LIMIT_LOCK      63, 1
+
+/* MSR_SMI_COUNT (0x34): SMIs since reset, package scope */
+#define LD_SMI_COUNT                 0, 32
+
+/* IA32_PERF_CTL (0x199) */
+#define LD_PERF_CTL_RATIO            8, 8
+#define LD_PERF_CTL_TARGET           0, 16
+
+/* IA32_PERF_STATUS (0x198) */
+#define LD_PERF_STATUS_RATIO         8, 8
+#define LD_PERF_STATUS_VID           32, 16
+
+/* IA32_THERM_STATUS (0x19C); IA32_PACKAGE_THERM_STATUS shares the layout */
+#define LD_THERM_STATUS_THERMAL      0, 1
+#define LD_THERM_STATUS_THERMAL_LOG  1, 1
+#define LD_THERM_STATUS_PROCHOT      2, 1
+#define LD_THERM_STATUS_PROCHOT_LOG  3, 1
+#define LD_THERM_STATUS_CRITICAL     4, 1
+#define LD_THERM_STATUS_POWER        10, 1
+#define LD_THERM_STATUS_POWER_LOG    11, 1
+#define LD_THERM_STATUS_CURRENT      12, 1
+#define LD_THERM_STATUS_CURRENT_LOG  13, 1
+#define LD_THERM_STATUS_XDOMAIN      14, 1
+#define LD_THERM_STATUS_XDOMAIN_LOG  15, 1
+#define LD_THERM_STATUS_READOUT      16, 7
+#define LD_THERM_STATUS_VALID        31, 1
+
+/* MSR_TEMPERATURE_TARGET (0x1A2) */
+#define LD_TEMPERATURE_TARGET_TJMAX  16, 8
+
+/* MSR_PKG_ENERGY_STATUS (0x611) */
+#define LD_PKG_ENERGY_STATUS_ENERGY  0, 32
+
+/* MSR_CORE_PERF_LIMIT_REASONS (0x64F), status bits only */
+#define LD_PERF_LIMIT_PROCHOT        0, 1
+#define LD_PERF_LIMIT_THERMAL        1, 1
+#define LD_PERF_LIMIT_RSR            4, 1
+#define LD_PERF_LIMIT_RATL           5, 1
+#define LD_PERF_LIMIT_VR_THERM       6, 1
+#define LD_PERF_LIMIT_VR_TDC         7, 1
+#define LD_PERF_LIMIT_OTHER          8, 1
+#define LD_PERF_LIMIT_PL1            10, 1
+#define LD_PERF_LIMIT_PL2            11, 1
+#define LD_PERF_LIMIT_MAX_TURBO      12, 1
+#define LD_PERF_LIMIT_TTA            13, 1
+
+/* OC mailbox (0x150): command in the high dword, data in the low dword */
+#define LD_OC_MAILBOX_DATA           0, 32
+#define LD_OC_MAILBOX_CMD            32, 8
+#define LD_OC_MAILBOX_PLANE          40, 8
+#define LD_OC_MAILBOX_PARAM          48, 8
+#define LD_OC_MAILBOX_BUSY           63, 1
+#define LD_OC_MAILBOX_STATUS         32, 8   /* completion code in the response, 0 = success */
+#define LD_OC_DATA_RATIO             0, 8
+#define LD_OC_DATA_VOLTAGE_TARGET    8, 12
+#define LD_OC_DATA_VOLTAGE_MODE      20, 1
+#define LD_OC_DATA_OFFSET            21, 11
+
+#define LD_OC_CMD_READ_VOLTAGE       0x10
+#define LD_OC_CMD_WRITE_VOLTAGE      0x11
+#define LD_OC_PLANE_CORE             0x0
+
+#define LD_CORE_TYPE_ATOM            0x20
+#define LD_CORE_TYPE_CORE            0x40
+
+/* ---- MSR ---- */
+
+int ld_rdmsr(int fd, uint32_t reg, uint64_t *out);
+int ld_wrmsr(int fd, uint32_t reg, uint64_t val);
+
+/* Cached /dev/cpu/N/msr handle. Owned by the library: do not close it. */
+int ld_msr_fd(int cpu, int write);
+int ld_msr_read(int cpu, uint32_t reg, uint64_t *out);
+int ld_msr_write(int cpu, uint32_t reg, uint64_t val);
+void ld_msr_forget(int cpu);
+
+struct ld_msr_op {
+    int cpu;
+    uint32_t reg;
+    uint64_t value;
+    int ok;
+};
+
+/* Reads every op through the cached handles; returns how many succeeded. */
+size_t ld_msr_read_batch(struct ld_msr_op *ops, size_t count);
+
+/* ---- MCHBAR MMIO ---- */
+
+struct ld_mmio {
+    int fd;
+    volatile uint8_t *base;
+    uint64_t phys;
+    int writable;
+};
+
+int ld_mmio_open(struct ld_mmio *mmio, int write, char *err, size_t err_sz);
+void ld_mmio_close(struct ld_mmio *mmio);
+/* Process-wide mapping, kept open until ld_close_all(). */
+struct ld_mmio *ld_mmio_shared(int write, char *err, size_t err_sz);
+
+static inline uint64_t ld_rd64(volatile uint8_t *base, uint32_t off) {
+    volatile uint32_t *p32 = (volatile uint32_t *)(base + off);
+    uint64_t lo = p32[0];
+    uint64_t hi = p32[1];
+    return lo | (hi << 32);
+}
+
+static inline void ld_wr64(volatile uint8_t *base, uint32_t off, uint64_t v) {
+    volatile uint32_t *p32 = (volatile uint32_t *)(base + off);
+    // write low then high, then read back to flush the posted write
+    p32[0] = (uint32_t)(v & 0xffffffffu);
+    p32[1] = (uint32_t)(v >> 32);
+    (void)p32[1];
+}
+
+/* ---- RAPL units and power limits ---- */
+
+struct ld_rapl_units {
+    int power_unit;
+    double unit_watts;
+    int energy_unit;
+    double energy_unit_j;
+    int time_unit;
+    double time_unit_s;
+};
+
+void ld_rapl_units_decode(uint64_t raw, struct ld_rapl_units *out);
+int ld_rapl_units_read(struct ld_rapl_units *out);
+
+uint64_t ld_pl_set_units(uint64_t cur, uint16_t pl1_units, uint16_t pl2_units);
+/* Returns 0 and the rounded field value, or -1 when it does not fit in 15 bits. */
+int ld_watts_to_units(double watts, double unit_watts, uint16_t *out);
+
+static inline uint16_t ld_pl1_units(uint64_t val) {
+    return (uint16_t)LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL1);
+}
+
+static inline uint16_t ld_pl2_units(uint64_t val) {
+    return (uint16_t)LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL2);
+}
+
+/* ---- powercap sysfs ---- */
+
+int ld_write_text_file(const char *path, const char *text, char *err, size_t err_sz);
+/*
+ * PL1/PL2 on the package zone's long_term/short_term constraints (see
+ * ld_powercap.h for the full zone tree).
+ */
+int ld_write_powercap_uw(uint64_t pl1_uw, uint64_t pl2_uw, char *err, size_t err_sz);
+
+/* ---- CPU topology ---- */
+
+struct ld_cpu_list {
+    int *ids;
+    size_t count;
+    size_t cap;
+};
+
+void ld_cpu_list_init(struct ld_cpu_list *list);
+void ld_cpu_list_free(struct ld_cpu_list *list);
+int ld_cpu_list_add(struct ld_cpu_list *list, int cpu);
+
+int ld_cpu_is_online(int cpu);
+int ld_core_type_supported(void);
+/* CPUID 0x1A core type, cached per CPU after the first lookup. */
+int ld_detect_core_type(int cpu, int *out_type);
+/* Online CPUs split into P / E / unknown lists, each sorted by id. */
+int ld_enumerate_cpus(struct ld_cpu_list *p_list, struct ld_cpu_list *e_list, struct ld_cpu_list *u_list,
+                      int *supports);
+
+/* ---- ratios and thermal status ---- */
+
+int ld_read_ratio_target(int cpu, uint8_t *ratio_out);
+int ld_read_ratio_current(int cpu, uint8_t *ratio_out);
+int ld_set_ratio(int cpu, uint8_t ratio);
+int ld_read_thermal_status(int cpu, uint64_t *thermal_out);
+
+/* IA32_PERF_STATUS VID field (bits 47:32) in volts; a VID of 0 means the CPU does not report it. */
+static inline double ld_vid_volts(uint32_t vid) {
+    return (double)vid / 8192.0;
+}
+
+/* ---- OC mailbox ---- */
+
+uint32_t ld_oc_encode_offset_mv(double mv);
+double ld_oc_decode_offset_mv(uint32_t raw);
+int ld_oc_mailbox_read(int cpu, uint8_t plane, uint32_t *data_out);
+int ld_oc_mailbox_write(int cpu, uint8_t plane, uint32_t data);
+
+/*
+ * One mailbox transaction with a param byte, waiting for BUSY to clear.
+ * Returns 0, -1 when the MSR access fails or the mailbox stays busy
+ * (errno set), or the nonzero completion code.
+ */
+int ld_oc_mailbox_call(int cpu, uint8_t cmd, uint8_t plane, uint8_t param, uint32_t data, uint32_t *data_out);
+
+/*
+ * Per-point V/F curve: on CPUs that expose it, the param byte of the
+ * voltage commands selects a V/F point (1-based) and the data holds that
+ * point's ratio and offset. Point 0 is the plane-wide setting that
+ * ld_oc_mailbox_write() changes. Firmware without per-point support rejects
+ * the param or ignores it; both read as no points.
+ */
+#define LD_OC_MAX_VF_POINTS 15
+
+struct ld_oc_vf_point {
+    int index;
+    unsigned int ratio;
+    double offset_mv;
+    uint32_t raw;
+};
+
+int ld_oc_vf_read(int cpu, uint8_t plane, struct ld_oc_vf_point *points, int max_points, int *count_out);
+/* Read-modify-write of one point's offset; *readback_out is the data read after the write. */
+int ld_oc_vf_write_offset(int cpu, uint8_t plane, int point, double mv, uint32_t *readback_out);
+
+void ld_close_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+#pragma once
+
+// Thin C++ layer over ld_core.h / ld_regs.h. Every register in LD_REGISTERS()
+// becomes a namespace (ld::pkg_power_limit, ld::therm_status, ...) holding
+// kAddr, kMask and one Field<> type per field, so decoding is a constexpr
+// shift and mask and new registers only need a table line.
+
+#include "ld_core.h"
+#include "ld_powercap.h"
+#include "ld_regs.h"
+
+#include <cstdint>
+#include <string>
+
+namespace ld {
+
+enum class Unit : std::uint8_t {
+    Raw = LD_UNIT_RAW,
+    Flag = LD_UNIT_FLAG,
+    Hex = LD_UNIT_HEX,
+    Power = LD_UNIT_POWER,
+    Energy = LD_UNIT_ENERGY,
+    TimeWindow = LD_UNIT_TIME_WINDOW,
+    Exp2 = LD_UNIT_EXP2,
+    Ratio = LD_UNIT_RATIO,
+    DegC = LD_UNIT_DEGC,
+    DegCBelow = LD_UNIT_DEGC_BELOW,
+    Vid = LD_UNIT_VID,
+    OcMv = LD_UNIT_OC_MV,
+};
+
+template <unsigned Shift, unsigned Width, bool Signed = false, Unit U = Unit::Raw>
+struct Field {
+    static_assert(Width > 0 && Shift + Width <= 64, "field outside 64-bit register");
+
+    static constexpr unsigned shift = Shift;
+    static constexpr unsigned width = Width;
+    static constexpr bool is_signed = Signed;
+    static constexpr Unit unit = U;
+
+    static constexpr std::uint64_t max() {
+        return Width >= 64 ? ~0ULL : ((1ULL << Width) - 1ULL);
+    }
+    static constexpr std::uint64_t mask() {
+        return max() << Shift;
+    }
+    static constexpr std::uint64_t get(std::uint64_t v) {
+        return (v & mask()) >> Shift;
+    }
+    static constexpr std::int64_t get_signed(std::uint64_t v) {
+        return (Signed && Width < 64 && ((get(v) >> (Width - 1)) & 1u))
+                   ? static_cast<std::int64_t>(get(v) | (~0ULL << Width))
+                   : static_cast<std::int64_t>(get(v));
+    }
+    static constexpr std::uint64_t set(std::uint64_t v, std::uint64_t x) {
+        return (v & ~mask()) | ((x << Shift) & mask());
+    }
+    static constexpr bool changed(std::uint64_t a, std::uint64_t b) {
+        return ((a ^ b) & mask()) != 0;
+    }
+};
+
+#define LD_CXX_FIELD_(name, shift, width, sign, unit) \
+    using name = Field<shift, width, (sign) == LD_SIGNED, static_cast<Unit>(unit)>;
+#define LD_CXX_FIELD(name, f, sign, unit) LD_CXX_FIELD_(name, f, sign, unit)
+#define LD_CXX_MASK_(name, shift, width, sign, unit) | LD_FIELD_MASK_(shift, width)
+#define LD_CXX_MASK(name, f, sign, unit) LD_CXX_MASK_(name, f, sign, unit)
+#define LD_CXX_REGISTER(id, name, space, addr, fields)                     \
+    namespace name {                                                       \
+    constexpr ld_reg_id kId = LD_REG_##id;                                 \
+    constexpr std::uint32_t kAddr = addr;                                  \
+    constexpr std::uint64_t kMask = 0 fields(LD_CXX_MASK);                 \
+    fields(LD_CXX_FIELD)                                                   \
+    constexpr std::uint64_t diff(std::uint64_t a, std::uint64_t b) {       \
+        return (a ^ b) & kMask;                                            \
+    }                                                                      \
+    }
+LD_REGISTERS(LD_CXX_REGISTER)
+#undef LD_CXX_REGISTER
+#undef LD_CXX_MASK
+#undef LD_CXX_MASK_
+#undef LD_CXX_FIELD
+#undef LD_CXX_FIELD_
+
+constexpr std::uint64_t apply_pl_units(std::uint64_t cur, std::uint16_t pl1_units, std::uint16_t pl2_units) {
+    return pkg_power_limit::pl2::set(pkg_power_limit::pl1::set(cur, pl1_units), pl2_units);
+}
+
+constexpr std::uint16_t pl1_units(std::uint64_t val) {
+    return static_cast<std::uint16_t>(pkg_power_limit::pl1::get(val));
+}
+
+constexpr std::uint16_t pl2_units(std::uint64_t val) {
+    return static_cast<std::uint16_t>(pkg_power_limit::pl2::get(val));
+}
+
+// "name=value ..." for every field of the register.
+inline std::string format(ld_reg_id id, std::uint64_t v, const ld_reg_ctx *ctx = nullptr) {
+    char buf[512];
+    ld_reg_format(ld_reg_get(id), v, ctx, buf, sizeof(buf));
+    return buf;
+}
+
+// "field: old -> new, ..." for the fields that differ; empty when none do.
+inline std::string diff(ld_reg_id id, std::uint64_t before, std::uint64_t after, const ld_reg_ctx *ctx = nullptr) {
+    char buf[512];
+    ld_reg_diff(ld_reg_get(id), before, after, ctx, buf, sizeof(buf));
+    return buf;
+}
+
+inline bool read_msr(int cpu, std::uint32_t reg, std::uint64_t &out) {
+    return ld_msr_read(cpu, reg, &out) == 0;
+}
+
+inline bool write_msr(int cpu, std::uint32_t reg, std::uint64_t val) {
+    return ld_msr_write(cpu, reg, val) == 0;
+}
+
+// Owns an MCHBAR mapping for its lifetime.
+class Mmio {
+public:
+    Mmio() = default;
+    Mmio(const Mmio &) = delete;
+    Mmio &operator=(const Mmio &) = delete;
+    ~Mmio() { ld_mmio_close(&mmio_); }
+
+    bool open(bool write, char *err, std::size_t err_sz) {
+        ld_mmio_close(&mmio_);
+        return ld_mmio_open(&mmio_, write ? 1 : 0, err, err_sz) == 0;
+    }
+    bool is_open() const { return mmio_.base != nullptr; }
+    std::uint64_t read64(std::uint32_t off) const { return ld_rd64(mmio_.base, off); }
+    void write64(std::uint32_t off, std::uint64_t v) const { ld_wr64(mmio_.base, off, v); }
+
+private:
+    ld_mmio mmio_{-1, nullptr, 0, 0};
+};
+
+}  // namespace ld
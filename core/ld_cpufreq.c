@@ -0,0 +1,419 @@
+#define _GNU_SOURCE
+
+#include "ld_cpufreq.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct ld_cpufreq shared_cpufreq;
+static int shared_cpufreq_ready = 0;
+
+static const char *const knob_names[LD_PSTATE_KNOB_COUNT] = {
+    [LD_PSTATE_MAX_PERF_PCT] = "max_perf_pct",
+    [LD_PSTATE_MIN_PERF_PCT] = "min_perf_pct",
+    [LD_PSTATE_NO_TURBO] = "no_turbo",
+};
+
+static int read_text_fd(int fd, char *buf, size_t buf_sz) {
+    ssize_t n = pread(fd, buf, buf_sz - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' ')) {
+        buf[--n] = '\0';
+    }
+    return 0;
+}
+
+static int read_text_path(const char *path, char *buf, size_t buf_sz) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = read_text_fd(fd, buf, buf_sz);
+    close(fd);
+    return rc;
+}
+
+static int parse_long_text(const char *text, long *out) {
+    char *end = NULL;
+    errno = 0;
+    long v = strtol(text, &end, 10);
+    if (errno != 0 || end == text) {
+        return -1;
+    }
+    *out = v;
+    return 0;
+}
+
+static int read_long_fd(int fd, long *out) {
+    char buf[32];
+    if (read_text_fd(fd, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    return parse_long_text(buf, out);
+}
+
+static int read_u32_path(const char *path, uint32_t *out) {
+    char buf[32];
+    long v = 0;
+    if (read_text_path(path, buf, sizeof(buf)) != 0 || parse_long_text(buf, &v) != 0 || v < 0) {
+        return -1;
+    }
+    *out = (uint32_t)v;
+    return 0;
+}
+
+static int open_cached(int *fd, const char *path, char *err, size_t err_sz) {
+    if (*fd >= 0) {
+        return 0;
+    }
+    *fd = open(path, O_RDWR | O_CLOEXEC);
+    if (*fd < 0) {
+        // Read-only is enough for sampling when we are not root.
+        *fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (*fd < 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "open(%s) failed: %s", path, strerror(errno));
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static int write_long_fd(int fd, const char *what, long value, char *err, size_t err_sz) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%ld", value);
+    if (pwrite(fd, buf, (size_t)len, 0) != (ssize_t)len) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "write %s=%ld failed: %s", what, value, strerror(errno));
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void cpu_file(const struct ld_cpufreq *cf, int cpu, const char *file, char *out, size_t out_sz) {
+    snprintf(out, out_sz, "%s/cpu%d/cpufreq/%s", cf->root, cpu, file);
+}
+
+int ld_cpufreq_open(struct ld_cpufreq *cf, const char *root, char *err, size_t err_sz) {
+    memset(cf, 0, sizeof(*cf));
+    for (size_t i = 0; i < LD_PSTATE_KNOB_COUNT; i++) {
+        cf->knob_fd[i] = -1;
+    }
+    snprintf(cf->root, sizeof(cf->root), "%s", root ? root : LD_CPUFREQ_ROOT);
+
+    DIR *dir = opendir(cf->root);
+    if (!dir) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "opendir(%s) failed: %s", cf->root, strerror(errno));
+        }
+        return -1;
+    }
+    int max_cpu = -1;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "cpu", 3) == 0 && isdigit((unsigned char)de->d_name[3])) {
+            int cpu = atoi(de->d_name + 3);
+            if (cpu > max_cpu) {
+                max_cpu = cpu;
+            }
+        }
+    }
+    closedir(dir);
+
+    if (max_cpu >= 0) {
+        cf->cpus = calloc((size_t)max_cpu + 1, sizeof(*cf->cpus));
+        if (!cf->cpus) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "out of memory");
+            }
+            return -1;
+        }
+        cf->cpu_count = (size_t)max_cpu + 1;
+    }
+    int first = -1;
+    for (size_t i = 0; i < cf->cpu_count; i++) {
+        struct ld_cpufreq_cpu *c = &cf->cpus[i];
+        char path[384];
+        c->min_fd = -1;
+        c->max_fd = -1;
+        cpu_file(cf, (int)i, "scaling_max_freq", path, sizeof(path));
+        if (access(path, F_OK) != 0) {
+            continue;
+        }
+        cpu_file(cf, (int)i, "cpuinfo_min_freq", path, sizeof(path));
+        read_u32_path(path, &c->cpuinfo_min_khz);
+        cpu_file(cf, (int)i, "cpuinfo_max_freq", path, sizeof(path));
+        read_u32_path(path, &c->cpuinfo_max_khz);
+        c->present = 1;
+        cf->present_count++;
+        if (first < 0) {
+            first = (int)i;
+        }
+    }
+
+    char path[384];
+    char text[32];
+    if (first >= 0) {
+        cpu_file(cf, first, "scaling_driver", path, sizeof(path));
+        read_text_path(path, cf->driver, sizeof(cf->driver));
+        cpu_file(cf, first, "scaling_governor", path, sizeof(path));
+        read_text_path(path, cf->governor, sizeof(cf->governor));
+    }
+    snprintf(path, sizeof(path), "%s/intel_pstate/status", cf->root);
+    if (read_text_path(path, text, sizeof(text)) == 0) {
+        if (strcmp(text, "active") == 0) {
+            cf->mode = LD_PSTATE_ACTIVE;
+        } else if (strcmp(text, "passive") == 0) {
+            cf->mode = LD_PSTATE_PASSIVE;
+        } else {
+            cf->mode = LD_PSTATE_OFF;
+        }
+    }
+    // intel_pstate only exposes EPP when HWP is in use.
+    if (cf->mode == LD_PSTATE_ACTIVE && first >= 0) {
+        cpu_file(cf, first, "energy_performance_preference", path, sizeof(path));
+        cf->hwp = access(path, F_OK) == 0;
+    }
+    return 0;
+}
+
+void ld_cpufreq_close(struct ld_cpufreq *cf) {
+    for (size_t i = 0; i < cf->cpu_count; i++) {
+        if (cf->cpus[i].min_fd >= 0) {
+            close(cf->cpus[i].min_fd);
+        }
+        if (cf->cpus[i].max_fd >= 0) {
+            close(cf->cpus[i].max_fd);
+        }
+    }
+    for (size_t i = 0; i < LD_PSTATE_KNOB_COUNT; i++) {
+        if (cf->knob_fd[i] >= 0) {
+            close(cf->knob_fd[i]);
+        }
+    }
+    free(cf->cpus);
+    memset(cf, 0, sizeof(*cf));
+    for (size_t i = 0; i < LD_PSTATE_KNOB_COUNT; i++) {
+        cf->knob_fd[i] = -1;
+    }
+}
+
+struct ld_cpufreq *ld_cpufreq_shared(char *err, size_t err_sz) {
+    if (!shared_cpufreq_ready) {
+        if (ld_cpufreq_open(&shared_cpufreq, NULL, err, err_sz) != 0) {
+            return NULL;
+        }
+        shared_cpufreq_ready = 1;
+    }
+    return &shared_cpufreq;
+}
+
+void ld_cpufreq_shared_free(void) {
+    if (shared_cpufreq_ready) {
+        ld_cpufreq_close(&shared_cpufreq);
+        shared_cpufreq_ready = 0;
+    }
+}
+
+const char *ld_pstate_mode_name(enum ld_pstate_mode mode) {
+    switch (mode) {
+    case LD_PSTATE_NONE: return "none";
+    case LD_PSTATE_ACTIVE: return "active";
+    case LD_PSTATE_PASSIVE: return "passive";
+    case LD_PSTATE_OFF: return "off";
+    }
+    return "unknown";
+}
+
+const char *ld_pstate_knob_name(enum ld_pstate_knob knob) {
+    return knob < LD_PSTATE_KNOB_COUNT ? knob_names[knob] : "unknown";
+}
+
+int ld_pstate_knob_find(const char *name) {
+    for (int i = 0; i < LD_PSTATE_KNOB_COUNT; i++) {
+        if (strcmp(name, knob_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int ld_cpufreq_has_cpu(const struct ld_cpufreq *cf, int cpu) {
+    return cf && cpu >= 0 && (size_t)cpu < cf->cpu_count && cf->cpus[cpu].present;
+}
+
+static int cpu_fds(struct ld_cpufreq *cf, int cpu, char *err, size_t err_sz) {
+    if (!ld_cpufreq_has_cpu(cf, cpu)) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "cpu%d has no cpufreq policy", cpu);
+        }
+        return -1;
+    }
+    struct ld_cpufreq_cpu *c = &cf->cpus[cpu];
+    char path[384];
+    cpu_file(cf, cpu, "scaling_min_freq", path, sizeof(path));
+    if (open_cached(&c->min_fd, path, err, err_sz) != 0) {
+        return -1;
+    }
+    cpu_file(cf, cpu, "scaling_max_freq", path, sizeof(path));
+    return open_cached(&c->max_fd, path, err, err_sz);
+}
+
+int ld_cpufreq_read(struct ld_cpufreq *cf, int cpu, uint32_t *min_khz, uint32_t *max_khz) {
+    if (cpu_fds(cf, cpu, NULL, 0) != 0) {
+        return -1;
+    }
+    long lo = 0;
+    long hi = 0;
+    if (read_long_fd(cf->cpus[cpu].min_fd, &lo) != 0 || read_long_fd(cf->cpus[cpu].max_fd, &hi) != 0) {
+        return -1;
+    }
+    *min_khz = (uint32_t)lo;
+    *max_khz = (uint32_t)hi;
+    return 0;
+}
+
+int ld_cpufreq_set(struct ld_cpufreq *cf, int cpu, uint32_t min_khz, uint32_t max_khz, char *err, size_t err_sz) {
+    uint32_t cur_min = 0;
+    uint32_t cur_max = 0;
+    if (cpu_fds(cf, cpu, err, err_sz) != 0) {
+        return -1;
+    }
+    if (ld_cpufreq_read(cf, cpu, &cur_min, &cur_max) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "read cpu%d scaling limits failed: %s", cpu, strerror(errno));
+        }
+        return -1;
+    }
+    uint32_t want_min = min_khz ? min_khz : cur_min;
+    uint32_t want_max = max_khz ? max_khz : cur_max;
+    if (want_min > want_max) {
+        if (min_khz) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "cpu%d: min %u kHz above max %u kHz", cpu, want_min, want_max);
+            }
+            return -1;
+        }
+        want_min = want_max;
+    }
+
+    struct ld_cpufreq_cpu *c = &cf->cpus[cpu];
+    char what[48];
+    // The kernel rejects max < min, so lower min first when the range moves down.
+    int min_first = want_max < cur_min;
+    for (int step = 0; step < 2; step++) {
+        int do_min = (step == 0) == min_first;
+        uint32_t want = do_min ? want_min : want_max;
+        uint32_t cur = do_min ? cur_min : cur_max;
+        if (want == cur) {
+            continue;
+        }
+        snprintf(what, sizeof(what), "cpu%d %s", cpu, do_min ? "scaling_min_freq" : "scaling_max_freq");
+        if (write_long_fd(do_min ? c->min_fd : c->max_fd, what, (long)want, err, err_sz) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int ld_cpufreq_set_ratio(struct ld_cpufreq *cf, int cpu, uint8_t ratio, char *err, size_t err_sz) {
+    if (!ld_cpufreq_has_cpu(cf, cpu)) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "cpu%d has no cpufreq policy", cpu);
+        }
+        return -1;
+    }
+    const struct ld_cpufreq_cpu *c = &cf->cpus[cpu];
+    uint32_t khz = (uint32_t)ratio * LD_RATIO_KHZ;
+    if (c->cpuinfo_max_khz && khz > c->cpuinfo_max_khz) {
+        khz = c->cpuinfo_max_khz;
+    }
+    if (khz < c->cpuinfo_min_khz) {
+        khz = c->cpuinfo_min_khz;
+    }
+    return ld_cpufreq_set(cf, cpu, 0, khz, err, err_sz);
+}
+
+static int knob_fd(struct ld_cpufreq *cf, enum ld_pstate_knob knob, char *err, size_t err_sz) {
+    if (knob >= LD_PSTATE_KNOB_COUNT) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "unknown intel_pstate knob");
+        }
+        return -1;
+    }
+    char path[384];
+    snprintf(path, sizeof(path), "%s/intel_pstate/%s", cf->root, knob_names[knob]);
+    if (open_cached(&cf->knob_fd[knob], path, err, err_sz) != 0) {
+        return -1;
+    }
+    return cf->knob_fd[knob];
+}
+
+int ld_pstate_read(struct ld_cpufreq *cf, enum ld_pstate_knob knob) {
+    int fd = knob_fd(cf, knob, NULL, 0);
+    long v = 0;
+    if (fd < 0 || read_long_fd(fd, &v) != 0) {
+        return -1;
+    }
+    return (int)v;
+}
+
+int ld_pstate_write(struct ld_cpufreq *cf, enum ld_pstate_knob knob, int value, char *err, size_t err_sz) {
+    int fd = knob_fd(cf, knob, err, err_sz);
+    if (fd < 0) {
+        return -1;
+    }
+    return write_long_fd(fd, knob_names[knob], value, err, err_sz);
+}
+
+int ld_ratio_parse_path(const char *s, enum ld_ratio_path *out) {
+    if (!s) {
+        return -1;
+    }
+    if (strcmp(s, "auto") == 0) {
+        *out = LD_RATIO_AUTO;
+    } else if (strcmp(s, "perf-ctl") == 0) {
+        *out = LD_RATIO_PERF_CTL;
+    } else if (strcmp(s, "cpufreq") == 0) {
+        *out = LD_RATIO_CPUFREQ;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *ld_ratio_path_name(enum ld_ratio_path path) {
+    switch (path) {
+    case LD_RATIO_AUTO: return "auto";
+    case LD_RATIO_PERF_CTL: return "perf-ctl";
+    case LD_RATIO_CPUFREQ: return "cpufreq";
+    }
+    return "unknown";
+}
+
+int ld_ratio_select(const struct ld_cpufreq *cf, enum ld_ratio_path want, enum ld_ratio_path *out, char *err,
+                    size_t err_sz) {
+    int have_cpufreq = cf && cf->present_count > 0;
+    if (want == LD_RATIO_CPUFREQ && !have_cpufreq) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "no cpufreq policies under %s", cf ? cf->root : LD_CPUFREQ_ROOT);
+        }
+        return -1;
+    }
+    if (want == LD_RATIO_AUTO) {
+        want = have_cpufreq ? LD_RATIO_CPUFREQ : LD_RATIO_PERF_CTL;
+    }
+    *out = want;
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef LD_CPUFREQ_H
+#define LD_CPUFREQ_H
+
+/*
+ * cpufreq / intel_pstate sysfs control: per-CPU scaling_min_freq and
+ * scaling_max_freq plus the intel_pstate globals (max_perf_pct,
+ * min_perf_pct, no_turbo).
+ *
+ * Any loaded cpufreq driver owns IA32_PERF_CTL: intel_pstate in active
+ * mode and the governors in passive mode or under acpi-cpufreq rewrite it
+ * on their next update, and with HWP the hardware ignores it entirely.
+ * A ratio written there then silently reverts, while a scaling_max_freq
+ * cap is honoured by every driver. ld_ratio_select() therefore picks the
+ * cpufreq path whenever a driver is present and PERF_CTL only without one.
+ *
+ * Files written repeatedly are opened once and reused with pread/pwrite
+ * until ld_cpufreq_close().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_CPUFREQ_ROOT "/sys/devices/system/cpu"
+/* Core ratios are multiples of the 100 MHz bus clock. */
+#define LD_RATIO_KHZ    100000u
+
+enum ld_pstate_mode {
+    LD_PSTATE_NONE,     /* intel_pstate not loaded */
+    LD_PSTATE_ACTIVE,   /* intel_pstate picks P-states itself (HWP or its internal governor) */
+    LD_PSTATE_PASSIVE,  /* intel_cpufreq: a generic governor drives PERF_CTL */
+    LD_PSTATE_OFF,      /* intel_pstate present but disabled */
+};
+
+enum ld_ratio_path {
+    LD_RATIO_AUTO,      /* selection only */
+    LD_RATIO_PERF_CTL,  /* IA32_PERF_CTL bits 15:8 */
+    LD_RATIO_CPUFREQ,   /* scaling_max_freq cap */
+};
+
+enum ld_pstate_knob {
+    LD_PSTATE_MAX_PERF_PCT,
+    LD_PSTATE_MIN_PERF_PCT,
+    LD_PSTATE_NO_TURBO,
+    LD_PSTATE_KNOB_COUNT,
+};
+
+struct ld_cpufreq_cpu {
+    int present;
+    uint32_t cpuinfo_min_khz;
+    uint32_t cpuinfo_max_khz;
+    int min_fd;
+    int max_fd;
+};
+
+struct ld_cpufreq {
+    char root[256];
+    char driver[32];        /* scaling_driver of the first CPU with cpufreq */
+    char governor[32];
+    enum ld_pstate_mode mode;
+    int hwp;
+    struct ld_cpufreq_cpu *cpus;   /* indexed by CPU number */
+    size_t cpu_count;
+    size_t present_count;
+    int knob_fd[LD_PSTATE_KNOB_COUNT];
+};
+
+/* root == NULL uses LD_CPUFREQ_ROOT. Succeeds without cpufreq; present_count is then 0. */
+int ld_cpufreq_open(struct ld_cpufreq *cf, const char *root, char *err, size_t err_sz);
+void ld_cpufreq_close(struct ld_cpufreq *cf);
+
+/* Process-wide instance, opened on first use and kept until ld_close_all(). */
+struct ld_cpufreq *ld_cpufreq_shared(char *err, size_t err_sz);
+void ld_cpufreq_shared_free(void);
+
+const char *ld_pstate_mode_name(enum ld_pstate_mode mode);
+const char *ld_pstate_knob_name(enum ld_pstate_knob knob);
+/* Knob by sysfs name ("max_perf_pct", ...); -1 when unknown. */
+int ld_pstate_knob_find(const char *name);
+
+int ld_cpufreq_has_cpu(const struct ld_cpufreq *cf, int cpu);
+int ld_cpufreq_read(struct ld_cpufreq *cf, int cpu, uint32_t *min_khz, uint32_t *max_khz);
+/* Either bound may be 0 to keep it; writes in the order the kernel accepts (min <= max at every step). */
+int ld_cpufreq_set(struct ld_cpufreq *cf, int cpu, uint32_t min_khz, uint32_t max_khz, char *err, size_t err_sz);
+/* Caps the CPU at ratio * 100 MHz (clamped to cpuinfo limits), lowering scaling_min_freq when it is above. */
+int ld_cpufreq_set_ratio(struct ld_cpufreq *cf, int cpu, uint8_t ratio, char *err, size_t err_sz);
+
+/* -1 when the knob does not exist (not intel_pstate, or no_turbo without turbo). */
+int ld_pstate_read(struct ld_cpufreq *cf, enum ld_pstate_knob knob);
+int ld_pstate_write(struct ld_cpufreq *cf, enum ld_pstate_knob knob, int value, char *err, size_t err_sz);
+
+/* "auto", "perf-ctl" or "cpufreq"; -1 for anything else. */
+int ld_ratio_parse_path(const char *s, enum ld_ratio_path *out);
+const char *ld_ratio_path_name(enum ld_ratio_path path);
+/* Resolves AUTO as described above; an explicit cpufreq request fails without cpufreq. */
+int ld_ratio_select(const struct ld_cpufreq *cf, enum ld_ratio_path want, enum ld_ratio_path *out, char *err,
+                    size_t err_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,614 @@
+#define _GNU_SOURCE
+
+#include "ld_dbus.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HDR_PATH         1
+#define HDR_INTERFACE    2
+#define HDR_MEMBER       3
+#define HDR_ERROR_NAME   4
+#define HDR_REPLY_SERIAL 5
+#define HDR_DESTINATION  6
+#define HDR_SENDER       7
+#define HDR_SIGNATURE    8
+#define HDR_UNIX_FDS     9
+
+#define MAX_MESSAGE_SIZE (1u << 24)
+
+/* ---- marshalling ---- */
+
+static void buf_reserve(struct ld_dbus_buf *buf, size_t extra) {
+    if (buf->failed || buf->len + extra <= buf->cap) {
+        return;
+    }
+    size_t cap = buf->cap ? buf->cap : 256;
+    while (cap < buf->len + extra) {
+        cap *= 2;
+    }
+    uint8_t *next = realloc(buf->data, cap);
+    if (!next) {
+        buf->failed = 1;
+        return;
+    }
+    buf->data = next;
+    buf->cap = cap;
+}
+
+static void buf_append(struct ld_dbus_buf *buf, const void *data, size_t len) {
+    buf_reserve(buf, len);
+    if (buf->failed) {
+        return;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+void ld_dbus_buf_free(struct ld_dbus_buf *buf) {
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+void ld_dbus_pad(struct ld_dbus_buf *buf, size_t align) {
+    static const uint8_t zeros[8] = { 0 };
+    size_t pad = (align - (buf->len % align)) % align;
+    buf_append(buf, zeros, pad);
+}
+
+void ld_dbus_put_byte(struct ld_dbus_buf *buf, uint8_t v) {
+    buf_append(buf, &v, 1);
+}
+
+void ld_dbus_put_u32(struct ld_dbus_buf *buf, uint32_t v) {
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    ld_dbus_pad(buf, 4);
+    buf_append(buf, b, 4);
+}
+
+void ld_dbus_put_bool(struct ld_dbus_buf *buf, int v) {
+    ld_dbus_put_u32(buf, v ? 1u : 0u);
+}
+
+void ld_dbus_put_string(struct ld_dbus_buf *buf, const char *s) {
+    size_t len = strlen(s);
+    ld_dbus_put_u32(buf, (uint32_t)len);
+    buf_append(buf, s, len + 1);
+}
+
+void ld_dbus_put_signature(struct ld_dbus_buf *buf, const char *s) {
+    size_t len = strlen(s);
+    ld_dbus_put_byte(buf, (uint8_t)len);
+    buf_append(buf, s, len + 1);
+}
+
+void ld_dbus_array_begin(struct ld_dbus_buf *buf, size_t elem_align, struct ld_dbus_array *a) {
+    ld_dbus_put_u32(buf, 0);
+    a->len_pos = buf->len - 4;
+    ld_dbus_pad(buf, elem_align);
+    a->start = buf->len;
+}
+
+void ld_dbus_array_end(struct ld_dbus_buf *buf, const struct ld_dbus_array *a) {
+    if (buf->failed) {
+        return;
+    }
+    uint32_t len = (uint32_t)(buf->len - a->start);
+    uint8_t *p = buf->data + a->len_pos;
+    p[0] = (uint8_t)len;
+    p[1] = (uint8_t)(len >> 8);
+    p[2] = (uint8_t)(len >> 16);
+    p[3] = (uint8_t)(len >> 24);
+}
+
+/* ---- demarshalling ---- */
+
+void ld_dbus_skip_align(struct ld_dbus_iter *it, size_t align) {
+    size_t pos = (it->pos + align - 1) / align * align;
+    if (pos > it->len) {
+        it->failed = 1;
+        pos = it->len;
+    }
+    it->pos = pos;
+}
+
+int ld_dbus_get_byte(struct ld_dbus_iter *it, uint8_t *out) {
+    if (it->failed || it->pos + 1 > it->len) {
+        it->failed = 1;
+        return -1;
+    }
+    *out = it->data[it->pos++];
+    return 0;
+}
+
+int ld_dbus_get_u32(struct ld_dbus_iter *it, uint32_t *out) {
+    ld_dbus_skip_align(it, 4);
+    if (it->failed || it->pos + 4 > it->len) {
+        it->failed = 1;
+        return -1;
+    }
+    const uint8_t *p = it->data + it->pos;
+    *out = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    it->pos += 4;
+    return 0;
+}
+
+int ld_dbus_get_bool(struct ld_dbus_iter *it, int *out) {
+    uint32_t v = 0;
+    if (ld_dbus_get_u32(it, &v) != 0) {
+        return -1;
+    }
+    *out = v != 0;
+    return 0;
+}
+
+int ld_dbus_get_string(struct ld_dbus_iter *it, const char **out) {
+    uint32_t len = 0;
+    if (ld_dbus_get_u32(it, &len) != 0 || (size_t)len + 1 > it->len - it->pos || it->data[it->pos + len] != '\0') {
+        it->failed = 1;
+        return -1;
+    }
+    *out = (const char *)(it->data + it->pos);
+    it->pos += (size_t)len + 1;
+    return 0;
+}
+
+int ld_dbus_get_signature(struct ld_dbus_iter *it, const char **out) {
+    uint8_t len = 0;
+    if (ld_dbus_get_byte(it, &len) != 0 || (size_t)len + 1 > it->len - it->pos || it->data[it->pos + len] != '\0') {
+        it->failed = 1;
+        return -1;
+    }
+    *out = (const char *)(it->data + it->pos);
+    it->pos += (size_t)len + 1;
+    return 0;
+}
+
+int ld_dbus_array_enter(struct ld_dbus_iter *it, size_t elem_align, size_t *end) {
+    uint32_t len = 0;
+    if (ld_dbus_get_u32(it, &len) != 0) {
+        return -1;
+    }
+    ld_dbus_skip_align(it, elem_align);
+    if (it->failed || len > it->len - it->pos) {
+        it->failed = 1;
+        return -1;
+    }
+    *end = it->pos + len;
+    return 0;
+}
+
+/* ---- transport ---- */
+
+static void set_err(char *err, size_t err_sz, const char *fmt, const char *detail) {
+    if (err && err_sz) {
+        snprintf(err, err_sz, fmt, detail);
+    }
+}
+
+static int write_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_line(int fd, char *out, size_t out_sz) {
+    size_t len = 0;
+    while (len + 1 < out_sz) {
+        char ch;
+        ssize_t n = read(fd, &ch, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        if (ch == '\n') {
+            if (len > 0 && out[len - 1] == '\r') {
+                len--;
+            }
+            out[len] = '\0';
+            return 0;
+        }
+        out[len++] = ch;
+    }
+    return -1;
+}
+
+static int socket_path_from_address(const char *address, char *path, size_t path_sz) {
+    const char *p = strstr(address, "unix:path=");
+    if (!p) {
+        return -1;
+    }
+    p += strlen("unix:path=");
+    size_t len = strcspn(p, ",;");
+    if (len == 0 || len >= path_sz) {
+        return -1;
+    }
+    memcpy(path, p, len);
+    path[len] = '\0';
+    return 0;
+}
+
+static int authenticate(int fd, char *err, size_t err_sz) {
+    char uid[32];
+    char hex[80];
+    snprintf(uid, sizeof(uid), "%u", (unsigned int)geteuid());
+    size_t pos = 0;
+    for (const char *c = uid; *c && pos + 3 < sizeof(hex); c++) {
+        pos += (size_t)snprintf(hex + pos, sizeof(hex) - pos, "%02x", (unsigned char)*c);
+    }
+    char line[256];
+    int len = snprintf(line, sizeof(line), "AUTH EXTERNAL %s\r\n", hex);
+    if (write_all(fd, "", 1) != 0 || write_all(fd, line, (size_t)len) != 0) {
+        set_err(err, err_sz, "D-Bus auth write failed: %s", strerror(errno));
+        return -1;
+    }
+    if (read_line(fd, line, sizeof(line)) != 0 || strncmp(line, "OK ", 3) != 0) {
+        set_err(err, err_sz, "D-Bus EXTERNAL auth rejected: %s", line);
+        return -1;
+    }
+    if (write_all(fd, "BEGIN\r\n", 7) != 0) {
+        set_err(err, err_sz, "D-Bus auth write failed: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* EXTERNAL auth and Hello on a connected socket; closes the bus on failure. */
+static int handshake(struct ld_dbus *bus, char *err, size_t err_sz) {
+    if (authenticate(bus->fd, err, err_sz) != 0) {
+        ld_dbus_close(bus);
+        return -1;
+    }
+
+    struct ld_dbus_msg reply;
+    if (ld_dbus_call_sync(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "Hello", NULL,
+                          NULL, &reply, 5000, err, err_sz) != 0) {
+        ld_dbus_close(bus);
+        return -1;
+    }
+    const char *name = NULL;
+    if (ld_dbus_get_string(&reply.body, &name) == 0) {
+        snprintf(bus->unique_name, sizeof(bus->unique_name), "%s", name);
+    }
+    ld_dbus_msg_free(&reply);
+    return 0;
+}
+
+int ld_dbus_connect(struct ld_dbus *bus, const char *address, char *err, size_t err_sz) {
+    memset(bus, 0, sizeof(*bus));
+    bus->fd = -1;
+    bus->next_serial = 1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!address) {
+        address = getenv("DBUS_SYSTEM_BUS_ADDRESS");
+    }
+    if (address && *address) {
+        if (socket_path_from_address(address, addr.sun_path, sizeof(addr.sun_path)) != 0) {
+            set_err(err, err_sz, "unsupported D-Bus address: %s", address);
+            return -1;
+        }
+    } else {
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", LD_DBUS_SYSTEM_SOCKET);
+    }
+
+    bus->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (bus->fd < 0 || connect(bus->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        set_err(err, err_sz, "connect to system bus failed: %s", strerror(errno));
+        ld_dbus_close(bus);
+        return -1;
+    }
+    return handshake(bus, err, err_sz);
+}
+
+int ld_dbus_connect_fd(struct ld_dbus *bus, int fd, char *err, size_t err_sz) {
+    memset(bus, 0, sizeof(*bus));
+    bus->fd = fd;
+    bus->next_serial = 1;
+    return handshake(bus, err, err_sz);
+}
+
+void ld_dbus_close(struct ld_dbus *bus) {
+    if (bus->fd >= 0) {
+        close(bus->fd);
+    }
+    free(bus->rx);
+    memset(bus, 0, sizeof(*bus));
+    bus->fd = -1;
+}
+
+static void put_header_field(struct ld_dbus_buf *hdr, uint8_t code, const char *sig, const char *s, uint32_t u) {
+    ld_dbus_pad(hdr, 8);
+    ld_dbus_put_byte(hdr, code);
+    ld_dbus_put_signature(hdr, sig);
+    if (sig[0] == 'u') {
+        ld_dbus_put_u32(hdr, u);
+    } else if (sig[0] == 'g') {
+        ld_dbus_put_signature(hdr, s);
+    } else {
+        ld_dbus_put_string(hdr, s);
+    }
+}
+
+int ld_dbus_send(struct ld_dbus *bus, const struct ld_dbus_out *m, const struct ld_dbus_buf *body, uint32_t *serial_out,
+                 char *err, size_t err_sz) {
+    if (bus->fd < 0) {
+        set_err(err, err_sz, "%s", "D-Bus connection is closed");
+        return -1;
+    }
+    uint32_t serial = bus->next_serial++;
+    size_t body_len = body ? body->len : 0;
+
+    struct ld_dbus_buf msg = { 0 };
+    ld_dbus_put_byte(&msg, 'l');
+    ld_dbus_put_byte(&msg, m->type);
+    ld_dbus_put_byte(&msg, m->flags);
+    ld_dbus_put_byte(&msg, 1);
+    ld_dbus_put_u32(&msg, (uint32_t)body_len);
+    ld_dbus_put_u32(&msg, serial);
+
+    struct ld_dbus_array fields;
+    ld_dbus_array_begin(&msg, 8, &fields);
+    if (m->path) {
+        put_header_field(&msg, HDR_PATH, "o", m->path, 0);
+    }
+    if (m->interface) {
+        put_header_field(&msg, HDR_INTERFACE, "s", m->interface, 0);
+    }
+    if (m->member) {
+        put_header_field(&msg, HDR_MEMBER, "s", m->member, 0);
+    }
+    if (m->error_name) {
+        put_header_field(&msg, HDR_ERROR_NAME, "s", m->error_name, 0);
+    }
+    if (m->reply_serial) {
+        put_header_field(&msg, HDR_REPLY_SERIAL, "u", NULL, m->reply_serial);
+    }
+    if (m->destination) {
+        put_header_field(&msg, HDR_DESTINATION, "s", m->destination, 0);
+    }
+    if (m->signature && *m->signature) {
+        put_header_field(&msg, HDR_SIGNATURE, "g", m->signature, 0);
+    }
+    ld_dbus_array_end(&msg, &fields);
+    ld_dbus_pad(&msg, 8);
+    if (body_len) {
+        buf_append(&msg, body->data, body_len);
+    }
+
+    int rc = 0;
+    if (msg.failed || (body && body->failed)) {
+        set_err(err, err_sz, "%s", "D-Bus message allocation failed");
+        rc = -1;
+    } else if (write_all(bus->fd, msg.data, msg.len) != 0) {
+        set_err(err, err_sz, "D-Bus send failed: %s", strerror(errno));
+        rc = -1;
+    }
+    ld_dbus_buf_free(&msg);
+    if (rc == 0 && serial_out) {
+        *serial_out = serial;
+    }
+    return rc;
+}
+
+int ld_dbus_call(struct ld_dbus *bus, const char *destination, const char *path, const char *interface,
+                 const char *member, const char *signature, const struct ld_dbus_buf *body, uint32_t *serial_out,
+                 char *err, size_t err_sz) {
+    struct ld_dbus_out m = { LD_DBUS_METHOD_CALL, 0, destination, path, interface, member, NULL, signature, 0 };
+    return ld_dbus_send(bus, &m, body, serial_out, err, err_sz);
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Splits one complete message off the receive buffer; 0 when more bytes are needed. */
+static int take_message(struct ld_dbus *bus, struct ld_dbus_msg *msg, char *err, size_t err_sz) {
+    if (bus->rx_len < 16) {
+        return 0;
+    }
+    if (bus->rx[0] != 'l') {
+        set_err(err, err_sz, "%s", "big-endian D-Bus messages are not supported");
+        return -1;
+    }
+    size_t fields_len = le32(bus->rx + 12);
+    size_t body_len = le32(bus->rx + 4);
+    if (fields_len > MAX_MESSAGE_SIZE || body_len > MAX_MESSAGE_SIZE) {
+        set_err(err, err_sz, "%s", "oversized D-Bus message");
+        return -1;
+    }
+    size_t hdr_len = (16 + fields_len + 7) & ~(size_t)7;
+    size_t total = hdr_len + body_len;
+    if (bus->rx_len < total) {
+        return 0;
+    }
+
+    memset(msg, 0, sizeof(*msg));
+    msg->raw = malloc(total);
+    if (!msg->raw) {
+        set_err(err, err_sz, "%s", "out of memory");
+        return -1;
+    }
+    memcpy(msg->raw, bus->rx, total);
+    memmove(bus->rx, bus->rx + total, bus->rx_len - total);
+    bus->rx_len -= total;
+
+    msg->type = msg->raw[1];
+    msg->flags = msg->raw[2];
+    msg->serial = le32(msg->raw + 8);
+
+    struct ld_dbus_iter it = { msg->raw, 16 + fields_len, 12, 0 };
+    size_t end = 0;
+    ld_dbus_array_enter(&it, 8, &end);
+    while (!it.failed && it.pos < end) {
+        uint8_t code = 0;
+        const char *sig = NULL;
+        ld_dbus_skip_align(&it, 8);
+        ld_dbus_get_byte(&it, &code);
+        if (ld_dbus_get_signature(&it, &sig) != 0) {
+            break;
+        }
+        const char *s = NULL;
+        uint32_t u = 0;
+        if (sig[0] == 'u') {
+            ld_dbus_get_u32(&it, &u);
+        } else if (sig[0] == 'g') {
+            ld_dbus_get_signature(&it, &s);
+        } else if (sig[0] == 's' || sig[0] == 'o') {
+            ld_dbus_get_string(&it, &s);
+        } else {
+            it.failed = 1;
+            break;
+        }
+        switch (code) {
+        case HDR_PATH: msg->path = s; break;
+        case HDR_INTERFACE: msg->interface = s; break;
+        case HDR_MEMBER: msg->member = s; break;
+        case HDR_ERROR_NAME: msg->error_name = s; break;
+        case HDR_REPLY_SERIAL: msg->reply_serial = u; break;
+        case HDR_DESTINATION: msg->destination = s; break;
+        case HDR_SENDER: msg->sender = s; break;
+        case HDR_SIGNATURE: msg->signature = s; break;
+        default: break;
+        }
+    }
+    if (it.failed) {
+        ld_dbus_msg_free(msg);
+        set_err(err, err_sz, "%s", "malformed D-Bus header");
+        return -1;
+    }
+    msg->body.data = msg->raw + hdr_len;
+    msg->body.len = body_len;
+    return 1;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+int ld_dbus_read(struct ld_dbus *bus, struct ld_dbus_msg *msg, int timeout_ms, char *err, size_t err_sz) {
+    double deadline = now_ms() + (timeout_ms > 0 ? timeout_ms : 0);
+    for (;;) {
+        int rc = take_message(bus, msg, err, err_sz);
+        if (rc != 0) {
+            return rc;
+        }
+        if (bus->fd < 0) {
+            set_err(err, err_sz, "%s", "D-Bus connection is closed");
+            return -1;
+        }
+        int wait = timeout_ms < 0 ? -1 : (int)(deadline - now_ms());
+        if (timeout_ms >= 0 && wait < 0) {
+            wait = 0;
+        }
+        struct pollfd pfd = { bus->fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, wait);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            set_err(err, err_sz, "poll failed: %s", strerror(errno));
+            return -1;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+        if (bus->rx_cap - bus->rx_len < 4096) {
+            size_t cap = bus->rx_cap ? bus->rx_cap * 2 : 8192;
+            uint8_t *next = realloc(bus->rx, cap);
+            if (!next) {
+                set_err(err, err_sz, "%s", "out of memory");
+                return -1;
+            }
+            bus->rx = next;
+            bus->rx_cap = cap;
+        }
+        ssize_t n = recv(bus->fd, bus->rx + bus->rx_len, bus->rx_cap - bus->rx_len, 0);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n <= 0) {
+            set_err(err, err_sz, "D-Bus connection lost: %s", n == 0 ? "closed by peer" : strerror(errno));
+            close(bus->fd);
+            bus->fd = -1;
+            return -1;
+        }
+        bus->rx_len += (size_t)n;
+    }
+}
+
+void ld_dbus_msg_free(struct ld_dbus_msg *msg) {
+    free(msg->raw);
+    memset(msg, 0, sizeof(*msg));
+}
+
+void ld_dbus_error_text(const struct ld_dbus_msg *msg, char *out, size_t out_sz) {
+    struct ld_dbus_iter body = msg->body;
+    const char *text = NULL;
+    if (msg->signature && msg->signature[0] == 's' && ld_dbus_get_string(&body, &text) == 0) {
+        snprintf(out, out_sz, "%s: %s", msg->error_name ? msg->error_name : "error", text);
+    } else {
+        snprintf(out, out_sz, "%s", msg->error_name ? msg->error_name : "error");
+    }
+}
+
+int ld_dbus_call_sync(struct ld_dbus *bus, const char *destination, const char *path, const char *interface,
+                      const char *member, const char *signature, const struct ld_dbus_buf *body,
+                      struct ld_dbus_msg *reply, int timeout_ms, char *err, size_t err_sz) {
+    uint32_t serial = 0;
+    if (ld_dbus_call(bus, destination, path, interface, member, signature, body, &serial, err, err_sz) != 0) {
+        return -1;
+    }
+    double deadline = now_ms() + timeout_ms;
+    for (;;) {
+        int left = (int)(deadline - now_ms());
+        struct ld_dbus_msg msg;
+        int rc = ld_dbus_read(bus, &msg, left > 0 ? left : 0, err, err_sz);
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc == 0) {
+            set_err(err, err_sz, "D-Bus %s timed out", member);
+            return -1;
+        }
+        if ((msg.type == LD_DBUS_METHOD_RETURN || msg.type == LD_DBUS_ERROR) && msg.reply_serial == serial) {
+            if (msg.type == LD_DBUS_ERROR) {
+                if (err && err_sz) {
+                    ld_dbus_error_text(&msg, err, err_sz);
+                }
+                ld_dbus_msg_free(&msg);
+                return -1;
+            }
+            if (reply) {
+                *reply = msg;
+            } else {
+                ld_dbus_msg_free(&msg);
+            }
+            return 0;
+        }
+        ld_dbus_msg_free(&msg);
+    }
+}
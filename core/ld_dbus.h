@@ -0,0 +1,143 @@
+#ifndef LD_DBUS_H
+#define LD_DBUS_H
+
+/*
+ * Minimal D-Bus client: unix socket transport, EXTERNAL auth and the
+ * marshalling subset the systemd manager calls need (bytes, booleans,
+ * u32, strings, object paths, signatures and arrays). Little-endian
+ * messages only, no fd passing. No libdbus/sd-bus dependency.
+ *
+ * Sends are non-blocking in spirit: callers fire several method calls,
+ * keep their serials and match replies and signals as they arrive from
+ * ld_dbus_read(), so ld_dbus_fd() can sit in an existing poll() loop.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_DBUS_SYSTEM_SOCKET "/run/dbus/system_bus_socket"
+
+enum ld_dbus_type {
+    LD_DBUS_METHOD_CALL = 1,
+    LD_DBUS_METHOD_RETURN = 2,
+    LD_DBUS_ERROR = 3,
+    LD_DBUS_SIGNAL = 4,
+};
+
+#define LD_DBUS_FLAG_NO_REPLY_EXPECTED 0x1
+
+struct ld_dbus {
+    int fd;
+    uint32_t next_serial;
+    char unique_name[64];
+    uint8_t *rx;
+    size_t rx_len;
+    size_t rx_cap;
+};
+
+/* Growable marshalling buffer; offsets (and so alignment) start at 0. */
+struct ld_dbus_buf {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    int failed;
+};
+
+struct ld_dbus_array {
+    size_t len_pos;
+    size_t start;
+};
+
+struct ld_dbus_iter {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    int failed;
+};
+
+struct ld_dbus_out {
+    uint8_t type;
+    uint8_t flags;
+    const char *destination;
+    const char *path;
+    const char *interface;
+    const char *member;
+    const char *error_name;
+    const char *signature;
+    uint32_t reply_serial;
+};
+
+struct ld_dbus_msg {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t serial;
+    uint32_t reply_serial;
+    const char *path;
+    const char *interface;
+    const char *member;
+    const char *error_name;
+    const char *destination;
+    const char *sender;
+    const char *signature;
+    struct ld_dbus_iter body;
+    uint8_t *raw;
+};
+
+/* address == NULL: $DBUS_SYSTEM_BUS_ADDRESS, else LD_DBUS_SYSTEM_SOCKET. Authenticates and calls Hello. */
+int ld_dbus_connect(struct ld_dbus *bus, const char *address, char *err, size_t err_sz);
+/* Same over an already connected stream socket (a socketpair in tests); the fd is closed on failure. */
+int ld_dbus_connect_fd(struct ld_dbus *bus, int fd, char *err, size_t err_sz);
+void ld_dbus_close(struct ld_dbus *bus);
+static inline int ld_dbus_fd(const struct ld_dbus *bus) {
+    return bus->fd;
+}
+
+int ld_dbus_send(struct ld_dbus *bus, const struct ld_dbus_out *m, const struct ld_dbus_buf *body, uint32_t *serial_out,
+                 char *err, size_t err_sz);
+/* Method call to a service; the reply is matched later by *serial_out. */
+int ld_dbus_call(struct ld_dbus *bus, const char *destination, const char *path, const char *interface,
+                 const char *member, const char *signature, const struct ld_dbus_buf *body, uint32_t *serial_out,
+                 char *err, size_t err_sz);
+/*
+ * Blocking call for setup steps: waits up to timeout_ms for the reply and
+ * discards anything else that arrives meanwhile. *reply may be NULL.
+ */
+int ld_dbus_call_sync(struct ld_dbus *bus, const char *destination, const char *path, const char *interface,
+                      const char *member, const char *signature, const struct ld_dbus_buf *body,
+                      struct ld_dbus_msg *reply, int timeout_ms, char *err, size_t err_sz);
+
+/* 1 with *msg filled, 0 on timeout (timeout_ms 0 = just drain, < 0 = wait), -1 when the connection failed. */
+int ld_dbus_read(struct ld_dbus *bus, struct ld_dbus_msg *msg, int timeout_ms, char *err, size_t err_sz);
+void ld_dbus_msg_free(struct ld_dbus_msg *msg);
+/* "Name: message" of an ERROR reply. */
+void ld_dbus_error_text(const struct ld_dbus_msg *msg, char *out, size_t out_sz);
+
+void ld_dbus_buf_free(struct ld_dbus_buf *buf);
+void ld_dbus_put_byte(struct ld_dbus_buf *buf, uint8_t v);
+void ld_dbus_put_bool(struct ld_dbus_buf *buf, int v);
+void ld_dbus_put_u32(struct ld_dbus_buf *buf, uint32_t v);
+void ld_dbus_put_string(struct ld_dbus_buf *buf, const char *s);  /* also object paths */
+void ld_dbus_put_signature(struct ld_dbus_buf *buf, const char *s);
+/* elem_align: 1 for y, 4 for u/s/o, 8 for structs and dict entries. */
+void ld_dbus_array_begin(struct ld_dbus_buf *buf, size_t elem_align, struct ld_dbus_array *a);
+void ld_dbus_array_end(struct ld_dbus_buf *buf, const struct ld_dbus_array *a);
+void ld_dbus_pad(struct ld_dbus_buf *buf, size_t align);
+
+int ld_dbus_get_byte(struct ld_dbus_iter *it, uint8_t *out);
+int ld_dbus_get_bool(struct ld_dbus_iter *it, int *out);
+int ld_dbus_get_u32(struct ld_dbus_iter *it, uint32_t *out);
+int ld_dbus_get_string(struct ld_dbus_iter *it, const char **out);  /* also object paths */
+int ld_dbus_get_signature(struct ld_dbus_iter *it, const char **out);
+/* Enters an array; iterate while it->pos < *end. */
+int ld_dbus_array_enter(struct ld_dbus_iter *it, size_t elem_align, size_t *end);
+void ld_dbus_skip_align(struct ld_dbus_iter *it, size_t align);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+
+#include "ld_energy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ld_powercap.h"
+
+/* MSR_PKG_ENERGY_STATUS is a 32-bit counter. */
+#define PKG_ENERGY_MASK 0xFFFFFFFFull
+
+void ld_cpu_energy_init(struct ld_cpu_energy *e) {
+    memset(e, 0, sizeof(*e));
+}
+
+void ld_cpu_energy_free(struct ld_cpu_energy *e) {
+    free(e->aperf);
+    free(e->busy_ticks);
+    free(e->joules);
+    free(e->busy_s);
+    free(e->seen);
+    free(e->aperf_seen);
+    free(e->total_j);
+    memset(e, 0, sizeof(*e));
+}
+
+const char *ld_energy_weight_name(enum ld_energy_weight weight) {
+    return weight == LD_ENERGY_APERF ? "aperf" : "busy";
+}
+
+static int alloc_slots(struct ld_cpu_energy *e) {
+    long conf = sysconf(_SC_NPROCESSORS_CONF);
+    int count = conf > 0 ? (int)conf : 1;
+    e->aperf = calloc((size_t)count, sizeof(*e->aperf));
+    e->busy_ticks = calloc((size_t)count, sizeof(*e->busy_ticks));
+    e->joules = calloc((size_t)count, sizeof(*e->joules));
+    e->busy_s = calloc((size_t)count, sizeof(*e->busy_s));
+    e->seen = calloc((size_t)count, sizeof(*e->seen));
+    e->aperf_seen = calloc((size_t)count, sizeof(*e->aperf_seen));
+    e->total_j = calloc((size_t)count, sizeof(*e->total_j));
+    if (!e->aperf || !e->busy_ticks || !e->joules || !e->busy_s || !e->seen || !e->aperf_seen || !e->total_j) {
+        return -1;
+    }
+    e->cpu_count = count;
+    return 0;
+}
+
+/* Package energy counter and whether it came from the MSR. */
+static int read_pkg_counter(uint64_t *counter, int *from_msr, uint64_t *range) {
+    struct ld_powercap *pc = ld_powercap_shared(NULL, 0);
+    struct ld_powercap_zone *zone = pc ? ld_powercap_package(pc) : NULL;
+    if (zone && zone->has_energy && ld_powercap_read_energy_uj(zone, counter) == 0) {
+        *from_msr = 0;
+        *range = zone->max_energy_range_uj;
+        return 0;
+    }
+    uint64_t raw = 0;
+    if (ld_msr_read(0, LD_MSR_PKG_ENERGY_STATUS, &raw) == 0) {
+        *counter = raw & PKG_ENERGY_MASK;
+        *from_msr = 1;
+        *range = PKG_ENERGY_MASK;
+        return 0;
+    }
+    return -1;
+}
+
+int ld_cpu_energy_sample(struct ld_cpu_energy *e, char *err, size_t err_sz) {
+    if (!e->cpu_count && alloc_slots(e) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "out of memory");
+        }
+        return -1;
+    }
+
+    uint64_t counter = 0;
+    uint64_t range = 0;
+    int from_msr = 0;
+    if (read_pkg_counter(&counter, &from_msr, &range) != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "package energy is unreadable (no powercap energy_uj and no msr access)");
+        }
+        return -1;
+    }
+    FILE *f = fopen("/proc/stat", "r");
+    if (!f) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "open(/proc/stat) failed");
+        }
+        return -1;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t t_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+    // A single unreadable APERF (now or at the previous sample) switches the whole interval to busy time, so
+    // shares stay comparable.
+    enum ld_energy_weight weight = LD_ENERGY_APERF;
+    double tick_s = 1.0 / (double)sysconf(_SC_CLK_TCK);
+    double weights_sum = 0.0;
+    double *weights = e->joules;
+    unsigned char *online = calloc((size_t)e->cpu_count, 1);
+    unsigned char *aperf_ok = calloc((size_t)e->cpu_count, 1);
+    uint64_t *aperf_now = calloc((size_t)e->cpu_count, sizeof(*aperf_now));
+    if (!online || !aperf_ok || !aperf_now) {
+        free(online);
+        free(aperf_ok);
+        free(aperf_now);
+        fclose(f);
+        if (err && err_sz) {
+            snprintf(err, err_sz, "out of memory");
+        }
+        return -1;
+    }
+
+    memset(e->busy_s, 0, (size_t)e->cpu_count * sizeof(*e->busy_s));
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        int cpu = -1;
+        unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+        user = nice = system = idle = iowait = irq = softirq = steal = 0;
+        if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu", &cpu, &user, &nice, &system, &idle, &iowait,
+                   &irq, &softirq, &steal) < 5 ||
+            cpu < 0 || cpu >= e->cpu_count) {
+            continue;
+        }
+        uint64_t busy = user + nice + system + irq + softirq + steal;
+        if (e->seen[cpu] && busy >= e->busy_ticks[cpu]) {
+            e->busy_s[cpu] = (double)(busy - e->busy_ticks[cpu]) * tick_s;
+        }
+        e->busy_ticks[cpu] = busy;
+        online[cpu] = 1;
+        // Every CPU is read even after a failure, so each one keeps a current baseline.
+        aperf_ok[cpu] = ld_msr_read(cpu, LD_MSR_APERF, &aperf_now[cpu]) == 0;
+    }
+    fclose(f);
+
+    for (int cpu = 0; cpu < e->cpu_count; cpu++) {
+        if (online[cpu] && e->seen[cpu] && !(aperf_ok[cpu] && e->aperf_seen[cpu])) {
+            weight = LD_ENERGY_BUSY;
+        }
+    }
+    for (int cpu = 0; cpu < e->cpu_count; cpu++) {
+        double w = 0.0;
+        if (online[cpu] && e->seen[cpu]) {
+            if (weight == LD_ENERGY_APERF) {
+                w = aperf_now[cpu] >= e->aperf[cpu] ? (double)(aperf_now[cpu] - e->aperf[cpu]) : 0.0;
+            } else {
+                w = e->busy_s[cpu];
+            }
+        }
+        weights[cpu] = w;
+        weights_sum += w;
+        // A failed read leaves no baseline: the next APERF interval must not start from an older value.
+        if (aperf_ok[cpu]) {
+            e->aperf[cpu] = aperf_now[cpu];
+        }
+        e->aperf_seen[cpu] = aperf_ok[cpu];
+    }
+
+    double pkg_j = 0.0;
+    int have_interval = e->samples > 0 && e->pkg_from_msr == from_msr && t_ns > e->t_ns;
+    if (have_interval) {
+        uint64_t delta = ld_powercap_energy_delta_uj(e->pkg_counter, counter, range);
+        if (from_msr) {
+            static double unit_j;
+            if (unit_j <= 0.0) {
+                struct ld_rapl_units units;
+                unit_j = ld_rapl_units_read(&units) == 0 ? units.energy_unit_j : 0.0;
+            }
+            pkg_j = (double)delta * unit_j;
+        } else {
+            pkg_j = (double)delta / 1e6;
+        }
+    }
+    for (int cpu = 0; cpu < e->cpu_count; cpu++) {
+        e->joules[cpu] = have_interval && weights_sum > 0.0 ? pkg_j * weights[cpu] / weights_sum : 0.0;
+        e->total_j[cpu] += e->joules[cpu];
+        e->seen[cpu] = online[cpu];
+    }
+    free(online);
+    free(aperf_ok);
+    free(aperf_now);
+
+    e->pkg_j = pkg_j;
+    e->pkg_total_j += pkg_j;
+    e->dt_s = have_interval ? (double)(t_ns - e->t_ns) / 1e9 : 0.0;
+    e->pkg_counter = counter;
+    e->pkg_from_msr = from_msr;
+    e->t_ns = t_ns;
+    e->weight = weight;
+    e->samples++;
+    return 0;
+}
+
+double ld_cpu_energy_sum(const struct ld_cpu_energy *e, const struct ld_cpu_list *cpus, double *busy_s) {
+    double joules = 0.0;
+    double busy = 0.0;
+    if (!cpus) {
+        for (int cpu = 0; cpu < e->cpu_count; cpu++) {
+            joules += e->joules[cpu];
+            busy += e->busy_s[cpu];
+        }
+    } else {
+        for (size_t i = 0; i < cpus->count; i++) {
+            int cpu = cpus->ids[i];
+            if (cpu >= 0 && cpu < e->cpu_count) {
+                joules += e->joules[cpu];
+                busy += e->busy_s[cpu];
+            }
+        }
+    }
+    if (busy_s) {
+        *busy_s = busy;
+    }
+    return joules;
+}
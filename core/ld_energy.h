@@ -0,0 +1,64 @@
+#ifndef LD_ENERGY_H
+#define LD_ENERGY_H
+
+/*
+ * Per-CPU energy estimate: the package energy of an interval split across
+ * the online CPUs by their APERF delta (cycles actually executed, so a core
+ * running busy at 5 GHz is charged more than one busy at 2 GHz). Without MSR
+ * access the split falls back to busy time from /proc/stat.
+ *
+ * Package energy comes from the powercap package zone (energy_uj), else
+ * from MSR_PKG_ENERGY_STATUS. It includes uncore and graphics, so the CPU
+ * shares add up to the whole package, not just the cores. Only package 0
+ * is read.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ld_energy_weight {
+    LD_ENERGY_APERF,
+    LD_ENERGY_BUSY,
+};
+
+struct ld_cpu_energy {
+    int cpu_count;              /* slots in the per-CPU arrays: highest CPU + 1 */
+    uint64_t *aperf;
+    uint64_t *busy_ticks;       /* user + nice + system + irq + softirq + steal */
+    double *joules;             /* last interval, 0 for offline CPUs */
+    double *busy_s;             /* last interval */
+    unsigned char *seen;        /* CPU was online in the previous sample */
+    unsigned char *aperf_seen;  /* aperf holds this CPU's reading from the previous sample */
+    double *total_j;            /* running sums since the first sample, for callers that diff their own */
+    double pkg_total_j;
+    uint64_t pkg_counter;       /* energy_uj, or raw MSR units */
+    int pkg_from_msr;
+    double pkg_j;               /* last interval */
+    double dt_s;                /* last interval, 0 until two samples were taken */
+    uint64_t t_ns;              /* CLOCK_MONOTONIC of the last sample */
+    enum ld_energy_weight weight;
+    int samples;
+};
+
+void ld_cpu_energy_init(struct ld_cpu_energy *e);
+void ld_cpu_energy_free(struct ld_cpu_energy *e);
+
+/* Takes a sample; from the second one on, joules/busy_s/pkg_j/dt_s describe the interval since the previous. */
+int ld_cpu_energy_sample(struct ld_cpu_energy *e, char *err, size_t err_sz);
+
+/* Joules of the last interval on cpus (NULL: every CPU); *busy_s (may be NULL) gets their busy seconds. */
+double ld_cpu_energy_sum(const struct ld_cpu_energy *e, const struct ld_cpu_list *cpus, double *busy_s);
+
+const char *ld_energy_weight_name(enum ld_energy_weight weight);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
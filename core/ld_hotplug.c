@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+
+#include "ld_hotplug.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static void online_path(const char *root, int cpu, char *out, size_t out_sz) {
+    snprintf(out, out_sz, "%s/cpu%d/online", root ? root : LD_HOTPLUG_ROOT, cpu);
+}
+
+static int hotplug_state(const char *root, int cpu) {
+    char path[256];
+    char buf[8] = {0};
+    online_path(root, cpu, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    return buf[0] != '0';
+}
+
+int ld_cpu_hotplug_state(int cpu) {
+    return hotplug_state(NULL, cpu);
+}
+
+int ld_offline_cpus(struct ld_cpu_list *out) {
+    DIR *dir = opendir(LD_HOTPLUG_ROOT);
+    if (!dir) {
+        return -1;
+    }
+    size_t first = out->count;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "cpu", 3) != 0 || de->d_name[3] == '\0') {
+            continue;
+        }
+        char *end = NULL;
+        long cpu = strtol(de->d_name + 3, &end, 10);
+        if (*end != '\0' || cpu < 0) {
+            continue;
+        }
+        if (ld_cpu_hotplug_state((int)cpu) == 0 && ld_cpu_list_add(out, (int)cpu) != 0) {
+            closedir(dir);
+            return -1;
+        }
+    }
+    closedir(dir);
+    qsort(out->ids + first, out->count - first, sizeof(int), compare_int);
+    return 0;
+}
+
+static int write_online(int fd, int online) {
+    return pwrite(fd, online ? "1" : "0", 1, 0) == 1 ? 0 : -1;
+}
+
+int ld_cpu_set_online(const struct ld_cpu_list *cpus, int online, struct ld_cpu_list *changed, char *err,
+                      size_t err_sz) {
+    return ld_cpu_set_online_at(NULL, cpus, online, changed, err, err_sz);
+}
+
+int ld_cpu_set_online_at(const char *root, const struct ld_cpu_list *cpus, int online, struct ld_cpu_list *changed,
+                         char *err, size_t err_sz) {
+    int *fds = calloc(cpus->count ? cpus->count : 1, sizeof(*fds));
+    if (!fds) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "out of memory");
+        }
+        return -1;
+    }
+    // All -1 before the first open can fail: the cleanup below closes every fd >= 0, and 0 is the server's stdin.
+    for (size_t i = 0; i < cpus->count; i++) {
+        fds[i] = -1;
+    }
+    int rc = 0;
+    for (size_t i = 0; i < cpus->count; i++) {
+        int cpu = cpus->ids[i];
+        // CPU0 stays: it usually cannot go offline, and everything else falls back to it.
+        if (cpu <= 0 || hotplug_state(root, cpu) == (online ? 1 : 0)) {
+            continue;
+        }
+        char path[256];
+        online_path(root, cpu, path, sizeof(path));
+        fds[i] = open(path, O_WRONLY | O_CLOEXEC);
+        if (fds[i] < 0) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "open(%s) failed: %s", path, strerror(errno));
+            }
+            rc = -1;
+            break;
+        }
+    }
+
+    size_t done = 0;
+    if (rc == 0) {
+        for (; done < cpus->count; done++) {
+            if (fds[done] < 0) {
+                continue;
+            }
+            if (write_online(fds[done], online) != 0) {
+                if (err && err_sz) {
+                    snprintf(err, err_sz, "cpu%d %s failed: %s", cpus->ids[done], online ? "online" : "offline",
+                             strerror(errno));
+                }
+                rc = -1;
+                break;
+            }
+        }
+    }
+    if (rc != 0) {
+        // Roll back what this batch already switched.
+        for (size_t i = 0; i < done; i++) {
+            if (fds[i] >= 0) {
+                write_online(fds[i], !online);
+            }
+        }
+    }
+    for (size_t i = 0; i < cpus->count; i++) {
+        if (fds[i] < 0) {
+            continue;
+        }
+        close(fds[i]);
+        if (rc == 0) {
+            ld_msr_forget(cpus->ids[i]);
+            if (changed) {
+                ld_cpu_list_add(changed, cpus->ids[i]);
+            }
+        }
+    }
+    free(fds);
+    return rc;
+}
@@ -0,0 +1,48 @@
+#ifndef LD_HOTPLUG_H
+#define LD_HOTPLUG_H
+
+/*
+ * CPU hotplug through /sys/devices/system/cpu/cpuN/online, used to park a
+ * whole P or E core group.
+ *
+ * The kernel serializes hotplug under device_hotplug_lock: concurrent
+ * writers to different online files only bounce off each other
+ * (restart_syscall) and finish one after another. A batch therefore opens
+ * every file up front, so a missing or read-only file fails before any CPU
+ * changes, and then writes back to back. A failed write switches the CPUs
+ * already changed back to where they were.
+ */
+
+#include <stddef.h>
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_HOTPLUG_ROOT "/sys/devices/system/cpu"
+
+/* 1 online, 0 offline, -1 when the CPU has no online file (CPU0 on most systems). */
+int ld_cpu_hotplug_state(int cpu);
+
+/* Appends every offline CPU, ascending. */
+int ld_offline_cpus(struct ld_cpu_list *out);
+
+/*
+ * Brings every CPU in cpus online (online != 0) or offline. CPU0 and CPUs
+ * already in the target state are left alone; the ones switched are
+ * appended to changed (may be NULL). Cached MSR handles of switched CPUs
+ * are dropped.
+ */
+int ld_cpu_set_online(const struct ld_cpu_list *cpus, int online, struct ld_cpu_list *changed, char *err,
+                      size_t err_sz);
+/* Same under another sysfs root (root == NULL uses LD_HOTPLUG_ROOT); tests point it at a scratch tree. */
+int ld_cpu_set_online_at(const char *root, const struct ld_cpu_list *cpus, int online, struct ld_cpu_list *changed,
+                         char *err, size_t err_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
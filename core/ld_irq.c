@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+
+#include "ld_irq.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+void ld_irq_table_init(struct ld_irq_table *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+static void clear_irqs(struct ld_irq_table *t) {
+    for (size_t i = 0; i < t->count; i++) {
+        free(t->irqs[i].per_cpu);
+    }
+    t->count = 0;
+}
+
+void ld_irq_table_free(struct ld_irq_table *t) {
+    clear_irqs(t);
+    free(t->irqs);
+    memset(t, 0, sizeof(*t));
+}
+
+/* "<hwirq>-<trigger>" ("2-edge", "327680-edge", "16-fasteoi") ends the chip columns. */
+static int is_hwirq_token(const char *tok, size_t len) {
+    size_t i = 0;
+    while (i < len && isdigit((unsigned char)tok[i])) {
+        i++;
+    }
+    return i > 0 && i + 1 < len && tok[i] == '-' && isalpha((unsigned char)tok[i + 1]);
+}
+
+static void parse_name(const char *rest, char *out, size_t out_sz) {
+    const char *p = rest;
+    const char *after_hwirq = NULL;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        size_t len = strcspn(p, " \t\n");
+        if (len == 0) {
+            break;
+        }
+        if (is_hwirq_token(p, len)) {
+            after_hwirq = p + len;
+            break;
+        }
+        p += len;
+    }
+    const char *name = after_hwirq ? after_hwirq : "";
+    while (*name == ' ' || *name == '\t') {
+        name++;
+    }
+    snprintf(out, out_sz, "%.*s", (int)strcspn(name, "\n"), name);
+}
+
+static void read_affinity(int irq, char *out, size_t out_sz) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+    out[0] = '\0';
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    ssize_t n = read(fd, out, out_sz - 1);
+    close(fd);
+    if (n < 0) {
+        n = 0;
+    }
+    out[n] = '\0';
+    out[strcspn(out, "\n")] = '\0';
+}
+
+int ld_irq_read(struct ld_irq_table *t, char *err, size_t err_sz) {
+    FILE *f = fopen(LD_IRQ_PROC, "r");
+    if (!f) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "open(%s) failed: %s", LD_IRQ_PROC, strerror(errno));
+        }
+        return -1;
+    }
+    clear_irqs(t);
+
+    // Columns are the online CPUs only, so map each column to its CPU number.
+    char *line = NULL;
+    size_t line_cap = 0;
+    int columns[1024];
+    int ncols = 0;
+    t->cpu_count = 0;
+    if (getline(&line, &line_cap, f) > 0) {
+        for (char *p = line; (p = strstr(p, "CPU")) != NULL && ncols < 1024; p += 3) {
+            int cpu = atoi(p + 3);
+            columns[ncols++] = cpu;
+            if (cpu + 1 > t->cpu_count) {
+                t->cpu_count = cpu + 1;
+            }
+        }
+    }
+
+    int rc = 0;
+    while (getline(&line, &line_cap, f) > 0) {
+        char *p = line;
+        while (*p == ' ') {
+            p++;
+        }
+        if (!isdigit((unsigned char)*p)) {
+            continue;
+        }
+        char *end = NULL;
+        long irq = strtol(p, &end, 10);
+        if (*end != ':') {
+            continue;
+        }
+        p = end + 1;
+        if (t->count == t->cap) {
+            size_t next = t->cap ? t->cap * 2 : 64;
+            struct ld_irq *grown = realloc(t->irqs, next * sizeof(*grown));
+            if (!grown) {
+                rc = -1;
+                break;
+            }
+            t->irqs = grown;
+            t->cap = next;
+        }
+        struct ld_irq *e = &t->irqs[t->count];
+        memset(e, 0, sizeof(*e));
+        e->irq = (int)irq;
+        e->cpu_count = t->cpu_count;
+        e->per_cpu = calloc(t->cpu_count ? (size_t)t->cpu_count : 1, sizeof(*e->per_cpu));
+        if (!e->per_cpu) {
+            rc = -1;
+            break;
+        }
+        for (int c = 0; c < ncols; c++) {
+            uint64_t v = strtoull(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+            e->per_cpu[columns[c]] = v;
+            e->total += v;
+            p = end;
+        }
+        parse_name(p, e->name, sizeof(e->name));
+        read_affinity(e->irq, e->affinity, sizeof(e->affinity));
+        t->count++;
+    }
+    free(line);
+    fclose(f);
+    if (rc != 0 && err && err_sz) {
+        snprintf(err, err_sz, "out of memory");
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    t->t_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    return rc;
+}
+
+const struct ld_irq *ld_irq_find(const struct ld_irq_table *t, int irq) {
+    for (size_t i = 0; i < t->count; i++) {
+        if (t->irqs[i].irq == irq) {
+            return &t->irqs[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t count_on(const struct ld_irq *e, int cpu) {
+    return cpu >= 0 && cpu < e->cpu_count ? e->per_cpu[cpu] : 0;
+}
+
+uint64_t ld_irq_delta(const struct ld_irq *prev, const struct ld_irq *cur, const struct ld_cpu_list *cpus) {
+    if (!prev || !cur) {
+        return 0;
+    }
+    if (!cpus) {
+        return cur->total >= prev->total ? cur->total - prev->total : 0;
+    }
+    // per_cpu arrays of two samples can differ in length after a hotplug; compare by CPU number.
+    uint64_t sum = 0;
+    for (size_t i = 0; i < cpus->count; i++) {
+        uint64_t before = count_on(prev, cpus->ids[i]);
+        uint64_t after = count_on(cur, cpus->ids[i]);
+        if (after > before) {
+            sum += after - before;
+        }
+    }
+    return sum;
+}
+
+int ld_irq_matches(const struct ld_irq *irq, const char *pattern) {
+    if (strcasecmp(pattern, "all") == 0) {
+        return 1;
+    }
+    char *end = NULL;
+    long n = strtol(pattern, &end, 10);
+    if (end != pattern && *end == '\0') {
+        return n == irq->irq;
+    }
+    return strcasestr(irq->name, pattern) != NULL;
+}
+
+int ld_irq_set_affinity(int irq, const char *list, char *err, size_t err_sz) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        int saved = errno;
+        if (err && err_sz) {
+            snprintf(err, err_sz, "open(%s) failed: %s", path, strerror(saved));
+        }
+        return saved == ENOENT ? 1 : -1;
+    }
+    size_t len = strlen(list);
+    ssize_t n = write(fd, list, len);
+    int saved = errno;
+    close(fd);
+    if (n == (ssize_t)len) {
+        return 0;
+    }
+    if (err && err_sz) {
+        snprintf(err, err_sz, "irq %d: %s", irq, strerror(saved));
+    }
+    // EIO: managed IRQ; EINVAL on some per-CPU and chained IRQs.
+    return saved == EIO || saved == EINVAL ? 1 : -1;
+}
@@ -0,0 +1,63 @@
+#ifndef LD_IRQ_H
+#define LD_IRQ_H
+
+/*
+ * Device interrupt accounting and steering: per-CPU counts from
+ * /proc/interrupts, affinity through /proc/irq/<n>/smp_affinity_list.
+ *
+ * Only numbered IRQs are handled; the per-CPU architecture rows (NMI, LOC,
+ * RES, ...) cannot be moved. Managed IRQs (multi-queue NVMe, most MSI-X
+ * network queues) reject affinity writes with EIO; the kernel already
+ * spreads them one per CPU, so they are reported and left alone.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_IRQ_PROC "/proc/interrupts"
+
+struct ld_irq {
+    int irq;
+    uint64_t total;
+    uint64_t *per_cpu;      /* indexed by CPU number */
+    int cpu_count;
+    char name[64];          /* action names, e.g. "nvme0q0" or "i915" */
+    char affinity[128];     /* smp_affinity_list, empty when unreadable */
+};
+
+struct ld_irq_table {
+    struct ld_irq *irqs;
+    size_t count;
+    size_t cap;
+    int cpu_count;          /* highest CPU column + 1 */
+    uint64_t t_ns;          /* CLOCK_MONOTONIC when read */
+};
+
+void ld_irq_table_init(struct ld_irq_table *t);
+void ld_irq_table_free(struct ld_irq_table *t);
+int ld_irq_read(struct ld_irq_table *t, char *err, size_t err_sz);
+const struct ld_irq *ld_irq_find(const struct ld_irq_table *t, int irq);
+
+/* Interrupts of irq between two samples, over all CPUs or only those in cpus (may be NULL). */
+uint64_t ld_irq_delta(const struct ld_irq *prev, const struct ld_irq *cur, const struct ld_cpu_list *cpus);
+
+/* "all", an IRQ number, or a case-insensitive substring of the action names. */
+int ld_irq_matches(const struct ld_irq *irq, const char *pattern);
+
+/*
+ * Writes smp_affinity_list. Returns 1 when the kernel refuses to move the
+ * IRQ (managed or per-CPU), 0 on success, -1 on other errors.
+ */
+int ld_irq_set_affinity(int irq, const char *list, char *err, size_t err_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
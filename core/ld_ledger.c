@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+
+#include "ld_ledger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LEDGER_VERSION 1
+
+void ld_ledger_init(struct ld_ledger *l, int64_t now) {
+    memset(l, 0, sizeof(*l));
+    snprintf(l->names[0], sizeof(l->names[0]), "default");
+    l->profile_count = 1;
+    l->since = now;
+}
+
+int ld_ledger_valid_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= LD_LEDGER_NAME_MAX) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_' ||
+              c == '-')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int ld_ledger_profile(struct ld_ledger *l, const char *name) {
+    if (!ld_ledger_valid_name(name)) {
+        return 0;
+    }
+    for (int i = 0; i < l->profile_count; i++) {
+        if (strcmp(l->names[i], name) == 0) {
+            return i;
+        }
+    }
+    if (l->profile_count == LD_LEDGER_PROFILES) {
+        return 0;
+    }
+    snprintf(l->names[l->profile_count], sizeof(l->names[0]), "%s", name);
+    l->dirty = 1;
+    return l->profile_count++;
+}
+
+static struct ld_ledger_day *day_slot(struct ld_ledger *l, int32_t day) {
+    struct ld_ledger_day *slot = &l->days[(uint32_t)day % LD_LEDGER_DAYS];
+    if (slot->day != day) {
+        memset(slot, 0, sizeof(*slot));
+        slot->day = day;
+    }
+    return slot;
+}
+
+void ld_ledger_observe(struct ld_ledger *l, enum ld_ledger_domain domain, uint64_t raw, uint64_t wrap,
+                       double uj_per_unit, double now_s, int32_t day) {
+    struct ld_ledger_counter *c = &l->counters[domain];
+    double dt = now_s - c->last_s;
+    if (c->have && dt > 0.0 && dt <= LD_LEDGER_MAX_GAP_S) {
+        uint64_t delta = raw >= c->last ? raw - c->last : (wrap > c->last ? wrap - c->last + raw : raw);
+        double uj = delta * uj_per_unit + c->frac_uj;
+        if (uj <= LD_LEDGER_MAX_W * 1e6 * dt) {
+            uint64_t whole = (uint64_t)uj;
+            c->frac_uj = uj - (double)whole;
+            int p = l->active >= 0 && l->active < l->profile_count ? l->active : 0;
+            l->total_uj[p][domain] += whole;
+            day_slot(l, day)->uj[p][domain] += whole;
+            l->dirty |= whole > 0;
+        }
+    }
+    c->last = raw;
+    c->last_s = now_s;
+    c->have = 1;
+}
+
+uint64_t ld_ledger_day_uj(const struct ld_ledger *l, int32_t day, int profile, enum ld_ledger_domain domain) {
+    const struct ld_ledger_day *slot = &l->days[(uint32_t)day % LD_LEDGER_DAYS];
+    if (slot->day != day) {
+        return 0;
+    }
+    if (profile >= 0) {
+        return profile < l->profile_count ? slot->uj[profile][domain] : 0;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < l->profile_count; i++) {
+        sum += slot->uj[i][domain];
+    }
+    return sum;
+}
+
+uint64_t ld_ledger_days_uj(const struct ld_ledger *l, int32_t first, int32_t last, int profile,
+                           enum ld_ledger_domain domain) {
+    uint64_t sum = 0;
+    for (int32_t day = first; day <= last; day++) {
+        sum += ld_ledger_day_uj(l, day, profile, domain);
+    }
+    return sum;
+}
+
+uint64_t ld_ledger_total_uj(const struct ld_ledger *l, int profile, enum ld_ledger_domain domain) {
+    if (profile >= 0) {
+        return profile < l->profile_count ? l->total_uj[profile][domain] : 0;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < l->profile_count; i++) {
+        sum += l->total_uj[i][domain];
+    }
+    return sum;
+}
+
+int32_t ld_ledger_local_day(int64_t unix_s) {
+    time_t t = (time_t)unix_s;
+    struct tm tm;
+    if (!localtime_r(&t, &tm)) {
+        return (int32_t)(unix_s / 86400);
+    }
+    return (int32_t)((unix_s + tm.tm_gmtoff) / 86400);
+}
+
+int ld_ledger_load(struct ld_ledger *l, const char *path, int64_t now, char *err, size_t err_sz) {
+    ld_ledger_init(l, now);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        snprintf(err, err_sz, "open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    char line[256];
+    char name[LD_LEDGER_NAME_MAX];
+    int version = 0;
+    while (fgets(line, sizeof(line), f)) {
+        int64_t since = 0;
+        int32_t day = 0;
+        uint64_t pkg = 0;
+        uint64_t dram = 0;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "version %d", &version) == 1) {
+            continue;
+        }
+        if (version != LEDGER_VERSION) {
+            break;
+        }
+        if (sscanf(line, "since %" SCNd64, &since) == 1) {
+            l->since = since;
+        } else if (sscanf(line, "active %47s", name) == 1) {
+            l->active = ld_ledger_profile(l, name);
+        } else if (sscanf(line, "profile %47s %" SCNu64 " %" SCNu64, name, &pkg, &dram) == 3) {
+            int p = ld_ledger_profile(l, name);
+            l->total_uj[p][LD_LEDGER_PKG] += pkg;
+            l->total_uj[p][LD_LEDGER_DRAM] += dram;
+        } else if (sscanf(line, "day %" SCNd32 " %47s %" SCNu64 " %" SCNu64, &day, name, &pkg, &dram) == 4 &&
+                   day > 0) {
+            int p = ld_ledger_profile(l, name);
+            struct ld_ledger_day *slot = day_slot(l, day);
+            slot->uj[p][LD_LEDGER_PKG] += pkg;
+            slot->uj[p][LD_LEDGER_DRAM] += dram;
+        }
+    }
+    fclose(f);
+    if (version != LEDGER_VERSION) {
+        snprintf(err, err_sz, "%s: unsupported ledger version %d", path, version);
+        ld_ledger_init(l, now);
+        return -1;
+    }
+    l->dirty = 0;
+    return 0;
+}
+
+static int mkdir_parent(const char *path) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *parent = dirname(dir);
+    if (mkdir(parent, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+/* Opens path.tmp for writing; *dir_fd is the directory to fsync after the rename. */
+static FILE *open_tmp(const char *path, char *tmp, size_t tmp_sz, int *dir_fd, char *err, size_t err_sz) {
+    *dir_fd = mkdir_parent(path);
+    if (*dir_fd < 0) {
+        snprintf(err, err_sz, "state directory of %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    snprintf(tmp, tmp_sz, "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        snprintf(err, err_sz, "open %s: %s", tmp, strerror(errno));
+        close(*dir_fd);
+    }
+    return f;
+}
+
+/* Closes f and renames it over path: either the old or the new contents survive a crash, never a torn file. */
+static int commit_tmp(FILE *f, const char *tmp, const char *path, int dir_fd, char *err, size_t err_sz) {
+    // Data on disk before the rename, and the rename on disk before the next checkpoint overwrites the tmp file.
+    int rc = fflush(f) == 0 && fsync(fileno(f)) == 0 ? 0 : -1;
+    if (fclose(f) != 0) {
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp, path) != 0) {
+        rc = -1;
+    }
+    if (rc != 0) {
+        snprintf(err, err_sz, "write %s: %s", path, strerror(errno));
+        unlink(tmp);
+    } else {
+        (void)fsync(dir_fd);
+    }
+    close(dir_fd);
+    return rc;
+}
+
+int ld_ledger_save(struct ld_ledger *l, const char *path, char *err, size_t err_sz) {
+    char tmp[520];
+    int dir_fd = -1;
+    FILE *f = open_tmp(path, tmp, sizeof(tmp), &dir_fd, err, err_sz);
+    if (!f) {
+        return -1;
+    }
+    fprintf(f, "# limits_droper energy ledger, microjoules: profile <name> <pkg> <dram>, day <day> <name> <pkg> <dram>\n");
+    fprintf(f, "version %d\n", LEDGER_VERSION);
+    fprintf(f, "since %" PRId64 "\n", l->since);
+    fprintf(f, "active %s\n", l->names[l->active]);
+    for (int i = 0; i < l->profile_count; i++) {
+        fprintf(f, "profile %s %" PRIu64 " %" PRIu64 "\n", l->names[i], l->total_uj[i][LD_LEDGER_PKG],
+                l->total_uj[i][LD_LEDGER_DRAM]);
+    }
+    for (int d = 0; d < LD_LEDGER_DAYS; d++) {
+        const struct ld_ledger_day *slot = &l->days[d];
+        for (int i = 0; slot->day > 0 && i < l->profile_count; i++) {
+            if (slot->uj[i][LD_LEDGER_PKG] || slot->uj[i][LD_LEDGER_DRAM]) {
+                fprintf(f, "day %" PRId32 " %s %" PRIu64 " %" PRIu64 "\n", slot->day, l->names[i],
+                        slot->uj[i][LD_LEDGER_PKG], slot->uj[i][LD_LEDGER_DRAM]);
+            }
+        }
+    }
+    if (commit_tmp(f, tmp, path, dir_fd, err, err_sz) != 0) {
+        return -1;
+    }
+    l->dirty = 0;
+    return 0;
+}
+
+int ld_ledger_save_name(const char *path, const char *name, char *err, size_t err_sz) {
+    char tmp[520];
+    int dir_fd = -1;
+    FILE *f = open_tmp(path, tmp, sizeof(tmp), &dir_fd, err, err_sz);
+    if (!f) {
+        return -1;
+    }
+    fprintf(f, "%s\n", name);
+    return commit_tmp(f, tmp, path, dir_fd, err, err_sz);
+}
@@ -0,0 +1,102 @@
+#ifndef LD_LEDGER_H
+#define LD_LEDGER_H
+
+/*
+ * Persistent energy ledger: package and DRAM energy summed into 64-bit
+ * microjoule totals, per profile and per local calendar day, kept across
+ * helper restarts and reboots in a small text state file.
+ *
+ * The hardware counters are narrow (32-bit MSR units, or powercap energy_uj
+ * wrapping at max_energy_range_uj), so the caller feeds raw readings often
+ * enough that a counter wraps at most once in between; each delta is charged
+ * to the profile active at that moment. Readings further apart than
+ * LD_LEDGER_MAX_GAP_S (suspend, a stopped helper) or implying more than
+ * LD_LEDGER_MAX_W only restart the pairing: that energy is not counted
+ * rather than guessed.
+ *
+ * Saves write a temporary file next to the state file, fsync it and rename
+ * it over the old one, so a crash leaves either the previous or the new
+ * checkpoint, never a torn one.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_LEDGER_PROFILES 16       /* profile 0 is "default": energy while no profile was applied */
+#define LD_LEDGER_NAME_MAX 48
+#define LD_LEDGER_DAYS 14           /* daily buckets kept, enough for this week and last */
+#define LD_LEDGER_MAX_GAP_S 600.0
+#define LD_LEDGER_MAX_W 2000.0
+
+enum ld_ledger_domain {
+    LD_LEDGER_PKG,
+    LD_LEDGER_DRAM,
+    LD_LEDGER_DOMAINS,
+};
+
+struct ld_ledger_counter {
+    uint64_t last;
+    double last_s;
+    int have;
+    double frac_uj;                 /* sub-microjoule remainder of MSR-unit deltas */
+};
+
+struct ld_ledger_day {
+    int32_t day;                    /* ld_ledger_local_day(); 0: unused slot */
+    uint64_t uj[LD_LEDGER_PROFILES][LD_LEDGER_DOMAINS];
+};
+
+struct ld_ledger {
+    char names[LD_LEDGER_PROFILES][LD_LEDGER_NAME_MAX];
+    int profile_count;
+    int active;
+    int64_t since;                  /* Unix time the ledger was started */
+    uint64_t total_uj[LD_LEDGER_PROFILES][LD_LEDGER_DOMAINS];
+    struct ld_ledger_day days[LD_LEDGER_DAYS];   /* slot day % LD_LEDGER_DAYS */
+    struct ld_ledger_counter counters[LD_LEDGER_DOMAINS];
+    int dirty;                      /* energy or profile changed since the last save */
+};
+
+void ld_ledger_init(struct ld_ledger *l, int64_t now);
+
+/* Profile names are 1-47 characters of [A-Za-z0-9._-]. */
+int ld_ledger_valid_name(const char *name);
+
+/* Index of name, added when new; 0 ("default") when the name is invalid or the table is full. */
+int ld_ledger_profile(struct ld_ledger *l, const char *name);
+
+/*
+ * Feeds one raw counter reading at monotonic now_s. wrap is the counter's
+ * range (2^32 for the MSRs, max_energy_range_uj for powercap) and
+ * uj_per_unit its scale (1 for energy_uj). The delta since the previous
+ * reading goes to the active profile and to day.
+ */
+void ld_ledger_observe(struct ld_ledger *l, enum ld_ledger_domain domain, uint64_t raw, uint64_t wrap,
+                       double uj_per_unit, double now_s, int32_t day);
+
+/* Energy of one day; profile -1 sums every profile. */
+uint64_t ld_ledger_day_uj(const struct ld_ledger *l, int32_t day, int profile, enum ld_ledger_domain domain);
+/* Energy of the days first..last inclusive. */
+uint64_t ld_ledger_days_uj(const struct ld_ledger *l, int32_t first, int32_t last, int profile,
+                           enum ld_ledger_domain domain);
+uint64_t ld_ledger_total_uj(const struct ld_ledger *l, int profile, enum ld_ledger_domain domain);
+
+/* Days since the epoch in local time, so a day bucket ends at local midnight. */
+int32_t ld_ledger_local_day(int64_t unix_s);
+
+/* Replaces *l with the file's contents. 1 when the file does not exist (l is left initialized), -1 on error. */
+int ld_ledger_load(struct ld_ledger *l, const char *path, int64_t now, char *err, size_t err_sz);
+/* Crash-safe checkpoint; clears dirty. Creates the directory of path when missing. */
+int ld_ledger_save(struct ld_ledger *l, const char *path, char *err, size_t err_sz);
+/* Writes name as the one line of path (the active profile file) with the same crash-safe sequence. */
+int ld_ledger_save_name(const char *path, const char *name, char *err, size_t err_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+#include "ld_limits.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ld_powercap.h"
+#include "ld_regs.h"
+
+struct pl_fields {
+    const char *limit;
+    const char *time;
+    const char *constraint;
+    size_t fallback_index;
+};
+
+static const struct pl_fields pl_fields[2] = {
+    { "pl1", "pl1_time", "long_term", 0 },
+    { "pl2", "pl2_time", "short_term", 1 },
+};
+
+int ld_limits_parse_backend(const char *s, enum ld_limits_backend *out) {
+    if (!s) {
+        return -1;
+    }
+    if (strcmp(s, "auto") == 0) {
+        *out = LD_LIMITS_AUTO;
+    } else if (strcmp(s, "direct") == 0) {
+        *out = LD_LIMITS_DIRECT;
+    } else if (strcmp(s, "powercap") == 0) {
+        *out = LD_LIMITS_POWERCAP;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *ld_limits_backend_name(enum ld_limits_path path, enum ld_limits_backend backend) {
+    if (backend == LD_LIMITS_POWERCAP) {
+        return path == LD_LIMITS_MSR ? "intel-rapl" : "intel-rapl-mmio";
+    }
+    if (backend == LD_LIMITS_DIRECT) {
+        return path == LD_LIMITS_MSR ? "msr" : "mchbar";
+    }
+    return "auto";
+}
+
+static struct ld_powercap_zone *package_zone(enum ld_limits_path path, char *err, size_t err_sz) {
+    struct ld_powercap *pc = ld_powercap_shared(err, err_sz);
+    if (!pc) {
+        return NULL;
+    }
+    const char *tree = ld_limits_backend_name(path, LD_LIMITS_POWERCAP);
+    struct ld_powercap_zone *zone = ld_powercap_package_in(pc, tree);
+    if (!zone && err && err_sz) {
+        snprintf(err, err_sz, "no %s package zone", tree);
+    }
+    return zone;
+}
+
+static int direct_available(enum ld_limits_path path, char *err, size_t err_sz) {
+    if (path == LD_LIMITS_MSR) {
+        if (ld_msr_fd(0, 1) < 0) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "open(/dev/cpu/0/msr) failed: %s", strerror(errno));
+            }
+            return 0;
+        }
+        return 1;
+    }
+    return ld_mmio_shared(0, err, err_sz) != NULL;
+}
+
+int ld_limits_select(enum ld_limits_path path, enum ld_limits_backend want, enum ld_limits_backend *out, char *err,
+                     size_t err_sz) {
+    if (want == LD_LIMITS_POWERCAP) {
+        if (!package_zone(path, err, err_sz)) {
+            return -1;
+        }
+        *out = LD_LIMITS_POWERCAP;
+        return 0;
+    }
+    if (direct_available(path, err, err_sz)) {
+        *out = LD_LIMITS_DIRECT;
+        return 0;
+    }
+    if (want == LD_LIMITS_AUTO && package_zone(path, NULL, 0)) {
+        *out = LD_LIMITS_POWERCAP;
+        return 0;
+    }
+    return -1;
+}
+
+int ld_limits_units(struct ld_rapl_units *out) {
+    if (ld_rapl_units_read(out) == 0) {
+        return 0;
+    }
+    ld_rapl_units_decode(LD_RAPL_UNITS_DEFAULT, out);
+    return 1;
+}
+
+static int constraint_index(const struct ld_powercap_zone *zone, const struct pl_fields *pl) {
+    int idx = ld_powercap_constraint_find(zone, pl->constraint);
+    if (idx < 0 && pl->fallback_index < zone->constraint_count) {
+        idx = (int)pl->fallback_index;
+    }
+    return idx;
+}
+
+/* Synthesizes the 0x610 layout from the zone's constraints. */
+static uint64_t powercap_to_reg(const struct ld_powercap_zone *zone, const struct ld_reg_ctx *ctx) {
+    const struct ld_reg_desc *reg = ld_reg_get(LD_REG_PKG_POWER_LIMIT);
+    uint64_t val = 0;
+    for (size_t i = 0; i < 2; i++) {
+        int idx = constraint_index(zone, &pl_fields[i]);
+        if (idx < 0) {
+            continue;
+        }
+        const struct ld_powercap_constraint *c = &zone->constraints[idx];
+        uint64_t raw = 0;
+        const struct ld_reg_field *f = ld_reg_field_find(reg, pl_fields[i].limit);
+        double watts = (double)c->power_limit_uw / 1e6;
+        if (ld_reg_field_encode(f, watts, ctx, &raw) != 0) {
+            raw = LD_FIELD_MASK_(0, f->width);
+        }
+        val = ld_reg_field_set(f, val, raw);
+        f = ld_reg_field_find(reg, pl_fields[i].time);
+        if (c->has_time_window && c->time_window_us > 0 &&
+            ld_reg_field_encode(f, (double)c->time_window_us / 1e6, ctx, &raw) == 0) {
+            val = ld_reg_field_set(f, val, raw);
+        }
+    }
+    if (zone->enabled > 0) {
+        val = LD_FIELD_SET(val, LD_PKG_POWER_LIMIT_PL1_EN, 1);
+        val = LD_FIELD_SET(val, LD_PKG_POWER_LIMIT_PL2_EN, 1);
+    }
+    return val;
+}
+
+static int powercap_write(struct ld_powercap_zone *zone, const struct ld_reg_ctx *ctx, uint64_t val, char *err,
+                          size_t err_sz) {
+    const struct ld_reg_desc *reg = ld_reg_get(LD_REG_PKG_POWER_LIMIT);
+    uint64_t cur = powercap_to_reg(zone, ctx);
+    // Only fields that differ are written, so an unchanged PL2 never
+    // loses precision to a round trip through RAPL units.
+    for (size_t i = 0; i < 2; i++) {
+        int idx = constraint_index(zone, &pl_fields[i]);
+        if (idx < 0) {
+            continue;
+        }
+        const struct ld_reg_field *f = ld_reg_field_find(reg, pl_fields[i].limit);
+        double v = 0.0;
+        if (((cur ^ val) & ld_reg_field_mask(f)) && ld_reg_field_get(f, val) != 0) {
+            ld_reg_field_scaled(f, val, ctx, &v);
+            if (ld_powercap_set_limit_uw(zone, (size_t)idx, (uint64_t)llround(v * 1e6), err, err_sz) != 0) {
+                return -1;
+            }
+        }
+        f = ld_reg_field_find(reg, pl_fields[i].time);
+        if (zone->constraints[idx].has_time_window && ((cur ^ val) & ld_reg_field_mask(f)) &&
+            ld_reg_field_scaled(f, val, ctx, &v) == 0) {
+            if (ld_powercap_set_time_window_us(zone, (size_t)idx, (uint64_t)llround(v * 1e6), err, err_sz) != 0) {
+                return -1;
+            }
+        }
+    }
+    int enable = LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL1_EN) || LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL2_EN);
+    if (zone->enabled >= 0 && enable != zone->enabled) {
+        return ld_powercap_set_enabled(zone, enable, err, err_sz);
+    }
+    return 0;
+}
+
+static void units_ctx(struct ld_reg_ctx *ctx) {
+    struct ld_rapl_units units;
+    ld_limits_units(&units);
+    ld_reg_ctx_from_units(ctx, &units, 0);
+}
+
+int ld_limits_read(enum ld_limits_path path, enum ld_limits_backend backend, uint64_t *out, char *err, size_t err_sz) {
+    if (backend == LD_LIMITS_POWERCAP) {
+        struct ld_powercap_zone *zone = package_zone(path, err, err_sz);
+        if (!zone) {
+            return -1;
+        }
+        struct ld_reg_ctx ctx;
+        units_ctx(&ctx);
+        ld_powercap_refresh(zone);
+        *out = powercap_to_reg(zone, &ctx);
+        return 0;
+    }
+    if (path == LD_LIMITS_MSR) {
+        if (ld_msr_read(0, LD_MSR_PKG_POWER_LIMIT, out) != 0) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "read MSR 0x%X failed: %s", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
+            }
+            return -1;
+        }
+        return 0;
+    }
+    struct ld_mmio *mmio = ld_mmio_shared(0, err, err_sz);
+    if (!mmio) {
+        return -1;
+    }
+    *out = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
+    return 0;
+}
+
+int ld_limits_write(enum ld_limits_path path, enum ld_limits_backend backend, uint64_t val, char *err, size_t err_sz) {
+    if (backend == LD_LIMITS_POWERCAP) {
+        struct ld_powercap_zone *zone = package_zone(path, err, err_sz);
+        if (!zone) {
+            return -1;
+        }
+        struct ld_reg_ctx ctx;
+        units_ctx(&ctx);
+        ld_powercap_refresh(zone);
+        return powercap_write(zone, &ctx, val, err, err_sz);
+    }
+    if (path == LD_LIMITS_MSR) {
+        if (ld_msr_write(0, LD_MSR_PKG_POWER_LIMIT, val) != 0) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "write MSR 0x%X failed: %s", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
+            }
+            return -1;
+        }
+        return 0;
+    }
+    struct ld_mmio *mmio = ld_mmio_shared(1, err, err_sz);
+    if (!mmio) {
+        return -1;
+    }
+    ld_wr64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT, val);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef LD_LIMITS_H
+#define LD_LIMITS_H
+
+/*
+ * Package power limit access with a choice of backend per path:
+ *
+ *   MSR path  (MSR_PKG_POWER_LIMIT 0x610): /dev/cpu/0/msr or powercap intel-rapl
+ *   MMIO path (MCHBAR 0x59A0):             /dev/mem mapping or powercap intel-rapl-mmio
+ *
+ * Values are always exchanged in the 0x610 register layout so callers do
+ * not care which backend is active. The powercap backends map PL1/PL2 to
+ * the package zone's long_term/short_term constraints (limit and time
+ * window) and both enable bits to the zone's enabled file; the clamp and
+ * lock bits are not exposed by powercap, read back as 0 and are ignored
+ * on write.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* MSR_RAPL_POWER_UNIT of most client parts: 1/8 W, 1/16384 J, 1/1024 s. */
+#define LD_RAPL_UNITS_DEFAULT 0xA0E03ULL
+
+enum ld_limits_path {
+    LD_LIMITS_MSR,
+    LD_LIMITS_MMIO,
+};
+
+enum ld_limits_backend {
+    LD_LIMITS_AUTO,      /* selection only: direct when it opens, else powercap */
+    LD_LIMITS_DIRECT,    /* MSR device or /dev/mem MCHBAR mapping */
+    LD_LIMITS_POWERCAP,  /* intel-rapl / intel-rapl-mmio package zone */
+};
+
+/* "auto", "direct" or "powercap"; returns -1 for anything else. */
+int ld_limits_parse_backend(const char *s, enum ld_limits_backend *out);
+/* "msr", "mchbar", "intel-rapl" or "intel-rapl-mmio". */
+const char *ld_limits_backend_name(enum ld_limits_path path, enum ld_limits_backend backend);
+
+/*
+ * Resolves want (AUTO probes the direct device first) to a concrete
+ * backend. Returns -1 with err set when the requested backend is not
+ * available; AUTO then reports the direct backend's error.
+ */
+int ld_limits_select(enum ld_limits_path path, enum ld_limits_backend want, enum ld_limits_backend *out, char *err,
+                     size_t err_sz);
+
+/* RAPL units from MSR 0x606, or LD_RAPL_UNITS_DEFAULT when the MSR is not readable. Returns 1 for the fallback. */
+int ld_limits_units(struct ld_rapl_units *out);
+
+int ld_limits_read(enum ld_limits_path path, enum ld_limits_backend backend, uint64_t *out, char *err, size_t err_sz);
+int ld_limits_write(enum ld_limits_path path, enum ld_limits_backend backend, uint64_t val, char *err, size_t err_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,390 @@
+#define _GNU_SOURCE
+
+#include "ld_powercap.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static struct ld_powercap shared_powercap = { NULL, 0 };
+static int shared_powercap_ready = 0;
+
+static int read_text_fd(int fd, char *buf, size_t buf_sz) {
+    ssize_t n = pread(fd, buf, buf_sz - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' ')) {
+        buf[--n] = '\0';
+    }
+    return 0;
+}
+
+static int read_text_at(const char *dir, const char *file, char *buf, size_t buf_sz) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = read_text_fd(fd, buf, buf_sz);
+    close(fd);
+    return rc;
+}
+
+static int parse_u64_text(const char *text, uint64_t *out) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (errno != 0 || end == text) {
+        return -1;
+    }
+    *out = (uint64_t)v;
+    return 0;
+}
+
+static int read_u64_at(const char *dir, const char *file, uint64_t *out) {
+    char buf[64];
+    if (read_text_at(dir, file, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    return parse_u64_text(buf, out);
+}
+
+static int read_u64_fd(int fd, uint64_t *out) {
+    char buf[64];
+    if (read_text_fd(fd, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    return parse_u64_text(buf, out);
+}
+
+static void zone_init(struct ld_powercap_zone *zone) {
+    memset(zone, 0, sizeof(*zone));
+    zone->parent = -1;
+    zone->energy_fd = -1;
+    for (size_t i = 0; i < LD_POWERCAP_MAX_CONSTRAINTS; i++) {
+        zone->constraints[i].limit_fd = -1;
+        zone->constraints[i].window_fd = -1;
+    }
+}
+
+static void zone_close(struct ld_powercap_zone *zone) {
+    if (zone->energy_fd >= 0) {
+        close(zone->energy_fd);
+        zone->energy_fd = -1;
+    }
+    for (size_t i = 0; i < LD_POWERCAP_MAX_CONSTRAINTS; i++) {
+        struct ld_powercap_constraint *c = &zone->constraints[i];
+        if (c->limit_fd >= 0) {
+            close(c->limit_fd);
+            c->limit_fd = -1;
+        }
+        if (c->window_fd >= 0) {
+            close(c->window_fd);
+            c->window_fd = -1;
+        }
+    }
+}
+
+int ld_powercap_refresh(struct ld_powercap_zone *zone) {
+    char file[64];
+    uint64_t v = 0;
+    zone->enabled = read_u64_at(zone->path, "enabled", &v) == 0 ? (int)v : -1;
+
+    size_t count = 0;
+    for (size_t i = 0; i < LD_POWERCAP_MAX_CONSTRAINTS; i++) {
+        struct ld_powercap_constraint *c = &zone->constraints[i];
+        snprintf(file, sizeof(file), "constraint_%zu_power_limit_uw", i);
+        if (read_u64_at(zone->path, file, &c->power_limit_uw) != 0) {
+            break;
+        }
+        snprintf(file, sizeof(file), "constraint_%zu_name", i);
+        if (read_text_at(zone->path, file, c->name, sizeof(c->name)) != 0) {
+            snprintf(c->name, sizeof(c->name), "constraint_%zu", i);
+        }
+        snprintf(file, sizeof(file), "constraint_%zu_time_window_us", i);
+        c->has_time_window = read_u64_at(zone->path, file, &c->time_window_us) == 0;
+        snprintf(file, sizeof(file), "constraint_%zu_max_power_uw", i);
+        c->has_max_power = read_u64_at(zone->path, file, &c->max_power_uw) == 0;
+        count = i + 1;
+    }
+    zone->constraint_count = count;
+    return 0;
+}
+
+static int zone_cmp(const void *a, const void *b) {
+    const struct ld_powercap_zone *za = a;
+    const struct ld_powercap_zone *zb = b;
+    return strcmp(za->id, zb->id);
+}
+
+int ld_powercap_discover(struct ld_powercap *pc, const char *root, char *err, size_t err_sz) {
+    pc->zones = NULL;
+    pc->count = 0;
+    if (!root) {
+        root = LD_POWERCAP_ROOT;
+    }
+
+    DIR *dir = opendir(root);
+    if (!dir) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "opendir(%s) failed: %s", root, strerror(errno));
+        }
+        return -1;
+    }
+
+    size_t cap = 0;
+    struct dirent *de = NULL;
+    while ((de = readdir(dir)) != NULL) {
+        // Zones are "<control type>:<n>[:<m>]"; the bare control type dirs have no ':'.
+        if (strncmp(de->d_name, "intel-rapl", 10) != 0 || !strchr(de->d_name, ':')) {
+            continue;
+        }
+        size_t id_len = strlen(de->d_name);
+        if (id_len >= sizeof(pc->zones[0].id) || strlen(root) + id_len + 2 > sizeof(pc->zones[0].path)) {
+            continue;
+        }
+        if (pc->count == cap) {
+            size_t next = cap ? cap * 2 : 8;
+            struct ld_powercap_zone *grown = realloc(pc->zones, next * sizeof(*grown));
+            if (!grown) {
+                closedir(dir);
+                ld_powercap_free(pc);
+                if (err && err_sz) {
+                    snprintf(err, err_sz, "alloc failed");
+                }
+                return -1;
+            }
+            pc->zones = grown;
+            cap = next;
+        }
+        struct ld_powercap_zone *zone = &pc->zones[pc->count];
+        zone_init(zone);
+        memcpy(zone->id, de->d_name, id_len + 1);
+        snprintf(zone->path, sizeof(zone->path), "%s/%s", root, zone->id);
+        if (read_text_at(zone->path, "name", zone->name, sizeof(zone->name)) != 0) {
+            snprintf(zone->name, sizeof(zone->name), "%s", zone->id);
+        }
+        zone->has_energy = read_u64_at(zone->path, "max_energy_range_uj", &zone->max_energy_range_uj) == 0;
+        ld_powercap_refresh(zone);
+        pc->count++;
+    }
+    closedir(dir);
+
+    if (pc->count > 1) {
+        qsort(pc->zones, pc->count, sizeof(pc->zones[0]), zone_cmp);
+    }
+    // Parent = the longest other id that is a ':'-terminated prefix of this one.
+    for (size_t i = 0; i < pc->count; i++) {
+        size_t best_len = 0;
+        for (size_t j = 0; j < pc->count; j++) {
+            size_t len = strlen(pc->zones[j].id);
+            if (i != j && len > best_len && strncmp(pc->zones[i].id, pc->zones[j].id, len) == 0 &&
+                pc->zones[i].id[len] == ':') {
+                pc->zones[i].parent = (int)j;
+                best_len = len;
+            }
+        }
+    }
+
+    if (pc->count == 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "no intel-rapl zones under %s", root);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+void ld_powercap_free(struct ld_powercap *pc) {
+    for (size_t i = 0; i < pc->count; i++) {
+        zone_close(&pc->zones[i]);
+    }
+    free(pc->zones);
+    pc->zones = NULL;
+    pc->count = 0;
+}
+
+struct ld_powercap *ld_powercap_shared(char *err, size_t err_sz) {
+    if (!shared_powercap_ready) {
+        if (ld_powercap_discover(&shared_powercap, NULL, err, err_sz) != 0) {
+            return NULL;
+        }
+        shared_powercap_ready = 1;
+    }
+    return &shared_powercap;
+}
+
+void ld_powercap_shared_free(void) {
+    if (shared_powercap_ready) {
+        ld_powercap_free(&shared_powercap);
+        shared_powercap_ready = 0;
+    }
+}
+
+struct ld_powercap_zone *ld_powercap_find(struct ld_powercap *pc, const char *id_or_name) {
+    if (!pc || !id_or_name) {
+        return NULL;
+    }
+    for (size_t i = 0; i < pc->count; i++) {
+        if (strcmp(pc->zones[i].id, id_or_name) == 0) {
+            return &pc->zones[i];
+        }
+    }
+    struct ld_powercap_zone *fallback = NULL;
+    for (size_t i = 0; i < pc->count; i++) {
+        if (strcmp(pc->zones[i].name, id_or_name) != 0) {
+            continue;
+        }
+        /* Names repeat across intel-rapl and intel-rapl-mmio; prefer the MSR-backed zone. */
+        if (strncmp(pc->zones[i].id, "intel-rapl:", 11) == 0) {
+            return &pc->zones[i];
+        }
+        if (!fallback) {
+            fallback = &pc->zones[i];
+        }
+    }
+    return fallback;
+}
+
+struct ld_powercap_zone *ld_powercap_package_in(struct ld_powercap *pc, const char *tree) {
+    size_t len = strlen(tree);
+    for (size_t i = 0; pc && i < pc->count; i++) {
+        struct ld_powercap_zone *zone = &pc->zones[i];
+        if (zone->parent < 0 && strncmp(zone->name, "package", 7) == 0 && strncmp(zone->id, tree, len) == 0 &&
+            zone->id[len] == ':') {
+            return zone;
+        }
+    }
+    return NULL;
+}
+
+struct ld_powercap_zone *ld_powercap_package(struct ld_powercap *pc) {
+    struct ld_powercap_zone *zone = ld_powercap_package_in(pc, "intel-rapl");
+    if (zone) {
+        return zone;
+    }
+    for (size_t i = 0; pc && i < pc->count; i++) {
+        if (pc->zones[i].parent < 0 && strncmp(pc->zones[i].name, "package", 7) == 0) {
+            return &pc->zones[i];
+        }
+    }
+    return NULL;
+}
+
+int ld_powercap_constraint_find(const struct ld_powercap_zone *zone, const char *name_or_index) {
+    if (!zone || !name_or_index || !*name_or_index) {
+        return -1;
+    }
+    for (size_t i = 0; i < zone->constraint_count; i++) {
+        if (strcmp(zone->constraints[i].name, name_or_index) == 0) {
+            return (int)i;
+        }
+    }
+    char *end = NULL;
+    long idx = strtol(name_or_index, &end, 10);
+    if (*end == '\0' && idx >= 0 && (size_t)idx < zone->constraint_count) {
+        return (int)idx;
+    }
+    return -1;
+}
+
+int ld_powercap_read_energy_uj(struct ld_powercap_zone *zone, uint64_t *out) {
+    if (zone->energy_fd < 0) {
+        char path[320];
+        snprintf(path, sizeof(path), "%s/energy_uj", zone->path);
+        zone->energy_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (zone->energy_fd < 0) {
+            return -1;
+        }
+    }
+    if (read_u64_fd(zone->energy_fd, out) != 0) {
+        close(zone->energy_fd);
+        zone->energy_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static int write_cached(int *fd, const char *zone_path, const char *file, uint64_t value, char *err, size_t err_sz) {
+    char path[384];
+    snprintf(path, sizeof(path), "%s/%s", zone_path, file);
+    if (*fd < 0) {
+        *fd = open(path, O_RDWR | O_CLOEXEC);
+        if (*fd < 0) {
+            if (err && err_sz) {
+                snprintf(err, err_sz, "open(%s) failed: %s", path, strerror(errno));
+            }
+            return -1;
+        }
+    }
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%" PRIu64, value);
+    ssize_t n = pwrite(*fd, buf, (size_t)len, 0);
+    if (n != (ssize_t)len) {
+        int saved_errno = errno;
+        if (err && err_sz) {
+            snprintf(err, err_sz, "write(%s) failed: %s", path, strerror(saved_errno));
+        }
+        close(*fd);
+        *fd = -1;
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+int ld_powercap_set_limit_uw(struct ld_powercap_zone *zone, size_t constraint, uint64_t uw, char *err, size_t err_sz) {
+    if (constraint >= zone->constraint_count) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "%s has no constraint %zu", zone->id, constraint);
+        }
+        return -1;
+    }
+    struct ld_powercap_constraint *c = &zone->constraints[constraint];
+    char file[64];
+    snprintf(file, sizeof(file), "constraint_%zu_power_limit_uw", constraint);
+    if (write_cached(&c->limit_fd, zone->path, file, uw, err, err_sz) != 0) {
+        return -1;
+    }
+    c->power_limit_uw = uw;
+    return 0;
+}
+
+int ld_powercap_set_time_window_us(struct ld_powercap_zone *zone, size_t constraint, uint64_t us, char *err,
+                                   size_t err_sz) {
+    if (constraint >= zone->constraint_count || !zone->constraints[constraint].has_time_window) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "%s constraint %zu has no time window", zone->id, constraint);
+        }
+        return -1;
+    }
+    struct ld_powercap_constraint *c = &zone->constraints[constraint];
+    char file[64];
+    snprintf(file, sizeof(file), "constraint_%zu_time_window_us", constraint);
+    if (write_cached(&c->window_fd, zone->path, file, us, err, err_sz) != 0) {
+        return -1;
+    }
+    c->time_window_us = us;
+    return 0;
+}
+
+int ld_powercap_set_enabled(struct ld_powercap_zone *zone, int enabled, char *err, size_t err_sz) {
+    int fd = -1;
+    int rc = write_cached(&fd, zone->path, "enabled", enabled ? 1 : 0, err, err_sz);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (rc != 0) {
+        return -1;
+    }
+    zone->enabled = enabled ? 1 : 0;
+    return 0;
+}
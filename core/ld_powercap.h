@@ -0,0 +1,90 @@
+#ifndef LD_POWERCAP_H
+#define LD_POWERCAP_H
+
+/*
+ * Kernel powercap (intel-rapl, intel-rapl-mmio) zone tree: discovery of
+ * every zone and constraint, limit/time-window writes and energy_uj
+ * sampling. This path needs neither MSR access nor /dev/mem.
+ *
+ * Zone files that are polled or written repeatedly (energy_uj and the
+ * constraint limit/time-window files) are opened once and reused with
+ * pread/pwrite until ld_powercap_free().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_POWERCAP_ROOT            "/sys/class/powercap"
+#define LD_POWERCAP_MAX_CONSTRAINTS 8
+
+struct ld_powercap_constraint {
+    char name[32];          /* "long_term", "short_term", "peak_power", ... */
+    uint64_t power_limit_uw;
+    uint64_t time_window_us;
+    uint64_t max_power_uw;
+    int has_time_window;
+    int has_max_power;
+    int limit_fd;
+    int window_fd;
+};
+
+struct ld_powercap_zone {
+    char id[64];            /* directory name, e.g. "intel-rapl:0:1" */
+    char path[256];
+    char name[64];          /* "package-0", "core", "uncore", "dram", "psys", ... */
+    int parent;             /* index of the parent zone, -1 for top-level zones */
+    int enabled;
+    int has_energy;
+    uint64_t max_energy_range_uj;
+    int energy_fd;
+    struct ld_powercap_constraint constraints[LD_POWERCAP_MAX_CONSTRAINTS];
+    size_t constraint_count;
+};
+
+struct ld_powercap {
+    struct ld_powercap_zone *zones;
+    size_t count;
+};
+
+/* root == NULL scans LD_POWERCAP_ROOT. Zones are sorted by id. */
+int ld_powercap_discover(struct ld_powercap *pc, const char *root, char *err, size_t err_sz);
+void ld_powercap_free(struct ld_powercap *pc);
+
+/* Process-wide tree, discovered on first use and kept until ld_close_all(). */
+struct ld_powercap *ld_powercap_shared(char *err, size_t err_sz);
+void ld_powercap_shared_free(void);
+
+/* Matches a zone id ("intel-rapl:0") or name ("package-0"); ids win over names, intel-rapl over mmio. */
+struct ld_powercap_zone *ld_powercap_find(struct ld_powercap *pc, const char *id_or_name);
+/* The first package zone of the MSR-backed tree, else of any tree. */
+struct ld_powercap_zone *ld_powercap_package(struct ld_powercap *pc);
+/* The package zone of one tree: "intel-rapl" (MSR) or "intel-rapl-mmio" (MCHBAR). */
+struct ld_powercap_zone *ld_powercap_package_in(struct ld_powercap *pc, const char *tree);
+/* Constraint index by name ("long_term") or number ("0"); -1 when missing. */
+int ld_powercap_constraint_find(const struct ld_powercap_zone *zone, const char *name_or_index);
+
+/* Re-reads enabled, limits and time windows. */
+int ld_powercap_refresh(struct ld_powercap_zone *zone);
+int ld_powercap_read_energy_uj(struct ld_powercap_zone *zone, uint64_t *out);
+int ld_powercap_set_limit_uw(struct ld_powercap_zone *zone, size_t constraint, uint64_t uw, char *err, size_t err_sz);
+int ld_powercap_set_time_window_us(struct ld_powercap_zone *zone, size_t constraint, uint64_t us, char *err,
+                                   size_t err_sz);
+int ld_powercap_set_enabled(struct ld_powercap_zone *zone, int enabled, char *err, size_t err_sz);
+
+/* energy_uj counters wrap at max_energy_range_uj. */
+static inline uint64_t ld_powercap_energy_delta_uj(uint64_t prev, uint64_t cur, uint64_t max_range_uj) {
+    if (cur >= prev) {
+        return cur - prev;
+    }
+    return max_range_uj > prev ? (max_range_uj - prev) + cur : cur;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
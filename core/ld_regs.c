@@ -0,0 +1,300 @@
+#include "ld_regs.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LD_FIELD_ENTRY_(name, shift, width, sign, unit) { #name, shift, width, sign, unit },
+#define LD_FIELD_ENTRY(name, f, sign, unit) LD_FIELD_ENTRY_(name, f, sign, unit)
+#define LD_FIELD_MASK_ENTRY_(name, shift, width, sign, unit) | LD_FIELD_MASK_(shift, width)
+#define LD_FIELD_MASK_ENTRY(name, f, sign, unit) LD_FIELD_MASK_ENTRY_(name, f, sign, unit)
+
+#define LD_REG_FIELD_TABLE_(id, name, space, addr, fields) \
+    static const struct ld_reg_field name##_fields[] = { fields(LD_FIELD_ENTRY) };
+LD_REGISTERS(LD_REG_FIELD_TABLE_)
+#undef LD_REG_FIELD_TABLE_
+
+#define LD_REG_DESC_(id, name, space, addr, fields) \
+    { LD_REG_##id, #name, space, addr, name##_fields, sizeof(name##_fields) / sizeof(name##_fields[0]), \
+      0 fields(LD_FIELD_MASK_ENTRY) },
+static const struct ld_reg_desc reg_table[LD_REG_COUNT] = {
+    LD_REGISTERS(LD_REG_DESC_)
+};
+#undef LD_REG_DESC_
+
+const struct ld_reg_desc *ld_reg_get(enum ld_reg_id id) {
+    if ((int)id < 0 || id >= LD_REG_COUNT) {
+        return NULL;
+    }
+    return &reg_table[id];
+}
+
+const struct ld_reg_desc *ld_reg_find(const char *name_or_addr) {
+    if (!name_or_addr || !*name_or_addr) {
+        return NULL;
+    }
+    for (size_t i = 0; i < LD_REG_COUNT; i++) {
+        if (strcmp(reg_table[i].name, name_or_addr) == 0) {
+            return &reg_table[i];
+        }
+    }
+    char *end = NULL;
+    unsigned long addr = strtoul(name_or_addr, &end, 0);
+    if (end == name_or_addr || *end != '\0') {
+        return NULL;
+    }
+    for (size_t i = 0; i < LD_REG_COUNT; i++) {
+        if (reg_table[i].space == LD_SPACE_MSR && reg_table[i].addr == addr) {
+            return &reg_table[i];
+        }
+    }
+    return NULL;
+}
+
+const struct ld_reg_field *ld_reg_field_find(const struct ld_reg_desc *reg, const char *name) {
+    if (!reg || !name) {
+        return NULL;
+    }
+    for (size_t i = 0; i < reg->field_count; i++) {
+        if (strcmp(reg->fields[i].name, name) == 0) {
+            return &reg->fields[i];
+        }
+    }
+    return NULL;
+}
+
+void ld_reg_ctx_from_units(struct ld_reg_ctx *ctx, const struct ld_rapl_units *units, int tjmax) {
+    memset(ctx, 0, sizeof(*ctx));
+    if (units) {
+        ctx->unit_watts = units->unit_watts;
+        ctx->energy_unit_j = units->energy_unit_j;
+        ctx->time_unit_s = units->time_unit_s;
+    }
+    ctx->tjmax = tjmax;
+}
+
+static double time_window_s(uint64_t raw, double time_unit_s) {
+    unsigned int y = (unsigned int)(raw & 0x1Fu);
+    unsigned int z = (unsigned int)((raw >> 5) & 0x3u);
+    return ldexp(1.0 + (double)z / 4.0, (int)y) * time_unit_s;
+}
+
+int ld_reg_field_scaled(const struct ld_reg_field *f, uint64_t v, const struct ld_reg_ctx *ctx, double *out) {
+    uint64_t raw = ld_reg_field_get(f, v);
+    double sraw = f->sign == LD_SIGNED ? (double)ld_reg_field_get_signed(f, v) : (double)raw;
+    *out = sraw;
+    switch (f->unit) {
+    case LD_UNIT_POWER:
+        if (!ctx || ctx->unit_watts <= 0.0) {
+            return -1;
+        }
+        *out = sraw * ctx->unit_watts;
+        return 0;
+    case LD_UNIT_ENERGY:
+        if (!ctx || ctx->energy_unit_j <= 0.0) {
+            return -1;
+        }
+        *out = sraw * ctx->energy_unit_j;
+        return 0;
+    case LD_UNIT_TIME_WINDOW:
+        if (!ctx || ctx->time_unit_s <= 0.0) {
+            return -1;
+        }
+        *out = time_window_s(raw, ctx->time_unit_s);
+        return 0;
+    case LD_UNIT_EXP2:
+        *out = ldexp(1.0, -(int)raw);
+        return 0;
+    case LD_UNIT_RATIO:
+        *out = sraw * 100.0;
+        return 0;
+    case LD_UNIT_DEGC_BELOW:
+        if (!ctx || ctx->tjmax <= 0) {
+            return -1;
+        }
+        *out = (double)ctx->tjmax - sraw;
+        return 0;
+    case LD_UNIT_VID:
+        *out = sraw / 8192.0;
+        return 0;
+    case LD_UNIT_OC_MV:
+        *out = sraw / 1.024;
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+int ld_reg_field_encode(const struct ld_reg_field *f, double value, const struct ld_reg_ctx *ctx, uint64_t *raw_out) {
+    if (!isfinite(value)) {
+        return -1;
+    }
+    double raw = value;
+    switch (f->unit) {
+    case LD_UNIT_POWER:
+        if (!ctx || ctx->unit_watts <= 0.0) {
+            return -1;
+        }
+        raw = value / ctx->unit_watts;
+        break;
+    case LD_UNIT_ENERGY:
+        if (!ctx || ctx->energy_unit_j <= 0.0) {
+            return -1;
+        }
+        raw = value / ctx->energy_unit_j;
+        break;
+    case LD_UNIT_TIME_WINDOW: {
+        if (!ctx || ctx->time_unit_s <= 0.0 || value <= 0.0) {
+            return -1;
+        }
+        // Pick the closest representable window.
+        double best_err = INFINITY;
+        uint64_t best = 0;
+        for (uint64_t cand = 0; cand <= 0x7Fu; cand++) {
+            double e = fabs(time_window_s(cand, ctx->time_unit_s) - value);
+            if (e < best_err) {
+                best_err = e;
+                best = cand;
+            }
+        }
+        *raw_out = best;
+        return 0;
+    }
+    case LD_UNIT_RATIO:
+        raw = value / 100.0;
+        break;
+    case LD_UNIT_DEGC_BELOW:
+        if (!ctx || ctx->tjmax <= 0) {
+            return -1;
+        }
+        raw = (double)ctx->tjmax - value;
+        break;
+    case LD_UNIT_VID:
+        raw = value * 8192.0;
+        break;
+    case LD_UNIT_OC_MV:
+        raw = value * 1.024;
+        break;
+    case LD_UNIT_EXP2:
+        return -1;
+    default:
+        break;
+    }
+
+    long long r = llround(raw);
+    uint64_t max = LD_FIELD_MASK_(0, f->width);
+    if (f->sign == LD_SIGNED) {
+        long long lim = (long long)(max >> 1);
+        if (r < -lim - 1 || r > lim) {
+            return -1;
+        }
+        *raw_out = (uint64_t)r & max;
+        return 0;
+    }
+    if (r < 0 || (uint64_t)r > max) {
+        return -1;
+    }
+    *raw_out = (uint64_t)r;
+    return 0;
+}
+
+static size_t append(char *buf, size_t buf_sz, size_t pos, const char *fmt, ...) {
+    if (pos >= buf_sz) {
+        return pos;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + pos, buf_sz - pos, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return pos;
+    }
+    pos += (size_t)n;
+    return pos < buf_sz ? pos : buf_sz - 1;
+}
+
+size_t ld_reg_field_format(const struct ld_reg_field *f, uint64_t v, const struct ld_reg_ctx *ctx, char *buf,
+                           size_t buf_sz) {
+    if (!buf || buf_sz == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+    uint64_t raw = ld_reg_field_get(f, v);
+    double scaled = 0.0;
+    int have = ld_reg_field_scaled(f, v, ctx, &scaled) == 0;
+
+    switch (f->unit) {
+    case LD_UNIT_FLAG:
+        return append(buf, buf_sz, 0, "%u", (unsigned int)raw);
+    case LD_UNIT_HEX:
+        return append(buf, buf_sz, 0, "0x%" PRIx64, raw);
+    case LD_UNIT_POWER:
+        return have ? append(buf, buf_sz, 0, "%.3fW", scaled) : append(buf, buf_sz, 0, "%" PRIu64 "u", raw);
+    case LD_UNIT_ENERGY:
+        return have ? append(buf, buf_sz, 0, "%.3fJ", scaled) : append(buf, buf_sz, 0, "%" PRIu64 "u", raw);
+    case LD_UNIT_TIME_WINDOW:
+        return have ? append(buf, buf_sz, 0, "%.4gs", scaled) : append(buf, buf_sz, 0, "0x%02" PRIx64, raw);
+    case LD_UNIT_EXP2:
+        return append(buf, buf_sz, 0, "1/%" PRIu64, (uint64_t)1 << (raw & 0x3Fu));
+    case LD_UNIT_RATIO:
+        return append(buf, buf_sz, 0, "%" PRIu64 "x", raw);
+    case LD_UNIT_DEGC:
+        return append(buf, buf_sz, 0, "%" PRIu64 "C", raw);
+    case LD_UNIT_DEGC_BELOW:
+        return have ? append(buf, buf_sz, 0, "%.0fC", scaled) : append(buf, buf_sz, 0, "-%" PRIu64 "C", raw);
+    case LD_UNIT_VID:
+        return append(buf, buf_sz, 0, "%.4fV", scaled);
+    case LD_UNIT_OC_MV:
+        return append(buf, buf_sz, 0, "%.3fmV", scaled);
+    default:
+        if (f->sign == LD_SIGNED) {
+            return append(buf, buf_sz, 0, "%" PRId64, ld_reg_field_get_signed(f, v));
+        }
+        return append(buf, buf_sz, 0, "%" PRIu64, raw);
+    }
+}
+
+size_t ld_reg_format(const struct ld_reg_desc *reg, uint64_t v, const struct ld_reg_ctx *ctx, char *buf, size_t buf_sz) {
+    if (!buf || buf_sz == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+    size_t pos = 0;
+    char text[64];
+    for (size_t i = 0; i < reg->field_count; i++) {
+        ld_reg_field_format(&reg->fields[i], v, ctx, text, sizeof(text));
+        pos = append(buf, buf_sz, pos, "%s%s=%s", i ? " " : "", reg->fields[i].name, text);
+    }
+    return pos;
+}
+
+size_t ld_reg_diff(const struct ld_reg_desc *reg, uint64_t before, uint64_t after, const struct ld_reg_ctx *ctx,
+                   char *buf, size_t buf_sz) {
+    if (buf && buf_sz) {
+        buf[0] = '\0';
+    }
+    size_t changed = 0;
+    size_t pos = 0;
+    uint64_t delta = before ^ after;
+    if (!(delta & reg->mask)) {
+        return 0;
+    }
+    char old_text[64];
+    char new_text[64];
+    for (size_t i = 0; i < reg->field_count; i++) {
+        const struct ld_reg_field *f = &reg->fields[i];
+        if (!(delta & ld_reg_field_mask(f))) {
+            continue;
+        }
+        if (buf && buf_sz) {
+            ld_reg_field_format(f, before, ctx, old_text, sizeof(old_text));
+            ld_reg_field_format(f, after, ctx, new_text, sizeof(new_text));
+            pos = append(buf, buf_sz, pos, "%s%s: %s -> %s", changed ? ", " : "", f->name, old_text, new_text);
+        }
+        changed++;
+    }
+    return changed;
+}
@@ -0,0 +1,204 @@
+#ifndef LD_REGS_H
+#define LD_REGS_H
+
+/*
+ * Register descriptor tables for every MSR/MCHBAR register the project
+ * touches. Each register is one LD_REGISTERS() line plus one field list;
+ * the C tables below, the C++ types in ld_core.hpp and the generic
+ * decode/diff/format helpers are all generated from them.
+ *
+ *   R(ID, name, space, address, FIELDS)
+ *   F(name, "shift, width" descriptor, signedness, unit)
+ */
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ld_reg_space {
+    LD_SPACE_MSR,
+    LD_SPACE_MCHBAR,
+};
+
+enum ld_field_sign {
+    LD_UNSIGNED,
+    LD_SIGNED,
+};
+
+enum ld_field_unit {
+    LD_UNIT_RAW,          /* plain integer */
+    LD_UNIT_FLAG,         /* single bit */
+    LD_UNIT_HEX,          /* opaque value, printed in hex */
+    LD_UNIT_POWER,        /* RAPL power units */
+    LD_UNIT_ENERGY,       /* RAPL energy units */
+    LD_UNIT_TIME_WINDOW,  /* RAPL 2^Y * (1 + Z/4) time window */
+    LD_UNIT_EXP2,         /* 1 / 2^x (the RAPL unit fields themselves) */
+    LD_UNIT_RATIO,        /* x 100 MHz */
+    LD_UNIT_DEGC,         /* degrees C */
+    LD_UNIT_DEGC_BELOW,   /* degrees C below TjMax */
+    LD_UNIT_VID,          /* 1/8192 V */
+    LD_UNIT_OC_MV,        /* OC mailbox offset, 1/1.024 mV */
+};
+
+#define LD_REG_RAPL_POWER_UNIT_FIELDS(F) \
+    F(power_unit,  LD_RAPL_POWER_UNIT_POWER,  LD_UNSIGNED, LD_UNIT_EXP2) \
+    F(energy_unit, LD_RAPL_POWER_UNIT_ENERGY, LD_UNSIGNED, LD_UNIT_EXP2) \
+    F(time_unit,   LD_RAPL_POWER_UNIT_TIME,   LD_UNSIGNED, LD_UNIT_EXP2)
+
+#define LD_REG_PKG_POWER_LIMIT_FIELDS(F) \
+    F(pl1,       LD_PKG_POWER_LIMIT_PL1,       LD_UNSIGNED, LD_UNIT_POWER) \
+    F(pl1_en,    LD_PKG_POWER_LIMIT_PL1_EN,    LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(pl1_clamp, LD_PKG_POWER_LIMIT_PL1_CLAMP, LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(pl1_time,  LD_PKG_POWER_LIMIT_PL1_TIME,  LD_UNSIGNED, LD_UNIT_TIME_WINDOW) \
+    F(pl2,       LD_PKG_POWER_LIMIT_PL2,       LD_UNSIGNED, LD_UNIT_POWER) \
+    F(pl2_en,    LD_PKG_POWER_LIMIT_PL2_EN,    LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(pl2_clamp, LD_PKG_POWER_LIMIT_PL2_CLAMP, LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(pl2_time,  LD_PKG_POWER_LIMIT_PL2_TIME,  LD_UNSIGNED, LD_UNIT_TIME_WINDOW) \
+    F(lock,      LD_PKG_POWER_LIMIT_LOCK,      LD_UNSIGNED, LD_UNIT_FLAG)
+
+#define LD_REG_PKG_ENERGY_STATUS_FIELDS(F) \
+    F(energy, LD_PKG_ENERGY_STATUS_ENERGY, LD_UNSIGNED, LD_UNIT_ENERGY)
+
+#define LD_REG_PERF_STATUS_FIELDS(F) \
+    F(ratio, LD_PERF_STATUS_RATIO, LD_UNSIGNED, LD_UNIT_RATIO) \
+    F(vid,   LD_PERF_STATUS_VID,   LD_UNSIGNED, LD_UNIT_VID)
+
+#define LD_REG_PERF_CTL_FIELDS(F) \
+    F(ratio, LD_PERF_CTL_RATIO, LD_UNSIGNED, LD_UNIT_RATIO)
+
+#define LD_REG_THERM_STATUS_FIELDS(F) \
+    F(thermal,      LD_THERM_STATUS_THERMAL,      LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(thermal_log,  LD_THERM_STATUS_THERMAL_LOG,  LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(prochot,      LD_THERM_STATUS_PROCHOT,      LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(prochot_log,  LD_THERM_STATUS_PROCHOT_LOG,  LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(critical,     LD_THERM_STATUS_CRITICAL,     LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(power,        LD_THERM_STATUS_POWER,        LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(power_log,    LD_THERM_STATUS_POWER_LOG,    LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(current,      LD_THERM_STATUS_CURRENT,      LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(current_log,  LD_THERM_STATUS_CURRENT_LOG,  LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(xdomain,      LD_THERM_STATUS_XDOMAIN,      LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(xdomain_log,  LD_THERM_STATUS_XDOMAIN_LOG,  LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(readout,      LD_THERM_STATUS_READOUT,      LD_UNSIGNED, LD_UNIT_DEGC_BELOW) \
+    F(valid,        LD_THERM_STATUS_VALID,        LD_UNSIGNED, LD_UNIT_FLAG)
+
+#define LD_REG_TEMPERATURE_TARGET_FIELDS(F) \
+    F(tjmax, LD_TEMPERATURE_TARGET_TJMAX, LD_UNSIGNED, LD_UNIT_DEGC)
+
+#define LD_REG_PERF_LIMIT_REASONS_FIELDS(F) \
+    F(prochot,   LD_PERF_LIMIT_PROCHOT,   LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(thermal,   LD_PERF_LIMIT_THERMAL,   LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(rsr,       LD_PERF_LIMIT_RSR,       LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(ratl,      LD_PERF_LIMIT_RATL,      LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(vr_therm,  LD_PERF_LIMIT_VR_THERM,  LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(vr_tdc,    LD_PERF_LIMIT_VR_TDC,    LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(other,     LD_PERF_LIMIT_OTHER,     LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(pl1,       LD_PERF_LIMIT_PL1,       LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(pl2,       LD_PERF_LIMIT_PL2,       LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(max_turbo, LD_PERF_LIMIT_MAX_TURBO, LD_UNSIGNED, LD_UNIT_FLAG) \
+    F(tta,       LD_PERF_LIMIT_TTA,       LD_UNSIGNED, LD_UNIT_FLAG)
+
+#define LD_REG_OC_MAILBOX_FIELDS(F) \
+    F(data,   LD_OC_MAILBOX_DATA,  LD_UNSIGNED, LD_UNIT_HEX) \
+    F(offset, LD_OC_DATA_OFFSET,   LD_SIGNED,   LD_UNIT_OC_MV) \
+    F(cmd,    LD_OC_MAILBOX_CMD,   LD_UNSIGNED, LD_UNIT_HEX) \
+    F(plane,  LD_OC_MAILBOX_PLANE, LD_UNSIGNED, LD_UNIT_RAW) \
+    F(param,  LD_OC_MAILBOX_PARAM, LD_UNSIGNED, LD_UNIT_RAW) \
+    F(busy,   LD_OC_MAILBOX_BUSY,  LD_UNSIGNED, LD_UNIT_FLAG)
+
+#define LD_REGISTERS(R) \
+    R(OC_MAILBOX,             oc_mailbox,             LD_SPACE_MSR,    LD_MSR_OC_MAILBOX,              LD_REG_OC_MAILBOX_FIELDS) \
+    R(PERF_STATUS,            perf_status,            LD_SPACE_MSR,    LD_MSR_PERF_STATUS,             LD_REG_PERF_STATUS_FIELDS) \
+    R(PERF_CTL,               perf_ctl,               LD_SPACE_MSR,    LD_MSR_PERF_CTL,                LD_REG_PERF_CTL_FIELDS) \
+    R(THERM_STATUS,           therm_status,           LD_SPACE_MSR,    LD_MSR_THERM_STATUS,            LD_REG_THERM_STATUS_FIELDS) \
+    R(TEMPERATURE_TARGET,     temperature_target,     LD_SPACE_MSR,    LD_MSR_TEMPERATURE_TARGET,      LD_REG_TEMPERATURE_TARGET_FIELDS) \
+    R(PACKAGE_THERM_STATUS,   package_therm_status,   LD_SPACE_MSR,    LD_MSR_PACKAGE_THERM_STATUS,    LD_REG_THERM_STATUS_FIELDS) \
+    R(RAPL_POWER_UNIT,        rapl_power_unit,        LD_SPACE_MSR,    LD_MSR_RAPL_POWER_UNIT,         LD_REG_RAPL_POWER_UNIT_FIELDS) \
+    R(PKG_POWER_LIMIT,        pkg_power_limit,        LD_SPACE_MSR,    LD_MSR_PKG_POWER_LIMIT,         LD_REG_PKG_POWER_LIMIT_FIELDS) \
+    R(PKG_ENERGY_STATUS,      pkg_energy_status,      LD_SPACE_MSR,    LD_MSR_PKG_ENERGY_STATUS,       LD_REG_PKG_ENERGY_STATUS_FIELDS) \
+    R(PERF_LIMIT_REASONS,     perf_limit_reasons,     LD_SPACE_MSR,    LD_MSR_CORE_PERF_LIMIT_REASONS, LD_REG_PERF_LIMIT_REASONS_FIELDS) \
+    R(MCHBAR_PKG_POWER_LIMIT, mchbar_pkg_power_limit, LD_SPACE_MCHBAR, LD_MCHBAR_PKG_POWER_LIMIT,      LD_REG_PKG_POWER_LIMIT_FIELDS)
+
+#define LD_REG_ENUM_(id, name, space, addr, fields) LD_REG_##id,
+enum ld_reg_id {
+    LD_REGISTERS(LD_REG_ENUM_)
+    LD_REG_COUNT
+};
+#undef LD_REG_ENUM_
+
+struct ld_reg_field {
+    const char *name;
+    uint8_t shift;
+    uint8_t width;
+    uint8_t sign;
+    uint8_t unit;
+};
+
+struct ld_reg_desc {
+    enum ld_reg_id id;
+    const char *name;
+    enum ld_reg_space space;
+    uint32_t addr;
+    const struct ld_reg_field *fields;
+    size_t field_count;
+    uint64_t mask;
+};
+
+/* Scale context for unit conversion; zeroed fields print raw values. */
+struct ld_reg_ctx {
+    double unit_watts;
+    double energy_unit_j;
+    double time_unit_s;
+    int tjmax;
+};
+
+const struct ld_reg_desc *ld_reg_get(enum ld_reg_id id);
+/* Looks a register up by table name ("pkg_power_limit") or MSR address ("0x610"). */
+const struct ld_reg_desc *ld_reg_find(const char *name_or_addr);
+const struct ld_reg_field *ld_reg_field_find(const struct ld_reg_desc *reg, const char *name);
+
+void ld_reg_ctx_from_units(struct ld_reg_ctx *ctx, const struct ld_rapl_units *units, int tjmax);
+
+static inline uint64_t ld_reg_field_mask(const struct ld_reg_field *f) {
+    return LD_FIELD_MASK_(f->shift, f->width);
+}
+
+static inline uint64_t ld_reg_field_get(const struct ld_reg_field *f, uint64_t v) {
+    return LD_FIELD_GET_(v, f->shift, f->width);
+}
+
+static inline int64_t ld_reg_field_get_signed(const struct ld_reg_field *f, uint64_t v) {
+    uint64_t raw = ld_reg_field_get(f, v);
+    if (f->sign == LD_SIGNED && f->width < 64 && (raw >> (f->width - 1)) & 1u) {
+        raw |= ~0ULL << f->width;
+    }
+    return (int64_t)raw;
+}
+
+static inline uint64_t ld_reg_field_set(const struct ld_reg_field *f, uint64_t v, uint64_t x) {
+    return LD_FIELD_SET_(v, x, f->shift, f->width);
+}
+
+/*
+ * Field value in its natural unit (W, J, s, MHz, C, V, mV). Returns 0 when
+ * a conversion is available, -1 when the unit needs context that is missing
+ * (the raw value is stored in *out then).
+ */
+int ld_reg_field_scaled(const struct ld_reg_field *f, uint64_t v, const struct ld_reg_ctx *ctx, double *out);
+/* Encodes a value in the field's natural unit; inverse of ld_reg_field_scaled(). */
+int ld_reg_field_encode(const struct ld_reg_field *f, double value, const struct ld_reg_ctx *ctx, uint64_t *raw_out);
+
+size_t ld_reg_field_format(const struct ld_reg_field *f, uint64_t v, const struct ld_reg_ctx *ctx, char *buf,
+                           size_t buf_sz);
+/* "name=value name=value ..." for every field. */
+size_t ld_reg_format(const struct ld_reg_desc *reg, uint64_t v, const struct ld_reg_ctx *ctx, char *buf, size_t buf_sz);
+/* "name: old -> new, ..." for the fields that differ; returns how many did. */
+size_t ld_reg_diff(const struct ld_reg_desc *reg, uint64_t before, uint64_t after, const struct ld_reg_ctx *ctx,
+                   char *buf, size_t buf_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+#define _GNU_SOURCE
+
+#include "ld_residency.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int ld_residency_init(struct ld_residency *r, const int *cpus, const char *types, size_t count, double now_s) {
+    memset(r, 0, sizeof(*r));
+    r->cpus = calloc(count ? count : 1, sizeof(*r->cpus));
+    r->ops = calloc(count ? count * 2 : 1, sizeof(*r->ops));
+    if (!r->cpus || !r->ops) {
+        ld_residency_free(r);
+        return -1;
+    }
+    r->count = count;
+    for (size_t i = 0; i < count; i++) {
+        r->cpus[i].cpu = cpus[i];
+        r->cpus[i].type = types[i];
+        r->cpus[i].ratio = -1;
+        r->cpus[i].band = -1;
+        r->ops[i * 2].cpu = cpus[i];
+        r->ops[i * 2].reg = LD_MSR_PERF_STATUS;
+        r->ops[i * 2 + 1].cpu = cpus[i];
+        r->ops[i * 2 + 1].reg = LD_MSR_THERM_STATUS;
+    }
+    uint64_t target = 0;
+    if (count && ld_msr_read(cpus[0], LD_MSR_TEMPERATURE_TARGET, &target) == 0) {
+        r->tjmax_c = (unsigned int)LD_FIELD_GET(target, LD_TEMPERATURE_TARGET_TJMAX);
+    }
+    if (r->tjmax_c == 0) {
+        r->tjmax_c = 100;
+    }
+    r->start_s = now_s;
+    return 0;
+}
+
+void ld_residency_free(struct ld_residency *r) {
+    free(r->cpus);
+    free(r->ops);
+    memset(r, 0, sizeof(*r));
+}
+
+void ld_residency_reset(struct ld_residency *r, double now_s) {
+    for (size_t i = 0; i < r->count; i++) {
+        struct ld_residency_cpu *c = &r->cpus[i];
+        memset(c->ratio_s, 0, sizeof(c->ratio_s));
+        memset(c->band_s, 0, sizeof(c->band_s));
+        c->total_s = 0.0;
+    }
+    r->samples = 0;
+    r->start_s = now_s;
+    r->last_s = now_s;
+}
+
+size_t ld_residency_sample(struct ld_residency *r, double now_s) {
+    double dt = now_s - r->last_s;
+    int charge = r->last_s > 0.0 && dt > 0.0 && dt <= LD_RESIDENCY_MAX_GAP_S;
+    size_t ok = ld_msr_read_batch(r->ops, r->count * 2);
+    for (size_t i = 0; i < r->count; i++) {
+        struct ld_residency_cpu *c = &r->cpus[i];
+        // The interval belongs to what the previous sample saw; this one's state holds until the next.
+        if (charge) {
+            if (c->ratio >= 0) {
+                c->ratio_s[c->ratio] += dt;
+            }
+            if (c->band >= 0) {
+                c->band_s[c->band] += dt;
+            }
+            c->total_s += dt;
+        }
+        const struct ld_msr_op *perf = &r->ops[i * 2];
+        const struct ld_msr_op *therm = &r->ops[i * 2 + 1];
+        c->ratio = perf->ok ? (int)(LD_FIELD_GET(perf->value, LD_PERF_STATUS_RATIO) % LD_RESIDENCY_RATIOS) : -1;
+        c->band = -1;
+        if (therm->ok && LD_FIELD_GET(therm->value, LD_THERM_STATUS_VALID)) {
+            int temp_c = (int)r->tjmax_c - (int)LD_FIELD_GET(therm->value, LD_THERM_STATUS_READOUT);
+            int band = temp_c < 0 ? 0 : temp_c / LD_RESIDENCY_BAND_C;
+            c->band = band < LD_RESIDENCY_BANDS ? band : LD_RESIDENCY_BANDS - 1;
+        }
+    }
+    if (charge) {
+        r->samples++;
+    }
+    r->last_s = now_s;
+    return ok / 2;
+}
@@ -0,0 +1,73 @@
+#ifndef LD_RESIDENCY_H
+#define LD_RESIDENCY_H
+
+/*
+ * Per-CPU residency histograms: seconds spent at each core ratio and in
+ * each temperature band.
+ *
+ * Every sample reads IA32_PERF_STATUS and IA32_THERM_STATUS on each CPU in
+ * one batch and charges the interval since the previous sample to the
+ * ratio and band that sample saw (sample and hold), so the histograms are
+ * only as fine as the sampling rate; 100 ms catches turbo bursts that a 1 Hz
+ * sensor poll would miss. Everything, including the MSR batch, is allocated
+ * once by ld_residency_init(): a sample only reads and adds.
+ *
+ * A core in a C-state keeps reporting its last ratio, so ratio time is wall
+ * time, not busy time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_RESIDENCY_RATIOS 128          /* PERF_STATUS ratios 0..127 */
+#define LD_RESIDENCY_BAND_C 5            /* width of a temperature band */
+#define LD_RESIDENCY_BANDS 24            /* 0..119 C; hotter readings land in the last band */
+/* Intervals longer than this are a stalled sampler, not residency, and only restart the pairing. */
+#define LD_RESIDENCY_MAX_GAP_S 5.0
+
+struct ld_residency_cpu {
+    int cpu;
+    char type;                           /* 'P', 'E' or 'U' */
+    double ratio_s[LD_RESIDENCY_RATIOS]; /* time with a PERF_STATUS reading */
+    double band_s[LD_RESIDENCY_BANDS];   /* time with a valid temperature reading */
+    double total_s;
+    int ratio;                           /* state of the last sample, -1: read failed */
+    int band;                            /* -1: no valid reading */
+};
+
+struct ld_residency {
+    struct ld_residency_cpu *cpus;
+    size_t count;
+    struct ld_msr_op *ops;               /* PERF_STATUS, THERM_STATUS per CPU */
+    unsigned int tjmax_c;
+    double start_s;                      /* of the histograms, reset by ld_residency_reset() */
+    double last_s;                       /* of the last sample, 0 before the first */
+    uint64_t samples;
+};
+
+/* Allocates the histograms for count CPUs; types[i] is the P/E/U letter of cpus[i]. -1 when out of memory. */
+int ld_residency_init(struct ld_residency *r, const int *cpus, const char *types, size_t count, double now_s);
+void ld_residency_free(struct ld_residency *r);
+
+/* Zeroes the histograms; the next sample starts a new interval. */
+void ld_residency_reset(struct ld_residency *r, double now_s);
+
+/* Reads every CPU and charges the time since the previous sample. Returns how many CPUs read. */
+size_t ld_residency_sample(struct ld_residency *r, double now_s);
+
+/* Lowest temperature of band. */
+static inline int ld_residency_band_c(int band) {
+    return band * LD_RESIDENCY_BAND_C;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+#define _GNU_SOURCE
+
+#include "ld_sampler.h"
+
+#include <math.h>
+#include <string.h>
+
+void ld_sampler_init(struct ld_sampler *s, int min_ms, int max_ms) {
+    memset(s, 0, sizeof(*s));
+    s->min_ms = min_ms < LD_SAMPLER_MIN_MS ? LD_SAMPLER_MIN_MS : min_ms;
+    s->max_ms = max_ms < s->min_ms ? s->min_ms : max_ms;
+    s->interval_ms = s->min_ms;
+}
+
+void ld_sampler_restart(struct ld_sampler *s) {
+    s->have_last = 0;
+    s->calm = 0;
+    s->interval_ms = s->min_ms;
+}
+
+static int moved(double prev, double cur, double step) {
+    return prev >= 0.0 && cur >= 0.0 && fabs(cur - prev) >= step;
+}
+
+static int active(const struct ld_sampler_signals *prev, const struct ld_sampler_signals *cur) {
+    double power_step = prev->pkg_w * LD_SAMPLER_POWER_SHARE;
+    if (power_step < LD_SAMPLER_POWER_W) {
+        power_step = LD_SAMPLER_POWER_W;
+    }
+    return moved(prev->pkg_w, cur->pkg_w, power_step) ||
+           moved(prev->avg_ratio, cur->avg_ratio, LD_SAMPLER_RATIO_STEP) ||
+           moved(prev->max_ratio, cur->max_ratio, LD_SAMPLER_RATIO_STEP) ||
+           cur->throttle_events != prev->throttle_events || cur->throttle_state != prev->throttle_state;
+}
+
+int ld_sampler_update(struct ld_sampler *s, const struct ld_sampler_signals *sig, double now_s, double *interval_s) {
+    *interval_s = s->have_last && now_s > s->last_s ? now_s - s->last_s : 0.0;
+    if (!s->have_last || active(&s->last, sig)) {
+        s->calm = 0;
+        s->interval_ms = s->min_ms;
+    } else if (++s->calm >= LD_SAMPLER_CALM_SAMPLES) {
+        /* Back off gradually: a load that settles for a moment and then moves again is still caught quickly. */
+        int next = s->interval_ms + s->interval_ms / 2;
+        s->interval_ms = next > s->max_ms ? s->max_ms : next;
+    }
+    if (s->interval_ms == s->min_ms) {
+        s->fast_samples++;
+    }
+    s->samples++;
+    s->last = *sig;
+    s->last_s = now_s;
+    s->have_last = 1;
+    return s->interval_ms;
+}
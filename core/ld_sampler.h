@@ -0,0 +1,84 @@
+#ifndef LD_SAMPLER_H
+#define LD_SAMPLER_H
+
+/*
+ * Adaptive sample interval for the sensor pollers: fast while package
+ * power, core ratios or throttle state are moving, slow while they hold
+ * still.
+ *
+ * Each sample is compared with the previous one. A change above the
+ * thresholds below drops the interval straight to the fastest allowed, so
+ * the sample after a load step already runs at full rate; after
+ * LD_SAMPLER_CALM_SAMPLES quiet samples in a row the interval grows by half
+ * at a time up to the slowest. An idle machine is polled at the slow end
+ * (every 2 s by default, half the work of a fixed 1 Hz poll), and a
+ * transient is followed at up to 10 Hz instead of being averaged into one
+ * reading.
+ *
+ * The interval varies, so the caller turns every counter delta into a rate
+ * with the interval ld_sampler_update() returns for that sample, never with
+ * the nominal one.
+ */
+
+#include <stdint.h>
+
+#include "ld_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_SAMPLER_MIN_MS 100              /* fastest interval callers may ask for */
+#define LD_SAMPLER_MAX_MS 2000             /* default slowest interval */
+#define LD_SAMPLER_CALM_SAMPLES 3          /* quiet samples before the interval grows */
+/* Package power change that counts as activity: this many watts, or this share of the previous reading. */
+#define LD_SAMPLER_POWER_W 2.0
+#define LD_SAMPLER_POWER_SHARE 0.10
+#define LD_SAMPLER_RATIO_STEP 2.0          /* change of the mean or highest core ratio */
+
+/* IA32_THERM_STATUS bits whose flips count as throttle state changes. */
+#define LD_SAMPLER_THERM_MASK                                                                                     \
+    (LD_FIELD_MASK(LD_THERM_STATUS_THERMAL) | LD_FIELD_MASK(LD_THERM_STATUS_PROCHOT) |                            \
+     LD_FIELD_MASK(LD_THERM_STATUS_CRITICAL) | LD_FIELD_MASK(LD_THERM_STATUS_POWER) |                             \
+     LD_FIELD_MASK(LD_THERM_STATUS_CURRENT) | LD_FIELD_MASK(LD_THERM_STATUS_XDOMAIN))
+
+/* What one sample saw; negative values are "not read" and never count as a change. */
+struct ld_sampler_signals {
+    double pkg_w;                          /* average package power over the interval */
+    double avg_ratio;                      /* mean core ratio */
+    double max_ratio;
+    uint64_t throttle_events;              /* cumulative, summed over the CPUs */
+    uint64_t throttle_state;               /* OR of every CPU's status & LD_SAMPLER_THERM_MASK */
+};
+
+struct ld_sampler {
+    int min_ms;
+    int max_ms;
+    int interval_ms;                       /* until the next sample */
+    int calm;                              /* quiet samples in a row */
+    double last_s;                         /* of the previous sample */
+    int have_last;
+    struct ld_sampler_signals last;
+    uint64_t fast_samples;                 /* samples taken at min_ms, for the caller's status line */
+    uint64_t samples;
+};
+
+/* min_ms is clamped to LD_SAMPLER_MIN_MS and max_ms to at least min_ms; sampling starts at the fastest rate. */
+void ld_sampler_init(struct ld_sampler *s, int min_ms, int max_ms);
+
+/*
+ * Feeds the signals of a sample taken at monotonic now_s and returns the
+ * interval to wait before the next one, in ms. *interval_s gets the time
+ * since the previous sample, 0 for the first; that is the interval this
+ * sample's rates belong to.
+ */
+int ld_sampler_update(struct ld_sampler *s, const struct ld_sampler_signals *sig, double now_s, double *interval_s);
+
+/* Forgets the previous sample (after a pause), keeping the limits; the next update counts as activity. */
+void ld_sampler_restart(struct ld_sampler *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
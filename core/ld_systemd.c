@@ -0,0 +1,372 @@
+#define _GNU_SOURCE
+
+#include "ld_systemd.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SYSTEMD_DEST "org.freedesktop.systemd1"
+#define SYSTEMD_PATH "/org/freedesktop/systemd1"
+#define SYSTEMD_MANAGER "org.freedesktop.systemd1.Manager"
+#define SYSTEMD_NO_SUCH_UNIT "org.freedesktop.systemd1.NoSuchUnit"
+
+#define JOB_REMOVED_MATCH \
+    "type='signal',sender='" SYSTEMD_DEST "',path='" SYSTEMD_PATH "',interface='" SYSTEMD_MANAGER \
+    "',member='JobRemoved'"
+
+static double mono_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+const char *ld_systemd_state_name(enum ld_systemd_state state) {
+    switch (state) {
+    case LD_SYSTEMD_QUEUED: return "queued";
+    case LD_SYSTEMD_RUNNING: return "running";
+    case LD_SYSTEMD_RELOADING: return "reloading";
+    case LD_SYSTEMD_DONE: return "done";
+    case LD_SYSTEMD_FAILED: return "failed";
+    case LD_SYSTEMD_SKIPPED: return "skipped";
+    }
+    return "unknown";
+}
+
+int ld_systemd_job_finished(const struct ld_systemd_job *job) {
+    return job->state == LD_SYSTEMD_DONE || job->state == LD_SYSTEMD_FAILED || job->state == LD_SYSTEMD_SKIPPED;
+}
+
+/* AddMatch + Subscribe on a freshly connected bus; closes it on failure. */
+static int subscribe(struct ld_systemd *sd, char *err, size_t err_sz) {
+    struct ld_dbus_buf body = { 0 };
+    ld_dbus_put_string(&body, JOB_REMOVED_MATCH);
+    int rc = ld_dbus_call_sync(&sd->bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                               "AddMatch", "s", &body, NULL, 5000, err, err_sz);
+    ld_dbus_buf_free(&body);
+    // Without Subscribe the manager only emits JobRemoved while some other
+    // client is subscribed.
+    if (rc == 0) {
+        rc = ld_dbus_call_sync(&sd->bus, SYSTEMD_DEST, SYSTEMD_PATH, SYSTEMD_MANAGER, "Subscribe", NULL, NULL, NULL,
+                               5000, err, err_sz);
+    }
+    if (rc != 0) {
+        ld_dbus_close(&sd->bus);
+        return -1;
+    }
+    sd->open = 1;
+    return 0;
+}
+
+int ld_systemd_open(struct ld_systemd *sd, char *err, size_t err_sz) {
+    sd->open = 0;
+    if (sd->next_id == 0) {
+        sd->next_id = 1;
+    }
+    if (ld_dbus_connect(&sd->bus, NULL, err, err_sz) != 0) {
+        return -1;
+    }
+    return subscribe(sd, err, err_sz);
+}
+
+int ld_systemd_open_fd(struct ld_systemd *sd, int fd, char *err, size_t err_sz) {
+    sd->open = 0;
+    if (sd->next_id == 0) {
+        sd->next_id = 1;
+    }
+    if (ld_dbus_connect_fd(&sd->bus, fd, err, err_sz) != 0) {
+        return -1;
+    }
+    return subscribe(sd, err, err_sz);
+}
+
+void ld_systemd_close(struct ld_systemd *sd) {
+    if (sd->open) {
+        ld_dbus_close(&sd->bus);
+    }
+    memset(sd, 0, sizeof(*sd));
+}
+
+size_t ld_systemd_pending(const struct ld_systemd *sd) {
+    size_t pending = 0;
+    for (size_t i = 0; i < sd->count; i++) {
+        if (!ld_systemd_job_finished(&sd->jobs[i])) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+const struct ld_systemd_job *ld_systemd_job(const struct ld_systemd *sd, uint32_t id) {
+    for (size_t i = 0; i < sd->count; i++) {
+        if (sd->jobs[i].id == id) {
+            return &sd->jobs[i];
+        }
+    }
+    return NULL;
+}
+
+static struct ld_systemd_job *alloc_job(struct ld_systemd *sd) {
+    if (sd->count < LD_SYSTEMD_MAX_JOBS) {
+        return &sd->jobs[sd->count++];
+    }
+    struct ld_systemd_job *oldest = NULL;
+    for (size_t i = 0; i < sd->count; i++) {
+        struct ld_systemd_job *job = &sd->jobs[i];
+        if (ld_systemd_job_finished(job) && (!oldest || job->id < oldest->id)) {
+            oldest = job;
+        }
+    }
+    return oldest;
+}
+
+static size_t free_slots(const struct ld_systemd *sd) {
+    return LD_SYSTEMD_MAX_JOBS - ld_systemd_pending(sd);
+}
+
+static int send_job_call(struct ld_systemd *sd, struct ld_systemd_job *job, char *err, size_t err_sz) {
+    struct ld_dbus_buf body = { 0 };
+    const char *member = NULL;
+    const char *sig = NULL;
+    if (strcmp(job->action, "start") == 0 || strcmp(job->action, "stop") == 0) {
+        member = strcmp(job->action, "start") == 0 ? "StartUnit" : "StopUnit";
+        sig = "ss";
+        ld_dbus_put_string(&body, job->unit);
+        ld_dbus_put_string(&body, "replace");
+    } else {
+        int enable = strcmp(job->action, "enable") == 0;
+        struct ld_dbus_array units;
+        member = enable ? "EnableUnitFiles" : "DisableUnitFiles";
+        sig = enable ? "asbb" : "asb";
+        ld_dbus_array_begin(&body, 4, &units);
+        ld_dbus_put_string(&body, job->unit);
+        ld_dbus_array_end(&body, &units);
+        ld_dbus_put_bool(&body, 0);  /* runtime */
+        if (enable) {
+            ld_dbus_put_bool(&body, 0);  /* force */
+        }
+    }
+    int rc = ld_dbus_call(&sd->bus, SYSTEMD_DEST, SYSTEMD_PATH, SYSTEMD_MANAGER, member, sig, &body, &job->serial, err,
+                          err_sz);
+    ld_dbus_buf_free(&body);
+    return rc;
+}
+
+int ld_systemd_submit(struct ld_systemd *sd, const char *action, const char *const *units, size_t count,
+                      uint32_t *first_id, char *err, size_t err_sz) {
+    if (strcmp(action, "start") != 0 && strcmp(action, "stop") != 0 && strcmp(action, "enable") != 0 &&
+        strcmp(action, "disable") != 0) {
+        snprintf(err, err_sz, "unsupported unit action: %s", action);
+        return -1;
+    }
+    if (!sd->open) {
+        snprintf(err, err_sz, "systemd bus connection is not open");
+        return -1;
+    }
+    ld_systemd_process(sd, 0, NULL, 0);
+    if (count > free_slots(sd)) {
+        snprintf(err, err_sz, "too many pending systemd jobs");
+        return -1;
+    }
+    *first_id = sd->next_id;
+    for (size_t i = 0; i < count; i++) {
+        struct ld_systemd_job *job = alloc_job(sd);
+        memset(job, 0, sizeof(*job));
+        job->id = sd->next_id++;
+        job->batch = *first_id;
+        snprintf(job->action, sizeof(job->action), "%s", action);
+        snprintf(job->unit, sizeof(job->unit), "%s", units[i]);
+        job->submitted_s = mono_s();
+        if (send_job_call(sd, job, err, err_sz) != 0) {
+            job->state = LD_SYSTEMD_FAILED;
+            snprintf(job->result, sizeof(job->result), "%s", err);
+            job->finished_s = job->submitted_s;
+            return -1;
+        }
+        job->state = LD_SYSTEMD_QUEUED;
+    }
+    return 0;
+}
+
+static void finish_job(struct ld_systemd_job *job, enum ld_systemd_state state, const char *result) {
+    job->state = state;
+    snprintf(job->result, sizeof(job->result), "%s", result);
+    job->finished_s = mono_s();
+}
+
+/*
+ * Unit file changes only take effect after a manager Reload, and one Reload
+ * covers every unit: it is sent once no unit file call of the batch is
+ * still waiting for its reply. Jobs waiting for it are RELOADING with
+ * serial 0 until then.
+ */
+static void reload_batch(struct ld_systemd *sd, uint32_t batch) {
+    size_t waiting = 0;
+    for (size_t i = 0; i < sd->count; i++) {
+        const struct ld_systemd_job *job = &sd->jobs[i];
+        if (job->batch != batch) {
+            continue;
+        }
+        if (job->state == LD_SYSTEMD_QUEUED) {
+            return;
+        }
+        if (job->state == LD_SYSTEMD_RELOADING && job->serial == 0) {
+            waiting++;
+        }
+    }
+    if (waiting == 0) {
+        return;
+    }
+    uint32_t serial = 0;
+    char err[128] = { 0 };
+    int rc = ld_dbus_call(&sd->bus, SYSTEMD_DEST, SYSTEMD_PATH, SYSTEMD_MANAGER, "Reload", NULL, NULL, &serial, err,
+                          sizeof(err));
+    for (size_t i = 0; i < sd->count; i++) {
+        struct ld_systemd_job *job = &sd->jobs[i];
+        if (job->batch == batch && job->state == LD_SYSTEMD_RELOADING && job->serial == 0) {
+            if (rc != 0) {
+                finish_job(job, LD_SYSTEMD_FAILED, err);
+            } else {
+                job->serial = serial;
+            }
+        }
+    }
+}
+
+/* The Reload reply finishes every job that waited for it. */
+static int handle_reload_reply(struct ld_systemd *sd, const struct ld_dbus_msg *msg) {
+    char text[128] = "done";
+    if (msg->type == LD_DBUS_ERROR) {
+        ld_dbus_error_text(msg, text, sizeof(text));
+    }
+    int matched = 0;
+    for (size_t i = 0; i < sd->count; i++) {
+        struct ld_systemd_job *job = &sd->jobs[i];
+        if (job->state == LD_SYSTEMD_RELOADING && job->serial != 0 && job->serial == msg->reply_serial) {
+            finish_job(job, msg->type == LD_DBUS_ERROR ? LD_SYSTEMD_FAILED : LD_SYSTEMD_DONE, text);
+            matched = 1;
+        }
+    }
+    return matched;
+}
+
+static void handle_reply(struct ld_systemd *sd, const struct ld_dbus_msg *msg) {
+    if (handle_reload_reply(sd, msg)) {
+        return;
+    }
+    struct ld_systemd_job *job = NULL;
+    for (size_t i = 0; i < sd->count; i++) {
+        if (sd->jobs[i].state == LD_SYSTEMD_QUEUED && sd->jobs[i].serial == msg->reply_serial) {
+            job = &sd->jobs[i];
+            break;
+        }
+    }
+    if (!job) {
+        return;
+    }
+    int unit_files = strcmp(job->action, "enable") == 0 || strcmp(job->action, "disable") == 0;
+    if (msg->type == LD_DBUS_ERROR) {
+        char text[128];
+        ld_dbus_error_text(msg, text, sizeof(text));
+        int missing = msg->error_name && strcmp(msg->error_name, SYSTEMD_NO_SUCH_UNIT) == 0;
+        finish_job(job, missing && strcmp(job->action, "stop") == 0 ? LD_SYSTEMD_SKIPPED : LD_SYSTEMD_FAILED, text);
+        if (unit_files) {
+            reload_batch(sd, job->batch);
+        }
+        return;
+    }
+    if (unit_files) {
+        job->state = LD_SYSTEMD_RELOADING;
+        job->serial = 0;
+        reload_batch(sd, job->batch);
+        return;
+    }
+    struct ld_dbus_iter body = msg->body;
+    const char *path = NULL;
+    if (ld_dbus_get_string(&body, &path) != 0) {
+        finish_job(job, LD_SYSTEMD_FAILED, "malformed job reply");
+        return;
+    }
+    snprintf(job->job_path, sizeof(job->job_path), "%s", path);
+    job->state = LD_SYSTEMD_RUNNING;
+}
+
+static void handle_signal(struct ld_systemd *sd, const struct ld_dbus_msg *msg) {
+    if (!msg->member || strcmp(msg->member, "JobRemoved") != 0 || !msg->interface ||
+        strcmp(msg->interface, SYSTEMD_MANAGER) != 0) {
+        return;
+    }
+    struct ld_dbus_iter body = msg->body;
+    uint32_t job_id = 0;
+    const char *path = NULL;
+    const char *unit = NULL;
+    const char *result = NULL;
+    if (ld_dbus_get_u32(&body, &job_id) != 0 || ld_dbus_get_string(&body, &path) != 0 ||
+        ld_dbus_get_string(&body, &unit) != 0 || ld_dbus_get_string(&body, &result) != 0) {
+        return;
+    }
+    for (size_t i = 0; i < sd->count; i++) {
+        struct ld_systemd_job *job = &sd->jobs[i];
+        if (job->state == LD_SYSTEMD_RUNNING && strcmp(job->job_path, path) == 0) {
+            finish_job(job, strcmp(result, "done") == 0 ? LD_SYSTEMD_DONE : LD_SYSTEMD_FAILED, result);
+            return;
+        }
+    }
+}
+
+int ld_systemd_process(struct ld_systemd *sd, int timeout_ms, char *err, size_t err_sz) {
+    if (!sd->open) {
+        return 0;
+    }
+    int first = 1;
+    for (;;) {
+        struct ld_dbus_msg msg;
+        int rc = ld_dbus_read(&sd->bus, &msg, first ? timeout_ms : 0, err, err_sz);
+        first = 0;
+        if (rc < 0) {
+            // Pending jobs cannot complete on a dead connection.
+            for (size_t i = 0; i < sd->count; i++) {
+                if (!ld_systemd_job_finished(&sd->jobs[i])) {
+                    finish_job(&sd->jobs[i], LD_SYSTEMD_FAILED, "bus connection lost");
+                }
+            }
+            ld_dbus_close(&sd->bus);
+            sd->open = 0;
+            return -1;
+        }
+        if (rc == 0) {
+            return 0;
+        }
+        if (msg.type == LD_DBUS_METHOD_RETURN || msg.type == LD_DBUS_ERROR) {
+            handle_reply(sd, &msg);
+        } else if (msg.type == LD_DBUS_SIGNAL) {
+            handle_signal(sd, &msg);
+        }
+        ld_dbus_msg_free(&msg);
+    }
+}
+
+static size_t pending_in(const struct ld_systemd *sd, uint32_t first_id, size_t count) {
+    size_t pending = 0;
+    for (size_t i = 0; i < sd->count; i++) {
+        const struct ld_systemd_job *job = &sd->jobs[i];
+        if (job->id >= first_id && job->id - first_id < count && !ld_systemd_job_finished(job)) {
+            pending++;
+        }
+    }
+    return pending;
+}
+
+size_t ld_systemd_wait(struct ld_systemd *sd, uint32_t first_id, size_t count, int timeout_ms, char *err,
+                       size_t err_sz) {
+    double deadline = mono_s() + timeout_ms / 1e3;
+    size_t pending = pending_in(sd, first_id, count);
+    while (pending > 0) {
+        int left = (int)((deadline - mono_s()) * 1e3);
+        if (left <= 0 || ld_systemd_process(sd, left, err, err_sz) != 0) {
+            break;
+        }
+        pending = pending_in(sd, first_id, count);
+    }
+    return pending_in(sd, first_id, count);
+}
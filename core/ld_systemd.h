@@ -0,0 +1,90 @@
+#ifndef LD_SYSTEMD_H
+#define LD_SYSTEMD_H
+
+/*
+ * systemd unit control over the system bus instead of forking systemctl.
+ *
+ * ld_systemd_submit() pipelines the manager calls for every unit and
+ * returns immediately; ld_systemd_process() matches the replies and the
+ * JobRemoved signals as they arrive, so the bus fd can be polled next to
+ * other work. start/stop jobs finish on JobRemoved; enable/disable finish
+ * after the unit file change and the manager Reload that follows it, one
+ * Reload per submitted batch.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ld_dbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LD_SYSTEMD_MAX_JOBS 32
+
+enum ld_systemd_state {
+    LD_SYSTEMD_QUEUED,     /* call sent, no reply yet */
+    LD_SYSTEMD_RUNNING,    /* job object created, waiting for JobRemoved */
+    LD_SYSTEMD_RELOADING,  /* unit files changed, waiting for the batch's Reload */
+    LD_SYSTEMD_DONE,
+    LD_SYSTEMD_FAILED,
+    LD_SYSTEMD_SKIPPED,    /* stop of a unit that is not installed */
+};
+
+struct ld_systemd_job {
+    uint32_t id;
+    uint32_t batch;        /* id of the first job of the same ld_systemd_submit() */
+    char action[8];
+    char unit[64];
+    char job_path[128];
+    uint32_t serial;
+    enum ld_systemd_state state;
+    char result[128];
+    double submitted_s;
+    double finished_s;
+};
+
+struct ld_systemd {
+    struct ld_dbus bus;
+    int open;
+    struct ld_systemd_job jobs[LD_SYSTEMD_MAX_JOBS];
+    size_t count;
+    uint32_t next_id;
+};
+
+/*
+ * Connects to the system bus and subscribes to the manager's JobRemoved
+ * signal. sd starts zeroed; reopening after a lost connection keeps the
+ * job table and id sequence.
+ */
+int ld_systemd_open(struct ld_systemd *sd, char *err, size_t err_sz);
+/* Same over an already connected socket instead of the system bus (tests run it against a socketpair). */
+int ld_systemd_open_fd(struct ld_systemd *sd, int fd, char *err, size_t err_sz);
+void ld_systemd_close(struct ld_systemd *sd);
+static inline int ld_systemd_fd(const struct ld_systemd *sd) {
+    return sd->open ? ld_dbus_fd(&sd->bus) : -1;
+}
+
+/*
+ * Queues action ("start", "stop", "enable" or "disable") for every unit.
+ * Job ids are consecutive from *first_id. Finished slots are recycled
+ * oldest first; -1 when every slot is still pending.
+ */
+int ld_systemd_submit(struct ld_systemd *sd, const char *action, const char *const *units, size_t count,
+                      uint32_t *first_id, char *err, size_t err_sz);
+/* Handles everything that arrives within timeout_ms (0 = drain only). -1 when the bus connection is lost. */
+int ld_systemd_process(struct ld_systemd *sd, int timeout_ms, char *err, size_t err_sz);
+/* Processes until jobs [first_id, first_id + count) finish or timeout_ms passes. Returns the number still pending. */
+size_t ld_systemd_wait(struct ld_systemd *sd, uint32_t first_id, size_t count, int timeout_ms, char *err, size_t err_sz);
+size_t ld_systemd_pending(const struct ld_systemd *sd);
+
+const struct ld_systemd_job *ld_systemd_job(const struct ld_systemd *sd, uint32_t id);
+int ld_systemd_job_finished(const struct ld_systemd_job *job);
+const char *ld_systemd_state_name(enum ld_systemd_state state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
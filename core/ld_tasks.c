@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+
+#include "ld_tasks.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void ld_task_table_init(struct ld_task_table *t, int fd_budget) {
+    memset(t, 0, sizeof(*t));
+    t->fd_budget = fd_budget > 0 ? fd_budget : 0;
+    long hz = sysconf(_SC_CLK_TCK);
+    t->tick_s = 1.0 / (double)(hz > 0 ? hz : 100);
+}
+
+static void drop_fd(struct ld_task_table *t, struct ld_task *task) {
+    if (task->fd >= 0) {
+        close(task->fd);
+        task->fd = -1;
+        t->open_fds--;
+    }
+}
+
+void ld_task_table_free(struct ld_task_table *t) {
+    for (size_t i = 0; i < t->count; i++) {
+        drop_fd(t, &t->tasks[i]);
+    }
+    free(t->tasks);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+static size_t hash_pid(int pid, size_t cap) {
+    return ((size_t)(unsigned int)pid * 2654435761u) & (cap - 1);
+}
+
+/* Slot of pid, or the empty slot where it would go. */
+static size_t find_slot(const struct ld_task_table *t, int pid) {
+    size_t i = hash_pid(pid, t->slot_cap);
+    while (t->slots[i] >= 0 && t->tasks[t->slots[i]].pid != pid) {
+        i = (i + 1) & (t->slot_cap - 1);
+    }
+    return i;
+}
+
+static int grow_slots(struct ld_task_table *t) {
+    size_t cap = t->slot_cap ? t->slot_cap * 2 : 1024;
+    int *slots = malloc(cap * sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->slot_cap = cap;
+    for (size_t i = 0; i < cap; i++) {
+        slots[i] = -1;
+    }
+    // Rebuild from the newest entry of each pid; older ones are exited and only kept for the totals.
+    for (size_t n = t->count; n-- > 0;) {
+        size_t i = find_slot(t, t->tasks[n].pid);
+        if (slots[i] < 0) {
+            slots[i] = (int)n;
+        }
+    }
+    return 0;
+}
+
+static struct ld_task *add_task(struct ld_task_table *t, int pid) {
+    if ((t->count + 1) * 2 > t->slot_cap && grow_slots(t) != 0) {
+        return NULL;
+    }
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 512;
+        struct ld_task *grown = realloc(t->tasks, cap * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        t->tasks = grown;
+        t->cap = cap;
+    }
+    struct ld_task *task = &t->tasks[t->count];
+    memset(task, 0, sizeof(*task));
+    task->pid = pid;
+    task->fd = -1;
+    task->last_cpu = -1;
+    t->slots[find_slot(t, pid)] = (int)t->count;
+    t->count++;
+    return task;
+}
+
+struct stat_fields {
+    char comm[32];
+    uint64_t cpu_ticks;
+    uint64_t start_ticks;
+    int cpu;
+};
+
+/* comm may hold spaces and ')', so the fields start after the last ')'. */
+static int parse_stat(const char *text, struct stat_fields *out) {
+    const char *open = strchr(text, '(');
+    const char *close = strrchr(text, ')');
+    if (!open || !close || close < open) {
+        return -1;
+    }
+    snprintf(out->comm, sizeof(out->comm), "%.*s", (int)(close - open - 1), open + 1);
+    // Field 3 (state) is index 0: utime 14, stime 15, starttime 22, processor 39.
+    unsigned long long utime = 0, stime = 0, start = 0;
+    int cpu = -1;
+    const char *p = close + 1;
+    for (int field = 0; field <= 36 && *p; field++) {
+        while (*p == ' ') {
+            p++;
+        }
+        if (field == 11) {
+            utime = strtoull(p, NULL, 10);
+        } else if (field == 12) {
+            stime = strtoull(p, NULL, 10);
+        } else if (field == 19) {
+            start = strtoull(p, NULL, 10);
+        } else if (field == 36) {
+            cpu = (int)strtol(p, NULL, 10);
+        }
+        p += strcspn(p, " ");
+    }
+    out->cpu_ticks = utime + stime;
+    out->start_ticks = start;
+    out->cpu = cpu;
+    return 0;
+}
+
+static int read_stat(struct ld_task_table *t, struct ld_task *task, struct stat_fields *out) {
+    char buf[1024];
+    ssize_t n;
+    if (task->fd >= 0) {
+        n = pread(task->fd, buf, sizeof(buf) - 1, 0);
+    } else {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/stat", task->pid);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        n = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (n > 0 && t->open_fds < t->fd_budget) {
+            task->fd = fd;
+            t->open_fds++;
+        } else {
+            close(fd);
+        }
+    }
+    if (n <= 0) {
+        return -1;
+    }
+    buf[n] = '\0';
+    return parse_stat(buf, out);
+}
+
+static void mark_exited(struct ld_task_table *t, struct ld_task *task) {
+    task->exited = 1;
+    task->delta_ticks = 0;
+    drop_fd(t, task);
+}
+
+static int scan_pid(struct ld_task_table *t, int pid) {
+    struct ld_task *task = NULL;
+    if (t->slot_cap) {
+        int idx = t->slots[find_slot(t, pid)];
+        task = idx >= 0 ? &t->tasks[idx] : NULL;
+    }
+    struct stat_fields f;
+    if (task && !task->exited) {
+        // A held fd of a process that is gone reads ESRCH even when the pid was reused since.
+        if (read_stat(t, task, &f) != 0) {
+            mark_exited(t, task);
+            task = NULL;
+        } else if (f.start_ticks != task->start_ticks) {
+            mark_exited(t, task);
+            task = NULL;
+        }
+    } else {
+        task = NULL;
+    }
+
+    if (!task) {
+        struct ld_task probe = { .pid = pid, .fd = -1 };
+        if (read_stat(t, &probe, &f) != 0) {
+            return 0;
+        }
+        task = add_task(t, pid);
+        if (!task) {
+            drop_fd(t, &probe);
+            return -1;
+        }
+        task->fd = probe.fd;
+        task->start_ticks = f.start_ticks;
+        // Started since the previous scan: everything it used falls in this interval.
+        task->cpu_ticks = t->scans > 0 ? 0 : f.cpu_ticks;
+    }
+    task->delta_ticks = f.cpu_ticks >= task->cpu_ticks ? f.cpu_ticks - task->cpu_ticks : 0;
+    task->cpu_ticks = f.cpu_ticks;
+    task->last_cpu = f.cpu;
+    memcpy(task->comm, f.comm, sizeof(task->comm));
+    task->gen = t->gen;
+    return 0;
+}
+
+int ld_task_scan(struct ld_task_table *t, char *err, size_t err_sz) {
+    DIR *dir = opendir("/proc");
+    if (!dir) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "opendir(/proc) failed: %s", strerror(errno));
+        }
+        return -1;
+    }
+    t->gen++;
+    int rc = 0;
+    struct dirent *de;
+    while (rc == 0 && (de = readdir(dir)) != NULL) {
+        if (!isdigit((unsigned char)de->d_name[0])) {
+            continue;
+        }
+        int pid = atoi(de->d_name);
+        if (pid > 0) {
+            rc = scan_pid(t, pid);
+        }
+    }
+    closedir(dir);
+    if (rc != 0) {
+        if (err && err_sz) {
+            snprintf(err, err_sz, "out of memory");
+        }
+        return -1;
+    }
+    for (size_t i = 0; i < t->count; i++) {
+        struct ld_task *task = &t->tasks[i];
+        if (!task->exited && task->gen != t->gen) {
+            mark_exited(t, task);
+        }
+    }
+    t->scans++;
+    return 0;
+}
+
+double ld_task_attribute(struct ld_task_table *t, const double *cpu_j, int cpu_count) {
+    uint64_t *ticks = calloc(cpu_count > 0 ? (size_t)cpu_count : 1, sizeof(*ticks));
+    double unattributed = 0.0;
+    if (!ticks) {
+        for (int cpu = 0; cpu < cpu_count; cpu++) {
+            unattributed += cpu_j[cpu];
+        }
+        return unattributed;
+    }
+    for (size_t i = 0; i < t->count; i++) {
+        const struct ld_task *task = &t->tasks[i];
+        if (task->delta_ticks && task->last_cpu >= 0 && task->last_cpu < cpu_count) {
+            ticks[task->last_cpu] += task->delta_ticks;
+        }
+    }
+    for (size_t i = 0; i < t->count; i++) {
+        struct ld_task *task = &t->tasks[i];
+        if (!task->delta_ticks) {
+            continue;
+        }
+        task->cpu_s += (double)task->delta_ticks * t->tick_s;
+        int cpu = task->last_cpu;
+        if (cpu >= 0 && cpu < cpu_count) {
+            task->joules += cpu_j[cpu] * (double)task->delta_ticks / (double)ticks[cpu];
+        }
+    }
+    for (int cpu = 0; cpu < cpu_count; cpu++) {
+        if (!ticks[cpu]) {
+            unattributed += cpu_j[cpu];
+        }
+    }
+    free(ticks);
+    return unattributed;
+}
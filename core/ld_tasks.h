@@ -0,0 +1,75 @@
+#ifndef LD_TASKS_H
+#define LD_TASKS_H
+
+/*
+ * Incremental per-process CPU time from /proc/<pid>/stat.
+ *
+ * Every scan is one readdir of /proc plus one pread per process: the stat
+ * file of a known process stays open between scans (up to fd_budget
+ * descriptors, after that it is opened per scan), and processes are found
+ * by pid through a hash instead of a search. Start time tells a reused pid
+ * from the process that had it.
+ *
+ * Energy is charged per interval: each CPU's joules go to the processes
+ * that last ran there, in proportion to the ticks they used. A process
+ * that spreads threads over several CPUs is charged at the rate of the CPU
+ * its main thread was seen on. Processes that exit stay in the table with
+ * their totals; the ticks between their last scan and the exit are lost.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ld_task {
+    int pid;
+    int fd;                     /* cached /proc/<pid>/stat, -1 when not held */
+    uint64_t start_ticks;       /* tells a reused pid apart */
+    uint64_t cpu_ticks;         /* utime + stime at the last scan */
+    uint64_t delta_ticks;       /* last interval */
+    int last_cpu;
+    char comm[32];
+    double cpu_s;               /* totals since the first scan */
+    double joules;
+    int exited;
+    unsigned int gen;
+};
+
+struct ld_task_table {
+    struct ld_task *tasks;
+    size_t count;
+    size_t cap;
+    int *slots;                 /* pid hash: index into tasks, -1 when empty */
+    size_t slot_cap;
+    int open_fds;
+    int fd_budget;
+    unsigned int gen;
+    int scans;
+    double tick_s;
+};
+
+void ld_task_table_init(struct ld_task_table *t, int fd_budget);
+void ld_task_table_free(struct ld_task_table *t);
+
+/*
+ * Rescans /proc. From the second scan on, delta_ticks holds each process's
+ * CPU time since the previous one; processes started in between are charged
+ * everything they used.
+ */
+int ld_task_scan(struct ld_task_table *t, char *err, size_t err_sz);
+
+/*
+ * Charges the last interval's per-CPU joules (cpu_j[0..cpu_count)) to the
+ * processes and adds delta_ticks to cpu_s. Returns the joules of CPUs no
+ * process was seen on (idle, interrupts, kernel work between scans).
+ */
+double ld_task_attribute(struct ld_task_table *t, const double *cpu_j, int cpu_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+#include "ld_thermal.h"
+
+#include <math.h>
+#include <string.h>
+
+/* Covariance trace above which forgetting pauses (no excitation, e.g. a steady load). */
+#define COV_TRACE_MAX 1e4
+/* A fit from a nearly constant power cannot tell R from ambient. */
+#define MIN_POWER_SPAN_W 3.0
+/* Temperature and power enter the fit divided by these, so all three regressors are of order 1. */
+#define TEMP_SCALE 100.0
+#define POWER_SCALE 100.0
+
+static void reset_cov(struct ld_thermal_model *m) {
+    memset(m->cov, 0, sizeof(m->cov));
+    for (int i = 0; i < 3; i++) {
+        m->cov[i][i] = 1.0;
+    }
+}
+
+void ld_thermal_model_init(struct ld_thermal_model *m) {
+    memset(m, 0, sizeof(*m));
+    /* Prior: tau 20 s, 0.5 C/W, 35 C ambient; weak enough to be gone after a few dozen samples. */
+    m->theta[0] = -1.0 / 20.0 * TEMP_SCALE;
+    m->theta[1] = 0.5 / 20.0 * POWER_SCALE;
+    m->theta[2] = 35.0 / 20.0;
+    reset_cov(m);
+}
+
+static void rls_update(struct ld_thermal_model *m, const double x[3], double y) {
+    double px[3];
+    for (int i = 0; i < 3; i++) {
+        px[i] = m->cov[i][0] * x[0] + m->cov[i][1] * x[1] + m->cov[i][2] * x[2];
+    }
+    double trace = m->cov[0][0] + m->cov[1][1] + m->cov[2][2];
+    double lambda = trace < COV_TRACE_MAX ? LD_THERMAL_FORGET : 1.0;
+    double denom = lambda + x[0] * px[0] + x[1] * px[1] + x[2] * px[2];
+    if (denom <= 0.0) {
+        return;
+    }
+    double err = y - (m->theta[0] * x[0] + m->theta[1] * x[1] + m->theta[2] * x[2]);
+    double k[3];
+    for (int i = 0; i < 3; i++) {
+        k[i] = px[i] / denom;
+        m->theta[i] += k[i] * err;
+    }
+    /* P = (P - k x'P) / lambda; x'P is px transposed because P is symmetric. */
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            m->cov[i][j] = (m->cov[i][j] - k[i] * px[j]) / lambda;
+        }
+    }
+    /* Rounding drifts P away from symmetric positive definite over millions of updates; keep it there. */
+    for (int i = 0; i < 3; i++) {
+        for (int j = i + 1; j < 3; j++) {
+            m->cov[i][j] = m->cov[j][i] = 0.5 * (m->cov[i][j] + m->cov[j][i]);
+        }
+        if (!(m->cov[i][i] > 0.0) || !isfinite(m->cov[i][i]) || !isfinite(m->theta[i])) {
+            reset_cov(m);
+            break;
+        }
+    }
+}
+
+void ld_thermal_model_update(struct ld_thermal_model *m, double t_s, double temp_c, double power_w) {
+    double dt = t_s - m->last_t_s;
+    if (m->have_last && dt >= 0.05 && dt <= 30.0 && power_w >= 0.0) {
+        /* Midpoint temperature: the rate over the interval belongs to its middle, not its start. */
+        double x[3] = { 0.5 * (temp_c + m->last_temp_c) / TEMP_SCALE, power_w / POWER_SCALE, 1.0 };
+        rls_update(m, x, (temp_c - m->last_temp_c) / dt);
+        if (m->samples == 0 || power_w < m->power_min_w) {
+            m->power_min_w = power_w;
+        }
+        if (m->samples == 0 || power_w > m->power_max_w) {
+            m->power_max_w = power_w;
+        }
+        m->samples++;
+    }
+    m->last_t_s = t_s;
+    m->last_temp_c = temp_c;
+    m->last_power_w = power_w;
+    m->have_last = 1;
+}
+
+int ld_thermal_model_params(const struct ld_thermal_model *m, struct ld_thermal_params *out) {
+    memset(out, 0, sizeof(*out));
+    double a = m->theta[0] / TEMP_SCALE;
+    if (!(a < 0.0) || !isfinite(m->theta[1]) || !isfinite(m->theta[2])) {
+        return -1;
+    }
+    out->tau_s = -1.0 / a;
+    out->r_c_per_w = m->theta[1] / POWER_SCALE * out->tau_s;
+    out->ambient_c = m->theta[2] * out->tau_s;
+    out->valid = m->samples >= LD_THERMAL_MIN_SAMPLES && m->power_max_w - m->power_min_w >= MIN_POWER_SPAN_W &&
+                 out->tau_s > 0.5 && out->tau_s < 3600.0 && out->r_c_per_w > 0.0 && out->r_c_per_w < 10.0;
+    return out->valid ? 0 : -1;
+}
+
+double ld_thermal_steady_c(const struct ld_thermal_params *p, double power_w) {
+    return p->ambient_c + p->r_c_per_w * power_w;
+}
+
+double ld_thermal_time_to_c(const struct ld_thermal_params *p, double temp_c, double power_w, double limit_c) {
+    if (temp_c >= limit_c) {
+        return 0.0;
+    }
+    double steady = ld_thermal_steady_c(p, power_w);
+    if (steady <= limit_c) {
+        return -1.0;
+    }
+    return p->tau_s * log((steady - temp_c) / (steady - limit_c));
+}
+
+int ld_thermal_predict(const struct ld_thermal_model *m, double temp_c, double pl1_w, double pl2_w, double limit_c,
+                       struct ld_thermal_prediction *out) {
+    memset(out, 0, sizeof(*out));
+    struct ld_thermal_params p;
+    if (ld_thermal_model_params(m, &p) != 0) {
+        return -1;
+    }
+    out->steady_pl1_c = ld_thermal_steady_c(&p, pl1_w);
+    out->steady_pl2_c = ld_thermal_steady_c(&p, pl2_w);
+    out->pl1_to_limit_s = ld_thermal_time_to_c(&p, temp_c, pl1_w, limit_c);
+    out->pl2_to_limit_s = ld_thermal_time_to_c(&p, temp_c, pl2_w, limit_c);
+    out->max_pl1_w = (limit_c - p.ambient_c) / p.r_c_per_w;
+    return 0;
+}
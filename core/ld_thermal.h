@@ -0,0 +1,83 @@
+#ifndef LD_THERMAL_H
+#define LD_THERMAL_H
+
+/*
+ * Online first-order thermal model: temperature against package power as
+ * a single RC stage,
+ *
+ *   dT/dt = (ambient + R * P - T) / tau
+ *
+ * fitted by recursive least squares on (T, P, 1) -> dT/dt from consecutive
+ * samples, with exponential forgetting so the fit follows fan curves and
+ * ambient changes. Samples may come at any interval.
+ *
+ * The model predicts the temperature a constant power settles at and how
+ * long it takes to get to a limit (TjMax), so a caller can lower PL2 or
+ * PL1 before PROCHOT instead of reading throttle flags afterwards. It
+ * describes whatever temperature it is fed: the package sensor, or one
+ * core's sensor against package power for a per-core model.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Samples before the fit is trusted, and the forgetting factor per sample. */
+#define LD_THERMAL_MIN_SAMPLES 20
+#define LD_THERMAL_FORGET 0.995
+
+struct ld_thermal_model {
+    double theta[3];            /* dT/dt = theta0 * T/100 + theta1 * P/100 + theta2 */
+    double cov[3][3];
+    double last_t_s;
+    double last_temp_c;
+    double last_power_w;
+    int have_last;
+    int samples;                /* fitted intervals */
+    double power_min_w;         /* power range seen; predictions outside it are extrapolations */
+    double power_max_w;
+};
+
+struct ld_thermal_params {
+    int valid;                  /* enough samples and a physical fit (tau > 0, R > 0) */
+    double tau_s;
+    double r_c_per_w;
+    double ambient_c;
+};
+
+void ld_thermal_model_init(struct ld_thermal_model *m);
+
+/*
+ * Feeds one sample: temperature at t_s and the average power over the
+ * interval that ended at t_s. Intervals shorter than 50 ms or longer than
+ * 30 s only restart the pairing.
+ */
+void ld_thermal_model_update(struct ld_thermal_model *m, double t_s, double temp_c, double power_w);
+
+int ld_thermal_model_params(const struct ld_thermal_model *m, struct ld_thermal_params *out);
+
+/* Temperature a constant power_w settles at. */
+double ld_thermal_steady_c(const struct ld_thermal_params *p, double power_w);
+
+/* Seconds from temp_c until limit_c at constant power_w; negative when it never gets there. 0 when already at it. */
+double ld_thermal_time_to_c(const struct ld_thermal_params *p, double temp_c, double power_w, double limit_c);
+
+/* Predictions for a candidate PL1/PL2 from the current temperature. */
+struct ld_thermal_prediction {
+    double steady_pl1_c;
+    double steady_pl2_c;
+    double pl2_to_limit_s;      /* holding PL2; negative: never */
+    double pl1_to_limit_s;      /* holding PL1; negative: never */
+    double max_pl1_w;           /* highest sustained power that stays below the limit */
+};
+
+int ld_thermal_predict(const struct ld_thermal_model *m, double temp_c, double pl1_w, double pl2_w, double limit_c,
+                       struct ld_thermal_prediction *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
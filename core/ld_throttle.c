@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+
+#include "ld_throttle.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ld_core.h"
+
+static const char *const counter_files[LD_THROTTLE_COUNTER_COUNT] = {
+    [LD_THROTTLE_CORE_EVENTS] = "core_throttle_count",
+    [LD_THROTTLE_CORE_MS] = "core_throttle_total_time_ms",
+    [LD_THROTTLE_PKG_EVENTS] = "package_throttle_count",
+    [LD_THROTTLE_PKG_MS] = "package_throttle_total_time_ms",
+};
+
+static const char *const counter_names[LD_THROTTLE_COUNTER_COUNT] = {
+    [LD_THROTTLE_CORE_EVENTS] = "core_thr",
+    [LD_THROTTLE_CORE_MS] = "core_thr_ms",
+    [LD_THROTTLE_PKG_EVENTS] = "pkg_thr",
+    [LD_THROTTLE_PKG_MS] = "pkg_thr_ms",
+};
+
+#define THROTTLE_LOG_MASK (LD_FIELD_MASK(LD_THERM_STATUS_THERMAL_LOG) | LD_FIELD_MASK(LD_THERM_STATUS_PROCHOT_LOG))
+
+/*
+ * Every R/WC0 log bit (odd bits 1-15 in IA32_THERM_STATUS, 1-11 in the
+ * package register), as the kernel's THERM_STATUS_CLEAR_*_MASK. The rest of
+ * the register is read-only status.
+ */
+#define THERM_LOG_BITS_CORE 0xAAAAull
+#define THERM_LOG_BITS_PKG  0x0AAAull
+
+void ld_throttle_init(struct ld_throttle_table *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+void ld_throttle_free(struct ld_throttle_table *t) {
+    for (size_t i = 0; i < t->count; i++) {
+        for (int k = 0; k < LD_THROTTLE_COUNTER_COUNT; k++) {
+            if (t->cpus[i].fds[k] >= 0) {
+                close(t->cpus[i].fds[k]);
+            }
+        }
+    }
+    free(t->cpus);
+    memset(t, 0, sizeof(*t));
+}
+
+struct ld_throttle_cpu *ld_throttle_cpu(struct ld_throttle_table *t, int cpu) {
+    for (size_t i = 0; i < t->count; i++) {
+        if (t->cpus[i].cpu == cpu) {
+            return &t->cpus[i];
+        }
+    }
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 64;
+        struct ld_throttle_cpu *grown = realloc(t->cpus, cap * sizeof(*grown));
+        if (!grown) {
+            return NULL;
+        }
+        t->cpus = grown;
+        t->cap = cap;
+    }
+    struct ld_throttle_cpu *c = &t->cpus[t->count++];
+    memset(c, 0, sizeof(*c));
+    c->cpu = cpu;
+    for (int k = 0; k < LD_THROTTLE_COUNTER_COUNT; k++) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/thermal_throttle/%s", cpu, counter_files[k]);
+        c->fds[k] = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    return c;
+}
+
+int ld_throttle_read(struct ld_throttle_cpu *c) {
+    if (c->fds[LD_THROTTLE_CORE_EVENTS] < 0) {
+        return -1;
+    }
+    c->from_msr = 0;
+    for (int k = 0; k < LD_THROTTLE_COUNTER_COUNT; k++) {
+        char buf[32];
+        ssize_t n = c->fds[k] >= 0 ? pread(c->fds[k], buf, sizeof(buf) - 1, 0) : -1;
+        if (n <= 0) {
+            c->have &= ~(1u << k);
+            continue;
+        }
+        buf[n] = '\0';
+        c->values[k] = strtoull(buf, NULL, 10);
+        c->have |= 1u << k;
+    }
+    return c->have & (1u << LD_THROTTLE_CORE_EVENTS) ? 0 : -1;
+}
+
+int ld_throttle_msr_log(struct ld_throttle_cpu *c, int pkg, uint64_t status) {
+    enum ld_throttle_counter counter = pkg ? LD_THROTTLE_PKG_EVENTS : LD_THROTTLE_CORE_EVENTS;
+    c->from_msr = 1;
+    c->have |= 1u << counter;
+    if (!(status & THROTTLE_LOG_MASK)) {
+        return 0;
+    }
+    c->values[counter]++;
+    // Log bits are write-0-to-clear: ones everywhere else leave the other logs (and anything latched since the
+    // read) alone, and the read-only fields are not written back.
+    uint64_t clear = (pkg ? THERM_LOG_BITS_PKG : THERM_LOG_BITS_CORE) & ~THROTTLE_LOG_MASK;
+    return ld_msr_write(c->cpu, pkg ? LD_MSR_PACKAGE_THERM_STATUS : LD_MSR_THERM_STATUS, clear);
+}
+
+const char *ld_throttle_counter_name(enum ld_throttle_counter counter) {
+    return counter >= 0 && counter < LD_THROTTLE_COUNTER_COUNT ? counter_names[counter] : "?";
+}
@@ -0,0 +1,75 @@
+#ifndef LD_THROTTLE_H
+#define LD_THROTTLE_H
+
+/*
+ * Per-CPU thermal throttle event counters that do not lose events between
+ * samples.
+ *
+ * The kernel's therm_throt driver counts every throttle interrupt in
+ * /sys/devices/system/cpu/cpuN/thermal_throttle/{core,package}_throttle_count
+ * and the time spent throttled in *_throttle_total_time_ms (newer kernels).
+ * Those files stay open between samples, one pread each. Without them the
+ * caller hands over the IA32_THERM_STATUS / IA32_PACKAGE_THERM_STATUS value
+ * it read: a set thermal or PROCHOT log bit counts as one event and is
+ * cleared, so the next event shows up again. That path cannot tell how long
+ * the CPU was throttled, and the log bits are one shared latch per CPU: two
+ * processes sampling them (the GUI's helper and the socket daemon) each
+ * count only the events the other has not cleared first.
+ *
+ * Counters are cumulative (since boot for sysfs, since the first sample for
+ * the MSR path); callers diff consecutive samples.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ld_throttle_counter {
+    LD_THROTTLE_CORE_EVENTS,
+    LD_THROTTLE_CORE_MS,
+    LD_THROTTLE_PKG_EVENTS,
+    LD_THROTTLE_PKG_MS,
+    LD_THROTTLE_COUNTER_COUNT,
+};
+
+struct ld_throttle_cpu {
+    int cpu;
+    int fds[LD_THROTTLE_COUNTER_COUNT];         /* -1 when the file is missing */
+    uint64_t values[LD_THROTTLE_COUNTER_COUNT];
+    unsigned int have;                          /* bit per counter holding a value */
+    int from_msr;                               /* events come from the MSR log bits */
+};
+
+struct ld_throttle_table {
+    struct ld_throttle_cpu *cpus;
+    size_t count;
+    size_t cap;
+};
+
+void ld_throttle_init(struct ld_throttle_table *t);
+void ld_throttle_free(struct ld_throttle_table *t);
+
+/* Entry for cpu, opening its sysfs files the first time; NULL when out of memory. */
+struct ld_throttle_cpu *ld_throttle_cpu(struct ld_throttle_table *t, int cpu);
+
+/* Rereads the sysfs counters. -1 when the CPU has no core_throttle_count: use ld_throttle_msr_log(). */
+int ld_throttle_read(struct ld_throttle_cpu *c);
+
+/*
+ * MSR path: counts a set thermal/PROCHOT log bit in status (read from
+ * IA32_THERM_STATUS, or IA32_PACKAGE_THERM_STATUS when pkg is set) as one
+ * event and clears the log bits on c->cpu. -1 when the clearing write fails;
+ * the event is counted anyway.
+ */
+int ld_throttle_msr_log(struct ld_throttle_cpu *c, int pkg, uint64_t status);
+
+const char *ld_throttle_counter_name(enum ld_throttle_counter counter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
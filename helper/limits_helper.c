@@ -1,278 +1,125 @@
 #define _GNU_SOURCE
 
-#include <cpuid.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <grp.h>
 #include <inttypes.h>
-#include <math.h>
-#include <sched.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAP_SIZE    (2 * 1024 * 1024)
-#define PL_OFF      0x59A0
-
-#include "../mchbar_base.h"
-
-#define MSR_OC_MAILBOX       0x150
-#define MSR_IA32_PERF_CTL     0x199
-#define MSR_IA32_PERF_STATUS  0x198
-#define MSR_IA32_THERM_STATUS 0x19C
-#define MSR_RAPL_POWER_UNIT  0x606
-#define MSR_PKG_POWER_LIMIT  0x610
-
-#define CORE_TYPE_ATOM 0x20
-#define CORE_TYPE_CORE 0x40
-
-#define OC_PLANE_CORE 0x0
-
-static int rdmsr(int fd, uint32_t reg, uint64_t *out) {
-    ssize_t n = pread(fd, out, sizeof(*out), reg);
-    if (n != (ssize_t)sizeof(*out)) {
-        return -1;
-    }
-    return 0;
+#include "../core/ld_affinity.h"
+#include "../core/ld_budget.h"
+#include "../core/ld_conflict.h"
+#include "../core/ld_core.h"
+#include "../core/ld_cpufreq.h"
+#include "../core/ld_energy.h"
+#include "../core/ld_hotplug.h"
+#include "../core/ld_irq.h"
+#include "../core/ld_ledger.h"
+#include "../core/ld_limits.h"
+#include "../core/ld_powercap.h"
+#include "../core/ld_residency.h"
+#include "../core/ld_systemd.h"
+#include "../core/ld_throttle.h"
+
+#define DEFAULT_SOCKET_PATH "/run/limits_droper.sock"
+#define MAX_SOCKET_CLIENTS 16
+#define SOCKET_OUT_MAX (4u << 20)   /* queued reply bytes a client may leave unread before it is dropped */
+#define SERVICE_WAIT_MS 30000
+#define CONFLICT_SAMPLE_MS 250
+#define PARK_STATE_PATH "/run/limits_droper.parked"
+#define IRQ_STATE_PATH "/run/limits_droper.irq"
+#define IRQ_SAMPLE_MAX_MS 10000
+#define BUDGET_PERIOD_MS 1000
+#define RESIDENCY_SAMPLE_MS 100
+#define DEFAULT_STATE_DIR "/var/lib/limits_droper"
+#define LEDGER_STATE_FILE "energy_ledger"
+#define LEDGER_PROFILE_FILE "active_profile"
+#define LEDGER_SAMPLE_MS 5000
+#define LEDGER_CHECKPOINT_S 300
+#define MAX_CGROUP_WATCHES 32
+
+/*
+ * PL1/PL2 backend per path (MSR, MCHBAR), from --backend/--msr-backend/
+ * --mmio-backend or LIMITS_HELPER_BACKEND. Server modes resolve them at
+ * startup; one-shot commands on first use.
+ */
+static enum ld_limits_backend limits_want[2] = { LD_LIMITS_AUTO, LD_LIMITS_AUTO };
+static enum ld_limits_backend limits_active[2];
+static int limits_ready[2];
+
+static const char *limits_path_label(enum ld_limits_path path) {
+    return path == LD_LIMITS_MSR ? "MSR" : "MMIO";
 }
 
-static int wrmsr(int fd, uint32_t reg, uint64_t val) {
-    ssize_t n = pwrite(fd, &val, sizeof(val), reg);
-    if (n != (ssize_t)sizeof(val)) {
-        return -1;
+static int limits_backend(enum ld_limits_path path, enum ld_limits_backend *out) {
+    if (!limits_ready[path]) {
+        char err[256] = {0};
+        if (ld_limits_select(path, limits_want[path], &limits_active[path], err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s limits unavailable: %s\n", limits_path_label(path), err[0] ? err : "unknown error");
+            return -1;
+        }
+        limits_ready[path] = 1;
     }
+    *out = limits_active[path];
     return 0;
 }
 
-static int open_msr_cpu(int cpu, bool write) {
-    char path[64];
-    snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
-    return open(path, write ? O_RDWR : O_RDONLY);
-}
-
-static int open_msr(bool write) {
-    return open_msr_cpu(0, write);
-}
-
-static int open_mmio(bool write, volatile uint8_t **out_base, char *err, size_t err_sz) {
-    uint64_t mchbar_base = 0;
-    if (mchbar_get_base(&mchbar_base, err, err_sz) != 0) {
-        return -1;
-    }
-
-    int fd = open("/dev/mem", (write ? O_RDWR : O_RDONLY) | O_SYNC);
-    if (fd < 0) {
-        if (err && err_sz) {
-            snprintf(err, err_sz, "open(/dev/mem) failed: %s", strerror(errno));
-        }
-        return -1;
-    }
-
-    int prot = write ? (PROT_READ | PROT_WRITE) : PROT_READ;
-    void *map = mmap(NULL, MAP_SIZE, prot, MAP_SHARED, fd, mchbar_base);
-    if (map == MAP_FAILED) {
-        if (err && err_sz) {
-            snprintf(err, err_sz, "mmap MMIO failed: %s", strerror(errno));
+/* Silent: a failure here is reported by the first command that needs the path. */
+static void select_limits_backends(void) {
+    for (int path = LD_LIMITS_MSR; path <= LD_LIMITS_MMIO; path++) {
+        if (!limits_ready[path] && ld_limits_select((enum ld_limits_path)path, limits_want[path],
+                                                    &limits_active[path], NULL, 0) == 0) {
+            limits_ready[path] = 1;
         }
-        close(fd);
-        return -1;
-    }
-
-    *out_base = (volatile uint8_t *)map;
-    return fd;
-}
-
-static void close_mmio(int fd, volatile uint8_t *base) {
-    if (base && base != MAP_FAILED) {
-        munmap((void *)base, MAP_SIZE);
-    }
-    if (fd >= 0) {
-        close(fd);
     }
 }
 
-static uint64_t rd64(volatile uint8_t *base, uint32_t off) {
-    volatile uint32_t *p32 = (volatile uint32_t *)(base + off);
-    uint64_t lo = p32[0];
-    uint64_t hi = p32[1];
-    return lo | (hi << 32);
-}
-
-static void wr64(volatile uint8_t *base, uint32_t off, uint64_t v) {
-    volatile uint32_t *p32 = (volatile uint32_t *)(base + off);
-    p32[0] = (uint32_t)(v & 0xffffffffu);
-    p32[1] = (uint32_t)(v >> 32);
-    (void)p32[1];
-}
-
-struct cpu_list {
-    int *ids;
-    size_t count;
-    size_t cap;
-};
-
-static void cpu_list_init(struct cpu_list *list) {
-    list->ids = NULL;
-    list->count = 0;
-    list->cap = 0;
-}
-
-static void cpu_list_free(struct cpu_list *list) {
-    free(list->ids);
-    list->ids = NULL;
-    list->count = 0;
-    list->cap = 0;
-}
-
-static int cpu_list_add(struct cpu_list *list, int cpu) {
-    if (list->count == list->cap) {
-        size_t next = list->cap ? list->cap * 2 : 8;
-        int *new_ids = realloc(list->ids, next * sizeof(*new_ids));
-        if (!new_ids) {
+/*
+ * Ratio path (IA32_PERF_CTL or cpufreq scaling_max_freq), from
+ * --ratio-backend or LIMITS_HELPER_RATIO_BACKEND; resolved like the
+ * limits backends. Every ratio command reports the path it used.
+ */
+static enum ld_ratio_path ratio_want = LD_RATIO_AUTO;
+static enum ld_ratio_path ratio_active;
+static int ratio_ready;
+
+static int ratio_path(enum ld_ratio_path *out) {
+    if (!ratio_ready) {
+        char err[256] = {0};
+        struct ld_cpufreq *cf = ld_cpufreq_shared(err, sizeof(err));
+        if (!cf || ld_ratio_select(cf, ratio_want, &ratio_active, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Ratio path unavailable: %s\n", err[0] ? err : "unknown error");
             return -1;
         }
-        list->ids = new_ids;
-        list->cap = next;
+        ratio_ready = 1;
     }
-    list->ids[list->count++] = cpu;
+    *out = ratio_active;
     return 0;
 }
 
-static int cpu_is_online(int cpu) {
-    char path[128];
-    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        return 1;
-    }
-    int val = 1;
-    if (fscanf(f, "%d", &val) != 1) {
-        val = 1;
-    }
-    fclose(f);
-    return val != 0;
-}
-
-static int core_type_supported(void) {
-    unsigned int max = __get_cpuid_max(0, NULL);
-    if (max < 0x1A) {
-        return 0;
-    }
-    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
-    if (!__get_cpuid_count(0x1A, 0, &eax, &ebx, &ecx, &edx)) {
-        return 0;
-    }
-    return eax != 0;
-}
-
-static int detect_core_type(int cpu, int *out_type) {
-    cpu_set_t old_set;
-    if (sched_getaffinity(0, sizeof(old_set), &old_set) != 0) {
-        return 0;
-    }
-
-    cpu_set_t set;
-    CPU_ZERO(&set);
-    CPU_SET(cpu, &set);
-    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
-        return 0;
-    }
-
-    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
-    unsigned int max = __get_cpuid_max(0, NULL);
-    int type = -1;
-
-    if (max >= 0x1A && __get_cpuid_count(0x1A, 0, &eax, &ebx, &ecx, &edx) && eax != 0) {
-        type = (int)((eax >> 24) & 0xFFu);
-    }
-
-    (void)sched_setaffinity(0, sizeof(old_set), &old_set);
-
-    if (type < 0) {
-        return 0;
-    }
-    *out_type = type;
-    return 1;
-}
-
-static int enumerate_cpus(struct cpu_list *p_list, struct cpu_list *e_list, struct cpu_list *u_list, int *supports) {
-    DIR *dir = opendir("/sys/devices/system/cpu");
-    if (!dir) {
-        return -1;
-    }
-
-    int has_core_type = core_type_supported();
-    if (supports) {
-        *supports = has_core_type;
-    }
-
-    struct dirent *de = NULL;
-    while ((de = readdir(dir)) != NULL) {
-        if (strncmp(de->d_name, "cpu", 3) != 0) {
-            continue;
-        }
-        const char *suffix = de->d_name + 3;
-        if (*suffix == '\0') {
-            continue;
-        }
-        char *end = NULL;
-        long cpu = strtol(suffix, &end, 10);
-        if (!end || *end != '\0') {
-            continue;
-        }
-        if (cpu < 0) {
-            continue;
-        }
-        if (!cpu_is_online((int)cpu)) {
-            continue;
-        }
-
-        if (!has_core_type) {
-            if (cpu_list_add(p_list, (int)cpu) != 0) {
-                closedir(dir);
-                return -1;
-            }
-            continue;
-        }
-
-        int type = 0;
-        int ok = detect_core_type((int)cpu, &type);
-        if (!ok) {
-            if (cpu_list_add(u_list, (int)cpu) != 0) {
-                closedir(dir);
-                return -1;
-            }
-            continue;
-        }
-
-        if (type == CORE_TYPE_CORE) {
-            if (cpu_list_add(p_list, (int)cpu) != 0) {
-                closedir(dir);
-                return -1;
-            }
-        } else if (type == CORE_TYPE_ATOM) {
-            if (cpu_list_add(e_list, (int)cpu) != 0) {
-                closedir(dir);
-                return -1;
-            }
-        } else {
-            if (cpu_list_add(u_list, (int)cpu) != 0) {
-                closedir(dir);
-                return -1;
-            }
-        }
+static void select_ratio_path(void) {
+    struct ld_cpufreq *cf = ld_cpufreq_shared(NULL, 0);
+    if (!ratio_ready && cf && ld_ratio_select(cf, ratio_want, &ratio_active, NULL, 0) == 0) {
+        ratio_ready = 1;
     }
-
-    closedir(dir);
-    return 0;
 }
 
-static void print_cpu_list(const char *label, const struct cpu_list *list) {
+static void print_cpu_list(const char *label, const struct ld_cpu_list *list) {
     printf("%s=", label);
     for (size_t i = 0; i < list->count; i++) {
         if (i) {
@@ -322,47 +169,6 @@ static int parse_double(const char *s, double *out) {
     return 1;
 }
 
-static int write_text_file(const char *path, const char *text, char *err, size_t err_sz) {
-    int fd = open(path, O_WRONLY);
-    if (fd < 0) {
-        if (err && err_sz) {
-            snprintf(err, err_sz, "open %s failed: %s", path, strerror(errno));
-        }
-        return -1;
-    }
-    size_t len = strlen(text);
-    ssize_t n = write(fd, text, len);
-    int saved_errno = errno;
-    close(fd);
-    if (n != (ssize_t)len) {
-        if (err && err_sz) {
-            if (n < 0) {
-                snprintf(err, err_sz, "write %s failed: %s", path, strerror(saved_errno));
-            } else {
-                snprintf(err, err_sz, "short write %s (%zd bytes)", path, n);
-            }
-        }
-        return -1;
-    }
-    return 0;
-}
-
-static int write_powercap_uw(uint64_t pl1_uw, uint64_t pl2_uw, char *err, size_t err_sz) {
-    char buf[32];
-    const char *pl1_path = "/sys/class/powercap/intel-rapl:0/constraint_0_power_limit_uw";
-    const char *pl2_path = "/sys/class/powercap/intel-rapl:0/constraint_1_power_limit_uw";
-
-    snprintf(buf, sizeof(buf), "%" PRIu64, pl1_uw);
-    if (write_text_file(pl1_path, buf, err, err_sz) != 0) {
-        return -1;
-    }
-    snprintf(buf, sizeof(buf), "%" PRIu64, pl2_uw);
-    if (write_text_file(pl2_path, buf, err, err_sz) != 0) {
-        return -1;
-    }
-    return 0;
-}
-
 static const char *find_systemctl(void) {
     if (access("/usr/bin/systemctl", X_OK) == 0) {
         return "/usr/bin/systemctl";
@@ -373,8 +179,8 @@ static const char *find_systemctl(void) {
     return NULL;
 }
 
-static int run_systemctl_action(const char *action, bool with_now, const char *const *services, size_t count,
-                                char *err, size_t err_sz) {
+static int run_systemctl_action(const char *action, const char *const *services, size_t count, char *err,
+                                size_t err_sz) {
     const char *systemctl = find_systemctl();
     if (!systemctl) {
         if (err && err_sz) {
@@ -383,7 +189,7 @@ static int run_systemctl_action(const char *action, bool with_now, const char *c
         return -1;
     }
 
-    size_t argv_cap = count + (with_now ? 4 : 3);
+    size_t argv_cap = count + 3;
     const char **argv = calloc(argv_cap, sizeof(*argv));
     if (!argv) {
         if (err && err_sz) {
@@ -394,9 +200,6 @@ static int run_systemctl_action(const char *action, bool with_now, const char *c
     size_t idx = 0;
     argv[idx++] = systemctl;
     argv[idx++] = action;
-    if (with_now) {
-        argv[idx++] = "--now";
-    }
     for (size_t i = 0; i < count; i++) {
         argv[idx++] = services[i];
     }
@@ -435,120 +238,352 @@ static int run_systemctl_action(const char *action, bool with_now, const char *c
     return 0;
 }
 
-static int read_ratio_on_cpu(int cpu, uint8_t *ratio_out) {
-    int fd = open_msr_cpu(cpu, false);
-    if (fd < 0) {
-        return -1;
+/*
+ * Unit control goes straight to the systemd manager over the system bus
+ * when it is reachable, with systemctl as the fallback. Server modes only
+ * submit the jobs and report them as queued; READ-SERVICE-JOBS polls their
+ * progress. One-shot commands wait for the jobs to finish.
+ */
+static struct ld_systemd systemd_bus;
+static bool service_async = false;
+
+/*
+ * --socket runs every command inside its poll loop, which also drives the
+ * residency, ledger and budget ticks for all clients. Commands there must
+ * not wait: the forms that would (READ-IRQS <ms>, the systemctl fallback)
+ * are refused, and clients use the snapshot forms instead.
+ */
+static bool socket_server = false;
+
+static const char *const powercap_writers[] = {
+    "thermald.service",
+    "tuned.service",
+    "tuned-ppd.service",
+    "power-profiles-daemon.service",
+};
+
+static struct ld_systemd *systemd_conn(void) {
+    if (!systemd_bus.open && ld_systemd_open(&systemd_bus, NULL, 0) != 0) {
+        return NULL;
     }
-    uint64_t val = 0;
-    if (rdmsr(fd, MSR_IA32_PERF_CTL, &val) != 0) {
-        close(fd);
-        return -1;
+    return &systemd_bus;
+}
+
+static void print_service_job(size_t idx, const struct ld_systemd_job *job, double now_s) {
+    char result[sizeof(job->result)];
+    snprintf(result, sizeof(result), "%s", job->result);
+    for (char *c = result; *c; c++) {
+        if (*c == ',' || *c == '\n') {
+            *c = ';';
+        }
     }
-    close(fd);
-    *ratio_out = (uint8_t)((val >> 8) & 0xFFu);
-    return 0;
+    double end_s = ld_systemd_job_finished(job) ? job->finished_s : now_s;
+    printf("SERVICE_JOB_%zu=id=%" PRIu32 ",action=%s,unit=%s,state=%s,elapsed_ms=%.0f,result=%s\n", idx, job->id,
+           job->action, job->unit, ld_systemd_state_name(job->state), (end_s - job->submitted_s) * 1e3, result);
 }
 
-static int read_ratio_current_on_cpu(int cpu, uint8_t *ratio_out) {
-    int fd = open_msr_cpu(cpu, false);
-    if (fd < 0) {
-        return -1;
+static double monotonic_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int run_service_jobs(const char *action, const char *const *services, size_t count) {
+    struct ld_systemd *sd = systemd_conn();
+    uint32_t first_id = 0;
+    char err[256] = {0};
+    if (!sd || ld_systemd_submit(sd, action, services, count, &first_id, err, sizeof(err)) != 0) {
+        if (sd && err[0]) {
+            fprintf(stderr, "systemd %s over D-Bus failed: %s\n", action, err);
+            return 1;
+        }
+        if (socket_server) {
+            fprintf(stderr, "systemd bus unavailable; the socket daemon does not wait for systemctl\n");
+            return 1;
+        }
+        // No bus: one systemctl per unit so a missing unit does not abort the rest.
+        printf("SERVICE_BUS=systemctl\n");
+        int rc = 0;
+        for (size_t i = 0; i < count; i++) {
+            err[0] = '\0';
+            if (run_systemctl_action(action, &services[i], 1, err, sizeof(err)) != 0) {
+                fprintf(stderr, "systemctl %s %s failed: %s\n", action, services[i], err[0] ? err : "unknown error");
+                rc = 1;
+            }
+        }
+        if (rc == 0) {
+            printf("OK\n");
+        }
+        return rc;
     }
-    uint64_t val = 0;
-    if (rdmsr(fd, MSR_IA32_PERF_STATUS, &val) != 0) {
-        close(fd);
-        return -1;
+
+    if (!service_async) {
+        ld_systemd_wait(sd, first_id, count, SERVICE_WAIT_MS, NULL, 0);
     }
-    close(fd);
-    *ratio_out = (uint8_t)((val >> 8) & 0xFFu);
-    return 0;
+    printf("SERVICE_BUS=dbus\n");
+    printf("SERVICE_JOB_COUNT=%zu\n", count);
+    int rc = 0;
+    double now_s = monotonic_s();
+    for (size_t i = 0; i < count; i++) {
+        const struct ld_systemd_job *job = ld_systemd_job(sd, first_id + (uint32_t)i);
+        if (!job) {
+            continue;
+        }
+        print_service_job(i, job, now_s);
+        if (job->state == LD_SYSTEMD_FAILED) {
+            fprintf(stderr, "%s %s failed: %s\n", job->action, job->unit, job->result);
+            rc = 1;
+        } else if (!service_async && !ld_systemd_job_finished(job)) {
+            fprintf(stderr, "%s %s timed out\n", job->action, job->unit);
+            rc = 1;
+        }
+    }
+    if (rc == 0) {
+        printf("OK\n");
+    }
+    return rc;
 }
 
-static int set_ratio_on_cpu(int cpu, uint8_t ratio) {
-    int fd = open_msr_cpu(cpu, true);
-    if (fd < 0) {
-        return -1;
+/*
+ * Core parking. CPUs the helper takes offline are recorded with their group
+ * in PARK_STATE_PATH: an offline CPU's core type can no longer be read, and
+ * a later one-shot --unpark needs it. /run is cleared at boot, like the
+ * hotplug state itself. Server and socket modes bring back what they parked
+ * when they exit.
+ */
+enum park_group { PARK_P, PARK_E, PARK_GROUPS };
+
+static struct ld_cpu_list parked[PARK_GROUPS];
+static struct ld_cpu_list parked_here[PARK_GROUPS];
+static bool parked_loaded;
+
+static void cpu_list_remove(struct ld_cpu_list *list, int cpu) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->ids[i] == cpu) {
+            memmove(&list->ids[i], &list->ids[i + 1], (list->count - i - 1) * sizeof(int));
+            list->count--;
+            return;
+        }
     }
-    uint64_t cur = 0;
-    if (rdmsr(fd, MSR_IA32_PERF_CTL, &cur) != 0) {
-        close(fd);
-        return -1;
+}
+
+static void park_load(void) {
+    if (parked_loaded) {
+        return;
     }
-    uint64_t next = (cur & ~0xFFFFULL) | ((uint64_t)ratio << 8);
-    if (wrmsr(fd, MSR_IA32_PERF_CTL, next) != 0) {
-        close(fd);
-        return -1;
+    parked_loaded = true;
+    FILE *f = fopen(PARK_STATE_PATH, "r");
+    if (!f) {
+        return;
+    }
+    char group = 0;
+    int cpu = 0;
+    while (fscanf(f, " %c %d", &group, &cpu) == 2) {
+        // Entries someone else brought back online are stale.
+        if ((group == 'P' || group == 'E') && ld_cpu_hotplug_state(cpu) == 0) {
+            ld_cpu_list_add(&parked[group == 'P' ? PARK_P : PARK_E], cpu);
+        }
     }
-    close(fd);
-    return 0;
+    fclose(f);
 }
 
-static int read_thermal_status_on_cpu(int cpu, uint64_t *thermal_out) {
-    int fd = open_msr_cpu(cpu, false);
-    if (fd < 0) {
-        return -1;
+static void park_save(void) {
+    if (parked[PARK_P].count == 0 && parked[PARK_E].count == 0) {
+        unlink(PARK_STATE_PATH);
+        return;
     }
-    uint64_t val = 0;
-    if (rdmsr(fd, MSR_IA32_THERM_STATUS, &val) != 0) {
-        close(fd);
-        return -1;
+    FILE *f = fopen(PARK_STATE_PATH, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to record parked CPUs in %s: %s\n", PARK_STATE_PATH, strerror(errno));
+        return;
     }
-    close(fd);
-    *thermal_out = val;
-    return 0;
+    for (int g = 0; g < PARK_GROUPS; g++) {
+        for (size_t i = 0; i < parked[g].count; i++) {
+            fprintf(f, "%c %d\n", g == PARK_P ? 'P' : 'E', parked[g].ids[i]);
+        }
+    }
+    fclose(f);
 }
 
-static int apply_ratio_list(const struct cpu_list *list, uint8_t ratio) {
-    for (size_t i = 0; i < list->count; i++) {
-        if (set_ratio_on_cpu(list->ids[i], ratio) != 0) {
-            return -1;
+static void print_park_state(void) {
+    struct ld_cpu_list offline;
+    ld_cpu_list_init(&offline);
+    ld_offline_cpus(&offline);
+    print_cpu_list("PARKED_P", &parked[PARK_P]);
+    print_cpu_list("PARKED_E", &parked[PARK_E]);
+    print_cpu_list("OFFLINE_CPUS", &offline);
+    ld_cpu_list_free(&offline);
+}
+
+/* Brings cpus online and drops them from the park records; *changed gets the CPUs switched. */
+static int unpark_list(const struct ld_cpu_list *cpus, struct ld_cpu_list *changed, char *err, size_t err_sz) {
+    int rc = ld_cpu_set_online(cpus, 1, changed, err, err_sz);
+    for (int g = 0; g < PARK_GROUPS; g++) {
+        for (size_t i = 0; i < cpus->count; i++) {
+            if (ld_cpu_hotplug_state(cpus->ids[i]) != 0) {
+                cpu_list_remove(&parked[g], cpus->ids[i]);
+                cpu_list_remove(&parked_here[g], cpus->ids[i]);
+            }
         }
     }
-    return 0;
+    park_save();
+    // cpufreq policies come and go with their CPUs.
+    ld_cpufreq_shared_free();
+    return rc;
+}
+
+static int cmd_park(enum park_group group) {
+    struct ld_cpu_list p_list, e_list, u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
+        fprintf(stderr, "Failed to enumerate CPUs\n");
+        ld_cpu_list_free(&p_list);
+        ld_cpu_list_free(&e_list);
+        ld_cpu_list_free(&u_list);
+        return 1;
+    }
+    park_load();
+    const struct ld_cpu_list *target = group == PARK_P ? &p_list : &e_list;
+    int rc = 0;
+    struct ld_cpu_list changed;
+    ld_cpu_list_init(&changed);
+    if (target->count == 0) {
+        fprintf(stderr, "No %s cores online\n", group == PARK_P ? "P" : "E");
+        rc = 1;
+    } else {
+        char err[256] = {0};
+        if (ld_cpu_set_online(target, 0, &changed, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s\n", err[0] ? err : "CPU offline failed");
+            rc = 1;
+        }
+        for (size_t i = 0; i < changed.count; i++) {
+            ld_cpu_list_add(&parked[group], changed.ids[i]);
+            ld_cpu_list_add(&parked_here[group], changed.ids[i]);
+        }
+        park_save();
+        ld_cpufreq_shared_free();
+    }
+    if (rc == 0) {
+        print_cpu_list("CHANGED_CPUS", &changed);
+        print_park_state();
+        printf("OK\n");
+    }
+    ld_cpu_list_free(&changed);
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
+    return rc;
 }
 
-static uint32_t oc_encode_offset_mv(double mv) {
-    long raw = lround(mv * 1.024);
-    uint32_t val = (uint32_t)(raw & 0x7FFu);
-    return val << 21;
+/* group == PARK_GROUPS brings back every offline CPU, parked by the helper or not. */
+static int cmd_unpark(enum park_group group) {
+    park_load();
+    struct ld_cpu_list cpus;
+    struct ld_cpu_list changed;
+    ld_cpu_list_init(&cpus);
+    ld_cpu_list_init(&changed);
+    if (group == PARK_GROUPS) {
+        ld_offline_cpus(&cpus);
+    } else {
+        for (size_t i = 0; i < parked[group].count; i++) {
+            ld_cpu_list_add(&cpus, parked[group].ids[i]);
+        }
+    }
+    char err[256] = {0};
+    int rc = 0;
+    if (unpark_list(&cpus, &changed, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err[0] ? err : "CPU online failed");
+        rc = 1;
+    } else {
+        print_cpu_list("CHANGED_CPUS", &changed);
+        print_park_state();
+        printf("OK\n");
+    }
+    ld_cpu_list_free(&cpus);
+    ld_cpu_list_free(&changed);
+    return rc;
 }
 
-static double oc_decode_offset_mv(uint32_t raw) {
-    int32_t val = (int32_t)((raw >> 21) & 0x7FFu);
-    if (val & 0x400) {
-        val |= ~0x7FF;
+static int parse_park_group(const char *arg, bool allow_all, enum park_group *out) {
+    if (arg && strcasecmp(arg, "P") == 0) {
+        *out = PARK_P;
+    } else if (arg && strcasecmp(arg, "E") == 0) {
+        *out = PARK_E;
+    } else if (arg && allow_all && strcasecmp(arg, "ALL") == 0) {
+        *out = PARK_GROUPS;
+    } else {
+        fprintf(stderr, "Invalid core group: %s (expected P or E%s)\n", arg ? arg : "", allow_all ? " or ALL" : "");
+        return 0;
     }
-    return (double)val / 1.024;
+    return 1;
 }
 
-static int oc_mailbox_read(int fd, uint8_t plane, uint32_t *data_out) {
-    uint32_t cmd = 0x80000010u | ((uint32_t)plane << 8);
-    uint64_t req = ((uint64_t)cmd << 32);
-    if (wrmsr(fd, MSR_OC_MAILBOX, req) != 0) {
-        return -1;
+/* Server exit: undo this process's parking. */
+static void restore_parked_here(void) {
+    struct ld_cpu_list cpus;
+    ld_cpu_list_init(&cpus);
+    for (int g = 0; g < PARK_GROUPS; g++) {
+        for (size_t i = 0; i < parked_here[g].count; i++) {
+            ld_cpu_list_add(&cpus, parked_here[g].ids[i]);
+        }
     }
-    uint64_t resp = 0;
-    if (rdmsr(fd, MSR_OC_MAILBOX, &resp) != 0) {
-        return -1;
+    if (cpus.count > 0) {
+        char err[256] = {0};
+        if (unpark_list(&cpus, NULL, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Restoring parked CPUs failed: %s\n", err);
+        }
+    }
+    ld_cpu_list_free(&cpus);
+}
+
+static int apply_ratio(int cpu, uint8_t ratio, enum ld_ratio_path path) {
+    if (path == LD_RATIO_CPUFREQ) {
+        char err[256] = {0};
+        if (ld_cpufreq_set_ratio(ld_cpufreq_shared(NULL, 0), cpu, ratio, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s\n", err[0] ? err : "cpufreq write failed");
+            return -1;
+        }
+        return 0;
+    }
+    return ld_set_ratio(cpu, ratio);
+}
+
+static int apply_ratio_list(const struct ld_cpu_list *list, uint8_t ratio, enum ld_ratio_path path) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (apply_ratio(list->ids[i], ratio, path) != 0) {
+            return -1;
+        }
     }
-    *data_out = (uint32_t)(resp & 0xFFFFFFFFu);
     return 0;
 }
 
-static int oc_mailbox_write(int fd, uint8_t plane, uint32_t data) {
-    uint32_t cmd = 0x80000011u | ((uint32_t)plane << 8);
-    uint64_t req = ((uint64_t)cmd << 32) | data;
-    return wrmsr(fd, MSR_OC_MAILBOX, req);
+/* Ratio target of cpu on path: PERF_CTL, or the scaling_max_freq cap on the cpufreq path. */
+static int target_ratio(int cpu, enum ld_ratio_path path, uint8_t *out) {
+    if (path == LD_RATIO_CPUFREQ) {
+        uint32_t min_khz = 0;
+        uint32_t max_khz = 0;
+        if (ld_cpufreq_read(ld_cpufreq_shared(NULL, 0), cpu, &min_khz, &max_khz) != 0) {
+            return -1;
+        }
+        *out = (uint8_t)(max_khz / LD_RATIO_KHZ);
+        return 0;
+    }
+    return ld_read_ratio_target(cpu, out);
 }
 
 static void usage(const char *argv0) {
     fprintf(stderr,
-        "Usage:\n"
+        "Usage: %s [--backend|--msr-backend|--mmio-backend auto|direct|powercap]\n"
+        "          [--ratio-backend auto|perf-ctl|cpufreq] <command>\n"
         "  %s --read\n"
         "  %s --write-msr 0xHEX64\n"
         "  %s --write-mmio 0xHEX64\n"
         "  %s --write-powercap <pl1_uw> <pl2_uw>\n"
+        "  %s --read-powercap\n"
+        "  %s --read-powercap-energy\n"
+        "  %s --write-powercap-zone <zone> <constraint> <limit_uw> [time_window_us]\n"
         "  %s --start-thermald\n"
         "  %s --stop-thermald\n"
         "  %s --disable-thermald\n"
@@ -561,16 +596,38 @@ static void usage(const char *argv0) {
         "  %s --stop-tuned-ppd\n"
         "  %s --disable-tuned-ppd\n"
         "  %s --enable-tuned-ppd\n"
+        "  %s --stop-powercap-writers\n"
+        "  %s --watch-conflicts [seconds]\n"
         "  %s --set-p-ratio <int>\n"
         "  %s --set-e-ratio <int>\n"
         "  %s --set-all-ratio <int>\n"
         "  %s --set-pe-ratio <p_int> <e_int>\n"
         "  %s --set-cpu-ratio <cpu> <ratio>\n"
+        "  %s --park P|E\n"
+        "  %s --unpark P|E|all\n"
+        "  %s --read-irqs [interval_ms]\n"
+        "  %s --steer-irqs P|E|favored|<cpulist> [irq|name]...\n"
+        "  %s --restore-irqs\n"
+        "  %s --read-cpu-energy [interval_ms]\n"
+        "  %s --read-cgroup-power [interval_ms] [cgroup]...\n"
+        "  %s --cgroup-budget <cgroup> <watts> [quota|ratio]\n"
+        "  %s --read-pstate\n"
+        "  %s --set-pstate <knob>=<value>...\n"
         "  %s --set-core-uv <mV>\n"
+        "  %s --read-vf-curve [plane]\n"
+        "  %s --set-vf-offset point <n> <mV> | band <min_ratio> <max_ratio> <mV>\n"
         "  %s --read-core-sensors\n"
-        "  %s --server\n",
+        "  %s --watch-residency [seconds]\n"
+        "  %s --read-ledger\n"
+        "  %s --set-profile <name>\n"
+        "  %s --read-package\n"
+        "  %s --server\n"
+        "  %s --socket [PATH] [--socket-group GROUP]\n"
+        "  %s --socket-fd <fd>\n",
+        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0,
         argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0,
-        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0);
+        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0,
+        argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0, argv0);
 }
 
 static void print_end(void) {
@@ -579,55 +636,33 @@ static void print_end(void) {
 }
 
 static int cmd_read(void) {
-    int msr_fd = open_msr(true);
-    if (msr_fd < 0) {
-        fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
-        return 1;
-    }
-
-    volatile uint8_t *mmio = NULL;
-    char mmio_err[256] = {0};
-    int mem_fd = open_mmio(false, &mmio, mmio_err, sizeof(mmio_err));
-    if (mem_fd < 0) {
-        fprintf(stderr, "open MMIO failed: %s\n", mmio_err[0] ? mmio_err : "unknown error");
-        close(msr_fd);
+    enum ld_limits_backend msr_backend;
+    enum ld_limits_backend mmio_backend;
+    if (limits_backend(LD_LIMITS_MSR, &msr_backend) != 0 || limits_backend(LD_LIMITS_MMIO, &mmio_backend) != 0) {
         return 1;
     }
 
-    uint64_t rapl_units = 0;
+    char err[256] = {0};
     uint64_t msr_val = 0;
     uint64_t mmio_val = 0;
-
-    if (rdmsr(msr_fd, MSR_RAPL_POWER_UNIT, &rapl_units) != 0) {
-        fprintf(stderr, "read MSR 0x%X failed: %s\n", MSR_RAPL_POWER_UNIT, strerror(errno));
-        close_mmio(mem_fd, mmio);
-        close(msr_fd);
-        return 1;
-    }
-
-    if (rdmsr(msr_fd, MSR_PKG_POWER_LIMIT, &msr_val) != 0) {
-        fprintf(stderr, "read MSR 0x%X failed: %s\n", MSR_PKG_POWER_LIMIT, strerror(errno));
-        close_mmio(mem_fd, mmio);
-        close(msr_fd);
+    if (ld_limits_read(LD_LIMITS_MSR, msr_backend, &msr_val, err, sizeof(err)) != 0 ||
+        ld_limits_read(LD_LIMITS_MMIO, mmio_backend, &mmio_val, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err[0] ? err : "read limits failed");
         return 1;
     }
 
-    mmio_val = rd64(mmio, PL_OFF);
-
-    struct cpu_list p_list;
-    struct cpu_list e_list;
-    struct cpu_list u_list;
-    cpu_list_init(&p_list);
-    cpu_list_init(&e_list);
-    cpu_list_init(&u_list);
+    struct ld_cpu_list p_list;
+    struct ld_cpu_list e_list;
+    struct ld_cpu_list u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
     int core_type_ok = 0;
-    if (enumerate_cpus(&p_list, &e_list, &u_list, &core_type_ok) != 0) {
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, &core_type_ok) != 0) {
         fprintf(stderr, "Failed to enumerate CPUs\n");
-        close_mmio(mem_fd, mmio);
-        close(msr_fd);
-        cpu_list_free(&p_list);
-        cpu_list_free(&e_list);
-        cpu_list_free(&u_list);
+        ld_cpu_list_free(&p_list);
+        ld_cpu_list_free(&e_list);
+        ld_cpu_list_free(&u_list);
         return 1;
     }
 
@@ -639,38 +674,65 @@ static int cmd_read(void) {
     uint8_t e_ratio_cur = 0;
     int p_ratio_cur_valid = 0;
     int e_ratio_cur_valid = 0;
-    if (p_list.count > 0 && read_ratio_on_cpu(p_list.ids[0], &p_ratio) == 0) {
+    if (p_list.count > 0 && ld_read_ratio_target(p_list.ids[0], &p_ratio) == 0) {
         p_ratio_valid = 1;
     }
-    if (e_list.count > 0 && read_ratio_on_cpu(e_list.ids[0], &e_ratio) == 0) {
+    if (e_list.count > 0 && ld_read_ratio_target(e_list.ids[0], &e_ratio) == 0) {
         e_ratio_valid = 1;
     }
-    if (p_list.count > 0 && read_ratio_current_on_cpu(p_list.ids[0], &p_ratio_cur) == 0) {
+    // On the cpufreq path the target is the scaling_max_freq cap, not PERF_CTL.
+    struct ld_cpufreq *cf = ld_cpufreq_shared(NULL, 0);
+    enum ld_ratio_path ratio = LD_RATIO_PERF_CTL;
+    int ratio_ok = cf && ld_ratio_select(cf, ratio_want, &ratio, NULL, 0) == 0;
+    if (ratio_ok && ratio == LD_RATIO_CPUFREQ) {
+        uint32_t min_khz = 0;
+        uint32_t max_khz = 0;
+        if (p_list.count > 0 && ld_cpufreq_read(cf, p_list.ids[0], &min_khz, &max_khz) == 0) {
+            p_ratio = (uint8_t)(max_khz / LD_RATIO_KHZ);
+            p_ratio_valid = 1;
+        }
+        if (e_list.count > 0 && ld_cpufreq_read(cf, e_list.ids[0], &min_khz, &max_khz) == 0) {
+            e_ratio = (uint8_t)(max_khz / LD_RATIO_KHZ);
+            e_ratio_valid = 1;
+        }
+    }
+    if (p_list.count > 0 && ld_read_ratio_current(p_list.ids[0], &p_ratio_cur) == 0) {
         p_ratio_cur_valid = 1;
     }
-    if (e_list.count > 0 && read_ratio_current_on_cpu(e_list.ids[0], &e_ratio_cur) == 0) {
+    if (e_list.count > 0 && ld_read_ratio_current(e_list.ids[0], &e_ratio_cur) == 0) {
         e_ratio_cur_valid = 1;
     }
 
     uint32_t core_uv_raw = 0;
     int core_uv_valid = 0;
     double core_uv_mv = 0.0;
-    if (oc_mailbox_read(msr_fd, OC_PLANE_CORE, &core_uv_raw) == 0) {
+    if (ld_oc_mailbox_read(0, LD_OC_PLANE_CORE, &core_uv_raw) == 0) {
         core_uv_valid = 1;
-        core_uv_mv = oc_decode_offset_mv(core_uv_raw);
+        core_uv_mv = ld_oc_decode_offset_mv(core_uv_raw);
     }
 
-    int power_unit = (int)(rapl_units & 0x0F);
-    double unit_watts = 1.0 / (double)(1u << power_unit);
+    // Powercap-backed values are synthesized in these units, so the
+    // default is consistent even when MSR 0x606 cannot be read.
+    struct ld_rapl_units units;
+    ld_limits_units(&units);
 
-    printf("POWER_UNIT=%d\n", power_unit);
-    printf("UNIT_WATTS=%.12f\n", unit_watts);
+    printf("POWER_UNIT=%d\n", units.power_unit);
+    printf("UNIT_WATTS=%.12f\n", units.unit_watts);
+    printf("TIME_UNIT_S=%.12f\n", units.time_unit_s);
     printf("MSR=0x%016" PRIx64 "\n", msr_val);
     printf("MMIO=0x%016" PRIx64 "\n", mmio_val);
+    printf("MSR_BACKEND=%s\n", ld_limits_backend_name(LD_LIMITS_MSR, msr_backend));
+    printf("MMIO_BACKEND=%s\n", ld_limits_backend_name(LD_LIMITS_MMIO, mmio_backend));
+    printf("RATIO_PATH=%s\n", ratio_ok ? ld_ratio_path_name(ratio) : "none");
+    printf("PSTATE_MODE=%s\n", ld_pstate_mode_name(cf ? cf->mode : LD_PSTATE_NONE));
+    printf("PSTATE_HWP=%d\n", cf ? cf->hwp : 0);
+    printf("CPUFREQ_DRIVER=%s\n", cf ? cf->driver : "");
     printf("CORE_TYPE_SUPPORTED=%d\n", core_type_ok);
     print_cpu_list("P_CPUS", &p_list);
     print_cpu_list("E_CPUS", &e_list);
     print_cpu_list("U_CPUS", &u_list);
+    park_load();
+    print_park_state();
     printf("P_RATIO_VALID=%d\n", p_ratio_valid);
     printf("E_RATIO_VALID=%d\n", e_ratio_valid);
     printf("P_RATIO_TARGET=%u\n", p_ratio);
@@ -683,71 +745,300 @@ static int cmd_read(void) {
     printf("CORE_UV_MV=%.3f\n", core_uv_mv);
     printf("CORE_UV_RAW=0x%08" PRIx32 "\n", core_uv_raw);
 
-    close_mmio(mem_fd, mmio);
-    close(msr_fd);
-    cpu_list_free(&p_list);
-    cpu_list_free(&e_list);
-    cpu_list_free(&u_list);
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
     return 0;
 }
 
-static int cmd_write_msr(uint64_t val) {
-    int msr_fd = open_msr(true);
-    if (msr_fd < 0) {
-        fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
-        return 1;
-    }
-    if (wrmsr(msr_fd, MSR_PKG_POWER_LIMIT, val) != 0) {
-        fprintf(stderr, "write MSR 0x%X failed: %s\n", MSR_PKG_POWER_LIMIT, strerror(errno));
-        close(msr_fd);
-        return 1;
+/*
+ * Conflict monitor: samples MSR 0x610, MCHBAR 0x59A0 and every powercap
+ * constraint limit, and attributes changes to the writer daemons that woke
+ * up in the same interval, or to firmware when SMIs fired in it. It starts with the first READ-CONFLICTS and is
+ * then sampled before every command (at most every CONFLICT_SAMPLE_MS) and
+ * from the socket server's poll timeout.
+ */
+static struct ld_conflict_monitor conflicts;
+static bool conflicts_active = false;
+
+static void conflict_read_sources(void (*fn)(int idx, uint64_t value, double now_s), double now_s) {
+    uint64_t val = 0;
+    if (ld_msr_read(0, LD_MSR_PKG_POWER_LIMIT, &val) == 0) {
+        fn(ld_conflict_source(&conflicts, "msr:0x610"), val, now_s);
+    }
+    struct ld_mmio *mmio = ld_mmio_shared(0, NULL, 0);
+    if (mmio) {
+        fn(ld_conflict_source(&conflicts, "mchbar:0x59a0"), ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT), now_s);
+    }
+    struct ld_powercap *pc = ld_powercap_shared(NULL, 0);
+    for (size_t i = 0; pc && i < pc->count; i++) {
+        struct ld_powercap_zone *zone = &pc->zones[i];
+        ld_powercap_refresh(zone);
+        for (size_t j = 0; j < zone->constraint_count; j++) {
+            char name[112];
+            snprintf(name, sizeof(name), "%s/%s", zone->id, zone->constraints[j].name);
+            fn(ld_conflict_source(&conflicts, name), zone->constraints[j].power_limit_uw, now_s);
+        }
     }
-    close(msr_fd);
-    printf("OK\n");
+}
+
+static void conflict_observe(int idx, uint64_t value, double now_s) {
+    ld_conflict_observe(&conflicts, idx, value, now_s);
+}
+
+static void conflict_expect(int idx, uint64_t value, double now_s) {
+    (void)now_s;
+    ld_conflict_expect(&conflicts, idx, value);
+}
+
+static void conflict_sample(bool force) {
+    double now_s = monotonic_s();
+    if (!conflicts_active || (!force && (now_s - conflicts.last_sample_s) * 1e3 < CONFLICT_SAMPLE_MS)) {
+        return;
+    }
+    ld_conflict_begin(&conflicts, now_s);
+    conflict_read_sources(conflict_observe, now_s);
+    uint64_t smi = 0;
+    if (ld_msr_read(0, LD_MSR_SMI_COUNT, &smi) == 0) {
+        ld_conflict_observe_smi(&conflicts, (uint32_t)LD_FIELD_GET(smi, LD_SMI_COUNT), now_s);
+    }
+    ld_conflict_end(&conflicts, now_s);
+}
+
+/* After our own write: whatever the sources read now is what we want to keep. */
+static void conflict_own_write(void) {
+    if (conflicts_active) {
+        conflict_read_sources(conflict_expect, monotonic_s());
+    }
+}
+
+static int cmd_read_conflicts(void) {
+    if (!conflicts_active) {
+        ld_conflict_init(&conflicts, monotonic_s());
+        conflicts_active = true;
+        conflict_sample(true);
+    }
+    double now_s = monotonic_s();
+    double elapsed_s = now_s - conflicts.start_s;
+    printf("CONFLICT_ELAPSED_S=%.1f\n", elapsed_s);
+    printf("CONFLICT_SAMPLES=%" PRIu64 "\n", conflicts.samples);
+    printf("CONFLICT_EVENTS=%" PRIu32 "\n", conflicts.events);
+    printf("CONFLICT_REVERT_EVENTS=%" PRIu32 "\n", conflicts.revert_events);
+    printf("CONFLICT_CHANGES_PER_MIN=%.2f\n", elapsed_s > 0.0 ? conflicts.events * 60.0 / elapsed_s : 0.0);
+    printf("CONFLICT_SOURCE_COUNT=%zu\n", conflicts.source_count);
+    for (size_t i = 0; i < conflicts.source_count; i++) {
+        const struct ld_conflict_source *src = &conflicts.sources[i];
+        int reg = strchr(src->name, '/') == NULL;
+        printf("CONFLICT_SOURCE_%zu=name=%s,value=", i, src->name);
+        printf(reg ? "0x%016" PRIx64 : "%" PRIu64, src->value);
+        printf(",changes=%" PRIu32 ",reverts=%" PRIu32 ",last_change_s=%.1f\n", src->changes, src->reverts,
+               src->changes ? now_s - src->last_change_s : -1.0);
+    }
+    printf("CONFLICT_SERVICE_COUNT=%d\n", LD_CONFLICT_WRITER_COUNT);
+    for (size_t i = 0; i < LD_CONFLICT_WRITER_COUNT; i++) {
+        const struct ld_conflict_service *svc = &conflicts.services[i];
+        printf("CONFLICT_SERVICE_%zu=name=%s,active=%d,pid=%d,last_active_s=%.1f,correlated=%" PRIu32
+               ",reverts=%" PRIu32 ",lift=%.2f\n",
+               i, svc->name, svc->pid > 0, svc->pid, svc->last_active_s > 0.0 ? now_s - svc->last_active_s : -1.0,
+               svc->correlated, svc->reverts, ld_conflict_lift(&conflicts, svc));
+    }
+    const struct ld_conflict_smi *smi = &conflicts.smi;
+    printf("CONFLICT_SMI=valid=%d,total=%" PRIu64 ",intervals=%" PRIu32 ",correlated=%" PRIu32 ",reverts=%" PRIu32
+           ",last_s=%.1f,lift=%.2f\n",
+           smi->valid, smi->total, smi->fired_intervals, smi->correlated, smi->reverts,
+           smi->last_s > 0.0 ? now_s - smi->last_s : -1.0, ld_conflict_smi_lift(&conflicts));
+    double confidence = 0.0;
+    int proven = 0;
+    const struct ld_conflict_service *culprit = ld_conflict_culprit(&conflicts, &confidence, &proven);
+    printf("CONFLICT_CULPRIT=%s\n", culprit ? culprit->name : "none");
+    printf("CONFLICT_CONFIDENCE=%.2f\n", confidence);
+    printf("CONFLICT_PROVEN=%d\n", proven);
     return 0;
 }
 
-static int cmd_write_mmio(uint64_t val) {
-    volatile uint8_t *mmio = NULL;
-    char mmio_err[256] = {0};
-    int mem_fd = open_mmio(true, &mmio, mmio_err, sizeof(mmio_err));
-    if (mem_fd < 0) {
-        fprintf(stderr, "open MMIO failed: %s\n", mmio_err[0] ? mmio_err : "unknown error");
+static int cmd_watch_conflicts(int seconds) {
+    ld_conflict_init(&conflicts, monotonic_s());
+    conflicts_active = true;
+    double end_s = monotonic_s() + seconds;
+    while (monotonic_s() < end_s) {
+        conflict_sample(true);
+        usleep(CONFLICT_SAMPLE_MS * 1000);
+    }
+    return cmd_read_conflicts();
+}
+
+static int cmd_write_limits(enum ld_limits_path path, uint64_t val) {
+    enum ld_limits_backend backend;
+    if (limits_backend(path, &backend) != 0) {
+        return 1;
+    }
+    char err[256] = {0};
+    if (ld_limits_write(path, backend, val, err, sizeof(err)) != 0) {
+        fprintf(stderr, "write %s limits via %s failed: %s\n", limits_path_label(path),
+                ld_limits_backend_name(path, backend), err[0] ? err : "unknown error");
         return 1;
     }
-    wr64(mmio, PL_OFF, val);
-    close_mmio(mem_fd, mmio);
+    conflict_own_write();
     printf("OK\n");
     return 0;
 }
 
 static int cmd_write_powercap(uint64_t pl1_uw, uint64_t pl2_uw) {
     char err[256] = {0};
-    if (write_powercap_uw(pl1_uw, pl2_uw, err, sizeof(err)) != 0) {
+    if (ld_write_powercap_uw(pl1_uw, pl2_uw, err, sizeof(err)) != 0) {
         fprintf(stderr, "Failed to write powercap: %s\n", err[0] ? err : "unknown error");
         return 1;
     }
+    conflict_own_write();
     printf("OK\n");
     return 0;
 }
 
-static int cmd_service(const char *action, bool with_now, const char *service_name) {
-    const char *services[] = {service_name};
+static struct ld_powercap *powercap_tree(void) {
+    char err[256] = {0};
+    struct ld_powercap *pc = ld_powercap_shared(err, sizeof(err));
+    if (!pc) {
+        fprintf(stderr, "powercap unavailable: %s\n", err[0] ? err : "unknown error");
+    }
+    return pc;
+}
+
+static int cmd_read_powercap(void) {
+    struct ld_powercap *pc = powercap_tree();
+    if (!pc) {
+        return 1;
+    }
+    printf("POWERCAP_ZONE_COUNT=%zu\n", pc->count);
+    for (size_t i = 0; i < pc->count; i++) {
+        struct ld_powercap_zone *zone = &pc->zones[i];
+        ld_powercap_refresh(zone);
+        uint64_t energy = 0;
+        int energy_ok = zone->has_energy && ld_powercap_read_energy_uj(zone, &energy) == 0;
+        printf("POWERCAP_ZONE_%zu=id=%s,name=%s,parent=%s,enabled=%d,constraints=%zu", i, zone->id, zone->name,
+               zone->parent >= 0 ? pc->zones[zone->parent].id : "", zone->enabled, zone->constraint_count);
+        if (energy_ok) {
+            printf(",energy_uj=%" PRIu64 ",max_energy_range_uj=%" PRIu64, energy, zone->max_energy_range_uj);
+        }
+        printf("\n");
+        for (size_t j = 0; j < zone->constraint_count; j++) {
+            const struct ld_powercap_constraint *c = &zone->constraints[j];
+            printf("POWERCAP_ZONE_%zu_CONSTRAINT_%zu=name=%s,limit_uw=%" PRIu64, i, j, c->name, c->power_limit_uw);
+            if (c->has_time_window) {
+                printf(",time_window_us=%" PRIu64, c->time_window_us);
+            }
+            if (c->has_max_power) {
+                printf(",max_power_uw=%" PRIu64, c->max_power_uw);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
+
+static int cmd_read_powercap_energy(void) {
+    struct ld_powercap *pc = powercap_tree();
+    if (!pc) {
+        return 1;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    size_t count = 0;
+    for (size_t i = 0; i < pc->count; i++) {
+        count += pc->zones[i].has_energy ? 1 : 0;
+    }
+    printf("POWERCAP_T_NS=%" PRIu64 "\n", (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec);
+    printf("POWERCAP_ENERGY_COUNT=%zu\n", count);
+    size_t idx = 0;
+    for (size_t i = 0; i < pc->count; i++) {
+        struct ld_powercap_zone *zone = &pc->zones[i];
+        if (!zone->has_energy) {
+            continue;
+        }
+        uint64_t energy = 0;
+        int ok = ld_powercap_read_energy_uj(zone, &energy) == 0;
+        printf("POWERCAP_ENERGY_%zu=id=%s,name=%s,valid=%d,energy_uj=%" PRIu64 ",max_energy_range_uj=%" PRIu64 "\n",
+               idx++, zone->id, zone->name, ok, energy, zone->max_energy_range_uj);
+    }
+    return 0;
+}
+
+static int cmd_write_powercap_zone(const char *zone_name, const char *constraint_name, uint64_t limit_uw,
+                                   int has_window, uint64_t window_us) {
+    struct ld_powercap *pc = powercap_tree();
+    if (!pc) {
+        return 1;
+    }
+    struct ld_powercap_zone *zone = ld_powercap_find(pc, zone_name);
+    if (!zone) {
+        fprintf(stderr, "Unknown powercap zone: %s\n", zone_name);
+        return 2;
+    }
+    int idx = ld_powercap_constraint_find(zone, constraint_name);
+    if (idx < 0) {
+        fprintf(stderr, "Unknown constraint %s on %s\n", constraint_name, zone->id);
+        return 2;
+    }
+    const struct ld_powercap_constraint *c = &zone->constraints[idx];
+    if (c->has_max_power && c->max_power_uw > 0 && limit_uw > c->max_power_uw) {
+        fprintf(stderr, "Refusing %s %s limit above max_power_uw (%" PRIu64 ")\n", zone->id, c->name,
+                c->max_power_uw);
+        return 2;
+    }
     char err[256] = {0};
-    if (run_systemctl_action(action, with_now, services, 1, err, sizeof(err)) != 0) {
-        fprintf(stderr, "systemctl %s failed: %s\n", action, err[0] ? err : "unknown error");
+    if (ld_powercap_set_limit_uw(zone, (size_t)idx, limit_uw, err, sizeof(err)) != 0 ||
+        (has_window && ld_powercap_set_time_window_us(zone, (size_t)idx, window_us, err, sizeof(err)) != 0)) {
+        fprintf(stderr, "Failed to write powercap: %s\n", err[0] ? err : "unknown error");
         return 1;
     }
+    conflict_own_write();
     printf("OK\n");
     return 0;
 }
 
-static int cmd_set_ratio_list(const struct cpu_list *list, uint8_t ratio, const char *label) {
+static int cmd_service(const char *action, const char *service_name) {
+    const char *services[] = {service_name};
+    return run_service_jobs(action, services, 1);
+}
+
+static int cmd_stop_powercap_writers(void) {
+    return run_service_jobs("stop", powercap_writers, sizeof(powercap_writers) / sizeof(powercap_writers[0]));
+}
+
+static int cmd_read_service_jobs(void) {
+    struct ld_systemd *sd = systemd_conn();
+    if (!sd) {
+        printf("SERVICE_BUS=systemctl\n");
+        printf("SERVICE_JOBS_PENDING=0\n");
+        printf("SERVICE_JOB_COUNT=0\n");
+        return 0;
+    }
+    ld_systemd_process(sd, 0, NULL, 0);
+    printf("SERVICE_BUS=dbus\n");
+    printf("SERVICE_JOBS_PENDING=%zu\n", ld_systemd_pending(sd));
+    printf("SERVICE_JOB_COUNT=%zu\n", sd->count);
+    // Slots are recycled, so list them by id.
+    double now_s = monotonic_s();
+    uint32_t last = 0;
+    for (size_t i = 0; i < sd->count; i++) {
+        const struct ld_systemd_job *next = NULL;
+        for (size_t j = 0; j < sd->count; j++) {
+            if (sd->jobs[j].id > last && (!next || sd->jobs[j].id < next->id)) {
+                next = &sd->jobs[j];
+            }
+        }
+        print_service_job(i, next, now_s);
+        last = next->id;
+    }
+    return 0;
+}
+
+static int cmd_set_ratio_list(const struct ld_cpu_list *list, uint8_t ratio, const char *label,
+                              enum ld_ratio_path path) {
     if (list->count == 0) {
         fprintf(stderr, "No %s cores detected\n", label);
         return 1;
     }
-    if (apply_ratio_list(list, ratio) != 0) {
+    if (apply_ratio_list(list, ratio, path) != 0) {
         fprintf(stderr, "Failed to apply ratio\n");
         return 1;
     }
@@ -755,21 +1046,26 @@ static int cmd_set_ratio_list(const struct cpu_list *list, uint8_t ratio, const
 }
 
 static int cmd_set_p_ratio(int ratio) {
-    struct cpu_list p_list, e_list, u_list;
-    cpu_list_init(&p_list);
-    cpu_list_init(&e_list);
-    cpu_list_init(&u_list);
-    if (enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
+    enum ld_ratio_path path;
+    if (ratio_path(&path) != 0) {
+        return 1;
+    }
+    printf("RATIO_PATH=%s\n", ld_ratio_path_name(path));
+    struct ld_cpu_list p_list, e_list, u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
         fprintf(stderr, "Failed to enumerate CPUs\n");
-        cpu_list_free(&p_list);
-        cpu_list_free(&e_list);
-        cpu_list_free(&u_list);
+        ld_cpu_list_free(&p_list);
+        ld_cpu_list_free(&e_list);
+        ld_cpu_list_free(&u_list);
         return 1;
     }
-    int rc = cmd_set_ratio_list(&p_list, (uint8_t)ratio, "P");
-    cpu_list_free(&p_list);
-    cpu_list_free(&e_list);
-    cpu_list_free(&u_list);
+    int rc = cmd_set_ratio_list(&p_list, (uint8_t)ratio, "P", path);
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
     if (rc == 0) {
         printf("OK\n");
     }
@@ -777,21 +1073,26 @@ static int cmd_set_p_ratio(int ratio) {
 }
 
 static int cmd_set_e_ratio(int ratio) {
-    struct cpu_list p_list, e_list, u_list;
-    cpu_list_init(&p_list);
-    cpu_list_init(&e_list);
-    cpu_list_init(&u_list);
-    if (enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
+    enum ld_ratio_path path;
+    if (ratio_path(&path) != 0) {
+        return 1;
+    }
+    printf("RATIO_PATH=%s\n", ld_ratio_path_name(path));
+    struct ld_cpu_list p_list, e_list, u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
         fprintf(stderr, "Failed to enumerate CPUs\n");
-        cpu_list_free(&p_list);
-        cpu_list_free(&e_list);
-        cpu_list_free(&u_list);
+        ld_cpu_list_free(&p_list);
+        ld_cpu_list_free(&e_list);
+        ld_cpu_list_free(&u_list);
         return 1;
     }
-    int rc = cmd_set_ratio_list(&e_list, (uint8_t)ratio, "E");
-    cpu_list_free(&p_list);
-    cpu_list_free(&e_list);
-    cpu_list_free(&u_list);
+    int rc = cmd_set_ratio_list(&e_list, (uint8_t)ratio, "E", path);
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
     if (rc == 0) {
         printf("OK\n");
     }
@@ -799,30 +1100,35 @@ static int cmd_set_e_ratio(int ratio) {
 }
 
 static int cmd_set_all_ratio(int ratio) {
-    struct cpu_list p_list, e_list, u_list;
-    cpu_list_init(&p_list);
-    cpu_list_init(&e_list);
-    cpu_list_init(&u_list);
-    if (enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
+    enum ld_ratio_path path;
+    if (ratio_path(&path) != 0) {
+        return 1;
+    }
+    printf("RATIO_PATH=%s\n", ld_ratio_path_name(path));
+    struct ld_cpu_list p_list, e_list, u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
         fprintf(stderr, "Failed to enumerate CPUs\n");
-        cpu_list_free(&p_list);
-        cpu_list_free(&e_list);
-        cpu_list_free(&u_list);
+        ld_cpu_list_free(&p_list);
+        ld_cpu_list_free(&e_list);
+        ld_cpu_list_free(&u_list);
         return 1;
     }
     int rc = 0;
-    if (cmd_set_ratio_list(&p_list, (uint8_t)ratio, "P") != 0) {
+    if (cmd_set_ratio_list(&p_list, (uint8_t)ratio, "P", path) != 0) {
         rc = 1;
     }
-    if (cmd_set_ratio_list(&e_list, (uint8_t)ratio, "E") != 0) {
+    if (cmd_set_ratio_list(&e_list, (uint8_t)ratio, "E", path) != 0) {
         rc = 1;
     }
-    if (cmd_set_ratio_list(&u_list, (uint8_t)ratio, "U") != 0) {
+    if (cmd_set_ratio_list(&u_list, (uint8_t)ratio, "U", path) != 0) {
         rc = 1;
     }
-    cpu_list_free(&p_list);
-    cpu_list_free(&e_list);
-    cpu_list_free(&u_list);
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
     if (rc == 0) {
         printf("OK\n");
     }
@@ -830,27 +1136,32 @@ static int cmd_set_all_ratio(int ratio) {
 }
 
 static int cmd_set_pe_ratio(int ratio_p, int ratio_e) {
-    struct cpu_list p_list, e_list, u_list;
-    cpu_list_init(&p_list);
-    cpu_list_init(&e_list);
-    cpu_list_init(&u_list);
-    if (enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
+    enum ld_ratio_path path;
+    if (ratio_path(&path) != 0) {
+        return 1;
+    }
+    printf("RATIO_PATH=%s\n", ld_ratio_path_name(path));
+    struct ld_cpu_list p_list, e_list, u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, NULL) != 0) {
         fprintf(stderr, "Failed to enumerate CPUs\n");
-        cpu_list_free(&p_list);
-        cpu_list_free(&e_list);
-        cpu_list_free(&u_list);
+        ld_cpu_list_free(&p_list);
+        ld_cpu_list_free(&e_list);
+        ld_cpu_list_free(&u_list);
         return 1;
     }
     int rc = 0;
-    if (cmd_set_ratio_list(&p_list, (uint8_t)ratio_p, "P") != 0) {
+    if (cmd_set_ratio_list(&p_list, (uint8_t)ratio_p, "P", path) != 0) {
         rc = 1;
     }
-    if (cmd_set_ratio_list(&e_list, (uint8_t)ratio_e, "E") != 0) {
+    if (cmd_set_ratio_list(&e_list, (uint8_t)ratio_e, "E", path) != 0) {
         rc = 1;
     }
-    cpu_list_free(&p_list);
-    cpu_list_free(&e_list);
-    cpu_list_free(&u_list);
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
     if (rc == 0) {
         printf("OK\n");
     }
@@ -858,7 +1169,12 @@ static int cmd_set_pe_ratio(int ratio_p, int ratio_e) {
 }
 
 static int cmd_set_cpu_ratio(int cpu, int ratio) {
-    if (set_ratio_on_cpu(cpu, (uint8_t)ratio) != 0) {
+    enum ld_ratio_path path;
+    if (ratio_path(&path) != 0) {
+        return 1;
+    }
+    printf("RATIO_PATH=%s\n", ld_ratio_path_name(path));
+    if (apply_ratio(cpu, (uint8_t)ratio, path) != 0) {
         fprintf(stderr, "Failed to set ratio on cpu %d\n", cpu);
         return 1;
     }
@@ -866,72 +1182,1076 @@ static int cmd_set_cpu_ratio(int cpu, int ratio) {
     return 0;
 }
 
+/*
+ * IRQ steering. The affinity an IRQ had before the helper first moved it is
+ * kept in IRQ_STATE_PATH until RESTORE-IRQS, so steering twice (or from a
+ * profile at every start) still restores the original spread.
+ */
+struct irq_saved {
+    int irq;
+    char list[128];
+};
+
+static struct ld_irq_table irq_prev;
+static bool irq_prev_valid;
+
+static size_t irq_saved_load(struct irq_saved **out) {
+    *out = NULL;
+    FILE *f = fopen(IRQ_STATE_PATH, "r");
+    if (!f) {
+        return 0;
+    }
+    size_t count = 0;
+    size_t cap = 0;
+    struct irq_saved e;
+    while (fscanf(f, "%d %127s", &e.irq, e.list) == 2) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 32;
+            struct irq_saved *grown = realloc(*out, cap * sizeof(*grown));
+            if (!grown) {
+                break;
+            }
+            *out = grown;
+        }
+        (*out)[count++] = e;
+    }
+    fclose(f);
+    return count;
+}
+
+static void irq_saved_store(const struct irq_saved *saved, size_t count) {
+    if (count == 0) {
+        unlink(IRQ_STATE_PATH);
+        return;
+    }
+    FILE *f = fopen(IRQ_STATE_PATH, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to record IRQ affinities in %s: %s\n", IRQ_STATE_PATH, strerror(errno));
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fprintf(f, "%d %s\n", saved[i].irq, saved[i].list);
+    }
+    fclose(f);
+}
+
+static const struct irq_saved *irq_saved_find(const struct irq_saved *saved, size_t count, int irq) {
+    for (size_t i = 0; i < count; i++) {
+        if (saved[i].irq == irq) {
+            return &saved[i];
+        }
+    }
+    return NULL;
+}
+
+/* irqbalance rewrites smp_affinity every 10 s and undoes any steering. */
+static bool irqbalance_running(void) {
+    DIR *proc = opendir("/proc");
+    if (!proc) {
+        return false;
+    }
+    bool found = false;
+    struct dirent *de;
+    while (!found && (de = readdir(proc)) != NULL) {
+        if (!isdigit((unsigned char)de->d_name[0])) {
+            continue;
+        }
+        char path[64];
+        char comm[32] = {0};
+        snprintf(path, sizeof(path), "/proc/%d/comm", atoi(de->d_name));
+        FILE *f = fopen(path, "r");
+        if (f) {
+            if (fgets(comm, sizeof(comm), f)) {
+                comm[strcspn(comm, "\n")] = '\0';
+                found = strcmp(comm, "irqbalance") == 0;
+            }
+            fclose(f);
+        }
+    }
+    closedir(proc);
+    return found;
+}
+
+/*
+ * Per-IRQ rates over interval_ms, or since the previous READ-IRQS when
+ * interval_ms is 0 (server modes; the GUI polls this). p_rate counts the
+ * interrupts that landed on P-cores.
+ */
+static int cmd_read_irqs(int interval_ms) {
+    char err[256] = {0};
+    if (interval_ms > 0 || !irq_prev_valid) {
+        if (ld_irq_read(&irq_prev, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+        irq_prev_valid = true;
+        if (interval_ms > 0) {
+            usleep((useconds_t)interval_ms * 1000);
+        }
+    }
+    struct ld_irq_table cur;
+    ld_irq_table_init(&cur);
+    if (ld_irq_read(&cur, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        ld_irq_table_free(&cur);
+        return 1;
+    }
+    struct ld_cpu_list p_list, e_list, u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
+    int supports = 0;
+    ld_enumerate_cpus(&p_list, &e_list, &u_list, &supports);
+    bool hybrid = supports && e_list.count > 0;
+    struct irq_saved *saved = NULL;
+    size_t saved_count = irq_saved_load(&saved);
+
+    double dt = cur.t_ns > irq_prev.t_ns ? (double)(cur.t_ns - irq_prev.t_ns) / 1e9 : 0.0;
+    printf("IRQ_INTERVAL_MS=%.0f\n", dt * 1e3);
+    printf("IRQBALANCE_RUNNING=%d\n", irqbalance_running() ? 1 : 0);
+    for (size_t i = 0; i < cur.count; i++) {
+        const struct ld_irq *e = &cur.irqs[i];
+        const struct ld_irq *prev = ld_irq_find(&irq_prev, e->irq);
+        double rate = dt > 0.0 ? (double)ld_irq_delta(prev, e, NULL) / dt : 0.0;
+        // On a non-hybrid part every CPU is a P-core and the split says nothing.
+        double p_rate = dt > 0.0 && hybrid ? (double)ld_irq_delta(prev, e, &p_list) / dt : 0.0;
+        printf("IRQ_%zu=irq=%d,rate=%.1f,p_rate=%.1f,total=%" PRIu64 ",affinity=%s,steered=%d,name=%s\n", i, e->irq,
+               rate, p_rate, e->total, e->affinity[0] ? e->affinity : "-",
+               irq_saved_find(saved, saved_count, e->irq) ? 1 : 0, e->name);
+    }
+    printf("IRQ_COUNT=%zu\n", cur.count);
+    free(saved);
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
+
+    ld_irq_table_free(&irq_prev);
+    irq_prev = cur;
+    return 0;
+}
+
+/* target: P, E or an explicit CPU list; patterns: IRQ numbers or name substrings, none means all. */
+static int cmd_steer_irqs(const char *target, char **patterns, int npatterns) {
+    char list[1024];
+    enum ld_core_class cls;
+    char err[256] = {0};
+    if (ld_core_class_parse(target, &cls) == 0) {
+        struct ld_cpu_list cpus;
+        ld_cpu_list_init(&cpus);
+        int rc = ld_core_class_cpus(cls, &cpus, err, sizeof(err));
+        ld_cpu_list_format(&cpus, list, sizeof(list));
+        ld_cpu_list_free(&cpus);
+        if (rc != 0) {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+    } else if (target[0] && strspn(target, "0123456789,-") == strlen(target)) {
+        snprintf(list, sizeof(list), "%s", target);
+    } else {
+        fprintf(stderr, "Invalid IRQ target: %s (expected P, E, favored or a CPU list)\n", target);
+        return 2;
+    }
+
+    struct ld_irq_table t;
+    ld_irq_table_init(&t);
+    if (ld_irq_read(&t, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    }
+    struct irq_saved *saved = NULL;
+    size_t saved_count = irq_saved_load(&saved);
+    size_t steered = 0;
+    size_t skipped = 0;
+    int rc = 0;
+    for (size_t i = 0; i < t.count; i++) {
+        const struct ld_irq *e = &t.irqs[i];
+        bool match = npatterns == 0;
+        for (int k = 0; k < npatterns && !match; k++) {
+            match = ld_irq_matches(e, patterns[k]);
+        }
+        if (!match || !e->affinity[0]) {
+            continue;
+        }
+        int res = ld_irq_set_affinity(e->irq, list, err, sizeof(err));
+        if (res == 0) {
+            if (!irq_saved_find(saved, saved_count, e->irq)) {
+                struct irq_saved *grown = realloc(saved, (saved_count + 1) * sizeof(*grown));
+                if (grown) {
+                    saved = grown;
+                    saved[saved_count].irq = e->irq;
+                    snprintf(saved[saved_count].list, sizeof(saved[saved_count].list), "%s", e->affinity);
+                    saved_count++;
+                }
+            }
+            printf("IRQ_STEERED_%zu=irq=%d,from=%s,to=%s,name=%s\n", steered++, e->irq, e->affinity, list, e->name);
+        } else if (res == 1) {
+            printf("IRQ_SKIPPED_%zu=irq=%d,reason=%s,name=%s\n", skipped++, e->irq, "managed", e->name);
+        } else {
+            fprintf(stderr, "%s\n", err);
+            rc = 1;
+        }
+    }
+    irq_saved_store(saved, saved_count);
+    free(saved);
+    ld_irq_table_free(&t);
+    if (steered == 0 && skipped == 0 && rc == 0) {
+        fprintf(stderr, "No IRQ matches\n");
+        return 1;
+    }
+    printf("IRQ_STEERED_COUNT=%zu\n", steered);
+    printf("IRQ_SKIPPED_COUNT=%zu\n", skipped);
+    if (irqbalance_running()) {
+        printf("IRQBALANCE_RUNNING=1\n");
+    }
+    if (rc == 0) {
+        printf("OK\n");
+    }
+    return rc;
+}
+
+static int cmd_restore_irqs(void) {
+    struct irq_saved *saved = NULL;
+    size_t count = irq_saved_load(&saved);
+    size_t restored = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        char err[256] = {0};
+        int res = ld_irq_set_affinity(saved[i].irq, saved[i].list, err, sizeof(err));
+        if (res == 0) {
+            restored++;
+        } else if (res < 0) {
+            // Keep it recorded so a later RESTORE-IRQS can retry.
+            fprintf(stderr, "%s\n", err);
+            saved[kept++] = saved[i];
+        }
+    }
+    irq_saved_store(saved, kept);
+    free(saved);
+    printf("IRQ_RESTORED=%zu\n", restored);
+    if (kept != 0) {
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
+
+/*
+ * Per-cgroup power and budgets. Every watched cgroup is charged from the
+ * same per-CPU energy sample; budgets take one feedback step per sample.
+ * Samples are taken before commands (at most every BUDGET_PERIOD_MS) and,
+ * while a budget is set, from the server's idle timeout. Errors are kept
+ * per cgroup and reported by READ-CGROUP-POWER, since a sample can run
+ * inside an unrelated command.
+ */
+struct cgroup_watch {
+    struct ld_budget b;
+    char error[192];
+};
+
+static struct cgroup_watch cgroup_watches[MAX_CGROUP_WATCHES];
+static size_t cgroup_watch_count;
+static struct ld_cpu_energy cgroup_energy;
+static char cgroup_energy_error[192];
+static double cgroup_last_tick_s;
+
+static struct cgroup_watch *cgroup_watch_get(const char *cgroup, bool create) {
+    while (*cgroup == '/') {
+        cgroup++;
+    }
+    for (size_t i = 0; i < cgroup_watch_count; i++) {
+        if (strcmp(cgroup_watches[i].b.cgroup, cgroup) == 0) {
+            return &cgroup_watches[i];
+        }
+    }
+    if (!create || cgroup_watch_count == MAX_CGROUP_WATCHES) {
+        return NULL;
+    }
+    struct cgroup_watch *w = &cgroup_watches[cgroup_watch_count++];
+    ld_budget_init(&w->b, cgroup);
+    w->error[0] = '\0';
+    return w;
+}
+
+static bool budgets_active(void) {
+    for (size_t i = 0; i < cgroup_watch_count; i++) {
+        if (cgroup_watches[i].b.mode != LD_BUDGET_WATCH) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The first level below the cgroup root, as a default view. */
+static void cgroup_watch_defaults(void) {
+    DIR *dir = opendir(LD_CGROUP_ROOT);
+    if (!dir) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        uint64_t usage = 0;
+        if (de->d_name[0] != '.' && ld_cgroup_usage_usec(de->d_name, &usage) == 0) {
+            cgroup_watch_get(de->d_name, true);
+        }
+    }
+    closedir(dir);
+}
+
+static int apply_budget(struct cgroup_watch *w, char *err, size_t err_sz) {
+    if (w->b.mode == LD_BUDGET_QUOTA) {
+        return ld_budget_write_quota(&w->b, err, err_sz);
+    }
+    enum ld_ratio_path path;
+    if (ratio_path(&path) != 0 || apply_ratio_list(&w->b.cpus, (uint8_t)w->b.ratio, path) != 0) {
+        snprintf(err, err_sz, "%.128s: ratio x%d write failed", w->b.cgroup, w->b.ratio);
+        return -1;
+    }
+    return 0;
+}
+
+/* Undoes what a budget wrote: the saved cpu.max, or the ratio from before the budget. */
+static void release_budget(struct cgroup_watch *w) {
+    char err[256] = {0};
+    if (w->b.mode == LD_BUDGET_QUOTA && ld_budget_restore_quota(&w->b, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Restoring cpu.max of %s failed: %s\n", w->b.cgroup, err);
+    }
+    if (w->b.mode == LD_BUDGET_RATIO && w->b.ratio != w->b.ratio_max) {
+        w->b.ratio = w->b.ratio_max;
+        if (apply_budget(w, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s\n", err);
+        }
+    }
+    w->b.mode = LD_BUDGET_WATCH;
+    w->b.budget_w = 0.0;
+}
+
+static void restore_budgets_here(void) {
+    for (size_t i = 0; i < cgroup_watch_count; i++) {
+        release_budget(&cgroup_watches[i]);
+    }
+}
+
+static void cgroup_tick(double min_ms) {
+    double now_s = monotonic_s();
+    if (cgroup_watch_count == 0 || (now_s - cgroup_last_tick_s) * 1e3 < min_ms) {
+        return;
+    }
+    cgroup_last_tick_s = now_s;
+    cgroup_energy_error[0] = '\0';
+    if (ld_cpu_energy_sample(&cgroup_energy, cgroup_energy_error, sizeof(cgroup_energy_error)) != 0) {
+        return;
+    }
+    for (size_t i = 0; i < cgroup_watch_count; i++) {
+        struct cgroup_watch *w = &cgroup_watches[i];
+        w->error[0] = '\0';
+        if (ld_budget_update(&w->b, &cgroup_energy, w->error, sizeof(w->error)) != 0) {
+            continue;
+        }
+        if (ld_budget_step(&w->b)) {
+            apply_budget(w, w->error, sizeof(w->error));
+        }
+    }
+}
+
+static void print_cgroup_watch(size_t idx, const struct cgroup_watch *w) {
+    char limit[32] = "-";
+    if (w->b.mode == LD_BUDGET_QUOTA) {
+        if (w->b.quota_us < 0) {
+            snprintf(limit, sizeof(limit), "max");
+        } else {
+            snprintf(limit, sizeof(limit), "%.0f%%", 100.0 * (double)w->b.quota_us / (double)w->b.period_us);
+        }
+    } else if (w->b.mode == LD_BUDGET_RATIO) {
+        snprintf(limit, sizeof(limit), "x%d", w->b.ratio);
+    }
+    printf("CGROUP_%zu=valid=%d,watts=%.2f,avg_w=%.2f,cpu_load=%.3f,cpus=%zu,mode=%s,budget_w=%.1f,limit=%s,cgroup=%s\n",
+           idx, w->b.valid, w->b.watts, w->b.watts_avg, w->b.cpu_load, w->b.cpus.count,
+           ld_budget_mode_name(w->b.mode), w->b.budget_w, limit, w->b.cgroup[0] ? w->b.cgroup : "/");
+    if (w->error[0]) {
+        printf("CGROUP_ERROR_%zu=%s\n", idx, w->error);
+    }
+}
+
+static void print_cgroup_power(void) {
+    if (cgroup_energy_error[0]) {
+        printf("CGPOWER_ERROR=%s\n", cgroup_energy_error);
+    }
+    printf("CGPOWER_WEIGHT=%s\n", ld_energy_weight_name(cgroup_energy.weight));
+    printf("CGPOWER_INTERVAL_MS=%.0f\n", cgroup_energy.dt_s * 1e3);
+    printf("CGPOWER_PKG_W=%.2f\n", cgroup_energy.dt_s > 0.0 ? cgroup_energy.pkg_j / cgroup_energy.dt_s : 0.0);
+    for (size_t i = 0; i < cgroup_watch_count; i++) {
+        print_cgroup_watch(i, &cgroup_watches[i]);
+    }
+    printf("CGROUP_COUNT=%zu\n", cgroup_watch_count);
+}
+
+/*
+ * Adds the named cgroups (none: the first level below the root) to the
+ * watch list and reports every watched cgroup. interval_ms > 0 takes two
+ * samples that far apart; 0 reports the latest sample (server modes).
+ */
+static int cmd_read_cgroup_power(char **cgroups, int count, int interval_ms) {
+    for (int i = 0; i < count; i++) {
+        if (!cgroup_watch_get(cgroups[i], true)) {
+            fprintf(stderr, "Too many cgroups (at most %d)\n", MAX_CGROUP_WATCHES);
+            return 2;
+        }
+    }
+    if (cgroup_watch_count == 0) {
+        cgroup_watch_defaults();
+    }
+    if (cgroup_watch_count == 0) {
+        fprintf(stderr, "No cgroup v2 hierarchy with cpu.stat under %s\n", LD_CGROUP_ROOT);
+        return 1;
+    }
+    if (interval_ms > 0) {
+        cgroup_tick(0);
+        usleep((useconds_t)interval_ms * 1000);
+        cgroup_tick(0);
+    } else {
+        // Callers poll about once per period; do not skip a sample over timer jitter.
+        cgroup_tick(BUDGET_PERIOD_MS / 2);
+    }
+    print_cgroup_power();
+    return cgroup_energy_error[0] ? 1 : 0;
+}
+
+static int cmd_set_cgroup_budget(const char *cgroup, double watts, enum ld_budget_mode mode) {
+    struct cgroup_watch *w = cgroup_watch_get(cgroup, true);
+    if (!w) {
+        fprintf(stderr, "Too many cgroups (at most %d)\n", MAX_CGROUP_WATCHES);
+        return 2;
+    }
+    uint64_t usage = 0;
+    if (!w->b.cgroup[0] || ld_cgroup_usage_usec(w->b.cgroup, &usage) != 0) {
+        fprintf(stderr, "%s: not a cgroup v2 group below %s\n", cgroup, LD_CGROUP_ROOT);
+        return 1;
+    }
+    if (w->b.mode != mode) {
+        release_budget(w);
+    }
+    if (mode == LD_BUDGET_QUOTA && w->b.mode != LD_BUDGET_QUOTA) {
+        // Start from the quota the cgroup has now; it is also the ceiling and what release writes back.
+        if (ld_budget_quota_load(&w->b) != 0) {
+            fprintf(stderr, "%s: no cpu.max (enable the cpu controller in the parent)\n", w->b.cgroup);
+            return 1;
+        }
+    } else if (mode == LD_BUDGET_RATIO && w->b.mode != LD_BUDGET_RATIO) {
+        enum ld_ratio_path path;
+        uint8_t ratio = 0;
+        w->b.cpus.count = 0;
+        if (ld_cgroup_effective_cpus(w->b.cgroup, &w->b.cpus) != 0 || w->b.cpus.count == 0 ||
+            ratio_path(&path) != 0 || target_ratio(w->b.cpus.ids[0], path, &ratio) != 0 || ratio == 0) {
+            fprintf(stderr, "%s: cannot read the current ratio of its CPUs\n", w->b.cgroup);
+            return 1;
+        }
+        w->b.ratio = ratio;
+        w->b.ratio_max = ratio;
+    }
+    w->b.mode = mode;
+    w->b.budget_w = mode == LD_BUDGET_WATCH ? 0.0 : watts;
+    printf("CGROUP_BUDGET=cgroup=%s,mode=%s,budget_w=%.1f\n", w->b.cgroup, ld_budget_mode_name(mode), w->b.budget_w);
+    printf("OK\n");
+    return 0;
+}
+
+static int cmd_clear_cgroup_budget(const char *cgroup) {
+    if (strcasecmp(cgroup, "all") == 0) {
+        restore_budgets_here();
+    } else {
+        struct cgroup_watch *w = cgroup_watch_get(cgroup, false);
+        if (!w) {
+            fprintf(stderr, "%s: no budget\n", cgroup);
+            return 1;
+        }
+        release_budget(w);
+    }
+    printf("OK\n");
+    return 0;
+}
+
+/*
+ * Running per-CPU energy for clients that attribute it themselves (ldctl
+ * energy). Sums only grow, so any number of clients can diff their own
+ * samples without resetting each other's intervals.
+ */
+static struct ld_cpu_energy cpu_energy_sums;
+
+static int cmd_read_cpu_energy(int interval_ms) {
+    char err[256] = {0};
+    if (ld_cpu_energy_sample(&cpu_energy_sums, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    }
+    if (interval_ms > 0) {
+        usleep((useconds_t)interval_ms * 1000);
+        if (ld_cpu_energy_sample(&cpu_energy_sums, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+    }
+    const struct ld_cpu_energy *e = &cpu_energy_sums;
+    printf("CPU_ENERGY_T_NS=%" PRIu64 "\n", e->t_ns);
+    printf("CPU_ENERGY_WEIGHT=%s\n", ld_energy_weight_name(e->weight));
+    printf("CPU_ENERGY_PKG_J=%.6f\n", e->pkg_total_j);
+    size_t count = 0;
+    for (int cpu = 0; cpu < e->cpu_count; cpu++) {
+        if (e->seen[cpu]) {
+            printf("CPU_ENERGY_%zu=cpu=%d,joules=%.6f\n", count++, cpu, e->total_j[cpu]);
+        }
+    }
+    printf("CPU_ENERGY_COUNT=%zu\n", count);
+    return 0;
+}
+
+static int cmd_read_pstate(void) {
+    char err[256] = {0};
+    struct ld_cpufreq *cf = ld_cpufreq_shared(err, sizeof(err));
+    if (!cf) {
+        fprintf(stderr, "%s\n", err[0] ? err : "cpufreq unavailable");
+        return 1;
+    }
+    enum ld_ratio_path ratio;
+    int ratio_ok = ld_ratio_select(cf, ratio_want, &ratio, NULL, 0) == 0;
+    printf("RATIO_PATH=%s\n", ratio_ok ? ld_ratio_path_name(ratio) : "none");
+    printf("PSTATE_MODE=%s\n", ld_pstate_mode_name(cf->mode));
+    printf("PSTATE_HWP=%d\n", cf->hwp);
+    printf("CPUFREQ_DRIVER=%s\n", cf->driver);
+    printf("CPUFREQ_GOVERNOR=%s\n", cf->governor);
+    // Missing knobs are reported as -1 so the set of keys stays fixed.
+    printf("PSTATE_MAX_PERF_PCT=%d\n", ld_pstate_read(cf, LD_PSTATE_MAX_PERF_PCT));
+    printf("PSTATE_MIN_PERF_PCT=%d\n", ld_pstate_read(cf, LD_PSTATE_MIN_PERF_PCT));
+    printf("PSTATE_NO_TURBO=%d\n", ld_pstate_read(cf, LD_PSTATE_NO_TURBO));
+    size_t idx = 0;
+    for (size_t cpu = 0; cpu < cf->cpu_count; cpu++) {
+        uint32_t min_khz = 0;
+        uint32_t max_khz = 0;
+        if (!ld_cpufreq_has_cpu(cf, (int)cpu) || ld_cpufreq_read(cf, (int)cpu, &min_khz, &max_khz) != 0) {
+            continue;
+        }
+        printf("CPUFREQ_%zu=cpu=%zu,min_khz=%u,max_khz=%u,cpuinfo_min_khz=%u,cpuinfo_max_khz=%u\n",
+               idx++, cpu, min_khz, max_khz, cf->cpus[cpu].cpuinfo_min_khz, cf->cpus[cpu].cpuinfo_max_khz);
+    }
+    printf("CPUFREQ_COUNT=%zu\n", idx);
+    return 0;
+}
+
+/* Applies knob=value pairs in the given order; stops at the first failure. */
+static int cmd_set_pstate(char **pairs, int count) {
+    char err[256] = {0};
+    struct ld_cpufreq *cf = ld_cpufreq_shared(err, sizeof(err));
+    if (!cf) {
+        fprintf(stderr, "%s\n", err[0] ? err : "cpufreq unavailable");
+        return 1;
+    }
+    if (cf->mode == LD_PSTATE_NONE) {
+        fprintf(stderr, "intel_pstate is not loaded\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        char name[32];
+        const char *eq = strchr(pairs[i], '=');
+        size_t len = eq ? (size_t)(eq - pairs[i]) : 0;
+        int value = 0;
+        if (!eq || len >= sizeof(name) || !parse_int(eq + 1, &value)) {
+            fprintf(stderr, "Invalid pstate setting: %s\n", pairs[i]);
+            return 2;
+        }
+        memcpy(name, pairs[i], len);
+        name[len] = '\0';
+        int knob = ld_pstate_knob_find(name);
+        int max = knob == LD_PSTATE_NO_TURBO ? 1 : 100;
+        if (knob < 0 || value < 0 || value > max) {
+            fprintf(stderr, "Invalid pstate setting: %s\n", pairs[i]);
+            return 2;
+        }
+        if (ld_pstate_write(cf, (enum ld_pstate_knob)knob, value, err, sizeof(err)) != 0) {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+    }
+    printf("OK\n");
+    return 0;
+}
+
+/* Throttle counters stay open across READ-CORE-SENSORS calls (server and socket mode). */
+static struct ld_throttle_table throttles;
+
+/* pkg_msr: CPU 0's entry holding the package log-bit count when there is no sysfs, else NULL. */
+static void print_throttle(const struct ld_throttle_cpu *thr, const struct ld_throttle_cpu *pkg_msr) {
+    if (!thr || !thr->have) {
+        return;
+    }
+    printf(",thr_src=%s", thr->from_msr ? "msr" : "sysfs");
+    for (int k = 0; k < LD_THROTTLE_COUNTER_COUNT; k++) {
+        const struct ld_throttle_cpu *src = thr->from_msr && k == LD_THROTTLE_PKG_EVENTS && pkg_msr ? pkg_msr : thr;
+        if (src->have & (1u << k)) {
+            printf(",%s=%" PRIu64, ld_throttle_counter_name((enum ld_throttle_counter)k), src->values[k]);
+        }
+    }
+}
+
+static void print_core_sensors(const struct ld_cpu_list *list, const char *type, size_t *idx,
+                               const struct ld_throttle_cpu *pkg_msr) {
+    if (list->count == 0) {
+        return;
+    }
+    // One PERF_STATUS + THERM_STATUS pair per CPU, read through the cached handles.
+    struct ld_msr_op *ops = calloc(list->count * 2, sizeof(*ops));
+    if (ops) {
+        for (size_t i = 0; i < list->count; i++) {
+            ops[i * 2].cpu = list->ids[i];
+            ops[i * 2].reg = LD_MSR_PERF_STATUS;
+            ops[i * 2 + 1].cpu = list->ids[i];
+            ops[i * 2 + 1].reg = LD_MSR_THERM_STATUS;
+        }
+        (void)ld_msr_read_batch(ops, list->count * 2);
+    }
+    for (size_t i = 0; i < list->count; i++, (*idx)++) {
+        unsigned int ratio = 0;
+        unsigned int vid = 0;
+        uint64_t thermal = 0;
+        if (ops && ops[i * 2].ok) {
+            ratio = (unsigned int)LD_FIELD_GET(ops[i * 2].value, LD_PERF_STATUS_RATIO);
+            vid = (unsigned int)LD_FIELD_GET(ops[i * 2].value, LD_PERF_STATUS_VID);
+        }
+        if (ops && ops[i * 2 + 1].ok) {
+            thermal = ops[i * 2 + 1].value;
+        }
+        struct ld_throttle_cpu *thr = ld_throttle_cpu(&throttles, list->ids[i]);
+        if (thr && ld_throttle_read(thr) != 0 && ops && ops[i * 2 + 1].ok) {
+            (void)ld_throttle_msr_log(thr, 0, thermal);
+        }
+        printf("CORE_SENSOR_%zu=cpu=%d,type=%s,ratio=%u,thermal=0x%016" PRIx64 ",vid=%u",
+               *idx,
+               list->ids[i],
+               type,
+               ratio,
+               thermal,
+               vid);
+        print_throttle(thr, pkg_msr);
+        printf("\n");
+    }
+    free(ops);
+}
+
 static int cmd_read_core_sensors(void) {
-    struct cpu_list p_list;
-    struct cpu_list e_list;
-    struct cpu_list u_list;
-    cpu_list_init(&p_list);
-    cpu_list_init(&e_list);
-    cpu_list_init(&u_list);
+    struct ld_cpu_list p_list;
+    struct ld_cpu_list e_list;
+    struct ld_cpu_list u_list;
+    ld_cpu_list_init(&p_list);
+    ld_cpu_list_init(&e_list);
+    ld_cpu_list_init(&u_list);
     int core_type_ok = 0;
-    if (enumerate_cpus(&p_list, &e_list, &u_list, &core_type_ok) != 0) {
+    if (ld_enumerate_cpus(&p_list, &e_list, &u_list, &core_type_ok) != 0) {
         fprintf(stderr, "Failed to enumerate CPUs\n");
-        cpu_list_free(&p_list);
-        cpu_list_free(&e_list);
-        cpu_list_free(&u_list);
+        ld_cpu_list_free(&p_list);
+        ld_cpu_list_free(&e_list);
+        ld_cpu_list_free(&u_list);
         return 1;
     }
 
+    // SMIs ride along with every sensor sample so callers get a per-interval rate without another round trip.
+    uint64_t smi = 0;
+    int smi_ok = ld_msr_read(0, LD_MSR_SMI_COUNT, &smi) == 0;
+    printf("SMI_COUNT_VALID=%d\n", smi_ok);
+    printf("SMI_COUNT=%u\n", (unsigned int)LD_FIELD_GET(smi, LD_SMI_COUNT));
+
+    // Without the kernel's thermal_throttle files the package count comes from the package log bits, kept on CPU 0's entry.
+    struct ld_throttle_cpu *pkg_msr = ld_throttle_cpu(&throttles, 0);
+    uint64_t pkg_therm = 0;
+    if (pkg_msr && (pkg_msr->fds[LD_THROTTLE_CORE_EVENTS] >= 0 ||
+                    ld_msr_read(0, LD_MSR_PACKAGE_THERM_STATUS, &pkg_therm) != 0)) {
+        pkg_msr = NULL;
+    }
+    if (pkg_msr) {
+        (void)ld_throttle_msr_log(pkg_msr, 1, pkg_therm);
+    }
+
     size_t total = p_list.count + e_list.count + u_list.count;
     printf("CORE_SENSOR_COUNT=%zu\n", total);
 
     size_t idx = 0;
-    for (size_t i = 0; i < p_list.count; i++, idx++) {
-        int cpu = p_list.ids[i];
-        uint8_t ratio = 0;
-        uint64_t thermal = 0;
-        int ratio_ok = read_ratio_current_on_cpu(cpu, &ratio) == 0;
-        int thermal_ok = read_thermal_status_on_cpu(cpu, &thermal) == 0;
-        printf("CORE_SENSOR_%zu=cpu=%d,type=P,ratio=%u,thermal=0x%016" PRIx64 "\n",
-               idx,
-               cpu,
-               ratio_ok ? (unsigned int)ratio : 0u,
-               thermal_ok ? thermal : (uint64_t)0);
-        (void)ratio_ok;
-        (void)thermal_ok;
-    }
-    for (size_t i = 0; i < e_list.count; i++, idx++) {
-        int cpu = e_list.ids[i];
-        uint8_t ratio = 0;
-        uint64_t thermal = 0;
-        int ratio_ok = read_ratio_current_on_cpu(cpu, &ratio) == 0;
-        int thermal_ok = read_thermal_status_on_cpu(cpu, &thermal) == 0;
-        printf("CORE_SENSOR_%zu=cpu=%d,type=E,ratio=%u,thermal=0x%016" PRIx64 "\n",
-               idx,
-               cpu,
-               ratio_ok ? (unsigned int)ratio : 0u,
-               thermal_ok ? thermal : (uint64_t)0);
-        (void)ratio_ok;
-        (void)thermal_ok;
-    }
-    for (size_t i = 0; i < u_list.count; i++, idx++) {
-        int cpu = u_list.ids[i];
-        uint8_t ratio = 0;
-        uint64_t thermal = 0;
-        int ratio_ok = read_ratio_current_on_cpu(cpu, &ratio) == 0;
-        int thermal_ok = read_thermal_status_on_cpu(cpu, &thermal) == 0;
-        printf("CORE_SENSOR_%zu=cpu=%d,type=U,ratio=%u,thermal=0x%016" PRIx64 "\n",
-               idx,
-               cpu,
-               ratio_ok ? (unsigned int)ratio : 0u,
-               thermal_ok ? thermal : (uint64_t)0);
-        (void)ratio_ok;
-        (void)thermal_ok;
-    }
-
-    cpu_list_free(&p_list);
-    cpu_list_free(&e_list);
-    cpu_list_free(&u_list);
+    print_core_sensors(&p_list, "P", &idx, pkg_msr);
+    print_core_sensors(&e_list, "E", &idx, pkg_msr);
+    print_core_sensors(&u_list, "U", &idx, pkg_msr);
+
+    ld_cpu_list_free(&p_list);
+    ld_cpu_list_free(&e_list);
+    ld_cpu_list_free(&u_list);
+    return 0;
+}
+
+/*
+ * Ratio and temperature residency: started by the first READ-RESIDENCY, then
+ * sampled every RESIDENCY_SAMPLE_MS from the server's poll timeout and before
+ * every command. The CPU list is fixed at start; RESET-RESIDENCY only zeroes
+ * the histograms.
+ */
+static struct ld_residency residency;
+static bool residency_active = false;
+
+static int residency_start(void) {
+    if (residency_active) {
+        return 0;
+    }
+    struct ld_cpu_list lists[3];
+    const char types[3] = { 'P', 'E', 'U' };
+    for (int k = 0; k < 3; k++) {
+        ld_cpu_list_init(&lists[k]);
+    }
+    int core_type_ok = 0;
+    if (ld_enumerate_cpus(&lists[0], &lists[1], &lists[2], &core_type_ok) != 0) {
+        fprintf(stderr, "Failed to enumerate CPUs\n");
+        for (int k = 0; k < 3; k++) {
+            ld_cpu_list_free(&lists[k]);
+        }
+        return 1;
+    }
+    size_t total = lists[0].count + lists[1].count + lists[2].count;
+    int *cpus = calloc(total ? total : 1, sizeof(*cpus));
+    char *cpu_types = calloc(total ? total : 1, 1);
+    size_t n = 0;
+    for (int k = 0; cpus && cpu_types && k < 3; k++) {
+        for (size_t i = 0; i < lists[k].count; i++, n++) {
+            cpus[n] = lists[k].ids[i];
+            cpu_types[n] = types[k];
+        }
+    }
+    int rc = cpus && cpu_types ? ld_residency_init(&residency, cpus, cpu_types, total, monotonic_s()) : -1;
+    free(cpus);
+    free(cpu_types);
+    for (int k = 0; k < 3; k++) {
+        ld_cpu_list_free(&lists[k]);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Out of memory for residency histograms\n");
+        return 1;
+    }
+    residency_active = true;
+    (void)ld_residency_sample(&residency, monotonic_s());
+    return 0;
+}
+
+static void residency_tick(void) {
+    double now_s = monotonic_s();
+    if (residency_active && (now_s - residency.last_s) * 1e3 >= RESIDENCY_SAMPLE_MS) {
+        (void)ld_residency_sample(&residency, now_s);
+    }
+}
+
+/* "bin:seconds;..." for the non-empty bins; scale turns a bin index into its label. */
+static void print_residency_bins(const char *key, const double *bins, int count, int scale) {
+    printf(",%s=", key);
+    bool first = true;
+    for (int i = count - 1; i >= 0; i--) {
+        if (bins[i] <= 0.0) {
+            continue;
+        }
+        printf("%s%d:%.2f", first ? "" : ";", i * scale, bins[i]);
+        first = false;
+    }
+}
+
+static int cmd_read_residency(void) {
+    if (residency_start() != 0) {
+        return 1;
+    }
+    residency_tick();
+    printf("RESIDENCY_ELAPSED_S=%.1f\n", monotonic_s() - residency.start_s);
+    printf("RESIDENCY_SAMPLES=%" PRIu64 "\n", residency.samples);
+    printf("RESIDENCY_SAMPLE_MS=%d\n", RESIDENCY_SAMPLE_MS);
+    printf("RESIDENCY_TEMP_BAND_C=%d\n", LD_RESIDENCY_BAND_C);
+    printf("RESIDENCY_TJMAX=%u\n", residency.tjmax_c);
+    printf("RESIDENCY_CPU_COUNT=%zu\n", residency.count);
+    for (size_t i = 0; i < residency.count; i++) {
+        const struct ld_residency_cpu *c = &residency.cpus[i];
+        printf("RESIDENCY_CPU_%zu=cpu=%d,type=%c,total_s=%.2f,ratio=%d", i, c->cpu, c->type, c->total_s, c->ratio);
+        print_residency_bins("ratios", c->ratio_s, LD_RESIDENCY_RATIOS, 1);
+        print_residency_bins("temps", c->band_s, LD_RESIDENCY_BANDS, LD_RESIDENCY_BAND_C);
+        printf("\n");
+    }
+    return 0;
+}
+
+static int cmd_reset_residency(void) {
+    if (residency_start() != 0) {
+        return 1;
+    }
+    ld_residency_reset(&residency, monotonic_s());
+    printf("OK\n");
+    return 0;
+}
+
+static int cmd_watch_residency(int seconds) {
+    if (residency_start() != 0) {
+        return 1;
+    }
+    double end_s = monotonic_s() + seconds;
+    while (monotonic_s() < end_s) {
+        usleep(RESIDENCY_SAMPLE_MS * 1000);
+        residency_tick();
+    }
+    return cmd_read_residency();
+}
+
+/*
+ * Energy ledger (ld_ledger.h). Only the socket daemon records: it loads the
+ * state file at start, samples package and DRAM energy every
+ * LEDGER_SAMPLE_MS from its poll loop and checkpoints every
+ * LEDGER_CHECKPOINT_S and on exit. Other modes report the last checkpoint.
+ * SET-PROFILE from any mode writes the active profile file, which the
+ * daemon picks up on its next sample, so the GUI's own helper can switch
+ * the attribution too.
+ */
+static struct ld_ledger ledger;
+static bool ledger_recording = false;
+static double ledger_last_sample_s;
+static double ledger_last_save_s;
+static struct timespec ledger_profile_mtime;
+static const char *ledger_pkg_source = "none";
+static bool ledger_dram_valid = false;
+
+static void state_path(char *out, size_t out_sz, const char *file) {
+    const char *dir = getenv("LIMITS_HELPER_STATE_DIR");
+    snprintf(out, out_sz, "%s/%s", dir && *dir ? dir : DEFAULT_STATE_DIR, file);
+}
+
+/* Name from the active profile file; -1 when there is none or it holds no valid name. */
+static int read_active_profile(char *name, size_t name_sz, struct timespec *mtime) {
+    char path[512];
+    state_path(path, sizeof(path), LEDGER_PROFILE_FILE);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    struct stat st;
+    if (mtime && fstat(fileno(f), &st) == 0) {
+        *mtime = st.st_mtim;
+    }
+    int rc = fgets(name, (int)name_sz, f) ? 0 : -1;
+    fclose(f);
+    if (rc == 0) {
+        name[strcspn(name, "\r\n")] = '\0';
+        rc = ld_ledger_valid_name(name) ? 0 : -1;
+    }
+    return rc;
+}
+
+static void ledger_pick_up_profile(void) {
+    char path[512];
+    state_path(path, sizeof(path), LEDGER_PROFILE_FILE);
+    struct stat st;
+    if (stat(path, &st) != 0 ||
+        (st.st_mtim.tv_sec == ledger_profile_mtime.tv_sec && st.st_mtim.tv_nsec == ledger_profile_mtime.tv_nsec)) {
+        return;
+    }
+    char name[LD_LEDGER_NAME_MAX];
+    if (read_active_profile(name, sizeof(name), &ledger_profile_mtime) == 0) {
+        int p = ld_ledger_profile(&ledger, name);
+        if (p != ledger.active) {
+            ledger.active = p;
+            ledger.dirty = 1;
+        }
+    }
+}
+
+/* Charges the energy since the previous sample to the profile active until now, then follows a profile switch. */
+static void ledger_sample(double now_s) {
+    int32_t day = ld_ledger_local_day((int64_t)time(NULL));
+    ledger_last_sample_s = now_s;
+    struct ld_powercap *pc = ld_powercap_shared(NULL, 0);
+    struct ld_powercap_zone *pkg = pc ? ld_powercap_package(pc) : NULL;
+    struct ld_powercap_zone *dram = pc ? ld_powercap_find(pc, "dram") : NULL;
+    uint64_t raw = 0;
+    static struct ld_rapl_units units;
+    static int units_ok = -1;
+    if (pkg && pkg->has_energy && ld_powercap_read_energy_uj(pkg, &raw) == 0) {
+        ld_ledger_observe(&ledger, LD_LEDGER_PKG, raw, pkg->max_energy_range_uj, 1.0, now_s, day);
+        ledger_pkg_source = "powercap";
+    } else {
+        if (units_ok < 0) {
+            units_ok = ld_rapl_units_read(&units) == 0;
+        }
+        if (units_ok && ld_msr_read(0, LD_MSR_PKG_ENERGY_STATUS, &raw) == 0) {
+            ld_ledger_observe(&ledger, LD_LEDGER_PKG, LD_FIELD_GET(raw, LD_PKG_ENERGY_STATUS_ENERGY),
+                              UINT64_C(1) << 32, units.energy_unit_j * 1e6, now_s, day);
+            ledger_pkg_source = "msr";
+        }
+    }
+    ledger_dram_valid = dram && dram->has_energy && ld_powercap_read_energy_uj(dram, &raw) == 0;
+    if (ledger_dram_valid) {
+        ld_ledger_observe(&ledger, LD_LEDGER_DRAM, raw, dram->max_energy_range_uj, 1.0, now_s, day);
+    }
+    ledger_pick_up_profile();
+}
+
+static void ledger_checkpoint(void) {
+    char path[512];
+    char err[256] = {0};
+    state_path(path, sizeof(path), LEDGER_STATE_FILE);
+    ledger_last_save_s = monotonic_s();
+    if (ld_ledger_save(&ledger, path, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Energy ledger checkpoint failed: %s\n", err);
+    }
+}
+
+static void ledger_start(void) {
+    char path[512];
+    char err[256] = {0};
+    state_path(path, sizeof(path), LEDGER_STATE_FILE);
+    // A ledger that does not parse is left alone for inspection rather than overwritten with a fresh one.
+    if (ld_ledger_load(&ledger, path, (int64_t)time(NULL), err, sizeof(err)) < 0) {
+        fprintf(stderr, "Energy ledger disabled: %s\n", err);
+        return;
+    }
+    ledger_recording = true;
+    ledger_last_save_s = monotonic_s();
+    ledger_sample(monotonic_s());
+}
+
+/* force: sample now and checkpoint whatever changed (shutdown). */
+static void ledger_tick(bool force) {
+    if (!ledger_recording) {
+        return;
+    }
+    double now_s = monotonic_s();
+    if (force || (now_s - ledger_last_sample_s) * 1e3 >= LEDGER_SAMPLE_MS) {
+        ledger_sample(now_s);
+    }
+    if (ledger.dirty && (force || now_s - ledger_last_save_s >= LEDGER_CHECKPOINT_S)) {
+        ledger_checkpoint();
+    }
+}
+
+static void format_ledger_day(int32_t day, char *out, size_t out_sz) {
+    // Day numbers are local days since the epoch, so the UTC date of their midnight is the local date.
+    time_t t = (time_t)day * 86400;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(out, out_sz, "%Y-%m-%d", &tm);
+}
+
+/* profile -1: every profile (the machine). */
+static void print_ledger_totals(const struct ld_ledger *l, int profile, int32_t today, int32_t week_start) {
+    printf("today_pkg_wh=%.3f,today_dram_wh=%.3f,week_pkg_wh=%.3f,week_dram_wh=%.3f,last_week_pkg_wh=%.3f,"
+           "last_week_dram_wh=%.3f,total_pkg_kwh=%.4f,total_dram_kwh=%.4f\n",
+           ld_ledger_day_uj(l, today, profile, LD_LEDGER_PKG) / 3.6e9,
+           ld_ledger_day_uj(l, today, profile, LD_LEDGER_DRAM) / 3.6e9,
+           ld_ledger_days_uj(l, week_start, today, profile, LD_LEDGER_PKG) / 3.6e9,
+           ld_ledger_days_uj(l, week_start, today, profile, LD_LEDGER_DRAM) / 3.6e9,
+           ld_ledger_days_uj(l, week_start - 7, week_start - 1, profile, LD_LEDGER_PKG) / 3.6e9,
+           ld_ledger_days_uj(l, week_start - 7, week_start - 1, profile, LD_LEDGER_DRAM) / 3.6e9,
+           ld_ledger_total_uj(l, profile, LD_LEDGER_PKG) / 3.6e12,
+           ld_ledger_total_uj(l, profile, LD_LEDGER_DRAM) / 3.6e12);
+}
+
+static int cmd_read_ledger(void) {
+    static struct ld_ledger from_file;
+    const struct ld_ledger *l = &ledger;
+    char path[512];
+    state_path(path, sizeof(path), LEDGER_STATE_FILE);
+    char active[LD_LEDGER_NAME_MAX] = {0};
+    if (ledger_recording) {
+        ledger_sample(monotonic_s());
+        snprintf(active, sizeof(active), "%s", ledger.names[ledger.active]);
+    } else {
+        char err[256] = {0};
+        if (ld_ledger_load(&from_file, path, (int64_t)time(NULL), err, sizeof(err)) < 0) {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+        l = &from_file;
+        if (read_active_profile(active, sizeof(active), NULL) != 0) {
+            snprintf(active, sizeof(active), "%s", from_file.names[from_file.active]);
+        }
+    }
+    int32_t today = ld_ledger_local_day((int64_t)time(NULL));
+    // Day 0 was a Thursday; weeks start on Monday.
+    int32_t week_start = today - (today + 3) % 7;
+    char date[16];
+    printf("LEDGER_RECORDING=%d\n", ledger_recording);
+    printf("LEDGER_STATE=%s\n", path);
+    printf("LEDGER_SINCE=%" PRId64 "\n", l->since);
+    printf("LEDGER_PKG_SOURCE=%s\n", ledger_pkg_source);
+    printf("LEDGER_DRAM_VALID=%d\n", ledger_dram_valid);
+    printf("LEDGER_ACTIVE_PROFILE=%s\n", active);
+    format_ledger_day(today, date, sizeof(date));
+    printf("LEDGER_TODAY=%s\n", date);
+    format_ledger_day(week_start, date, sizeof(date));
+    printf("LEDGER_WEEK_START=%s\n", date);
+    printf("LEDGER_MACHINE=");
+    print_ledger_totals(l, -1, today, week_start);
+    printf("LEDGER_PROFILE_COUNT=%d\n", l->profile_count);
+    for (int i = 0; i < l->profile_count; i++) {
+        printf("LEDGER_PROFILE_%d=name=%s,", i, l->names[i]);
+        print_ledger_totals(l, i, today, week_start);
+    }
+    printf("LEDGER_DAY_COUNT=%d\n", LD_LEDGER_DAYS);
+    for (int i = 0; i < LD_LEDGER_DAYS; i++) {
+        int32_t day = today - i;
+        format_ledger_day(day, date, sizeof(date));
+        printf("LEDGER_DAY_%d=date=%s,pkg_wh=%.3f,dram_wh=%.3f\n", i, date,
+               ld_ledger_day_uj(l, day, -1, LD_LEDGER_PKG) / 3.6e9, ld_ledger_day_uj(l, day, -1, LD_LEDGER_DRAM) / 3.6e9);
+    }
+    return 0;
+}
+
+static int cmd_set_profile(const char *name) {
+    if (!ld_ledger_valid_name(name)) {
+        fprintf(stderr, "Invalid profile name: %s (letters, digits, '.', '_' and '-', up to %d characters)\n", name,
+                LD_LEDGER_NAME_MAX - 1);
+        return 2;
+    }
+    char path[512];
+    char err[640];
+    state_path(path, sizeof(path), LEDGER_PROFILE_FILE);
+    if (ld_ledger_save_name(path, name, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Failed to record the active profile: %s\n", err);
+        return 1;
+    }
+    if (ledger_recording) {
+        ledger_sample(monotonic_s());
+        int p = ld_ledger_profile(&ledger, name);
+        if (p != ledger.active) {
+            ledger.active = p;
+            ledger.dirty = 1;
+        }
+    }
+    printf("LEDGER_ACTIVE_PROFILE=%s\n", name);
+    return 0;
+}
+
+static int cmd_read_package(void) {
+    if (ld_msr_fd(0, 0) < 0) {
+        fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    struct ld_msr_op ops[] = {
+        {0, LD_MSR_RAPL_POWER_UNIT, 0, 0},
+        {0, LD_MSR_PKG_ENERGY_STATUS, 0, 0},
+        {0, LD_MSR_PACKAGE_THERM_STATUS, 0, 0},
+        {0, LD_MSR_TEMPERATURE_TARGET, 0, 0},
+        {0, LD_MSR_CORE_PERF_LIMIT_REASONS, 0, 0},
+    };
+    (void)ld_msr_read_batch(ops, sizeof(ops) / sizeof(ops[0]));
+    if (!ops[0].ok || !ops[1].ok) {
+        fprintf(stderr, "read RAPL energy MSRs failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    struct ld_rapl_units units;
+    ld_rapl_units_decode(ops[0].value, &units);
+    printf("ENERGY_UNIT=%d\n", units.energy_unit);
+    printf("ENERGY_UNIT_J=%.12f\n", units.energy_unit_j);
+    printf("PKG_ENERGY_RAW=%" PRIu64 "\n", ops[1].value & 0xFFFFFFFFu);
+    printf("PKG_THERM_VALID=%d\n", ops[2].ok);
+    printf("PKG_THERM=0x%016" PRIx64 "\n", ops[2].value);
+    printf("TJMAX_VALID=%d\n", ops[3].ok);
+    printf("TJMAX=%u\n", (unsigned int)LD_FIELD_GET(ops[3].value, LD_TEMPERATURE_TARGET_TJMAX));
+    printf("PERF_LIMIT_REASONS_VALID=%d\n", ops[4].ok);
+    printf("PERF_LIMIT_REASONS=0x%08" PRIx64 "\n", ops[4].value & 0xFFFFFFFFu);
     return 0;
 }
 
@@ -941,24 +2261,169 @@ static int cmd_set_core_uv(double mv) {
         return 2;
     }
 
-    int msr_fd = open_msr(true);
-    if (msr_fd < 0) {
+    if (ld_msr_fd(0, 1) < 0) {
         fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
         return 1;
     }
 
-    uint32_t raw = oc_encode_offset_mv(mv);
-    if (oc_mailbox_write(msr_fd, OC_PLANE_CORE, raw) != 0) {
+    uint32_t raw = ld_oc_encode_offset_mv(mv);
+    if (ld_oc_mailbox_write(0, LD_OC_PLANE_CORE, raw) != 0) {
         fprintf(stderr, "write OC mailbox failed: %s\n", strerror(errno));
-        close(msr_fd);
         return 1;
     }
 
-    close(msr_fd);
     printf("OK\n");
     return 0;
 }
 
+static void print_vf_point(const struct ld_oc_vf_point *pt) {
+    printf("VF_POINT_%d=ratio=%u,offset_mv=%.1f,raw=0x%08" PRIx32 "\n", pt->index, pt->ratio, pt->offset_mv + 0.0, pt->raw);
+}
+
+static int cmd_read_vf_curve(int plane) {
+    if (ld_msr_fd(0, 1) < 0) {
+        fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
+        return 1;
+    }
+    struct ld_oc_vf_point points[LD_OC_MAX_VF_POINTS];
+    int count = 0;
+    int rc = ld_oc_vf_read(0, (uint8_t)plane, points, LD_OC_MAX_VF_POINTS, &count);
+    if (rc < 0) {
+        fprintf(stderr, "read OC mailbox failed: %s\n", strerror(errno));
+        return 1;
+    }
+    printf("VF_PLANE=%d\n", plane);
+    printf("VF_MAILBOX_STATUS=%d\n", rc);
+    printf("VF_SUPPORTED=%d\n", rc == 0 && count > 0);
+    printf("VF_POINT_COUNT=%d\n", count);
+    for (int i = 0; i < count; i++) {
+        print_vf_point(&points[i]);
+    }
+    return 0;
+}
+
+/*
+ * Puts the points of a band that were already touched back to the offsets
+ * read before the write. A half-applied curve is the one state worse than
+ * either the old or the new one, so every restored point is reported.
+ */
+static int restore_vf_points(const struct ld_oc_vf_point *saved, const int *touched, int count) {
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        const struct ld_oc_vf_point *pt = &saved[touched[i]];
+        uint32_t readback = 0;
+        int rc = ld_oc_vf_write_offset(0, LD_OC_PLANE_CORE, pt->index, pt->offset_mv, &readback);
+        bool ok = rc == 0 && LD_FIELD_GET(readback, LD_OC_DATA_OFFSET) == LD_FIELD_GET(pt->raw, LD_OC_DATA_OFFSET);
+        printf("VF_RESTORED_%d=%s,offset_mv=%.1f\n", pt->index, ok ? "ok" : "failed", pt->offset_mv + 0.0);
+        if (!ok) {
+            fprintf(stderr, "V/F point %d: restoring %.1f mV failed, the curve is left partly written\n", pt->index,
+                    pt->offset_mv + 0.0);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/*
+ * Writes mv to every point whose ratio lies in [min_ratio, max_ratio] (one point when point > 0) and checks the
+ * readback. Any failure restores the points already written, the failing one included.
+ */
+static int cmd_set_vf_offset(int point, int min_ratio, int max_ratio, double mv) {
+    if (mv < -500.0 || mv > 500.0) {
+        fprintf(stderr, "Refusing voltage offset outside [-500, 500] mV.\n");
+        return 2;
+    }
+    if (ld_msr_fd(0, 1) < 0) {
+        fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
+        return 1;
+    }
+    struct ld_oc_vf_point points[LD_OC_MAX_VF_POINTS];
+    int count = 0;
+    int rc = ld_oc_vf_read(0, LD_OC_PLANE_CORE, points, LD_OC_MAX_VF_POINTS, &count);
+    if (rc < 0) {
+        fprintf(stderr, "read OC mailbox failed: %s\n", strerror(errno));
+        return 1;
+    }
+    if (rc > 0 || count == 0) {
+        fprintf(stderr, "Per-point V/F offsets are not supported on this CPU (mailbox status %d).\n", rc);
+        return 1;
+    }
+
+    struct ld_oc_vf_point saved[LD_OC_MAX_VF_POINTS];
+    memcpy(saved, points, sizeof(saved));
+    int touched[LD_OC_MAX_VF_POINTS];
+    int written = 0;
+    uint32_t want = (uint32_t)LD_FIELD_GET(ld_oc_encode_offset_mv(mv), LD_OC_DATA_OFFSET);
+    for (int i = 0; i < count; i++) {
+        struct ld_oc_vf_point *pt = &points[i];
+        if (point > 0 ? pt->index != point : (pt->ratio < (unsigned int)min_ratio || pt->ratio > (unsigned int)max_ratio)) {
+            continue;
+        }
+        touched[written++] = i;
+        uint32_t readback = 0;
+        rc = ld_oc_vf_write_offset(0, LD_OC_PLANE_CORE, pt->index, mv, &readback);
+        if (rc < 0) {
+            fprintf(stderr, "write V/F point %d failed: %s\n", pt->index, strerror(errno));
+        } else if (rc > 0) {
+            fprintf(stderr, "V/F point %d: mailbox status %d\n", pt->index, rc);
+        } else if (LD_FIELD_GET(readback, LD_OC_DATA_OFFSET) != want) {
+            fprintf(stderr, "V/F point %d: readback %.1f mV, wanted %.1f mV\n", pt->index,
+                    ld_oc_decode_offset_mv(readback) + 0.0, mv);
+            rc = 1;
+        }
+        if (rc != 0) {
+            int lost = restore_vf_points(saved, touched, written);
+            printf("VF_POINTS_WRITTEN=0\n");
+            printf("VF_POINTS_RESTORED=%d\n", written - lost);
+            return 1;
+        }
+        pt->raw = readback;
+        pt->ratio = (unsigned int)LD_FIELD_GET(readback, LD_OC_DATA_RATIO);
+        pt->offset_mv = ld_oc_decode_offset_mv(readback);
+    }
+    if (written == 0) {
+        if (point > 0) {
+            fprintf(stderr, "No V/F point %d (CPU reports %d points)\n", point, count);
+        } else {
+            fprintf(stderr, "No V/F point with a ratio in [%d, %d]\n", min_ratio, max_ratio);
+        }
+        return 2;
+    }
+    for (int i = 0; i < written; i++) {
+        print_vf_point(&points[touched[i]]);
+    }
+    printf("VF_POINTS_WRITTEN=%d\n", written);
+    return 0;
+}
+
+/* SET-VF-OFFSET arguments: point <n> <mV> | band <min_ratio> <max_ratio> <mV>. */
+static int run_set_vf_offset(char **args, int count) {
+    int point = 0;
+    int min_ratio = 0;
+    int max_ratio = 0;
+    double mv = 0.0;
+    if (count == 3 && strcmp(args[0], "point") == 0) {
+        if (!parse_int(args[1], &point) || point < 1 || point > LD_OC_MAX_VF_POINTS) {
+            fprintf(stderr, "Invalid V/F point: %s\n", args[1]);
+            return 2;
+        }
+    } else if (count == 4 && strcmp(args[0], "band") == 0) {
+        if (!parse_int(args[1], &min_ratio) || !parse_int(args[2], &max_ratio) ||
+            min_ratio <= 0 || max_ratio > 255 || min_ratio > max_ratio) {
+            fprintf(stderr, "Invalid ratio band: %s %s\n", args[1], args[2]);
+            return 2;
+        }
+    } else {
+        fprintf(stderr, "Expected point <n> <mV> or band <min_ratio> <max_ratio> <mV>\n");
+        return 2;
+    }
+    if (!parse_double(args[count - 1], &mv)) {
+        fprintf(stderr, "Invalid voltage offset: %s\n", args[count - 1]);
+        return 2;
+    }
+    return cmd_set_vf_offset(point, min_ratio, max_ratio, mv);
+}
+
 static int dispatch_server_command(const char *line) {
     // Make a mutable copy for tokenization.
     char buf[4096];
@@ -982,6 +2447,9 @@ static int dispatch_server_command(const char *line) {
     if (!cmd) {
         return 1;
     }
+    conflict_sample(false);
+    residency_tick();
+    cgroup_tick(BUDGET_PERIOD_MS);
 
     if (strcmp(cmd, "READ") == 0) {
         return cmd_read();
@@ -989,6 +2457,26 @@ static int dispatch_server_command(const char *line) {
     if (strcmp(cmd, "READ-CORE-SENSORS") == 0) {
         return cmd_read_core_sensors();
     }
+    if (strcmp(cmd, "READ-PACKAGE") == 0) {
+        return cmd_read_package();
+    }
+    if (strcmp(cmd, "READ-RESIDENCY") == 0) {
+        return cmd_read_residency();
+    }
+    if (strcmp(cmd, "RESET-RESIDENCY") == 0) {
+        return cmd_reset_residency();
+    }
+    if (strcmp(cmd, "READ-LEDGER") == 0) {
+        return cmd_read_ledger();
+    }
+    if (strcmp(cmd, "SET-PROFILE") == 0) {
+        char *arg = strtok_r(NULL, " \t", &save);
+        if (!arg) {
+            fprintf(stderr, "Missing profile name\n");
+            return 2;
+        }
+        return cmd_set_profile(arg);
+    }
     if (strcmp(cmd, "WRITE-MSR") == 0) {
         char *arg = strtok_r(NULL, " \t", &save);
         if (!arg) {
@@ -1000,7 +2488,7 @@ static int dispatch_server_command(const char *line) {
             fprintf(stderr, "Invalid value: %s\n", arg);
             return 2;
         }
-        return cmd_write_msr(val);
+        return cmd_write_limits(LD_LIMITS_MSR, val);
     }
     if (strcmp(cmd, "WRITE-MMIO") == 0) {
         char *arg = strtok_r(NULL, " \t", &save);
@@ -1013,7 +2501,7 @@ static int dispatch_server_command(const char *line) {
             fprintf(stderr, "Invalid value: %s\n", arg);
             return 2;
         }
-        return cmd_write_mmio(val);
+        return cmd_write_limits(LD_LIMITS_MMIO, val);
     }
     if (strcmp(cmd, "WRITE-POWERCAP") == 0) {
         char *a1 = strtok_r(NULL, " \t", &save);
@@ -1030,41 +2518,73 @@ static int dispatch_server_command(const char *line) {
         }
         return cmd_write_powercap(pl1_uw, pl2_uw);
     }
+    if (strcmp(cmd, "READ-POWERCAP") == 0) {
+        return cmd_read_powercap();
+    }
+    if (strcmp(cmd, "READ-POWERCAP-ENERGY") == 0) {
+        return cmd_read_powercap_energy();
+    }
+    if (strcmp(cmd, "WRITE-POWERCAP-ZONE") == 0) {
+        char *zone = strtok_r(NULL, " \t", &save);
+        char *constraint = strtok_r(NULL, " \t", &save);
+        char *limit = strtok_r(NULL, " \t", &save);
+        char *window = strtok_r(NULL, " \t", &save);
+        uint64_t limit_uw = 0;
+        uint64_t window_us = 0;
+        if (!zone || !constraint || !limit) {
+            fprintf(stderr, "Missing zone, constraint or limit\n");
+            return 2;
+        }
+        if (!parse_u64(limit, &limit_uw) || limit_uw == 0 || (window && (!parse_u64(window, &window_us) || window_us == 0))) {
+            fprintf(stderr, "Invalid powercap values\n");
+            return 2;
+        }
+        return cmd_write_powercap_zone(zone, constraint, limit_uw, window != NULL, window_us);
+    }
     if (strcmp(cmd, "START-THERMALD") == 0) {
-        return cmd_service("start", false, "thermald.service");
+        return cmd_service("start", "thermald.service");
     }
     if (strcmp(cmd, "STOP-THERMALD") == 0) {
-        return cmd_service("stop", false, "thermald.service");
+        return cmd_service("stop", "thermald.service");
     }
     if (strcmp(cmd, "DISABLE-THERMALD") == 0) {
-        return cmd_service("disable", false, "thermald.service");
+        return cmd_service("disable", "thermald.service");
     }
     if (strcmp(cmd, "ENABLE-THERMALD") == 0) {
-        return cmd_service("enable", false, "thermald.service");
+        return cmd_service("enable", "thermald.service");
     }
     if (strcmp(cmd, "START-TUNED") == 0) {
-        return cmd_service("start", false, "tuned.service");
+        return cmd_service("start", "tuned.service");
     }
     if (strcmp(cmd, "STOP-TUNED") == 0) {
-        return cmd_service("stop", false, "tuned.service");
+        return cmd_service("stop", "tuned.service");
     }
     if (strcmp(cmd, "DISABLE-TUNED") == 0) {
-        return cmd_service("disable", false, "tuned.service");
+        return cmd_service("disable", "tuned.service");
     }
     if (strcmp(cmd, "ENABLE-TUNED") == 0) {
-        return cmd_service("enable", false, "tuned.service");
+        return cmd_service("enable", "tuned.service");
     }
     if (strcmp(cmd, "START-TUNED-PPD") == 0) {
-        return cmd_service("start", false, "tuned-ppd.service");
+        return cmd_service("start", "tuned-ppd.service");
     }
     if (strcmp(cmd, "STOP-TUNED-PPD") == 0) {
-        return cmd_service("stop", false, "tuned-ppd.service");
+        return cmd_service("stop", "tuned-ppd.service");
     }
     if (strcmp(cmd, "DISABLE-TUNED-PPD") == 0) {
-        return cmd_service("disable", false, "tuned-ppd.service");
+        return cmd_service("disable", "tuned-ppd.service");
     }
     if (strcmp(cmd, "ENABLE-TUNED-PPD") == 0) {
-        return cmd_service("enable", false, "tuned-ppd.service");
+        return cmd_service("enable", "tuned-ppd.service");
+    }
+    if (strcmp(cmd, "READ-CONFLICTS") == 0) {
+        return cmd_read_conflicts();
+    }
+    if (strcmp(cmd, "STOP-POWERCAP-WRITERS") == 0) {
+        return cmd_stop_powercap_writers();
+    }
+    if (strcmp(cmd, "READ-SERVICE-JOBS") == 0) {
+        return cmd_read_service_jobs();
     }
     if (strcmp(cmd, "SET-P-RATIO") == 0) {
         char *arg = strtok_r(NULL, " \t", &save);
@@ -1137,6 +2657,104 @@ static int dispatch_server_command(const char *line) {
         }
         return cmd_set_cpu_ratio(cpu, ratio);
     }
+    if (strcmp(cmd, "PARK") == 0 || strcmp(cmd, "UNPARK") == 0) {
+        bool park = strcmp(cmd, "PARK") == 0;
+        enum park_group group;
+        if (!parse_park_group(strtok_r(NULL, " \t", &save), !park, &group)) {
+            return 2;
+        }
+        return park ? cmd_park(group) : cmd_unpark(group);
+    }
+    if (strcmp(cmd, "READ-IRQS") == 0) {
+        char *arg = strtok_r(NULL, " \t", &save);
+        int interval_ms = 0;
+        if (arg && (!parse_int(arg, &interval_ms) || interval_ms < 0 || interval_ms > IRQ_SAMPLE_MAX_MS)) {
+            fprintf(stderr, "Invalid interval: %s\n", arg);
+            return 2;
+        }
+        if (interval_ms > 0 && socket_server) {
+            fprintf(stderr, "READ-IRQS <ms> would stall the socket daemon; poll READ-IRQS without an interval\n");
+            return 2;
+        }
+        return cmd_read_irqs(interval_ms);
+    }
+    if (strcmp(cmd, "STEER-IRQS") == 0) {
+        char *target = strtok_r(NULL, " \t", &save);
+        char *patterns[64];
+        int count = 0;
+        char *arg;
+        if (!target) {
+            fprintf(stderr, "Missing IRQ target\n");
+            return 2;
+        }
+        while ((arg = strtok_r(NULL, " \t", &save)) != NULL && count < 64) {
+            patterns[count++] = arg;
+        }
+        return cmd_steer_irqs(target, patterns, count);
+    }
+    if (strcmp(cmd, "RESTORE-IRQS") == 0) {
+        return cmd_restore_irqs();
+    }
+    if (strcmp(cmd, "READ-CPU-ENERGY") == 0) {
+        return cmd_read_cpu_energy(0);
+    }
+    if (strcmp(cmd, "READ-CGROUP-POWER") == 0) {
+        char *cgroups[MAX_CGROUP_WATCHES];
+        int count = 0;
+        char *arg;
+        while ((arg = strtok_r(NULL, " \t", &save)) != NULL && count < MAX_CGROUP_WATCHES) {
+            cgroups[count++] = arg;
+        }
+        return cmd_read_cgroup_power(cgroups, count, 0);
+    }
+    if (strcmp(cmd, "SET-CGROUP-BUDGET") == 0) {
+        char *cgroup = strtok_r(NULL, " \t", &save);
+        char *watts_arg = strtok_r(NULL, " \t", &save);
+        char *mode_arg = strtok_r(NULL, " \t", &save);
+        double watts = 0.0;
+        enum ld_budget_mode mode = LD_BUDGET_QUOTA;
+        if (!cgroup || !watts_arg) {
+            fprintf(stderr, "Missing cgroup or watts\n");
+            return 2;
+        }
+        if (!parse_double(watts_arg, &watts) || watts <= 0.0) {
+            fprintf(stderr, "Invalid watts: %s\n", watts_arg);
+            return 2;
+        }
+        if (mode_arg && (ld_budget_mode_parse(mode_arg, &mode) != 0 || mode == LD_BUDGET_WATCH)) {
+            fprintf(stderr, "Invalid budget mode: %s (expected quota or ratio)\n", mode_arg);
+            return 2;
+        }
+        return cmd_set_cgroup_budget(cgroup, watts, mode);
+    }
+    if (strcmp(cmd, "CLEAR-CGROUP-BUDGET") == 0) {
+        char *cgroup = strtok_r(NULL, " \t", &save);
+        if (!cgroup) {
+            fprintf(stderr, "Missing cgroup\n");
+            return 2;
+        }
+        return cmd_clear_cgroup_budget(cgroup);
+    }
+    if (strcmp(cmd, "READ-PSTATE") == 0) {
+        return cmd_read_pstate();
+    }
+    if (strcmp(cmd, "SET-PSTATE") == 0) {
+        char *pairs[LD_PSTATE_KNOB_COUNT];
+        int count = 0;
+        char *arg;
+        while ((arg = strtok_r(NULL, " \t", &save)) != NULL) {
+            if (count >= LD_PSTATE_KNOB_COUNT) {
+                fprintf(stderr, "Too many pstate settings\n");
+                return 2;
+            }
+            pairs[count++] = arg;
+        }
+        if (count == 0) {
+            fprintf(stderr, "Missing pstate settings\n");
+            return 2;
+        }
+        return cmd_set_pstate(pairs, count);
+    }
     if (strcmp(cmd, "SET-CORE-UV") == 0) {
         char *arg = strtok_r(NULL, " \t", &save);
         if (!arg) {
@@ -1150,6 +2768,28 @@ static int dispatch_server_command(const char *line) {
         }
         return cmd_set_core_uv(mv);
     }
+    if (strcmp(cmd, "READ-VF-CURVE") == 0) {
+        char *arg = strtok_r(NULL, " \t", &save);
+        int plane = LD_OC_PLANE_CORE;
+        if (arg && (!parse_int(arg, &plane) || plane < 0 || plane > 4)) {
+            fprintf(stderr, "Invalid voltage plane: %s\n", arg);
+            return 2;
+        }
+        return cmd_read_vf_curve(plane);
+    }
+    if (strcmp(cmd, "SET-VF-OFFSET") == 0) {
+        char *args[4];
+        int count = 0;
+        char *arg;
+        while ((arg = strtok_r(NULL, " \t", &save)) != NULL) {
+            if (count >= 4) {
+                fprintf(stderr, "Too many arguments\n");
+                return 2;
+            }
+            args[count++] = arg;
+        }
+        return run_set_vf_offset(args, count);
+    }
     if (strcmp(cmd, "QUIT") == 0) {
         return -1;
     }
@@ -1158,20 +2798,474 @@ static int dispatch_server_command(const char *line) {
     return 2;
 }
 
+static volatile sig_atomic_t server_stop = 0;
+
+static void on_server_signal(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+/* Without SA_RESTART, so a blocking read returns and the server can clean up. */
+static void install_stop_handler(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_server_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+}
+
+/* --cgroup-budget: holds one budget in the foreground until interrupted, then restores. */
+static int run_cgroup_budget(const char *cgroup, double watts, enum ld_budget_mode mode) {
+    select_ratio_path();
+    int rc = cmd_set_cgroup_budget(cgroup, watts, mode);
+    if (rc != 0) {
+        return rc;
+    }
+    fflush(stdout);
+    install_stop_handler();
+    while (!server_stop) {
+        cgroup_tick(0);
+        print_cgroup_watch(0, &cgroup_watches[0]);
+        fflush(stdout);
+        usleep(BUDGET_PERIOD_MS * 1000);
+    }
+    restore_budgets_here();
+    return 0;
+}
+
 static int run_server(void) {
+    select_limits_backends();
+    select_ratio_path();
+    service_async = true;
+    install_stop_handler();
     char line[4096];
-    while (fgets(line, sizeof(line), stdin)) {
+    while (!server_stop) {
+        // Budgets and residency need samples while the client is idle. Clients wait
+        // for END before the next line, so nothing sits in stdin's buffer here.
+        if (budgets_active() || residency_active) {
+            struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN, .revents = 0 };
+            int ready = poll(&pfd, 1, residency_active ? RESIDENCY_SAMPLE_MS : BUDGET_PERIOD_MS);
+            if (ready <= 0) {
+                residency_tick();
+                cgroup_tick(BUDGET_PERIOD_MS);
+                continue;
+            }
+        }
+        if (!fgets(line, sizeof(line), stdin)) {
+            break;
+        }
         int rc = dispatch_server_command(line);
         if (rc == -1) {
             break;
         }
         print_end();
     }
+    restore_parked_here();
+    restore_budgets_here();
+    return 0;
+}
+
+/*
+ * Socket mode speaks the same line protocol as --server, but stdout and
+ * stderr share one stream: error text is returned as ERR= lines and every
+ * reply carries the command's exit status as RC= before END.
+ */
+
+struct socket_client {
+    int fd;
+    char buf[4096];
+    size_t len;
+    // Replies not yet written: the server never blocks on one client, so a client that stops reading only
+    // grows its own queue, up to SOCKET_OUT_MAX.
+    char *out;
+    size_t out_len;
+    size_t out_off;
+    size_t out_cap;
+};
+
+static void client_free(struct socket_client *c) {
+    close(c->fd);
+    free(c->out);
+    c->out = NULL;
+    c->out_len = 0;
+    c->out_off = 0;
+    c->out_cap = 0;
+}
+
+static bool client_pending(const struct socket_client *c) {
+    return c->out_off < c->out_len;
+}
+
+static int client_queue(struct socket_client *c, const char *data, size_t len) {
+    if (c->out_off == c->out_len) {
+        c->out_off = 0;
+        c->out_len = 0;
+    }
+    if (c->out_len - c->out_off + len > SOCKET_OUT_MAX) {
+        return -1;
+    }
+    if (c->out_len + len > c->out_cap) {
+        // Compact before growing: the written head of the queue is dead space.
+        memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+        c->out_len -= c->out_off;
+        c->out_off = 0;
+    }
+    if (c->out_len + len > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < c->out_len + len) {
+            cap *= 2;
+        }
+        char *grown = realloc(c->out, cap);
+        if (!grown) {
+            return -1;
+        }
+        c->out = grown;
+        c->out_cap = cap;
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+    return 0;
+}
+
+/* Writes what the socket takes; 0 when the rest has to wait for POLLOUT, -1 when the client is gone. */
+static int client_flush(struct socket_client *c) {
+    while (client_pending(c)) {
+        ssize_t n = write(c->fd, c->out + c->out_off, c->out_len - c->out_off);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->out_off += (size_t)n;
+    }
+    return 0;
+}
+
+/* Appends the whole of a capture memfd to the client's queue. */
+static int client_queue_fd(struct socket_client *c, int fd) {
+    char chunk[4096];
+    off_t off = 0;
+    for (;;) {
+        ssize_t n = pread(fd, chunk, sizeof(chunk), off);
+        if (n <= 0) {
+            return n < 0 ? -1 : 0;
+        }
+        if (client_queue(c, chunk, (size_t)n) != 0) {
+            return -1;
+        }
+        off += n;
+    }
+}
+
+static int serve_socket_command(struct socket_client *c, const char *line) {
+    int out_fd = memfd_create("limits_helper_out", MFD_CLOEXEC);
+    int err_fd = memfd_create("limits_helper_err", MFD_CLOEXEC);
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    if (out_fd < 0 || err_fd < 0 || saved_out < 0 || saved_err < 0) {
+        int fds[] = { out_fd, err_fd, saved_out, saved_err };
+        for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+        return -2;
+    }
+    // The reply is captured, not written to the client directly, so a slow reader cannot stall the server here.
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+
+    int rc = dispatch_server_command(line);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    int queued = client_queue_fd(c, out_fd);
+    close(out_fd);
+    if (rc == -1 || queued != 0) {
+        close(err_fd);
+        return rc == -1 ? -1 : -2;
+    }
+
+    char errbuf[4096];
+    ssize_t n = pread(err_fd, errbuf, sizeof(errbuf) - 1, 0);
+    close(err_fd);
+    if (n > 0) {
+        errbuf[n] = '\0';
+        char *save = NULL;
+        for (char *ln = strtok_r(errbuf, "\n", &save); ln; ln = strtok_r(NULL, "\n", &save)) {
+            char out[4200];
+            int len = snprintf(out, sizeof(out), "ERR=%s\n", ln);
+            if (len > 0 && client_queue(c, out, (size_t)len) != 0) {
+                return -2;
+            }
+        }
+    }
+
+    char tail[64];
+    int len = snprintf(tail, sizeof(tail), "RC=%d\nEND\n", rc);
+    if (client_queue(c, tail, (size_t)len) != 0) {
+        return -2;
+    }
+    return 0;
+}
+
+/* Returns -1 once the client quit or disconnected, or left too much of its replies unread. */
+static int serve_socket_client(struct socket_client *c) {
+    ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len);
+    if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        return -1;
+    }
+    c->len += (size_t)n;
+
+    for (;;) {
+        char *nl = memchr(c->buf, '\n', c->len);
+        if (!nl) {
+            if (c->len == sizeof(c->buf) - 1) {
+                return -1;
+            }
+            return client_flush(c);
+        }
+        *nl = '\0';
+        int rc = serve_socket_command(c, c->buf);
+        size_t consumed = (size_t)(nl - c->buf) + 1;
+        memmove(c->buf, c->buf + consumed, c->len - consumed);
+        c->len -= consumed;
+        if (rc != 0) {
+            // QUIT still gets what it printed, as far as the socket takes it without waiting.
+            (void)client_flush(c);
+            return -1;
+        }
+    }
+}
+
+static int run_socket_fd(int fd) {
+    select_limits_backends();
+    select_ratio_path();
+    service_async = true;
+    signal(SIGPIPE, SIG_IGN);
+    struct socket_client client = { .fd = fd };
+    install_stop_handler();
+    while (!server_stop) {
+        // Same idle sampling as run_server(): a client that only reads now and then still gets residency.
+        if (budgets_active() || residency_active) {
+            struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+            int ready = poll(&pfd, 1, residency_active ? RESIDENCY_SAMPLE_MS : BUDGET_PERIOD_MS);
+            if (ready <= 0) {
+                residency_tick();
+                cgroup_tick(BUDGET_PERIOD_MS);
+                continue;
+            }
+        }
+        // The only client: a blocking fd, so each flush writes the whole reply.
+        if (serve_socket_client(&client) != 0) {
+            break;
+        }
+    }
+    client_free(&client);
+    restore_parked_here();
+    restore_budgets_here();
+    return 0;
+}
+
+static int run_socket_server(const char *path, const char *group) {
+    select_limits_backends();
+    select_ratio_path();
+    service_async = true;
+    socket_server = true;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "socket failed: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink(path);
+    mode_t old_mask = umask(0177);
+    int bind_rc = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bind_rc != 0 || listen(listen_fd, 8) != 0) {
+        fprintf(stderr, "bind/listen %s failed: %s\n", path, strerror(errno));
+        close(listen_fd);
+        return 1;
+    }
+    if (group) {
+        struct group *gr = getgrnam(group);
+        if (!gr || chown(path, (uid_t)-1, gr->gr_gid) != 0 || chmod(path, 0660) != 0) {
+            fprintf(stderr, "Failed to grant group %s access to %s\n", group, path);
+            close(listen_fd);
+            unlink(path);
+            return 1;
+        }
+    }
+
+    install_stop_handler();
+    signal(SIGPIPE, SIG_IGN);
+    ledger_start();
+
+    struct socket_client clients[MAX_SOCKET_CLIENTS];
+    size_t nclients = 0;
+
+    while (!server_stop) {
+        struct pollfd pfds[MAX_SOCKET_CLIENTS + 2];
+        pfds[0].fd = listen_fd;
+        pfds[0].events = POLLIN;
+        for (size_t i = 0; i < nclients; i++) {
+            // A client with replies still queued is not read from until it has taken them.
+            pfds[i + 1].fd = clients[i].fd;
+            pfds[i + 1].events = client_pending(&clients[i]) ? POLLOUT : POLLIN;
+        }
+        // Job replies and JobRemoved signals are consumed as they arrive,
+        // not only when a client asks for READ-SERVICE-JOBS.
+        pfds[nclients + 1].fd = ld_systemd_fd(&systemd_bus);
+        pfds[nclients + 1].events = POLLIN;
+        pfds[nclients + 1].revents = 0;
+        int timeout_ms = conflicts_active ? CONFLICT_SAMPLE_MS : -1;
+        if (residency_active && (timeout_ms < 0 || timeout_ms > RESIDENCY_SAMPLE_MS)) {
+            timeout_ms = RESIDENCY_SAMPLE_MS;
+        }
+        if (budgets_active() && (timeout_ms < 0 || timeout_ms > BUDGET_PERIOD_MS)) {
+            timeout_ms = BUDGET_PERIOD_MS;
+        }
+        if (ledger_recording && (timeout_ms < 0 || timeout_ms > LEDGER_SAMPLE_MS)) {
+            timeout_ms = LEDGER_SAMPLE_MS;
+        }
+        int ready = poll(pfds, nclients + 2, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        if (pfds[nclients + 1].revents) {
+            ld_systemd_process(&systemd_bus, 0, NULL, 0);
+        }
+        conflict_sample(false);
+        residency_tick();
+        ledger_tick(false);
+        cgroup_tick(BUDGET_PERIOD_MS);
+
+        for (size_t i = nclients; i > 0; i--) {
+            struct socket_client *client = &clients[i - 1];
+            int rc = 0;
+            if (pfds[i].revents & (POLLHUP | POLLERR)) {
+                rc = client_pending(client) ? -1 : serve_socket_client(client);
+            } else if (pfds[i].revents & POLLOUT) {
+                rc = client_flush(client);
+            } else if (pfds[i].revents & POLLIN) {
+                rc = serve_socket_client(client);
+            }
+            if (rc != 0) {
+                client_free(client);
+                clients[i - 1] = clients[nclients - 1];
+                nclients--;
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) {
+                if (nclients == MAX_SOCKET_CLIENTS) {
+                    close(fd);
+                } else {
+                    memset(&clients[nclients], 0, sizeof(clients[nclients]));
+                    clients[nclients].fd = fd;
+                    nclients++;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nclients; i++) {
+        client_free(&clients[i]);
+    }
+    close(listen_fd);
+    unlink(path);
+    ledger_tick(true);
+    restore_parked_here();
+    restore_budgets_here();
     return 0;
 }
 
 
+/* --backend / --msr-backend / --mmio-backend <auto|direct|powercap>; returns -1 on a bad value, else 1 if consumed. */
+static int parse_backend_option(const char *opt, const char *value) {
+    enum ld_limits_backend backend;
+    int msr = strcmp(opt, "--backend") == 0 || strcmp(opt, "--msr-backend") == 0;
+    int mmio = strcmp(opt, "--backend") == 0 || strcmp(opt, "--mmio-backend") == 0;
+    if (!msr && !mmio) {
+        return 0;
+    }
+    if (ld_limits_parse_backend(value, &backend) != 0) {
+        fprintf(stderr, "Invalid backend: %s (expected auto, direct or powercap)\n", value ? value : "");
+        return -1;
+    }
+    if (msr) {
+        limits_want[LD_LIMITS_MSR] = backend;
+    }
+    if (mmio) {
+        limits_want[LD_LIMITS_MMIO] = backend;
+    }
+    return 1;
+}
+
+/* --ratio-backend <auto|perf-ctl|cpufreq>; same return convention as parse_backend_option(). */
+static int parse_ratio_option(const char *opt, const char *value) {
+    if (strcmp(opt, "--ratio-backend") != 0) {
+        return 0;
+    }
+    if (ld_ratio_parse_path(value, &ratio_want) != 0) {
+        fprintf(stderr, "Invalid ratio backend: %s (expected auto, perf-ctl or cpufreq)\n", value ? value : "");
+        return -1;
+    }
+    return 1;
+}
+
 int main(int argc, char **argv) {
+    const char *env_backend = getenv("LIMITS_HELPER_BACKEND");
+    if (env_backend && *env_backend && parse_backend_option("--backend", env_backend) < 0) {
+        return 2;
+    }
+    const char *env_ratio = getenv("LIMITS_HELPER_RATIO_BACKEND");
+    if (env_ratio && *env_ratio && parse_ratio_option("--ratio-backend", env_ratio) < 0) {
+        return 2;
+    }
+    while (argc >= 3) {
+        int rc = parse_backend_option(argv[1], argv[2]);
+        if (rc == 0) {
+            rc = parse_ratio_option(argv[1], argv[2]);
+        }
+        if (rc < 0) {
+            return 2;
+        }
+        if (rc == 0) {
+            break;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
     if (argc < 2 || strcmp(argv[1], "--help") == 0) {
         usage(argv[0]);
         return 2;
@@ -1180,6 +3274,48 @@ int main(int argc, char **argv) {
     if (strcmp(argv[1], "--server") == 0) {
         return run_server();
     }
+    if (strcmp(argv[1], "--socket") == 0) {
+        const char *path = DEFAULT_SOCKET_PATH;
+        const char *group = NULL;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--socket-group") == 0 && i + 1 < argc) {
+                group = argv[++i];
+            } else if (argv[i][0] == '/') {
+                path = argv[i];
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+        return run_socket_server(path, group);
+    }
+    if (strcmp(argv[1], "--socket-fd") == 0) {
+        int fd = -1;
+        if (argc < 3 || !parse_int(argv[2], &fd) || fd < 0) {
+            usage(argv[0]);
+            return 2;
+        }
+        return run_socket_fd(fd);
+    }
+    if (strcmp(argv[1], "--read-package") == 0) {
+        return cmd_read_package();
+    }
+    if (strcmp(argv[1], "--read-powercap") == 0) {
+        return cmd_read_powercap();
+    }
+    if (strcmp(argv[1], "--read-powercap-energy") == 0) {
+        return cmd_read_powercap_energy();
+    }
+    if (strcmp(argv[1], "--write-powercap-zone") == 0) {
+        uint64_t limit_uw = 0;
+        uint64_t window_us = 0;
+        if (argc < 5 || !parse_u64(argv[4], &limit_uw) || limit_uw == 0 ||
+            (argc > 5 && (!parse_u64(argv[5], &window_us) || window_us == 0))) {
+            usage(argv[0]);
+            return 2;
+        }
+        return cmd_write_powercap_zone(argv[2], argv[3], limit_uw, argc > 5, window_us);
+    }
     if (strcmp(argv[1], "--read") == 0) {
         return cmd_read();
     }
@@ -1193,7 +3329,7 @@ int main(int argc, char **argv) {
             fprintf(stderr, "Invalid value: %s\n", argv[2]);
             return 2;
         }
-        return cmd_write_msr(val);
+        return cmd_write_limits(LD_LIMITS_MSR, val);
     }
     if (strcmp(argv[1], "--write-mmio") == 0) {
         if (argc < 3) {
@@ -1205,7 +3341,7 @@ int main(int argc, char **argv) {
             fprintf(stderr, "Invalid value: %s\n", argv[2]);
             return 2;
         }
-        return cmd_write_mmio(val);
+        return cmd_write_limits(LD_LIMITS_MMIO, val);
     }
     if (strcmp(argv[1], "--write-powercap") == 0) {
         if (argc < 4) {
@@ -1222,40 +3358,69 @@ int main(int argc, char **argv) {
         return cmd_write_powercap(pl1_uw, pl2_uw);
     }
     if (strcmp(argv[1], "--start-thermald") == 0) {
-        return cmd_service("start", false, "thermald.service");
+        return cmd_service("start", "thermald.service");
     }
     if (strcmp(argv[1], "--stop-thermald") == 0) {
-        return cmd_service("stop", false, "thermald.service");
+        return cmd_service("stop", "thermald.service");
     }
     if (strcmp(argv[1], "--disable-thermald") == 0) {
-        return cmd_service("disable", false, "thermald.service");
+        return cmd_service("disable", "thermald.service");
     }
     if (strcmp(argv[1], "--enable-thermald") == 0) {
-        return cmd_service("enable", false, "thermald.service");
+        return cmd_service("enable", "thermald.service");
     }
     if (strcmp(argv[1], "--start-tuned") == 0) {
-        return cmd_service("start", false, "tuned.service");
+        return cmd_service("start", "tuned.service");
     }
     if (strcmp(argv[1], "--stop-tuned") == 0) {
-        return cmd_service("stop", false, "tuned.service");
+        return cmd_service("stop", "tuned.service");
     }
     if (strcmp(argv[1], "--disable-tuned") == 0) {
-        return cmd_service("disable", false, "tuned.service");
+        return cmd_service("disable", "tuned.service");
     }
     if (strcmp(argv[1], "--enable-tuned") == 0) {
-        return cmd_service("enable", false, "tuned.service");
+        return cmd_service("enable", "tuned.service");
     }
     if (strcmp(argv[1], "--start-tuned-ppd") == 0) {
-        return cmd_service("start", false, "tuned-ppd.service");
+        return cmd_service("start", "tuned-ppd.service");
     }
     if (strcmp(argv[1], "--stop-tuned-ppd") == 0) {
-        return cmd_service("stop", false, "tuned-ppd.service");
+        return cmd_service("stop", "tuned-ppd.service");
     }
     if (strcmp(argv[1], "--disable-tuned-ppd") == 0) {
-        return cmd_service("disable", false, "tuned-ppd.service");
+        return cmd_service("disable", "tuned-ppd.service");
     }
     if (strcmp(argv[1], "--enable-tuned-ppd") == 0) {
-        return cmd_service("enable", false, "tuned-ppd.service");
+        return cmd_service("enable", "tuned-ppd.service");
+    }
+    if (strcmp(argv[1], "--watch-conflicts") == 0) {
+        int seconds = 30;
+        if (argc > 2 && (!parse_int(argv[2], &seconds) || seconds <= 0)) {
+            fprintf(stderr, "Invalid duration: %s\n", argv[2]);
+            return 2;
+        }
+        return cmd_watch_conflicts(seconds);
+    }
+    if (strcmp(argv[1], "--watch-residency") == 0) {
+        int seconds = 10;
+        if (argc > 2 && (!parse_int(argv[2], &seconds) || seconds <= 0)) {
+            fprintf(stderr, "Invalid duration: %s\n", argv[2]);
+            return 2;
+        }
+        return cmd_watch_residency(seconds);
+    }
+    if (strcmp(argv[1], "--read-ledger") == 0) {
+        return cmd_read_ledger();
+    }
+    if (strcmp(argv[1], "--set-profile") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 2;
+        }
+        return cmd_set_profile(argv[2]);
+    }
+    if (strcmp(argv[1], "--stop-powercap-writers") == 0) {
+        return cmd_stop_powercap_writers();
     }
     if (strcmp(argv[1], "--set-p-ratio") == 0) {
         if (argc < 3) {
@@ -1321,6 +3486,83 @@ int main(int argc, char **argv) {
         }
         return cmd_set_cpu_ratio(cpu, ratio);
     }
+    if (strcmp(argv[1], "--park") == 0 || strcmp(argv[1], "--unpark") == 0) {
+        bool park = strcmp(argv[1], "--park") == 0;
+        enum park_group group;
+        if (argc < 3) {
+            usage(argv[0]);
+            return 2;
+        }
+        if (!parse_park_group(argv[2], !park, &group)) {
+            return 2;
+        }
+        return park ? cmd_park(group) : cmd_unpark(group);
+    }
+    if (strcmp(argv[1], "--read-irqs") == 0) {
+        int interval_ms = 1000;
+        if (argc >= 3 && (!parse_int(argv[2], &interval_ms) || interval_ms <= 0 || interval_ms > IRQ_SAMPLE_MAX_MS)) {
+            fprintf(stderr, "Invalid interval: %s\n", argv[2]);
+            return 2;
+        }
+        return cmd_read_irqs(interval_ms);
+    }
+    if (strcmp(argv[1], "--steer-irqs") == 0) {
+        if (argc < 3) {
+            usage(argv[0]);
+            return 2;
+        }
+        return cmd_steer_irqs(argv[2], argv + 3, argc - 3);
+    }
+    if (strcmp(argv[1], "--restore-irqs") == 0) {
+        return cmd_restore_irqs();
+    }
+    if (strcmp(argv[1], "--read-cpu-energy") == 0) {
+        int interval_ms = 1000;
+        if (argc >= 3 && (!parse_int(argv[2], &interval_ms) || interval_ms <= 0 || interval_ms > IRQ_SAMPLE_MAX_MS)) {
+            fprintf(stderr, "Invalid interval: %s\n", argv[2]);
+            return 2;
+        }
+        return cmd_read_cpu_energy(interval_ms);
+    }
+    if (strcmp(argv[1], "--read-cgroup-power") == 0) {
+        int interval_ms = 1000;
+        int first = 2;
+        if (argc >= 3 && parse_int(argv[2], &interval_ms)) {
+            if (interval_ms <= 0 || interval_ms > IRQ_SAMPLE_MAX_MS) {
+                fprintf(stderr, "Invalid interval: %s\n", argv[2]);
+                return 2;
+            }
+            first = 3;
+        }
+        return cmd_read_cgroup_power(argv + first, argc - first, interval_ms);
+    }
+    if (strcmp(argv[1], "--cgroup-budget") == 0) {
+        double watts = 0.0;
+        enum ld_budget_mode mode = LD_BUDGET_QUOTA;
+        if (argc < 4) {
+            usage(argv[0]);
+            return 2;
+        }
+        if (!parse_double(argv[3], &watts) || watts <= 0.0) {
+            fprintf(stderr, "Invalid watts: %s\n", argv[3]);
+            return 2;
+        }
+        if (argc >= 5 && (ld_budget_mode_parse(argv[4], &mode) != 0 || mode == LD_BUDGET_WATCH)) {
+            fprintf(stderr, "Invalid budget mode: %s (expected quota or ratio)\n", argv[4]);
+            return 2;
+        }
+        return run_cgroup_budget(argv[2], watts, mode);
+    }
+    if (strcmp(argv[1], "--read-pstate") == 0) {
+        return cmd_read_pstate();
+    }
+    if (strcmp(argv[1], "--set-pstate") == 0) {
+        if (argc < 3 || argc - 2 > LD_PSTATE_KNOB_COUNT) {
+            usage(argv[0]);
+            return 2;
+        }
+        return cmd_set_pstate(argv + 2, argc - 2);
+    }
     if (strcmp(argv[1], "--set-core-uv") == 0) {
         if (argc < 3) {
             usage(argv[0]);
@@ -1333,6 +3575,21 @@ int main(int argc, char **argv) {
         }
         return cmd_set_core_uv(mv);
     }
+    if (strcmp(argv[1], "--read-vf-curve") == 0) {
+        int plane = LD_OC_PLANE_CORE;
+        if (argc >= 3 && (!parse_int(argv[2], &plane) || plane < 0 || plane > 4)) {
+            fprintf(stderr, "Invalid voltage plane: %s\n", argv[2]);
+            return 2;
+        }
+        return cmd_read_vf_curve(plane);
+    }
+    if (strcmp(argv[1], "--set-vf-offset") == 0) {
+        if (argc < 5 || argc > 6) {
+            usage(argv[0]);
+            return 2;
+        }
+        return run_set_vf_offset(argv + 2, argc - 2);
+    }
     if (strcmp(argv[1], "--read-core-sensors") == 0) {
         return cmd_read_core_sensors();
     }
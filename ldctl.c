@@ -0,0 +1,3932 @@
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/ld_affinity.h"
+#include "core/ld_core.h"
+#include "core/ld_powercap.h"
+#include "core/ld_regs.h"
+#include "core/ld_sampler.h"
+#include "core/ld_tasks.h"
+#include "core/ld_thermal.h"
+#include "core/ld_throttle.h"
+
+/*
+ * ldctl: one command-line front end for limits_helper.
+ *
+ * Talks to a running helper over its unix socket (limits_helper --socket) so
+ * repeated calls reuse the helper's state. When no helper is listening, it
+ * starts a private helper on a socketpair (through pkexec when not root),
+ * which then accesses the hardware directly for the lifetime of this process.
+ * Every subcommand prints JSON on stdout.
+ */
+
+#define DEFAULT_SOCKET_PATH "/run/limits_droper.sock"
+#define DEFAULT_HELPER_PATH "/usr/local/bin/limits_helper"
+
+#define THERM_STATUS_THERMAL  LD_FIELD_MASK(LD_THERM_STATUS_THERMAL)
+#define THERM_STATUS_PROCHOT  LD_FIELD_MASK(LD_THERM_STATUS_PROCHOT)
+#define THERM_STATUS_CRITICAL LD_FIELD_MASK(LD_THERM_STATUS_CRITICAL)
+#define THERM_STATUS_POWER    LD_FIELD_MASK(LD_THERM_STATUS_POWER)
+#define THERM_STATUS_CURRENT  LD_FIELD_MASK(LD_THERM_STATUS_CURRENT)
+#define THERM_STATUS_XDOMAIN  LD_FIELD_MASK(LD_THERM_STATUS_XDOMAIN)
+#define THERM_STATUS_VALID    LD_FIELD_MASK(LD_THERM_STATUS_VALID)
+
+struct helper_conn {
+    int fd;
+    pid_t child;
+    const char *transport;
+    char buf[16384];
+    size_t len;
+};
+
+struct reply {
+    char **keys;
+    char **values;
+    size_t count;
+    size_t cap;
+    char err[1024];
+    int rc;
+};
+
+struct options {
+    const char *socket_path;
+    const char *helper_path;
+    const char *backend;    /* --backend for a helper started by ldctl */
+    int direct;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR && !stop_requested) {
+    }
+}
+
+static int parse_int(const char *s, int *out) {
+    char *end = NULL;
+    errno = 0;
+    long v = strtol(s, &end, 0);
+    if (errno != 0 || !end || *end != '\0' || v < INT32_MIN || v > INT32_MAX) {
+        return 0;
+    }
+    *out = (int)v;
+    return 1;
+}
+
+static int parse_double(const char *s, double *out) {
+    char *end = NULL;
+    errno = 0;
+    double v = strtod(s, &end);
+    if (errno != 0 || !end || *end != '\0' || !isfinite(v)) {
+        return 0;
+    }
+    *out = v;
+    return 1;
+}
+
+static int parse_bool_word(const char *s, int *out) {
+    if (!strcmp(s, "yes") || !strcmp(s, "true") || !strcmp(s, "1") || !strcmp(s, "on")) {
+        *out = 1;
+        return 1;
+    }
+    if (!strcmp(s, "no") || !strcmp(s, "false") || !strcmp(s, "0") || !strcmp(s, "off")) {
+        *out = 0;
+        return 1;
+    }
+    return 0;
+}
+
+/* ---- helper replies ---- */
+
+static void reply_init(struct reply *r) {
+    memset(r, 0, sizeof(*r));
+}
+
+static void reply_clear(struct reply *r) {
+    for (size_t i = 0; i < r->count; i++) {
+        free(r->keys[i]);
+        free(r->values[i]);
+    }
+    r->count = 0;
+    r->err[0] = '\0';
+    r->rc = 0;
+}
+
+static void reply_free(struct reply *r) {
+    reply_clear(r);
+    free(r->keys);
+    free(r->values);
+    memset(r, 0, sizeof(*r));
+}
+
+static int reply_add(struct reply *r, const char *line) {
+    const char *eq = strchr(line, '=');
+    if (!eq) {
+        return 0;
+    }
+    if (r->count == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 32;
+        char **keys = realloc(r->keys, cap * sizeof(*keys));
+        if (!keys) {
+            return -1;
+        }
+        r->keys = keys;
+        char **values = realloc(r->values, cap * sizeof(*values));
+        if (!values) {
+            return -1;
+        }
+        r->values = values;
+        r->cap = cap;
+    }
+    r->keys[r->count] = strndup(line, (size_t)(eq - line));
+    r->values[r->count] = strdup(eq + 1);
+    if (!r->keys[r->count] || !r->values[r->count]) {
+        free(r->keys[r->count]);
+        free(r->values[r->count]);
+        return -1;
+    }
+    r->count++;
+    return 0;
+}
+
+static const char *reply_get(const struct reply *r, const char *key) {
+    for (size_t i = 0; i < r->count; i++) {
+        if (strcmp(r->keys[i], key) == 0) {
+            return r->values[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t reply_u64(const struct reply *r, const char *key) {
+    const char *v = reply_get(r, key);
+    return v ? strtoull(v, NULL, 0) : 0;
+}
+
+static int reply_int(const struct reply *r, const char *key) {
+    const char *v = reply_get(r, key);
+    return v ? (int)strtol(v, NULL, 0) : 0;
+}
+
+static double reply_double(const struct reply *r, const char *key) {
+    const char *v = reply_get(r, key);
+    return v ? strtod(v, NULL) : 0.0;
+}
+
+/* ---- helper connection ---- */
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int conn_read_line(struct helper_conn *c, char *out, size_t out_sz) {
+    for (;;) {
+        char *nl = memchr(c->buf, '\n', c->len);
+        if (nl) {
+            size_t n = (size_t)(nl - c->buf);
+            if (n >= out_sz) {
+                n = out_sz - 1;
+            }
+            memcpy(out, c->buf, n);
+            out[n] = '\0';
+            size_t consumed = (size_t)(nl - c->buf) + 1;
+            memmove(c->buf, c->buf + consumed, c->len - consumed);
+            c->len -= consumed;
+            return 0;
+        }
+        if (c->len == sizeof(c->buf)) {
+            return -1;
+        }
+        ssize_t n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        c->len += (size_t)n;
+    }
+}
+
+/*
+ * --helper, then LIMITS_HELPER_PATH. Without either, pkexec gets the installed path: the polkit policy only
+ * authorizes its exec.path, so a helper next to a development build of ldctl would be refused. Root runs the
+ * sibling helper of this binary when there is one.
+ */
+static const char *resolve_helper_path(const struct options *opt, int via_pkexec) {
+    if (opt->helper_path) {
+        return opt->helper_path;
+    }
+    const char *env = getenv("LIMITS_HELPER_PATH");
+    if (env && *env) {
+        return env;
+    }
+    if (via_pkexec) {
+        return DEFAULT_HELPER_PATH;
+    }
+    static char sibling[4096];
+    ssize_t n = readlink("/proc/self/exe", sibling, sizeof(sibling) - 1);
+    if (n > 0) {
+        sibling[n] = '\0';
+        char *slash = strrchr(sibling, '/');
+        if (slash && (size_t)(slash - sibling) + sizeof("/limits_helper") < sizeof(sibling)) {
+            strcpy(slash, "/limits_helper");
+            if (access(sibling, X_OK) == 0) {
+                return sibling;
+            }
+        }
+    }
+    return DEFAULT_HELPER_PATH;
+}
+
+static int conn_connect_socket(struct helper_conn *c, const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    c->fd = fd;
+    c->transport = "socket";
+    return 0;
+}
+
+static int conn_spawn_helper(struct helper_conn *c, const struct options *opt, char *err, size_t err_sz) {
+    int via_pkexec = geteuid() != 0;
+    const char *helper = resolve_helper_path(opt, via_pkexec);
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        snprintf(err, err_sz, "socketpair failed: %s", strerror(errno));
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        snprintf(err, err_sz, "fork failed: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        if (dup2(sv[1], STDIN_FILENO) < 0) {
+            _exit(127);
+        }
+        const char *backend = opt->backend ? opt->backend : "auto";
+        if (!via_pkexec) {
+            execl(helper, helper, "--backend", backend, "--socket-fd", "0", (char *)NULL);
+        } else {
+            execlp("pkexec", "pkexec", helper, "--backend", backend, "--socket-fd", "0", (char *)NULL);
+        }
+        _exit(127);
+    }
+
+    close(sv[1]);
+    c->fd = sv[0];
+    c->child = pid;
+    c->transport = "direct";
+    return 0;
+}
+
+static int conn_open(struct helper_conn *c, const struct options *opt, char *err, size_t err_sz) {
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    c->child = -1;
+    if (!opt->direct && conn_connect_socket(c, opt->socket_path) == 0) {
+        return 0;
+    }
+    return conn_spawn_helper(c, opt, err, err_sz);
+}
+
+static void conn_close(struct helper_conn *c) {
+    if (c->fd >= 0) {
+        write_all(c->fd, "QUIT\n", 5);
+        close(c->fd);
+        c->fd = -1;
+    }
+    if (c->child > 0) {
+        int status = 0;
+        waitpid(c->child, &status, 0);
+        c->child = -1;
+    }
+}
+
+/*
+ * Sends one command and collects the reply up to END.
+ * Returns -1 on transport failure, the helper's RC otherwise.
+ */
+static int helper_call(struct helper_conn *c, struct reply *r, char *err, size_t err_sz, const char *fmt, ...) {
+    char cmd[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(cmd, sizeof(cmd) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= sizeof(cmd) - 1) {
+        snprintf(err, err_sz, "command too long");
+        return -1;
+    }
+    cmd[n++] = '\n';
+
+    reply_clear(r);
+    if (write_all(c->fd, cmd, (size_t)n) != 0) {
+        snprintf(err, err_sz, "helper write failed: %s", strerror(errno));
+        return -1;
+    }
+
+    char line[4096];
+    for (;;) {
+        if (conn_read_line(c, line, sizeof(line)) != 0) {
+            snprintf(err, err_sz, "helper closed the connection (authentication cancelled or helper missing?)");
+            return -1;
+        }
+        if (strcmp(line, "END") == 0) {
+            break;
+        }
+        if (strncmp(line, "ERR=", 4) == 0) {
+            size_t used = strlen(r->err);
+            snprintf(r->err + used, sizeof(r->err) - used, "%s%s", used ? "; " : "", line + 4);
+        } else if (strncmp(line, "RC=", 3) == 0) {
+            r->rc = (int)strtol(line + 3, NULL, 10);
+        } else if (reply_add(r, line) != 0) {
+            snprintf(err, err_sz, "out of memory");
+            return -1;
+        }
+    }
+
+    if (r->rc != 0) {
+        snprintf(err, err_sz, "%s", r->err[0] ? r->err : "helper command failed");
+    }
+    return r->rc;
+}
+
+/* ---- JSON output ---- */
+
+static void json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c == '\n') {
+            printf("\\n");
+        } else if (c == '\t') {
+            printf("\\t");
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+static int json_error(const char *cmd, const char *err) {
+    printf("{\"cmd\":");
+    json_string(cmd);
+    printf(",\"ok\":false,\"error\":");
+    json_string(err);
+    printf("}\n");
+    fflush(stdout);
+    return 1;
+}
+
+static void json_pl(const char *key, uint64_t val, double unit_watts) {
+    uint16_t pl1 = ld_pl1_units(val);
+    uint16_t pl2 = ld_pl2_units(val);
+    printf("\"%s\":{\"raw\":\"0x%016" PRIx64 "\",\"pl1_units\":%u,\"pl1_w\":%.3f,"
+           "\"pl1_enabled\":%s,\"pl2_units\":%u,\"pl2_w\":%.3f,\"pl2_enabled\":%s}",
+           key, val,
+           pl1, (double)pl1 * unit_watts, LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL1_EN) ? "true" : "false",
+           pl2, (double)pl2 * unit_watts, LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL2_EN) ? "true" : "false");
+}
+
+static void json_cpu_array(const char *key, const char *list) {
+    printf("\"%s\":[%s]", key, list ? list : "");
+}
+
+static void json_write_result(const char *key, uint64_t before, uint64_t target, uint64_t after) {
+    printf("\"%s\":{\"before\":\"0x%016" PRIx64 "\",\"target\":\"0x%016" PRIx64 "\","
+           "\"after\":\"0x%016" PRIx64 "\",\"verified\":%s}",
+           key, before, target, after, after == target ? "true" : "false");
+}
+
+/* ---- sensors ---- */
+
+struct core_sample {
+    int cpu;
+    char type;
+    unsigned int ratio;
+    uint64_t thermal;
+    unsigned int vid;           /* PERF_STATUS VID, 1/8192 V; 0 when not reported */
+    uint64_t thr[LD_THROTTLE_COUNTER_COUNT];    /* cumulative throttle counters */
+    unsigned int thr_have;      /* bit per counter the helper reported */
+};
+
+struct sensor_sample {
+    double t;
+    struct core_sample *cores;
+    size_t count;
+    uint64_t energy_raw;
+    double energy_unit_j;
+    uint64_t energy_range;      /* counter modulus: 2^32 for the MSR, max_energy_range_uj for powercap */
+    const char *power_source;   /* "msr" or "powercap" */
+    int tjmax;
+    int pkg_temp_valid;
+    int pkg_temp_c;
+    uint32_t limit_reasons;
+    int limit_reasons_valid;
+    int smi_valid;
+    uint32_t smi_count;         /* MSR_SMI_COUNT */
+};
+
+static int thermal_temp_c(uint64_t thermal, int tjmax) {
+    if (!(thermal & THERM_STATUS_VALID) || tjmax <= 0) {
+        return -1;
+    }
+    return tjmax - (int)LD_FIELD_GET(thermal, LD_THERM_STATUS_READOUT);
+}
+
+static void sensor_sample_free(struct sensor_sample *s) {
+    free(s->cores);
+    s->cores = NULL;
+    s->count = 0;
+}
+
+/* Package energy from the powercap tree, for machines where the energy MSR is not readable. */
+static int read_powercap_package_energy(struct helper_conn *c, struct reply *r, struct sensor_sample *s, char *err,
+                                        size_t err_sz) {
+    if (helper_call(c, r, err, err_sz, "READ-POWERCAP-ENERGY") != 0) {
+        return -1;
+    }
+    size_t count = (size_t)reply_int(r, "POWERCAP_ENERGY_COUNT");
+    for (size_t i = 0; i < count; i++) {
+        char key[64];
+        char id[64];
+        char name[64];
+        int valid = 0;
+        uint64_t energy = 0;
+        uint64_t range = 0;
+        snprintf(key, sizeof(key), "POWERCAP_ENERGY_%zu", i);
+        const char *v = reply_get(r, key);
+        if (!v || sscanf(v, "id=%63[^,],name=%63[^,],valid=%d,energy_uj=%" SCNu64 ",max_energy_range_uj=%" SCNu64,
+                         id, name, &valid, &energy, &range) != 5) {
+            continue;
+        }
+        if (valid && strncmp(name, "package", 7) == 0 && strchr(id, ':') == strrchr(id, ':')) {
+            s->energy_raw = energy;
+            s->energy_unit_j = 1e-6;
+            s->energy_range = range;
+            s->power_source = "powercap";
+            return 0;
+        }
+    }
+    snprintf(err, err_sz, "no package energy counter (MSR 0x611 and powercap both unavailable)");
+    return -1;
+}
+
+static int read_sensor_sample(struct helper_conn *c, struct reply *r, struct sensor_sample *s, char *err, size_t err_sz) {
+    sensor_sample_free(s);
+    int rc = helper_call(c, r, err, err_sz, "READ-PACKAGE");
+    if (rc < 0) {
+        return -1;
+    }
+    s->t = now_seconds();
+    if (rc == 0) {
+        s->energy_raw = reply_u64(r, "PKG_ENERGY_RAW");
+        s->energy_unit_j = reply_double(r, "ENERGY_UNIT_J");
+        s->energy_range = UINT64_C(1) << 32;
+        s->power_source = "msr";
+        s->tjmax = reply_int(r, "TJMAX_VALID") ? reply_int(r, "TJMAX") : 0;
+        uint64_t pkg_therm = reply_u64(r, "PKG_THERM");
+        s->pkg_temp_c = reply_int(r, "PKG_THERM_VALID") ? thermal_temp_c(pkg_therm, s->tjmax) : -1;
+        s->pkg_temp_valid = s->pkg_temp_c >= 0;
+        s->limit_reasons_valid = reply_int(r, "PERF_LIMIT_REASONS_VALID");
+        s->limit_reasons = (uint32_t)reply_u64(r, "PERF_LIMIT_REASONS");
+    } else {
+        s->tjmax = 0;
+        s->pkg_temp_c = -1;
+        s->pkg_temp_valid = 0;
+        s->limit_reasons_valid = 0;
+        if (read_powercap_package_energy(c, r, s, err, err_sz) != 0) {
+            return -1;
+        }
+    }
+
+    if (helper_call(c, r, err, err_sz, "READ-CORE-SENSORS") != 0) {
+        return -1;
+    }
+    s->smi_valid = reply_int(r, "SMI_COUNT_VALID");
+    s->smi_count = (uint32_t)reply_u64(r, "SMI_COUNT");
+    size_t total = (size_t)reply_int(r, "CORE_SENSOR_COUNT");
+    s->cores = calloc(total ? total : 1, sizeof(*s->cores));
+    if (!s->cores) {
+        snprintf(err, err_sz, "out of memory");
+        return -1;
+    }
+    for (size_t i = 0; i < total; i++) {
+        char key[64];
+        snprintf(key, sizeof(key), "CORE_SENSOR_%zu", i);
+        const char *v = reply_get(r, key);
+        struct core_sample cs = { .cpu = -1, .type = 'U' };
+        char type = 'U';
+        // vid= is missing from older helpers.
+        if (!v || sscanf(v, "cpu=%d,type=%c,ratio=%u,thermal=%" SCNx64 ",vid=%u", &cs.cpu, &type, &cs.ratio,
+                         &cs.thermal, &cs.vid) < 4) {
+            continue;
+        }
+        cs.type = type;
+        // Throttle counters follow vid= on newer helpers; ",core_thr=" does not match ",core_thr_ms=".
+        for (int k = 0; k < LD_THROTTLE_COUNTER_COUNT; k++) {
+            char field[32];
+            snprintf(field, sizeof(field), ",%s=", ld_throttle_counter_name((enum ld_throttle_counter)k));
+            const char *at = strstr(v, field);
+            if (at) {
+                cs.thr[k] = strtoull(at + strlen(field), NULL, 10);
+                cs.thr_have |= 1u << k;
+            }
+        }
+        s->cores[s->count++] = cs;
+    }
+    return 0;
+}
+
+static double sample_power_w(const struct sensor_sample *prev, const struct sensor_sample *cur) {
+    double dt = cur->t - prev->t;
+    if (dt <= 0.0) {
+        return 0.0;
+    }
+    if (prev->power_source != cur->power_source) {
+        return 0.0;
+    }
+    uint64_t delta = ld_powercap_energy_delta_uj(prev->energy_raw, cur->energy_raw, cur->energy_range);
+    return (double)delta * cur->energy_unit_j / dt;
+}
+
+/* Growth of throttle counter k of cur->cores[i] since prev, -1 when either sample lacks it. */
+static long long throttle_delta(const struct sensor_sample *prev, const struct sensor_sample *cur, size_t i, int k) {
+    const struct core_sample *cs = &cur->cores[i];
+    const struct core_sample *ps = i < prev->count && prev->cores[i].cpu == cs->cpu ? &prev->cores[i] : NULL;
+    for (size_t j = 0; !ps && j < prev->count; j++) {
+        if (prev->cores[j].cpu == cs->cpu) {
+            ps = &prev->cores[j];
+        }
+    }
+    if (!ps || !(cs->thr_have & ps->thr_have & (1u << k)) || cs->thr[k] < ps->thr[k]) {
+        return -1;
+    }
+    return (long long)(cs->thr[k] - ps->thr[k]);
+}
+
+/* SMIs between two samples, -1 when either has no count. */
+static long sample_smis(const struct sensor_sample *prev, const struct sensor_sample *cur) {
+    if (!prev->smi_valid || !cur->smi_valid) {
+        return -1;
+    }
+    return (long)(uint32_t)(cur->smi_count - prev->smi_count);
+}
+
+/* Package thermal model fed from watch/top samples, with the PL1/PL2 it predicts for. */
+struct thermal_view {
+    struct ld_thermal_model model;
+    double pl1_w;               /* 0 when no candidate */
+    double pl2_w;
+};
+
+static void thermal_view_feed(struct thermal_view *tv, const struct sensor_sample *prev,
+                              const struct sensor_sample *cur) {
+    if (cur->pkg_temp_valid && prev->power_source == cur->power_source) {
+        ld_thermal_model_update(&tv->model, cur->t, cur->pkg_temp_c, sample_power_w(prev, cur));
+    }
+}
+
+static void json_seconds_or_null(const char *key, double s) {
+    if (s >= 0.0) {
+        printf("\"%s\":%.1f", key, s);
+    } else {
+        printf("\"%s\":null", key);
+    }
+}
+
+static void json_thermal(const struct thermal_view *tv, const struct sensor_sample *s, double power_w) {
+    struct ld_thermal_params p;
+    int valid = ld_thermal_model_params(&tv->model, &p) == 0 && s->pkg_temp_valid && s->tjmax > 0;
+    printf(",\"thermal\":{\"samples\":%d,\"valid\":%s", tv->model.samples, valid ? "true" : "false");
+    if (!valid) {
+        printf("}");
+        return;
+    }
+    printf(",\"tau_s\":%.1f,\"r_c_per_w\":%.3f,\"ambient_c\":%.1f,\"steady_c\":%.1f,", p.tau_s, p.r_c_per_w,
+           p.ambient_c, ld_thermal_steady_c(&p, power_w));
+    json_seconds_or_null("tjmax_in_s", ld_thermal_time_to_c(&p, s->pkg_temp_c, power_w, s->tjmax));
+    struct ld_thermal_prediction pred;
+    if (tv->pl1_w > 0.0 && ld_thermal_predict(&tv->model, s->pkg_temp_c, tv->pl1_w, tv->pl2_w, s->tjmax, &pred) == 0) {
+        printf(",\"candidate\":{\"pl1_w\":%.1f,\"pl2_w\":%.1f,\"steady_pl1_c\":%.1f,\"steady_pl2_c\":%.1f,",
+               tv->pl1_w, tv->pl2_w, pred.steady_pl1_c, pred.steady_pl2_c);
+        json_seconds_or_null("pl1_to_tjmax_s", pred.pl1_to_limit_s);
+        printf(",");
+        json_seconds_or_null("pl2_to_tjmax_s", pred.pl2_to_limit_s);
+        printf(",\"max_pl1_w\":%.1f}", pred.max_pl1_w);
+    }
+    printf("}");
+}
+
+static void json_throttle_delta(const char *key, long long delta) {
+    if (delta >= 0) {
+        printf("\"%s\":%lld,", key, delta);
+    } else {
+        printf("\"%s\":null,", key);
+    }
+}
+
+static void json_sample(const char *cmd, const struct sensor_sample *s, const struct sensor_sample *prev,
+                        const struct thermal_view *tv) {
+    printf("{\"cmd\":\"%s\",\"ok\":true,\"t\":%.3f,", cmd, s->t);
+    if (prev) {
+        // Adaptive sampling varies the interval; every per-interval number below covers exactly this one.
+        printf("\"interval_s\":%.3f,", s->t - prev->t);
+    }
+    printf("\"package\":{");
+    if (prev) {
+        printf("\"power_w\":%.3f,", sample_power_w(prev, s));
+        long smis = sample_smis(prev, s);
+        if (smis >= 0 && s->t > prev->t) {
+            printf("\"smis\":%ld,\"smi_per_s\":%.2f,", smis, (double)smis / (s->t - prev->t));
+        }
+    }
+    if (s->smi_valid) {
+        printf("\"smi_count\":%" PRIu32 ",", s->smi_count);
+    } else {
+        printf("\"smi_count\":null,");
+    }
+    printf("\"power_source\":\"%s\",\"energy_raw\":%" PRIu64 ",\"energy_unit_j\":%.9f,\"tjmax_c\":%d,",
+           s->power_source ? s->power_source : "none", s->energy_raw, s->energy_unit_j, s->tjmax);
+    if (s->pkg_temp_valid) {
+        printf("\"temp_c\":%d,", s->pkg_temp_c);
+    } else {
+        printf("\"temp_c\":null,");
+    }
+    if (prev && s->count) {
+        json_throttle_delta("throttle_events", throttle_delta(prev, s, 0, LD_THROTTLE_PKG_EVENTS));
+        json_throttle_delta("throttle_ms", throttle_delta(prev, s, 0, LD_THROTTLE_PKG_MS));
+    }
+    if (s->limit_reasons_valid) {
+        printf("\"limit_reasons\":\"0x%08" PRIx32 "\"}", s->limit_reasons);
+    } else {
+        printf("\"limit_reasons\":null}");
+    }
+    printf(",\"cores\":[");
+    for (size_t i = 0; i < s->count; i++) {
+        const struct core_sample *cs = &s->cores[i];
+        int temp = thermal_temp_c(cs->thermal, s->tjmax);
+        printf("%s{\"cpu\":%d,\"type\":\"%c\",\"ratio\":%u,\"mhz\":%u,", i ? "," : "",
+               cs->cpu, cs->type, cs->ratio, cs->ratio * 100u);
+        if (temp >= 0) {
+            printf("\"temp_c\":%d,", temp);
+        } else {
+            printf("\"temp_c\":null,");
+        }
+        if (cs->vid) {
+            printf("\"volts\":%.4f,", ld_vid_volts(cs->vid));
+        } else {
+            printf("\"volts\":null,");
+        }
+        if (prev) {
+            json_throttle_delta("throttle_events", throttle_delta(prev, s, i, LD_THROTTLE_CORE_EVENTS));
+            json_throttle_delta("throttle_ms", throttle_delta(prev, s, i, LD_THROTTLE_CORE_MS));
+        }
+        printf("\"thermal\":\"0x%016" PRIx64 "\",\"throttle\":{\"thermal\":%s,\"prochot\":%s,"
+               "\"critical\":%s,\"power\":%s,\"current\":%s,\"cross_domain\":%s}}",
+               cs->thermal,
+               (cs->thermal & THERM_STATUS_THERMAL) ? "true" : "false",
+               (cs->thermal & THERM_STATUS_PROCHOT) ? "true" : "false",
+               (cs->thermal & THERM_STATUS_CRITICAL) ? "true" : "false",
+               (cs->thermal & THERM_STATUS_POWER) ? "true" : "false",
+               (cs->thermal & THERM_STATUS_CURRENT) ? "true" : "false",
+               (cs->thermal & THERM_STATUS_XDOMAIN) ? "true" : "false");
+    }
+    printf("]");
+    if (tv && prev) {
+        json_thermal(tv, s, sample_power_w(prev, s));
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* ---- subcommands ---- */
+
+static int cmd_read(struct helper_conn *c, struct reply *r) {
+    char err[1024];
+    if (helper_call(c, r, err, sizeof(err), "READ") != 0) {
+        return json_error("read", err);
+    }
+    double unit_watts = reply_double(r, "UNIT_WATTS");
+    uint64_t msr = reply_u64(r, "MSR");
+    uint64_t mmio = reply_u64(r, "MMIO");
+
+    printf("{\"cmd\":\"read\",\"ok\":true,\"transport\":\"%s\",\"power_unit\":%d,\"unit_watts\":%.6f,",
+           c->transport, reply_int(r, "POWER_UNIT"), unit_watts);
+    json_pl("msr", msr, unit_watts);
+    putchar(',');
+    json_pl("mmio", mmio, unit_watts);
+    static const char *const backend_keys[] = { "MSR_BACKEND", "MMIO_BACKEND" };
+    for (size_t i = 0; i < 2; i++) {
+        const char *backend = reply_get(r, backend_keys[i]);
+        printf(",\"%s_backend\":", i == 0 ? "msr" : "mmio");
+        if (backend) {
+            json_string(backend);
+        } else {
+            printf("null");
+        }
+    }
+    printf(",\"in_sync\":%s,\"core_type_supported\":%s,",
+           msr == mmio ? "true" : "false", reply_int(r, "CORE_TYPE_SUPPORTED") ? "true" : "false");
+    json_cpu_array("p_cpus", reply_get(r, "P_CPUS"));
+    putchar(',');
+    json_cpu_array("e_cpus", reply_get(r, "E_CPUS"));
+    putchar(',');
+    json_cpu_array("u_cpus", reply_get(r, "U_CPUS"));
+
+    static const char *const kinds[] = { "P", "E" };
+    for (size_t i = 0; i < 2; i++) {
+        char key[32];
+        printf(",\"%c_ratio\":", kinds[i][0] == 'P' ? 'p' : 'e');
+        snprintf(key, sizeof(key), "%s_RATIO_VALID", kinds[i]);
+        if (!reply_int(r, key)) {
+            printf("null");
+            continue;
+        }
+        snprintf(key, sizeof(key), "%s_RATIO_TARGET", kinds[i]);
+        printf("{\"target\":%d,\"current\":", reply_int(r, key));
+        snprintf(key, sizeof(key), "%s_RATIO_CUR_VALID", kinds[i]);
+        if (reply_int(r, key)) {
+            snprintf(key, sizeof(key), "%s_RATIO_CUR", kinds[i]);
+            printf("%d}", reply_int(r, key));
+        } else {
+            printf("null}");
+        }
+    }
+    if (reply_int(r, "CORE_UV_VALID")) {
+        printf(",\"core_uv_mv\":%.3f,\"core_uv_raw\":\"%s\"}\n",
+               reply_double(r, "CORE_UV_MV"), reply_get(r, "CORE_UV_RAW"));
+    } else {
+        printf(",\"core_uv_mv\":null}\n");
+    }
+    fflush(stdout);
+    return 0;
+}
+
+struct limits_write {
+    double pl1_w;
+    double pl2_w;
+    double tau_s;               /* PL1 time window as written; 0 when left alone */
+    uint64_t msr_before;
+    uint64_t msr_target;
+    uint64_t msr_after;
+    uint64_t mmio_before;
+    uint64_t mmio_target;
+    uint64_t mmio_after;
+    int verified;
+};
+
+/*
+ * target: bit 0 = MSR, bit 1 = MMIO. tau_s > 0 also sets the PL1 time window
+ * (rounded to the nearest one the register can hold). Reads back after
+ * writing to fill in *_after/verified.
+ */
+static int write_limits(struct helper_conn *c, struct reply *r, double pl1_w, double pl2_w, double tau_s, int target,
+                        int powercap, struct limits_write *w, char *err, size_t err_sz) {
+    memset(w, 0, sizeof(*w));
+    if (helper_call(c, r, err, err_sz, "READ") != 0) {
+        return -1;
+    }
+    double unit_watts = reply_double(r, "UNIT_WATTS");
+    struct ld_reg_ctx ctx = { 0 };
+    ctx.time_unit_s = reply_double(r, "TIME_UNIT_S");
+    w->msr_before = reply_u64(r, "MSR");
+    w->mmio_before = reply_u64(r, "MMIO");
+    if (unit_watts <= 0.0) {
+        snprintf(err, err_sz, "invalid power unit reported by helper");
+        return -1;
+    }
+
+    uint16_t pl1_calc = 0;
+    uint16_t pl2_calc = 0;
+    if (ld_watts_to_units(pl1_w, unit_watts, &pl1_calc) != 0 || ld_watts_to_units(pl2_w, unit_watts, &pl2_calc) != 0) {
+        snprintf(err, err_sz, "values out of range for 15-bit power fields");
+        return -1;
+    }
+    w->pl1_w = (double)pl1_calc * unit_watts;
+    w->pl2_w = (double)pl2_calc * unit_watts;
+    w->msr_target = ld_pl_set_units(w->msr_before, pl1_calc, pl2_calc);
+    w->mmio_target = ld_pl_set_units(w->mmio_before, pl1_calc, pl2_calc);
+    if (tau_s > 0.0) {
+        const struct ld_reg_field *f = ld_reg_field_find(ld_reg_get(LD_REG_PKG_POWER_LIMIT), "pl1_time");
+        uint64_t raw = 0;
+        if (!f || ld_reg_field_encode(f, tau_s, &ctx, &raw) != 0) {
+            snprintf(err, err_sz, "cannot encode a %.3f s PL1 time window (time unit not reported)", tau_s);
+            return -1;
+        }
+        w->msr_target = ld_reg_field_set(f, w->msr_target, raw);
+        w->mmio_target = ld_reg_field_set(f, w->mmio_target, raw);
+        ld_reg_field_scaled(f, w->msr_target, &ctx, &w->tau_s);
+    }
+
+    if ((target & 1) && helper_call(c, r, err, err_sz, "WRITE-MSR 0x%016" PRIx64, w->msr_target) != 0) {
+        return -1;
+    }
+    if ((target & 2) && helper_call(c, r, err, err_sz, "WRITE-MMIO 0x%016" PRIx64, w->mmio_target) != 0) {
+        return -1;
+    }
+    if (powercap) {
+        uint64_t pl1_uw = (uint64_t)llround(w->pl1_w * 1000000.0);
+        uint64_t pl2_uw = (uint64_t)llround(w->pl2_w * 1000000.0);
+        if (helper_call(c, r, err, err_sz, "WRITE-POWERCAP %" PRIu64 " %" PRIu64, pl1_uw, pl2_uw) != 0) {
+            return -1;
+        }
+    }
+
+    if (helper_call(c, r, err, err_sz, "READ") != 0) {
+        return -1;
+    }
+    w->msr_after = reply_u64(r, "MSR");
+    w->mmio_after = reply_u64(r, "MMIO");
+    w->verified = 1;
+    if (target & 1) {
+        w->verified &= w->msr_after == w->msr_target;
+    }
+    if (target & 2) {
+        w->verified &= w->mmio_after == w->mmio_target;
+    }
+    return 0;
+}
+
+static int cmd_set(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    double pl1_w = 0.0;
+    double pl2_w = 0.0;
+    int target = 3;
+    int powercap = 0;
+    char err[1024];
+
+    for (int i = 0; i < argc; i++) {
+        char *eq = strchr(argv[i], '=');
+        if (!eq) {
+            snprintf(err, sizeof(err), "expected key=value, got '%s'", argv[i]);
+            return json_error("set", err);
+        }
+        *eq = '\0';
+        const char *key = argv[i];
+        const char *val = eq + 1;
+        int ok = 1;
+        if (!strcmp(key, "pl1")) {
+            ok = parse_double(val, &pl1_w);
+        } else if (!strcmp(key, "pl2")) {
+            ok = parse_double(val, &pl2_w);
+        } else if (!strcmp(key, "target")) {
+            if (!strcmp(val, "msr")) {
+                target = 1;
+            } else if (!strcmp(val, "mmio")) {
+                target = 2;
+            } else if (!strcmp(val, "both")) {
+                target = 3;
+            } else {
+                ok = 0;
+            }
+        } else if (!strcmp(key, "powercap")) {
+            ok = parse_bool_word(val, &powercap);
+        } else {
+            snprintf(err, sizeof(err), "unknown key '%s'", key);
+            return json_error("set", err);
+        }
+        if (!ok) {
+            snprintf(err, sizeof(err), "invalid value for %s: '%s'", key, val);
+            return json_error("set", err);
+        }
+    }
+    if (pl1_w <= 0.0 || pl2_w <= 0.0) {
+        return json_error("set", "pl1= and pl2= (watts, > 0) are required");
+    }
+
+    struct limits_write w;
+    if (write_limits(c, r, pl1_w, pl2_w, 0.0, target, powercap, &w, err, sizeof(err)) != 0) {
+        return json_error("set", err);
+    }
+
+    printf("{\"cmd\":\"set\",\"ok\":%s,\"pl1_w\":%.3f,\"pl2_w\":%.3f,\"powercap\":%s",
+           w.verified ? "true" : "false", w.pl1_w, w.pl2_w, powercap ? "true" : "false");
+    if (target & 1) {
+        putchar(',');
+        json_write_result("msr", w.msr_before, w.msr_target, w.msr_after);
+    }
+    if (target & 2) {
+        putchar(',');
+        json_write_result("mmio", w.mmio_before, w.mmio_target, w.mmio_after);
+    }
+    printf("}\n");
+    fflush(stdout);
+    return w.verified ? 0 : 1;
+}
+
+static int cmd_sync(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    char err[1024];
+    if (argc != 1 || (strcmp(argv[0], "msr->mmio") != 0 && strcmp(argv[0], "mmio->msr") != 0)) {
+        return json_error("sync", "expected 'msr->mmio' or 'mmio->msr'");
+    }
+    int to_mmio = strcmp(argv[0], "msr->mmio") == 0;
+
+    if (helper_call(c, r, err, sizeof(err), "READ") != 0) {
+        return json_error("sync", err);
+    }
+    uint64_t msr_before = reply_u64(r, "MSR");
+    uint64_t mmio_before = reply_u64(r, "MMIO");
+    uint64_t value = to_mmio ? msr_before : mmio_before;
+
+    if (helper_call(c, r, err, sizeof(err), "%s 0x%016" PRIx64,
+                    to_mmio ? "WRITE-MMIO" : "WRITE-MSR", value) != 0) {
+        return json_error("sync", err);
+    }
+    if (helper_call(c, r, err, sizeof(err), "READ") != 0) {
+        return json_error("sync", err);
+    }
+    uint64_t after = reply_u64(r, to_mmio ? "MMIO" : "MSR");
+
+    printf("{\"cmd\":\"sync\",\"ok\":%s,\"direction\":\"%s\",", after == value ? "true" : "false", argv[0]);
+    json_write_result(to_mmio ? "mmio" : "msr", to_mmio ? mmio_before : msr_before, value, after);
+    printf("}\n");
+    fflush(stdout);
+    return after == value ? 0 : 1;
+}
+
+static int cmd_ratio(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    char err[1024];
+    int a = 0;
+    int b = 0;
+    int rc = -2;
+
+    if (argc == 2 && (!strcmp(argv[0], "p") || !strcmp(argv[0], "e") || !strcmp(argv[0], "all")) &&
+        parse_int(argv[1], &a)) {
+        const char *verb = !strcmp(argv[0], "p") ? "SET-P-RATIO" : !strcmp(argv[0], "e") ? "SET-E-RATIO" : "SET-ALL-RATIO";
+        rc = helper_call(c, r, err, sizeof(err), "%s %d", verb, a);
+    } else if (argc == 3 && !strcmp(argv[0], "pe") && parse_int(argv[1], &a) && parse_int(argv[2], &b)) {
+        rc = helper_call(c, r, err, sizeof(err), "SET-PE-RATIO %d %d", a, b);
+    } else if (argc == 3 && !strcmp(argv[0], "cpu") && parse_int(argv[1], &a) && parse_int(argv[2], &b)) {
+        rc = helper_call(c, r, err, sizeof(err), "SET-CPU-RATIO %d %d", a, b);
+    } else {
+        return json_error("ratio", "usage: ratio p|e|all <ratio> | pe <p> <e> | cpu <cpu> <ratio>");
+    }
+    if (rc != 0) {
+        return json_error("ratio", err);
+    }
+
+    printf("{\"cmd\":\"ratio\",\"ok\":true,\"scope\":");
+    json_string(argv[0]);
+    printf(",\"result\":{");
+    for (size_t i = 0; i < r->count; i++) {
+        printf("%s", i ? "," : "");
+        json_string(r->keys[i]);
+        putchar(':');
+        json_string(r->values[i]);
+    }
+    printf("}}\n");
+    fflush(stdout);
+    return 0;
+}
+
+static int cmd_uv(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    char err[1024];
+    double mv = 0.0;
+    if (argc != 1 || !parse_double(argv[0], &mv)) {
+        return json_error("uv", "usage: uv <offset_mv>");
+    }
+    if (helper_call(c, r, err, sizeof(err), "SET-CORE-UV %.3f", mv) != 0) {
+        return json_error("uv", err);
+    }
+    if (helper_call(c, r, err, sizeof(err), "READ") != 0) {
+        return json_error("uv", err);
+    }
+    int valid = reply_int(r, "CORE_UV_VALID");
+    double readback = reply_double(r, "CORE_UV_MV");
+    printf("{\"cmd\":\"uv\",\"ok\":true,\"requested_mv\":%.3f,", mv);
+    if (valid) {
+        printf("\"readback_mv\":%.3f}\n", readback);
+    } else {
+        printf("\"readback_mv\":null}\n");
+    }
+    fflush(stdout);
+    return 0;
+}
+
+/* Prints the VF_POINT_<n> lines of a READ-VF-CURVE reply as a JSON array. */
+static void json_vf_points(const struct reply *r) {
+    printf("[");
+    int count = reply_int(r, "VF_POINT_COUNT");
+    int printed = 0;
+    for (int i = 1; i <= 255 && printed < count; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "VF_POINT_%d", i);
+        const char *v = reply_get(r, key);
+        unsigned int ratio = 0;
+        double offset_mv = 0.0;
+        unsigned int raw = 0;
+        if (!v || sscanf(v, "ratio=%u,offset_mv=%lf,raw=0x%x", &ratio, &offset_mv, &raw) != 3) {
+            continue;
+        }
+        printf("%s{\"index\":%d,\"ratio\":%u,\"offset_mv\":%.1f,\"raw\":\"0x%08x\"}",
+               printed ? "," : "", i, ratio, offset_mv, raw);
+        printed++;
+    }
+    printf("]");
+}
+
+static int cmd_vf(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    char err[1024];
+    int written = -1;
+    if (argc > 0) {
+        int point = 0;
+        int min_ratio = 0;
+        int max_ratio = 0;
+        double mv = 0.0;
+        int rc = 1;
+        if (argc == 3 && !strcmp(argv[0], "point") && parse_int(argv[1], &point) && parse_double(argv[2], &mv)) {
+            rc = helper_call(c, r, err, sizeof(err), "SET-VF-OFFSET point %d %.3f", point, mv);
+        } else if (argc == 4 && !strcmp(argv[0], "band") && parse_int(argv[1], &min_ratio) &&
+                   parse_int(argv[2], &max_ratio) && parse_double(argv[3], &mv)) {
+            rc = helper_call(c, r, err, sizeof(err), "SET-VF-OFFSET band %d %d %.3f", min_ratio, max_ratio, mv);
+        } else {
+            return json_error("vf", "usage: vf [point <n> <offset_mv> | band <min_ratio> <max_ratio> <offset_mv>]");
+        }
+        if (rc != 0) {
+            return json_error("vf", err);
+        }
+        written = reply_int(r, "VF_POINTS_WRITTEN");
+    }
+    if (helper_call(c, r, err, sizeof(err), "READ-VF-CURVE") != 0) {
+        return json_error("vf", err);
+    }
+    printf("{\"cmd\":\"vf\",\"ok\":true,\"supported\":%s,\"plane\":%d,",
+           reply_int(r, "VF_SUPPORTED") ? "true" : "false", reply_int(r, "VF_PLANE"));
+    if (written >= 0) {
+        printf("\"written\":%d,", written);
+    }
+    printf("\"points\":");
+    json_vf_points(r);
+    printf("}\n");
+    fflush(stdout);
+    return 0;
+}
+
+/* Copies the "key=bin:s;bin:s" field of a RESIDENCY_CPU_<n> value out as a JSON object keyed by bin. */
+static void json_residency_bins(const char *line, const char *key) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), ",%s=", key);
+    const char *p = strstr(line, pat);
+    printf("{");
+    int printed = 0;
+    for (p = p ? p + strlen(pat) : ""; *p && *p != ',';) {
+        int bin = 0;
+        double seconds = 0.0;
+        int used = 0;
+        if (sscanf(p, "%d:%lf%n", &bin, &seconds, &used) != 2) {
+            break;
+        }
+        printf("%s\"%d\":%.2f", printed++ ? "," : "", bin, seconds);
+        p += used;
+        if (*p == ';') {
+            p++;
+        }
+    }
+    printf("}");
+}
+
+static int cmd_residency(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    char err[1024];
+    int reset = 0;
+    int seconds = 0;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "reset")) {
+            reset = 1;
+        } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc && parse_int(argv[i + 1], &seconds) && seconds >= 0) {
+            i++;
+        } else {
+            return json_error("residency", "usage: residency [reset] [--seconds N]");
+        }
+    }
+    // The first call starts sampling; a helper started just for this command needs --seconds to see anything.
+    if (helper_call(c, r, err, sizeof(err), reset ? "RESET-RESIDENCY" : "READ-RESIDENCY") != 0) {
+        return json_error("residency", err);
+    }
+    if (seconds > 0) {
+        sleep((unsigned int)seconds);
+    }
+    if (helper_call(c, r, err, sizeof(err), "READ-RESIDENCY") != 0) {
+        return json_error("residency", err);
+    }
+    int count = reply_int(r, "RESIDENCY_CPU_COUNT");
+    printf("{\"cmd\":\"residency\",\"ok\":true,\"elapsed_s\":%.1f,\"samples\":%" PRIu64
+           ",\"sample_ms\":%d,\"band_c\":%d,\"cpus\":[",
+           reply_double(r, "RESIDENCY_ELAPSED_S"), reply_u64(r, "RESIDENCY_SAMPLES"),
+           reply_int(r, "RESIDENCY_SAMPLE_MS"), reply_int(r, "RESIDENCY_TEMP_BAND_C"));
+    for (int i = 0; i < count; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "RESIDENCY_CPU_%d", i);
+        const char *v = reply_get(r, key);
+        int cpu = -1;
+        char type = 'U';
+        double total_s = 0.0;
+        if (!v || sscanf(v, "cpu=%d,type=%c,total_s=%lf", &cpu, &type, &total_s) != 3) {
+            continue;
+        }
+        printf("%s{\"cpu\":%d,\"type\":\"%c\",\"total_s\":%.2f,\"ratios\":", i ? "," : "", cpu, type, total_s);
+        json_residency_bins(v, "ratios");
+        printf(",\"temps\":");
+        json_residency_bins(v, "temps");
+        printf("}");
+    }
+    printf("]}\n");
+    fflush(stdout);
+    return 0;
+}
+
+/* json_string() of a reply value, "" when the helper did not send it. */
+static void json_reply_string(const struct reply *r, const char *key) {
+    const char *v = reply_get(r, key);
+    json_string(v ? v : "");
+}
+
+/* Copies a LEDGER_MACHINE / LEDGER_PROFILE_<n> value out as JSON fields (after an optional name=). */
+static void json_ledger_totals(const char *v) {
+    double wh[6] = { 0 };
+    double kwh[2] = { 0 };
+    const char *p = strstr(v ? v : "", "today_pkg_wh=");
+    if (p) {
+        sscanf(p, "today_pkg_wh=%lf,today_dram_wh=%lf,week_pkg_wh=%lf,week_dram_wh=%lf,last_week_pkg_wh=%lf,"
+                  "last_week_dram_wh=%lf,total_pkg_kwh=%lf,total_dram_kwh=%lf",
+               &wh[0], &wh[1], &wh[2], &wh[3], &wh[4], &wh[5], &kwh[0], &kwh[1]);
+    }
+    printf("\"today_pkg_wh\":%.3f,\"today_dram_wh\":%.3f,\"week_pkg_wh\":%.3f,\"week_dram_wh\":%.3f,"
+           "\"last_week_pkg_wh\":%.3f,\"last_week_dram_wh\":%.3f,\"total_pkg_kwh\":%.4f,\"total_dram_kwh\":%.4f",
+           wh[0], wh[1], wh[2], wh[3], wh[4], wh[5], kwh[0], kwh[1]);
+}
+
+static int cmd_ledger(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    char err[1024];
+    if (argc == 2 && !strcmp(argv[0], "profile")) {
+        if (strpbrk(argv[1], " \t")) {
+            return json_error("ledger", "profile names cannot contain spaces");
+        }
+        if (helper_call(c, r, err, sizeof(err), "SET-PROFILE %s", argv[1]) != 0) {
+            return json_error("ledger", err);
+        }
+    } else if (argc != 0) {
+        return json_error("ledger", "usage: ledger [profile <name>]");
+    }
+    if (helper_call(c, r, err, sizeof(err), "READ-LEDGER") != 0) {
+        return json_error("ledger", err);
+    }
+    printf("{\"cmd\":\"ledger\",\"ok\":true,\"recording\":%s,\"since\":%" PRIu64 ",\"active_profile\":",
+           reply_int(r, "LEDGER_RECORDING") ? "true" : "false", reply_u64(r, "LEDGER_SINCE"));
+    json_reply_string(r, "LEDGER_ACTIVE_PROFILE");
+    printf(",\"pkg_source\":");
+    json_reply_string(r, "LEDGER_PKG_SOURCE");
+    printf(",\"dram\":%s,\"today\":", reply_int(r, "LEDGER_DRAM_VALID") ? "true" : "false");
+    json_reply_string(r, "LEDGER_TODAY");
+    printf(",\"week_start\":");
+    json_reply_string(r, "LEDGER_WEEK_START");
+    printf(",\"machine\":{");
+    json_ledger_totals(reply_get(r, "LEDGER_MACHINE"));
+    printf("},\"profiles\":[");
+    int count = reply_int(r, "LEDGER_PROFILE_COUNT");
+    for (int i = 0; i < count; i++) {
+        char key[32];
+        char name[64] = "";
+        snprintf(key, sizeof(key), "LEDGER_PROFILE_%d", i);
+        const char *v = reply_get(r, key);
+        if (!v || sscanf(v, "name=%63[^,]", name) != 1) {
+            continue;
+        }
+        printf("%s{\"name\":", i ? "," : "");
+        json_string(name);
+        printf(",");
+        json_ledger_totals(v);
+        printf("}");
+    }
+    printf("],\"days\":[");
+    count = reply_int(r, "LEDGER_DAY_COUNT");
+    for (int i = 0; i < count; i++) {
+        char key[32];
+        char date[16] = "";
+        double pkg_wh = 0.0;
+        double dram_wh = 0.0;
+        snprintf(key, sizeof(key), "LEDGER_DAY_%d", i);
+        const char *v = reply_get(r, key);
+        if (!v || sscanf(v, "date=%15[^,],pkg_wh=%lf,dram_wh=%lf", date, &pkg_wh, &dram_wh) != 3) {
+            continue;
+        }
+        printf("%s{\"date\":\"%s\",\"pkg_wh\":%.3f,\"dram_wh\":%.3f}", i ? "," : "", date, pkg_wh, dram_wh);
+    }
+    printf("]}\n");
+    fflush(stdout);
+    return 0;
+}
+
+static int cmd_sensors(struct helper_conn *c, struct reply *r) {
+    char err[1024];
+    struct sensor_sample s = { 0 };
+    if (read_sensor_sample(c, r, &s, err, sizeof(err)) != 0) {
+        sensor_sample_free(&s);
+        return json_error("sensors", err);
+    }
+    json_sample("sensors", &s, NULL, NULL);
+    sensor_sample_free(&s);
+    return 0;
+}
+
+/* max_ms, when given, takes --adaptive and --max-interval: 0 keeps the fixed --interval. */
+static int parse_interval_count(const char *cmd, int argc, char **argv, int *interval_ms, int *count,
+                                const char **out_path, int *max_ms) {
+    for (int i = 0; i < argc; i++) {
+        int ok = 0;
+        if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+            ok = parse_int(argv[++i], interval_ms) && *interval_ms >= 10;
+        } else if (max_ms && !strcmp(argv[i], "--adaptive")) {
+            *max_ms = *max_ms ? *max_ms : LD_SAMPLER_MAX_MS;
+            ok = 1;
+        } else if (max_ms && !strcmp(argv[i], "--max-interval") && i + 1 < argc) {
+            ok = parse_int(argv[++i], max_ms) && *max_ms >= LD_SAMPLER_MIN_MS;
+        } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+            ok = parse_int(argv[++i], count) && *count >= 0;
+        } else if (out_path && !strcmp(argv[i], "--out") && i + 1 < argc) {
+            *out_path = argv[++i];
+            ok = 1;
+        }
+        if (!ok) {
+            char err[256];
+            snprintf(err, sizeof(err), "invalid argument '%s'", argv[i]);
+            json_error(cmd, err);
+            return 0;
+        }
+    }
+    if (max_ms && *max_ms && *interval_ms < LD_SAMPLER_MIN_MS) {
+        char err[128];
+        snprintf(err, sizeof(err), "--adaptive needs --interval >= %d", LD_SAMPLER_MIN_MS);
+        json_error(cmd, err);
+        return 0;
+    }
+    return 1;
+}
+
+/* What the adaptive sampler compares between samples; prev NULL for the first. */
+static void sampler_signals(const struct sensor_sample *prev, const struct sensor_sample *s,
+                            struct ld_sampler_signals *sig) {
+    memset(sig, 0, sizeof(*sig));
+    sig->pkg_w = prev && s->power_source ? sample_power_w(prev, s) : -1.0;
+    sig->avg_ratio = -1.0;
+    sig->max_ratio = -1.0;
+    double ratio_sum = 0.0;
+    for (size_t i = 0; i < s->count; i++) {
+        const struct core_sample *cs = &s->cores[i];
+        ratio_sum += cs->ratio;
+        if (cs->ratio > sig->max_ratio) {
+            sig->max_ratio = cs->ratio;
+        }
+        sig->throttle_events += cs->thr[LD_THROTTLE_CORE_EVENTS];
+        sig->throttle_state |= cs->thermal & LD_SAMPLER_THERM_MASK;
+    }
+    if (s->count) {
+        sig->avg_ratio = ratio_sum / (double)s->count;
+        sig->throttle_events += s->cores[0].thr[LD_THROTTLE_PKG_EVENTS];
+    }
+}
+
+/* Sleeps until the next sample: the fixed interval, or whatever the sampler picks from this one. */
+static void sleep_next(struct ld_sampler *sampler, int interval_ms, const struct sensor_sample *prev,
+                       const struct sensor_sample *s) {
+    if (sampler) {
+        struct ld_sampler_signals sig;
+        double dt = 0.0;
+        sampler_signals(prev, s, &sig);
+        interval_ms = ld_sampler_update(sampler, &sig, s->t, &dt);
+    }
+    sleep_ms(interval_ms);
+}
+
+static int cmd_watch(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    int interval_ms = 1000;
+    int max_ms = 0;
+    int count = 0;
+    struct thermal_view tv;
+    memset(&tv, 0, sizeof(tv));
+    ld_thermal_model_init(&tv.model);
+    // --pl1/--pl2 pick the candidate limits to predict for; the rest goes to parse_interval_count.
+    char **rest = calloc((size_t)argc + 1, sizeof(*rest));
+    int rest_count = 0;
+    if (!rest) {
+        return json_error("watch", "out of memory");
+    }
+    for (int i = 0; i < argc; i++) {
+        double *dst = !strcmp(argv[i], "--pl1") ? &tv.pl1_w : !strcmp(argv[i], "--pl2") ? &tv.pl2_w : NULL;
+        if (!dst) {
+            rest[rest_count++] = argv[i];
+        } else if (i + 1 >= argc || !parse_double(argv[++i], dst) || *dst <= 0.0) {
+            free(rest);
+            return json_error("watch", "--pl1/--pl2 need watts");
+        }
+    }
+    int ok = parse_interval_count("watch", rest_count, rest, &interval_ms, &count, NULL, &max_ms);
+    free(rest);
+    if (!ok) {
+        return 1;
+    }
+
+    char err[1024];
+    if (tv.pl1_w <= 0.0 && helper_call(c, r, err, sizeof(err), "READ") == 0) {
+        uint64_t msr = reply_u64(r, "MSR");
+        tv.pl1_w = (double)ld_pl1_units(msr) * reply_double(r, "UNIT_WATTS");
+        if (tv.pl2_w <= 0.0) {
+            tv.pl2_w = (double)ld_pl2_units(msr) * reply_double(r, "UNIT_WATTS");
+        }
+    }
+    if (tv.pl2_w <= 0.0) {
+        tv.pl2_w = tv.pl1_w;
+    }
+    struct ld_sampler sampler;
+    ld_sampler_init(&sampler, interval_ms, max_ms);
+    struct sensor_sample prev = { 0 };
+    struct sensor_sample cur = { 0 };
+    int have_prev = 0;
+    for (int n = 0; !stop_requested && (count == 0 || n < count); n++) {
+        if (read_sensor_sample(c, r, &cur, err, sizeof(err)) != 0) {
+            sensor_sample_free(&prev);
+            sensor_sample_free(&cur);
+            return json_error("watch", err);
+        }
+        if (have_prev) {
+            thermal_view_feed(&tv, &prev, &cur);
+        }
+        json_sample("watch", &cur, have_prev ? &prev : NULL, &tv);
+        if (count == 0 || n + 1 < count) {
+            sleep_next(max_ms ? &sampler : NULL, interval_ms, have_prev ? &prev : NULL, &cur);
+        }
+        struct sensor_sample tmp = prev;
+        prev = cur;
+        cur = tmp;
+        have_prev = 1;
+    }
+    sensor_sample_free(&prev);
+    sensor_sample_free(&cur);
+    return 0;
+}
+
+static int cmd_record(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    int interval_ms = 1000;
+    int max_ms = 0;
+    int count = 0;
+    const char *path = NULL;
+    if (!parse_interval_count("record", argc, argv, &interval_ms, &count, &path, &max_ms)) {
+        return 1;
+    }
+    if (!path) {
+        return json_error("record", "--out <file.csv> is required");
+    }
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        char err[512];
+        snprintf(err, sizeof(err), "open %s failed: %s", path, strerror(errno));
+        return json_error("record", err);
+    }
+    fprintf(out, "t_s,interval_s,pkg_w,pkg_temp_c,max_core_temp_c,avg_ratio,max_ratio,throttled_cores,limit_reasons,smis,"
+                 "throttle_events,max_throttle_ms,pkg_throttle_events,pkg_throttle_ms\n");
+
+    char err[1024];
+    struct ld_sampler sampler;
+    ld_sampler_init(&sampler, interval_ms, max_ms);
+    struct sensor_sample prev = { 0 };
+    struct sensor_sample cur = { 0 };
+    double t0 = 0.0;
+    int rows = 0;
+    int rc = 0;
+    for (int n = 0; !stop_requested && (count == 0 || rows < count); n++) {
+        if (read_sensor_sample(c, r, &cur, err, sizeof(err)) != 0) {
+            rc = json_error("record", err);
+            break;
+        }
+        if (n == 0) {
+            t0 = cur.t;
+        } else {
+            double ratio_sum = 0.0;
+            unsigned int ratio_max = 0;
+            int temp_max = -1;
+            int throttled = 0;
+            // Summed over cores; -1 when no core reports the counter.
+            long long thr_events = -1;
+            long long thr_ms_max = -1;
+            for (size_t i = 0; i < cur.count; i++) {
+                const struct core_sample *cs = &cur.cores[i];
+                long long events = throttle_delta(&prev, &cur, i, LD_THROTTLE_CORE_EVENTS);
+                long long ms = throttle_delta(&prev, &cur, i, LD_THROTTLE_CORE_MS);
+                if (events >= 0) {
+                    thr_events = (thr_events < 0 ? 0 : thr_events) + events;
+                }
+                if (ms > thr_ms_max) {
+                    thr_ms_max = ms;
+                }
+                ratio_sum += cs->ratio;
+                if (cs->ratio > ratio_max) {
+                    ratio_max = cs->ratio;
+                }
+                int temp = thermal_temp_c(cs->thermal, cur.tjmax);
+                if (temp > temp_max) {
+                    temp_max = temp;
+                }
+                if (cs->thermal & (THERM_STATUS_THERMAL | THERM_STATUS_PROCHOT | THERM_STATUS_POWER | THERM_STATUS_CURRENT)) {
+                    throttled++;
+                }
+            }
+            fprintf(out, "%.3f,%.3f,%.3f,%d,%d,%.2f,%u,%d,0x%08" PRIx32 ",%ld,%lld,%lld,%lld,%lld\n",
+                    cur.t - t0, cur.t - prev.t, sample_power_w(&prev, &cur),
+                    cur.pkg_temp_c, temp_max,
+                    cur.count ? ratio_sum / (double)cur.count : 0.0, ratio_max, throttled,
+                    cur.limit_reasons, sample_smis(&prev, &cur), thr_events, thr_ms_max,
+                    cur.count ? throttle_delta(&prev, &cur, 0, LD_THROTTLE_PKG_EVENTS) : -1,
+                    cur.count ? throttle_delta(&prev, &cur, 0, LD_THROTTLE_PKG_MS) : -1);
+            fflush(out);
+            rows++;
+        }
+        if (count == 0 || rows < count) {
+            sleep_next(max_ms ? &sampler : NULL, interval_ms, n ? &prev : NULL, &cur);
+        }
+        struct sensor_sample tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    sensor_sample_free(&prev);
+    sensor_sample_free(&cur);
+    if (fclose(out) != 0 && rc == 0) {
+        snprintf(err, sizeof(err), "write %s failed: %s", path, strerror(errno));
+        return json_error("record", err);
+    }
+    if (rc == 0) {
+        printf("{\"cmd\":\"record\",\"ok\":true,\"file\":");
+        json_string(path);
+        printf(",\"rows\":%d,\"interval_ms\":%d", rows, interval_ms);
+        if (max_ms) {
+            printf(",\"max_interval_ms\":%d,\"fast_samples\":%" PRIu64 ",\"samples\":%" PRIu64, max_ms,
+                   sampler.fast_samples, sampler.samples);
+        }
+        printf("}\n");
+        fflush(stdout);
+    }
+    return rc;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmd_bench(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    int count = 200;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--count") && i + 1 < argc && parse_int(argv[i + 1], &count) && count > 0) {
+            i++;
+            continue;
+        }
+        return json_error("bench", "usage: bench [--count N]");
+    }
+
+    static const char *const commands[] = { "READ", "READ-PACKAGE", "READ-CORE-SENSORS" };
+    double *lat = calloc((size_t)count, sizeof(*lat));
+    if (!lat) {
+        return json_error("bench", "out of memory");
+    }
+
+    enum { NCOMMANDS = sizeof(commands) / sizeof(commands[0]) };
+    double stats[NCOMMANDS][5];
+    char err[1024];
+    for (size_t k = 0; k < NCOMMANDS; k++) {
+        double sum = 0.0;
+        for (int i = 0; i < count; i++) {
+            double t0 = now_seconds();
+            if (helper_call(c, r, err, sizeof(err), "%s", commands[k]) != 0) {
+                free(lat);
+                return json_error("bench", err);
+            }
+            lat[i] = (now_seconds() - t0) * 1e6;
+            sum += lat[i];
+        }
+        qsort(lat, (size_t)count, sizeof(*lat), compare_double);
+        stats[k][0] = lat[0];
+        stats[k][1] = sum / count;
+        stats[k][2] = lat[count / 2];
+        stats[k][3] = lat[(size_t)((count - 1) * 0.99)];
+        stats[k][4] = lat[count - 1];
+    }
+    free(lat);
+
+    printf("{\"cmd\":\"bench\",\"ok\":true,\"transport\":\"%s\",\"count\":%d,\"results\":{", c->transport, count);
+    for (size_t k = 0; k < NCOMMANDS; k++) {
+        printf("%s\"%s\":{\"min_us\":%.1f,\"avg_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}",
+               k ? "," : "", commands[k], stats[k][0], stats[k][1], stats[k][2], stats[k][3], stats[k][4]);
+    }
+    printf("}}\n");
+    fflush(stdout);
+    return 0;
+}
+
+/* Value of "key=" inside a comma-separated "k=v,k=v" reply value; "" when missing. */
+static const char *list_field(const char *list, const char *key, char *out, size_t out_sz) {
+    size_t key_len = strlen(key);
+    out[0] = '\0';
+    for (const char *p = list; p && *p;) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len > key_len && p[key_len] == '=' && strncmp(p, key, key_len) == 0) {
+            size_t n = len - key_len - 1;
+            if (n >= out_sz) {
+                n = out_sz - 1;
+            }
+            memcpy(out, p + key_len + 1, n);
+            out[n] = '\0';
+            break;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return out;
+}
+
+static void json_uw_as_watts(const char *json_key, const char *key, const char *list) {
+    char text[32];
+    list_field(list, key, text, sizeof(text));
+    if (text[0]) {
+        printf(",\"%s\":%.3f", json_key, (double)strtoull(text, NULL, 10) / 1e6);
+    }
+}
+
+static int powercap_list(struct helper_conn *c, struct reply *r) {
+    char err[1024];
+    if (helper_call(c, r, err, sizeof(err), "READ-POWERCAP") != 0) {
+        return json_error("powercap", err);
+    }
+    size_t count = (size_t)reply_int(r, "POWERCAP_ZONE_COUNT");
+    printf("{\"cmd\":\"powercap\",\"ok\":true,\"zones\":[");
+    for (size_t i = 0; i < count; i++) {
+        char key[96];
+        char text[128];
+        snprintf(key, sizeof(key), "POWERCAP_ZONE_%zu", i);
+        const char *zone = reply_get(r, key);
+        if (!zone) {
+            continue;
+        }
+        printf("%s{\"id\":", i ? "," : "");
+        json_string(list_field(zone, "id", text, sizeof(text)));
+        printf(",\"name\":");
+        json_string(list_field(zone, "name", text, sizeof(text)));
+        printf(",\"parent\":");
+        if (list_field(zone, "parent", text, sizeof(text))[0]) {
+            json_string(text);
+        } else {
+            printf("null");
+        }
+        printf(",\"enabled\":%s", atoi(list_field(zone, "enabled", text, sizeof(text))) ? "true" : "false");
+        if (list_field(zone, "energy_uj", text, sizeof(text))[0]) {
+            printf(",\"energy_uj\":%s", text);
+            printf(",\"max_energy_range_uj\":%s", list_field(zone, "max_energy_range_uj", text, sizeof(text)));
+        }
+        printf(",\"constraints\":[");
+        size_t n = (size_t)atoi(list_field(zone, "constraints", text, sizeof(text)));
+        for (size_t j = 0; j < n; j++) {
+            snprintf(key, sizeof(key), "POWERCAP_ZONE_%zu_CONSTRAINT_%zu", i, j);
+            const char *con = reply_get(r, key);
+            if (!con) {
+                continue;
+            }
+            printf("%s{\"index\":%zu,\"name\":", j ? "," : "", j);
+            json_string(list_field(con, "name", text, sizeof(text)));
+            json_uw_as_watts("limit_w", "limit_uw", con);
+            json_uw_as_watts("max_power_w", "max_power_uw", con);
+            if (list_field(con, "time_window_us", text, sizeof(text))[0]) {
+                printf(",\"time_window_s\":%.6f", (double)strtoull(text, NULL, 10) / 1e6);
+            }
+            putchar('}');
+        }
+        printf("]}");
+    }
+    printf("]}\n");
+    fflush(stdout);
+    return 0;
+}
+
+static int powercap_set(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    char err[1024];
+    double watts = 0.0;
+    double window_s = 0.0;
+    if (argc < 3 || argc > 4 || !parse_double(argv[2], &watts) || watts <= 0.0 ||
+        (argc == 4 && (!parse_double(argv[3], &window_s) || window_s <= 0.0))) {
+        return json_error("powercap", "usage: powercap set <zone> <constraint> <watts> [window_s]");
+    }
+    uint64_t limit_uw = (uint64_t)llround(watts * 1e6);
+    int rc = argc == 4 ? helper_call(c, r, err, sizeof(err), "WRITE-POWERCAP-ZONE %s %s %" PRIu64 " %" PRIu64,
+                                     argv[0], argv[1], limit_uw, (uint64_t)llround(window_s * 1e6))
+                       : helper_call(c, r, err, sizeof(err), "WRITE-POWERCAP-ZONE %s %s %" PRIu64, argv[0],
+                                     argv[1], limit_uw);
+    if (rc != 0) {
+        return json_error("powercap", err);
+    }
+    printf("{\"cmd\":\"powercap\",\"ok\":true,\"zone\":");
+    json_string(argv[0]);
+    printf(",\"constraint\":");
+    json_string(argv[1]);
+    printf(",\"limit_w\":%.3f", watts);
+    if (argc == 4) {
+        printf(",\"time_window_s\":%.6f", window_s);
+    }
+    printf("}\n");
+    fflush(stdout);
+    return 0;
+}
+
+struct powercap_energy {
+    char id[64];
+    uint64_t energy_uj;
+    uint64_t range_uj;
+    int valid;
+};
+
+/* Per-zone power from energy_uj deltas; needs no MSR access at all. */
+static int powercap_watch(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    int interval_ms = 1000;
+    int count = 0;
+    if (!parse_interval_count("powercap", argc, argv, &interval_ms, &count, NULL, NULL)) {
+        return 1;
+    }
+    char err[1024];
+    struct powercap_energy *prev = NULL;
+    size_t prev_count = 0;
+    uint64_t prev_ns = 0;
+    int rc = 0;
+    for (int n = 0; !stop_requested && (count == 0 || n <= count); n++) {
+        if (helper_call(c, r, err, sizeof(err), "READ-POWERCAP-ENERGY") != 0) {
+            rc = json_error("powercap", err);
+            break;
+        }
+        uint64_t t_ns = reply_u64(r, "POWERCAP_T_NS");
+        size_t cur_count = (size_t)reply_int(r, "POWERCAP_ENERGY_COUNT");
+        struct powercap_energy *cur = calloc(cur_count ? cur_count : 1, sizeof(*cur));
+        if (!cur) {
+            rc = json_error("powercap", "out of memory");
+            break;
+        }
+        for (size_t i = 0; i < cur_count; i++) {
+            char key[64];
+            char text[32];
+            snprintf(key, sizeof(key), "POWERCAP_ENERGY_%zu", i);
+            const char *v = reply_get(r, key);
+            list_field(v, "id", cur[i].id, sizeof(cur[i].id));
+            cur[i].valid = atoi(list_field(v, "valid", text, sizeof(text)));
+            cur[i].energy_uj = strtoull(list_field(v, "energy_uj", text, sizeof(text)), NULL, 10);
+            cur[i].range_uj = strtoull(list_field(v, "max_energy_range_uj", text, sizeof(text)), NULL, 10);
+        }
+        if (prev && t_ns > prev_ns) {
+            double dt = (double)(t_ns - prev_ns) / 1e9;
+            printf("{\"cmd\":\"powercap\",\"ok\":true,\"t\":%.3f,\"power_w\":{", now_seconds());
+            int first = 1;
+            for (size_t i = 0; i < cur_count; i++) {
+                for (size_t k = 0; k < prev_count; k++) {
+                    if (!cur[i].valid || !prev[k].valid || strcmp(cur[i].id, prev[k].id) != 0) {
+                        continue;
+                    }
+                    uint64_t d = ld_powercap_energy_delta_uj(prev[k].energy_uj, cur[i].energy_uj, cur[i].range_uj);
+                    printf("%s\"%s\":%.3f", first ? "" : ",", cur[i].id, (double)d / 1e6 / dt);
+                    first = 0;
+                    break;
+                }
+            }
+            printf("}}\n");
+            fflush(stdout);
+        }
+        free(prev);
+        prev = cur;
+        prev_count = cur_count;
+        prev_ns = t_ns;
+        if (count == 0 || n < count) {
+            sleep_ms(interval_ms);
+        }
+    }
+    free(prev);
+    return rc;
+}
+
+static int cmd_powercap(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    if (argc == 0 || !strcmp(argv[0], "list")) {
+        return powercap_list(c, r);
+    }
+    if (!strcmp(argv[0], "set")) {
+        return powercap_set(c, r, argc - 1, argv + 1);
+    }
+    if (!strcmp(argv[0], "watch")) {
+        return powercap_watch(c, r, argc - 1, argv + 1);
+    }
+    return json_error("powercap", "usage: powercap [list] | set <zone> <constraint> <watts> [window_s] | watch "
+                                  "[--interval ms] [--count N]");
+}
+
+/* Running per-CPU joules from READ-CPU-ENERGY, indexed by CPU number. */
+struct cpu_energy_sample {
+    double *joules;
+    int cpu_count;
+    double pkg_j;
+    char weight[16];
+};
+
+static int read_cpu_energy(struct helper_conn *c, struct reply *r, struct cpu_energy_sample *s, char *err,
+                           size_t err_sz) {
+    if (helper_call(c, r, err, err_sz, "READ-CPU-ENERGY") != 0) {
+        return -1;
+    }
+    int count = reply_int(r, "CPU_ENERGY_COUNT");
+    memset(s->joules, 0, (size_t)s->cpu_count * sizeof(*s->joules));
+    for (int i = 0; i < count; i++) {
+        char key[32];
+        char text[32];
+        snprintf(key, sizeof(key), "CPU_ENERGY_%d", i);
+        const char *list = reply_get(r, key);
+        int cpu = list ? atoi(list_field(list, "cpu", text, sizeof(text))) : -1;
+        if (cpu < 0) {
+            continue;
+        }
+        if (cpu >= s->cpu_count) {
+            double *grown = realloc(s->joules, (size_t)(cpu + 1) * sizeof(*grown));
+            if (!grown) {
+                snprintf(err, err_sz, "out of memory");
+                return -1;
+            }
+            memset(grown + s->cpu_count, 0, (size_t)(cpu + 1 - s->cpu_count) * sizeof(*grown));
+            s->joules = grown;
+            s->cpu_count = cpu + 1;
+        }
+        s->joules[cpu] = strtod(list_field(list, "joules", text, sizeof(text)), NULL);
+    }
+    s->pkg_j = reply_double(r, "CPU_ENERGY_PKG_J");
+    const char *weight = reply_get(r, "CPU_ENERGY_WEIGHT");
+    snprintf(s->weight, sizeof(s->weight), "%s", weight ? weight : "");
+    return 0;
+}
+
+static int compare_task_joules(const void *a, const void *b) {
+    const struct ld_task *x = *(const struct ld_task *const *)a;
+    const struct ld_task *y = *(const struct ld_task *const *)b;
+    if (x->joules != y->joules) {
+        return x->joules < y->joules ? 1 : -1;
+    }
+    return (x->cpu_s < y->cpu_s) - (x->cpu_s > y->cpu_s);
+}
+
+/* Descriptors the scanner may keep open: most of the hard limit, leaving room for everything else. */
+static int task_fd_budget(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        return 0;
+    }
+    if (rl.rlim_cur < rl.rlim_max) {
+        rlim_t want = rl.rlim_max == RLIM_INFINITY || rl.rlim_max > 65536 ? 65536 : rl.rlim_max;
+        if (want > rl.rlim_cur) {
+            rl.rlim_cur = want;
+            if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+                getrlimit(RLIMIT_NOFILE, &rl);
+            }
+        }
+    }
+    long budget = (long)(rl.rlim_cur > 65536 ? 65536 : rl.rlim_cur) - 64;
+    return budget > 0 ? (int)budget : 0;
+}
+
+static int cmd_energy(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    int seconds = 10;
+    int interval_ms = 1000;
+    int top = 20;
+    const char *csv_path = NULL;
+    for (int i = 0; i < argc; i++) {
+        int ok = 0;
+        if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            ok = parse_int(argv[++i], &seconds) && seconds >= 0;
+        } else if (!strcmp(argv[i], "--interval") && i + 1 < argc) {
+            ok = parse_int(argv[++i], &interval_ms) && interval_ms >= 100;
+        } else if (!strcmp(argv[i], "--top") && i + 1 < argc) {
+            ok = parse_int(argv[++i], &top) && top >= 0;
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csv_path = argv[++i];
+            ok = 1;
+        }
+        if (!ok) {
+            char err[256];
+            snprintf(err, sizeof(err), "invalid argument '%s'", argv[i]);
+            return json_error("energy", err);
+        }
+    }
+    FILE *csv = NULL;
+    if (csv_path && !(csv = fopen(csv_path, "w"))) {
+        char err[512];
+        snprintf(err, sizeof(err), "open %s failed: %s", csv_path, strerror(errno));
+        return json_error("energy", err);
+    }
+
+    char err[1024];
+    struct ld_task_table tasks;
+    ld_task_table_init(&tasks, task_fd_budget());
+    struct cpu_energy_sample prev = { 0 };
+    struct cpu_energy_sample cur = { 0 };
+    double *cpu_j = NULL;
+    double pkg_j = 0.0;
+    double unattributed_j = 0.0;
+    double t0 = now_seconds();
+    double elapsed = 0.0;
+    int rc = 0;
+    if (read_cpu_energy(c, r, &prev, err, sizeof(err)) != 0 || ld_task_scan(&tasks, err, sizeof(err)) != 0) {
+        rc = json_error("energy", err);
+    }
+    while (rc == 0 && !stop_requested && (seconds == 0 || elapsed < seconds)) {
+        sleep_ms(interval_ms);
+        if (read_cpu_energy(c, r, &cur, err, sizeof(err)) != 0 || ld_task_scan(&tasks, err, sizeof(err)) != 0) {
+            rc = json_error("energy", err);
+            break;
+        }
+        double *grown = realloc(cpu_j, (size_t)(cur.cpu_count ? cur.cpu_count : 1) * sizeof(*grown));
+        if (!grown) {
+            rc = json_error("energy", "out of memory");
+            break;
+        }
+        cpu_j = grown;
+        for (int cpu = 0; cpu < cur.cpu_count; cpu++) {
+            double before = cpu < prev.cpu_count ? prev.joules[cpu] : 0.0;
+            cpu_j[cpu] = cur.joules[cpu] > before ? cur.joules[cpu] - before : 0.0;
+        }
+        pkg_j += cur.pkg_j > prev.pkg_j ? cur.pkg_j - prev.pkg_j : 0.0;
+        unattributed_j += ld_task_attribute(&tasks, cpu_j, cur.cpu_count);
+        elapsed = now_seconds() - t0;
+        struct cpu_energy_sample tmp = prev;
+        prev = cur;
+        cur = tmp;
+    }
+    free(cpu_j);
+    free(prev.joules);
+    free(cur.joules);
+
+    const struct ld_task **ranked = NULL;
+    size_t ranked_count = 0;
+    if (rc == 0) {
+        ranked = malloc((tasks.count ? tasks.count : 1) * sizeof(*ranked));
+        if (!ranked) {
+            rc = json_error("energy", "out of memory");
+        }
+    }
+    for (size_t i = 0; rc == 0 && i < tasks.count; i++) {
+        if (tasks.tasks[i].joules > 0.0 || tasks.tasks[i].cpu_s > 0.0) {
+            ranked[ranked_count++] = &tasks.tasks[i];
+        }
+    }
+    if (ranked_count) {
+        qsort(ranked, ranked_count, sizeof(*ranked), compare_task_joules);
+    }
+
+    if (csv) {
+        if (rc == 0) {
+            fprintf(csv, "rank,pid,comm,joules,avg_w,cpu_s,exited\n");
+            for (size_t i = 0; i < ranked_count; i++) {
+                const struct ld_task *t = ranked[i];
+                // comm is free text; quote it and double embedded quotes.
+                fprintf(csv, "%zu,%d,\"", i + 1, t->pid);
+                for (const char *p = t->comm; *p; p++) {
+                    if (*p == '"') {
+                        fputc('"', csv);
+                    }
+                    fputc(*p, csv);
+                }
+                fprintf(csv, "\",%.3f,%.3f,%.2f,%d\n", t->joules, elapsed > 0.0 ? t->joules / elapsed : 0.0, t->cpu_s,
+                        t->exited);
+            }
+        }
+        if (fclose(csv) != 0 && rc == 0) {
+            snprintf(err, sizeof(err), "write %s failed: %s", csv_path, strerror(errno));
+            rc = json_error("energy", err);
+        }
+    }
+    if (rc == 0) {
+        double attributed_j = 0.0;
+        for (size_t i = 0; i < ranked_count; i++) {
+            attributed_j += ranked[i]->joules;
+        }
+        printf("{\"cmd\":\"energy\",\"ok\":true,\"seconds\":%.3f,\"pkg_j\":%.3f,\"attributed_j\":%.3f,"
+               "\"unattributed_j\":%.3f,\"weight\":",
+               elapsed, pkg_j, attributed_j, unattributed_j);
+        json_string(prev.weight);
+        printf(",\"scanned\":%zu", tasks.count);
+        if (csv_path) {
+            printf(",\"csv\":");
+            json_string(csv_path);
+        }
+        printf(",\"tasks\":[");
+        for (size_t i = 0; i < ranked_count && i < (size_t)top; i++) {
+            const struct ld_task *t = ranked[i];
+            printf("%s{\"pid\":%d,\"comm\":", i ? "," : "", t->pid);
+            json_string(t->comm);
+            printf(",\"joules\":%.3f,\"avg_w\":%.3f,\"cpu_s\":%.2f,\"exited\":%s}", t->joules,
+                   elapsed > 0.0 ? t->joules / elapsed : 0.0, t->cpu_s, t->exited ? "true" : "false");
+        }
+        printf("]}\n");
+        fflush(stdout);
+    }
+    free(ranked);
+    ld_task_table_free(&tasks);
+    return rc;
+}
+
+/* Offline: decodes raw register values through the shared descriptor table. */
+static int cmd_decode(int argc, char **argv) {
+    const char *usage_text = "usage: decode <register|0xADDR> <value> [<new_value>] [units=0xRAPL_UNIT] [tjmax=C]";
+    if (argc < 2) {
+        return json_error("decode", usage_text);
+    }
+    const struct ld_reg_desc *reg = ld_reg_find(argv[0]);
+    if (!reg) {
+        char err[256];
+        snprintf(err, sizeof(err), "unknown register '%s'", argv[0]);
+        return json_error("decode", err);
+    }
+
+    uint64_t values[2] = { 0, 0 };
+    int value_count = 0;
+    struct ld_rapl_units units;
+    int have_units = 0;
+    int tjmax = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *eq = strchr(argv[i], '=');
+        char *end = NULL;
+        if (!eq && value_count < 2) {
+            errno = 0;
+            values[value_count] = strtoull(argv[i], &end, 0);
+            if (errno == 0 && end != argv[i] && *end == '\0') {
+                value_count++;
+                continue;
+            }
+        } else if (eq && !strncmp(argv[i], "units=", 6)) {
+            errno = 0;
+            uint64_t raw = strtoull(eq + 1, &end, 0);
+            if (errno == 0 && end != eq + 1 && *end == '\0') {
+                ld_rapl_units_decode(raw, &units);
+                have_units = 1;
+                continue;
+            }
+        } else if (eq && !strncmp(argv[i], "tjmax=", 6) && parse_int(eq + 1, &tjmax) && tjmax > 0) {
+            continue;
+        }
+        return json_error("decode", usage_text);
+    }
+    if (value_count == 0) {
+        return json_error("decode", usage_text);
+    }
+
+    struct ld_reg_ctx ctx;
+    ld_reg_ctx_from_units(&ctx, have_units ? &units : NULL, tjmax);
+
+    uint64_t v = values[value_count - 1];
+    printf("{\"cmd\":\"decode\",\"ok\":true,\"register\":\"%s\",\"space\":\"%s\",\"addr\":\"0x%X\","
+           "\"raw\":\"0x%016" PRIx64 "\",\"fields\":{",
+           reg->name, reg->space == LD_SPACE_MCHBAR ? "mchbar" : "msr", (unsigned int)reg->addr, v);
+    for (size_t i = 0; i < reg->field_count; i++) {
+        const struct ld_reg_field *f = &reg->fields[i];
+        char text[64];
+        double scaled = 0.0;
+        int have = ld_reg_field_scaled(f, v, &ctx, &scaled) == 0;
+        ld_reg_field_format(f, v, &ctx, text, sizeof(text));
+        printf("%s\"%s\":{\"raw\":%" PRIu64 ",", i ? "," : "", f->name, ld_reg_field_get(f, v));
+        if (have && f->unit != LD_UNIT_FLAG && f->unit != LD_UNIT_HEX && f->unit != LD_UNIT_RAW) {
+            printf("\"value\":%.6g,", scaled);
+        }
+        printf("\"text\":");
+        json_string(text);
+        printf("}");
+    }
+    printf("}");
+    if (value_count == 2) {
+        char diff[1024];
+        size_t changed = ld_reg_diff(reg, values[0], values[1], &ctx, diff, sizeof(diff));
+        printf(",\"before\":\"0x%016" PRIx64 "\",\"changed_fields\":%zu,\"diff\":", values[0], changed);
+        json_string(diff);
+    }
+    printf("}\n");
+    fflush(stdout);
+    return 0;
+}
+
+/* ---- top: live terminal dashboard ---- */
+
+#define TOP_MAX_ROWS 200
+#define TOP_MAX_COLS 400
+#define TOP_MAX_PROFILES 9
+#define TOP_CELL_WIDTH 34
+
+enum top_attr {
+    ATTR_NORMAL = 0,
+    ATTR_BOLD,
+    ATTR_DIM,
+    ATTR_GREEN,
+    ATTR_YELLOW,
+    ATTR_RED,
+};
+
+static const char *const top_attr_sgr[] = {
+    "\x1b[0m", "\x1b[0;1m", "\x1b[0;2m", "\x1b[0;32m", "\x1b[0;33m", "\x1b[0;31m",
+};
+
+struct top_profile {
+    char name[64];
+    double pl1_w;
+    double pl2_w;
+    int p_ratio;
+    int e_ratio;
+    double core_uv_mv;
+    double tau_s;           /* PL1 time window; 0 when the profile leaves it alone */
+    char irq_target[32];    /* empty when the profile does not steer IRQs */
+    char irq_match[128];
+};
+
+/*
+ * Two character/attribute grids: the frame being composed and what the
+ * terminal currently shows. Only runs of cells that differ are written out.
+ */
+struct top_screen {
+    int rows;
+    int cols;
+    char text[TOP_MAX_ROWS][TOP_MAX_COLS];
+    unsigned char attr[TOP_MAX_ROWS][TOP_MAX_COLS];
+    char shown_text[TOP_MAX_ROWS][TOP_MAX_COLS];
+    unsigned char shown_attr[TOP_MAX_ROWS][TOP_MAX_COLS];
+    int full_redraw;
+    char out[65536];
+    size_t out_len;
+};
+
+static struct termios top_saved_termios;
+static int top_termios_saved = 0;
+static volatile sig_atomic_t top_resized = 0;
+
+static void on_winch(int sig) {
+    (void)sig;
+    top_resized = 1;
+}
+
+static void top_restore_terminal(void) {
+    if (top_termios_saved) {
+        static const char leave[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+        write_all(STDOUT_FILENO, leave, sizeof(leave) - 1);
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &top_saved_termios);
+        top_termios_saved = 0;
+    }
+}
+
+static int top_setup_terminal(char *err, size_t err_sz) {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        snprintf(err, err_sz, "top needs an interactive terminal");
+        return -1;
+    }
+    if (tcgetattr(STDIN_FILENO, &top_saved_termios) != 0) {
+        snprintf(err, err_sz, "tcgetattr failed: %s", strerror(errno));
+        return -1;
+    }
+    struct termios raw = top_saved_termios;
+    raw.c_lflag &= (tcflag_t)~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) {
+        snprintf(err, err_sz, "tcsetattr failed: %s", strerror(errno));
+        return -1;
+    }
+    top_termios_saved = 1;
+    atexit(top_restore_terminal);
+    static const char enter[] = "\x1b[?1049h\x1b[?25l\x1b[2J";
+    write_all(STDOUT_FILENO, enter, sizeof(enter) - 1);
+    return 0;
+}
+
+static void top_update_size(struct top_screen *scr) {
+    struct winsize ws;
+    int rows = 24;
+    int cols = 80;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        rows = ws.ws_row;
+        cols = ws.ws_col;
+    }
+    scr->rows = rows < TOP_MAX_ROWS ? rows : TOP_MAX_ROWS;
+    scr->cols = cols < TOP_MAX_COLS ? cols : TOP_MAX_COLS;
+    scr->full_redraw = 1;
+}
+
+static void top_clear(struct top_screen *scr) {
+    for (int y = 0; y < scr->rows; y++) {
+        memset(scr->text[y], ' ', (size_t)scr->cols);
+        memset(scr->attr[y], ATTR_NORMAL, (size_t)scr->cols);
+    }
+}
+
+static void top_put(struct top_screen *scr, int y, int x, unsigned char attr, const char *fmt, ...) {
+    if (y < 0 || y >= scr->rows || x >= scr->cols) {
+        return;
+    }
+    char buf[TOP_MAX_COLS + 1];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    for (int i = 0; i < n && x + i < scr->cols; i++) {
+        scr->text[y][x + i] = buf[i];
+        scr->attr[y][x + i] = attr;
+    }
+}
+
+static void top_out(struct top_screen *scr, const char *data, size_t len) {
+    if (scr->out_len + len > sizeof(scr->out)) {
+        write_all(STDOUT_FILENO, scr->out, scr->out_len);
+        scr->out_len = 0;
+    }
+    memcpy(scr->out + scr->out_len, data, len);
+    scr->out_len += len;
+}
+
+static void top_flush(struct top_screen *scr) {
+    scr->out_len = 0;
+    if (scr->full_redraw) {
+        top_out(scr, "\x1b[0m\x1b[2J", 8);
+        for (int y = 0; y < scr->rows; y++) {
+            memset(scr->shown_text[y], 0, (size_t)scr->cols);
+        }
+        scr->full_redraw = 0;
+    }
+
+    int cur_attr = -1;
+    for (int y = 0; y < scr->rows; y++) {
+        int x = 0;
+        while (x < scr->cols) {
+            if (scr->text[y][x] == scr->shown_text[y][x] && scr->attr[y][x] == scr->shown_attr[y][x]) {
+                x++;
+                continue;
+            }
+            char move[32];
+            int n = snprintf(move, sizeof(move), "\x1b[%d;%dH", y + 1, x + 1);
+            top_out(scr, move, (size_t)n);
+            while (x < scr->cols &&
+                   (scr->text[y][x] != scr->shown_text[y][x] || scr->attr[y][x] != scr->shown_attr[y][x])) {
+                if (scr->attr[y][x] != cur_attr) {
+                    cur_attr = scr->attr[y][x];
+                    top_out(scr, top_attr_sgr[cur_attr], strlen(top_attr_sgr[cur_attr]));
+                }
+                top_out(scr, &scr->text[y][x], 1);
+                scr->shown_text[y][x] = scr->text[y][x];
+                scr->shown_attr[y][x] = scr->attr[y][x];
+                x++;
+            }
+        }
+    }
+    if (scr->out_len > 0) {
+        write_all(STDOUT_FILENO, scr->out, scr->out_len);
+    }
+}
+
+static int json_find_number(const char *text, const char *key, double *out) {
+    char needle[64];
+    snprintf(needle, sizeof(needle), "\"%s\"", key);
+    const char *p = strstr(text, needle);
+    if (!p) {
+        return 0;
+    }
+    p += strlen(needle);
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    if (*p != ':') {
+        return 0;
+    }
+    char *end = NULL;
+    double v = strtod(p + 1, &end);
+    if (end == p + 1 || !isfinite(v)) {
+        return 0;
+    }
+    *out = v;
+    return 1;
+}
+
+/* Plain string values only; the GUI never writes escapes into the fields read here. */
+static int json_find_string(const char *text, const char *key, char *out, size_t out_sz) {
+    char needle[64];
+    snprintf(needle, sizeof(needle), "\"%s\"", key);
+    const char *p = strstr(text, needle);
+    if (!p) {
+        return 0;
+    }
+    p += strlen(needle);
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    if (*p++ != ':') {
+        return 0;
+    }
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    if (*p++ != '"') {
+        return 0;
+    }
+    size_t len = strcspn(p, "\"\\\n");
+    if (p[len] != '"') {
+        return 0;
+    }
+    snprintf(out, out_sz, "%.*s", (int)len, p);
+    return 1;
+}
+
+/* Sets the P and E ratio targets; 0 leaves that class alone (no E-cores, or not part of the change). */
+static int set_ratio_targets(struct helper_conn *c, struct reply *r, int p_ratio, int e_ratio, char *err,
+                             size_t err_sz) {
+    if (p_ratio > 0 && e_ratio > 0) {
+        return helper_call(c, r, err, err_sz, "SET-PE-RATIO %d %d", p_ratio, e_ratio);
+    }
+    if (p_ratio > 0) {
+        return helper_call(c, r, err, err_sz, "SET-P-RATIO %d", p_ratio);
+    }
+    if (e_ratio > 0) {
+        return helper_call(c, r, err, err_sz, "SET-E-RATIO %d", e_ratio);
+    }
+    return 0;
+}
+
+/* Reads a profile saved by the Qt GUI (version 1 JSON). */
+static int load_profile(const char *path, struct top_profile *p, char *err, size_t err_sz) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        snprintf(err, err_sz, "open %s failed: %s", path, strerror(errno));
+        return -1;
+    }
+    char text[16384];
+    size_t n = fread(text, 1, sizeof(text) - 1, f);
+    fclose(f);
+    text[n] = '\0';
+
+    double version = 0.0;
+    double p_ratio = 0.0;
+    double e_ratio = 0.0;
+    memset(p, 0, sizeof(*p));
+    if (!json_find_number(text, "version", &version) || version != 1.0) {
+        snprintf(err, err_sz, "%s: unsupported profile version", path);
+        return -1;
+    }
+    if (!json_find_number(text, "pl1_w", &p->pl1_w) || p->pl1_w <= 0.0 ||
+        !json_find_number(text, "pl2_w", &p->pl2_w) || p->pl2_w <= 0.0 ||
+        !json_find_number(text, "p_ratio", &p_ratio) || p_ratio <= 0.0 ||
+        !json_find_number(text, "core_uv_mv", &p->core_uv_mv)) {
+        snprintf(err, err_sz, "%s: missing or invalid profile fields", path);
+        return -1;
+    }
+    p->p_ratio = (int)lround(p_ratio);
+    // Profiles from machines without E-cores have e_ratio 0 or none at all: the E ratio is left alone.
+    if (!json_find_number(text, "e_ratio", &e_ratio) || e_ratio < 0.0) {
+        e_ratio = 0.0;
+    }
+    p->e_ratio = (int)lround(e_ratio);
+    if (!json_find_number(text, "tau_s", &p->tau_s) || p->tau_s < 0.0) {
+        p->tau_s = 0.0;
+    }
+    json_find_string(text, "irq_target", p->irq_target, sizeof(p->irq_target));
+    json_find_string(text, "irq_match", p->irq_match, sizeof(p->irq_match));
+
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(p->name, sizeof(p->name), "%s", base);
+    char *dot = strrchr(p->name, '.');
+    if (dot && strcmp(dot, ".json") == 0) {
+        *dot = '\0';
+    }
+    return 0;
+}
+
+static int profile_dir_filter(const struct dirent *de) {
+    size_t len = strlen(de->d_name);
+    return len > 5 && strcmp(de->d_name + len - 5, ".json") == 0 && strcmp(de->d_name, "startup_guard.json") != 0;
+}
+
+/* Same directory the GUI offers for its profile dialogs. */
+static int profile_dir(char *dir, size_t dir_sz) {
+    const char *xdg = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg) {
+        snprintf(dir, dir_sz, "%s/limits_droper/limits_ui_qt", xdg);
+    } else if (home && *home) {
+        snprintf(dir, dir_sz, "%s/.config/limits_droper/limits_ui_qt", home);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static size_t discover_profiles(struct top_profile *out, size_t max) {
+    char dir[4096];
+    if (profile_dir(dir, sizeof(dir)) != 0) {
+        return 0;
+    }
+
+    struct dirent **names = NULL;
+    int n = scandir(dir, &names, profile_dir_filter, alphasort);
+    if (n < 0) {
+        return 0;
+    }
+    size_t count = 0;
+    for (int i = 0; i < n; i++) {
+        char path[8192];
+        char err[256];
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+        if (count < max && load_profile(path, &out[count], err, sizeof(err)) == 0) {
+            count++;
+        }
+        free(names[i]);
+    }
+    free(names);
+    return count;
+}
+
+static int apply_profile(struct helper_conn *c, struct reply *r, const struct top_profile *p, int apply_uv,
+                         char *msg, size_t msg_sz) {
+    char err[1024];
+    struct limits_write w;
+    if (write_limits(c, r, p->pl1_w, p->pl2_w, p->tau_s, 3, 0, &w, err, sizeof(err)) != 0) {
+        snprintf(msg, msg_sz, "%s: limits failed: %s", p->name, err);
+        return -1;
+    }
+    // No E-cores (or all of them parked): the helper has no E ratio to read, and SET-PE-RATIO would fail.
+    int e_ratio = p->e_ratio;
+    if (e_ratio > 0 && helper_call(c, r, err, sizeof(err), "READ") == 0 && !reply_int(r, "E_RATIO_VALID")) {
+        e_ratio = 0;
+    }
+    if (set_ratio_targets(c, r, p->p_ratio, e_ratio, err, sizeof(err)) != 0) {
+        snprintf(msg, msg_sz, "%s: ratios failed: %s", p->name, err);
+        return -1;
+    }
+    if (apply_uv && helper_call(c, r, err, sizeof(err), "SET-CORE-UV %.3f", p->core_uv_mv) != 0) {
+        snprintf(msg, msg_sz, "%s: core UV failed: %s", p->name, err);
+        return -1;
+    }
+    if (p->irq_target[0] &&
+        helper_call(c, r, err, sizeof(err), "STEER-IRQS %s %s", p->irq_target, p->irq_match) != 0) {
+        snprintf(msg, msg_sz, "%s: IRQ steering failed: %s", p->name, err);
+        return -1;
+    }
+    // Attribution only: a name the ledger rejects must not turn a successful apply into a failure.
+    (void)helper_call(c, r, err, sizeof(err), "SET-PROFILE %s", p->name);
+    char e_text[16] = "-";
+    if (e_ratio > 0) {
+        snprintf(e_text, sizeof(e_text), "x%d", e_ratio);
+    }
+    snprintf(msg, msg_sz, "Applied %s: PL1 %.1f W PL2 %.1f W, P x%d E %s%s%s%s%s", p->name, w.pl1_w, w.pl2_w,
+             p->p_ratio, e_text, apply_uv ? ", UV applied" : "", p->irq_target[0] ? ", IRQs to " : "",
+             p->irq_target, w.verified ? "" : " (read-back mismatch!)");
+    return 0;
+}
+
+static const char *throttle_text(uint64_t thermal, unsigned char *attr) {
+    static char buf[32];
+    buf[0] = '\0';
+    if (thermal & THERM_STATUS_THERMAL) {
+        strcat(buf, "TH ");
+    }
+    if (thermal & THERM_STATUS_PROCHOT) {
+        strcat(buf, "PH ");
+    }
+    if (thermal & THERM_STATUS_POWER) {
+        strcat(buf, "PW ");
+    }
+    if (thermal & THERM_STATUS_CURRENT) {
+        strcat(buf, "CU ");
+    }
+    if (buf[0] == '\0') {
+        *attr = ATTR_GREEN;
+        return "ok";
+    }
+    *attr = (thermal & (THERM_STATUS_THERMAL | THERM_STATUS_PROCHOT)) ? ATTR_RED : ATTR_YELLOW;
+    buf[strlen(buf) - 1] = '\0';
+    return buf;
+}
+
+struct top_state {
+    int interval_ms;
+    int have_prev;
+    double power_w;
+    double smi_per_s;           /* negative when MSR_SMI_COUNT is unreadable */
+    int have_limits;
+    double unit_watts;
+    uint64_t msr;
+    uint64_t mmio;
+    double limits_read_at;
+    struct top_profile profiles[TOP_MAX_PROFILES];
+    size_t profile_count;
+    int pending_profile;
+    int apply_uv;
+    char message[1200];
+    unsigned char message_attr;
+    struct thermal_view thermal;
+};
+
+/* Row 7: where the package is heading at the current limits, before the throttle flags show it. */
+static void top_render_thermal(struct top_screen *scr, const struct top_state *st, const struct sensor_sample *s) {
+    top_put(scr, 7, 0, ATTR_BOLD, "Thermal");
+    struct ld_thermal_params p;
+    if (!s->pkg_temp_valid || s->tjmax <= 0) {
+        top_put(scr, 7, 10, ATTR_DIM, "no package temperature");
+        return;
+    }
+    if (ld_thermal_model_params(&st->thermal.model, &p) != 0) {
+        top_put(scr, 7, 10, ATTR_DIM, "fitting (%d/%d samples, needs changing load)", st->thermal.model.samples,
+                LD_THERMAL_MIN_SAMPLES);
+        return;
+    }
+    top_put(scr, 7, 10, ATTR_NORMAL, "tau %4.0f s  %4.2f C/W  amb %3.0f C", p.tau_s, p.r_c_per_w, p.ambient_c);
+    struct ld_thermal_prediction pred;
+    if (!st->have_limits ||
+        ld_thermal_predict(&st->thermal.model, s->pkg_temp_c, st->thermal.pl1_w, st->thermal.pl2_w, s->tjmax, &pred) != 0) {
+        return;
+    }
+    unsigned char attr = pred.steady_pl1_c >= s->tjmax ? ATTR_RED : pred.steady_pl1_c >= s->tjmax - 10 ? ATTR_YELLOW
+                                                                                                   : ATTR_GREEN;
+    top_put(scr, 7, 45, attr, "PL1 -> %3.0f C", pred.steady_pl1_c);
+    if (pred.pl2_to_limit_s < 0.0) {
+        top_put(scr, 7, 60, ATTR_GREEN, "PL2 never reaches TjMax");
+    } else {
+        attr = pred.pl2_to_limit_s < 10.0 ? ATTR_RED : ATTR_YELLOW;
+        top_put(scr, 7, 60, attr, "PL2 hits TjMax in %.0f s", pred.pl2_to_limit_s);
+    }
+    top_put(scr, 7, 88, ATTR_DIM, "sustainable %.0f W", pred.max_pl1_w);
+}
+
+static void top_render(struct top_screen *scr, const struct top_state *st, const struct sensor_sample *s,
+                       const char *transport) {
+    top_clear(scr);
+    top_put(scr, 0, 0, ATTR_BOLD, "ldctl top");
+    top_put(scr, 0, 11, ATTR_DIM, "%d ms  via %s   q quit  +/- rate  1-%zu profile  r redraw",
+            st->interval_ms, transport, st->profile_count ? st->profile_count : (size_t)1);
+
+    top_put(scr, 2, 0, ATTR_BOLD, "Package");
+    if (st->have_prev) {
+        top_put(scr, 2, 10, ATTR_NORMAL, "%7.2f W", st->power_w);
+    } else {
+        top_put(scr, 2, 10, ATTR_DIM, "      - W");
+    }
+    if (s->pkg_temp_valid) {
+        unsigned char attr = s->pkg_temp_c >= s->tjmax - 5 ? ATTR_RED : s->pkg_temp_c >= s->tjmax - 15 ? ATTR_YELLOW : ATTR_NORMAL;
+        top_put(scr, 2, 22, attr, "%3d C", s->pkg_temp_c);
+    } else {
+        top_put(scr, 2, 22, ATTR_DIM, "  - C");
+    }
+    top_put(scr, 2, 30, ATTR_DIM, "TjMax %d C", s->tjmax);
+    if (st->have_prev && st->smi_per_s >= 0.0) {
+        top_put(scr, 2, 44, st->smi_per_s > 0.0 ? ATTR_YELLOW : ATTR_DIM, "SMI %.1f/s", st->smi_per_s);
+    }
+
+    top_put(scr, 3, 0, ATTR_BOLD, "Limits");
+    if (st->have_limits) {
+        double u = st->unit_watts;
+        top_put(scr, 3, 10, ATTR_NORMAL, "MSR  PL1 %6.1f W  PL2 %6.1f W   MMIO PL1 %6.1f W  PL2 %6.1f W",
+                (double)ld_pl1_units(st->msr) * u, (double)ld_pl2_units(st->msr) * u,
+                (double)ld_pl1_units(st->mmio) * u, (double)ld_pl2_units(st->mmio) * u);
+        if (st->msr != st->mmio) {
+            top_put(scr, 3, 75, ATTR_YELLOW, "out of sync");
+        }
+    } else {
+        top_put(scr, 3, 10, ATTR_DIM, "unavailable");
+    }
+
+    top_put(scr, 4, 0, ATTR_BOLD, "Reasons");
+    if (!s->limit_reasons_valid) {
+        top_put(scr, 4, 10, ATTR_DIM, "unavailable");
+    } else {
+        const struct ld_reg_desc *reasons = ld_reg_get(LD_REG_PERF_LIMIT_REASONS);
+        int x = 10;
+        int any = 0;
+        for (size_t i = 0; i < reasons->field_count; i++) {
+            if (ld_reg_field_get(&reasons->fields[i], s->limit_reasons)) {
+                char name[32];
+                size_t n = 0;
+                for (const char *p = reasons->fields[i].name; *p && n + 1 < sizeof(name); p++) {
+                    name[n++] = (char)toupper((unsigned char)*p);
+                }
+                name[n] = '\0';
+                top_put(scr, 4, x, ATTR_YELLOW, "%s", name);
+                x += (int)n + 1;
+                any = 1;
+            }
+        }
+        if (!any) {
+            top_put(scr, 4, 10, ATTR_GREEN, "none");
+        }
+    }
+
+    top_put(scr, 5, 0, ATTR_BOLD, "Profiles");
+    if (st->profile_count == 0) {
+        top_put(scr, 5, 10, ATTR_DIM, "none (use --profile FILE)");
+    } else {
+        int x = 10;
+        for (size_t i = 0; i < st->profile_count; i++) {
+            unsigned char attr = (int)i == st->pending_profile ? ATTR_YELLOW : ATTR_NORMAL;
+            top_put(scr, 5, x, attr, "%zu:%s", i + 1, st->profiles[i].name);
+            x += (int)strlen(st->profiles[i].name) + 4;
+        }
+    }
+    top_render_thermal(scr, st, s);
+    if (st->pending_profile >= 0) {
+        top_put(scr, 6, 0, ATTR_YELLOW, "Apply profile %s%s? y/n", st->profiles[st->pending_profile].name,
+                st->apply_uv ? " (including core UV)" : "");
+    } else if (st->message[0]) {
+        top_put(scr, 6, 0, st->message_attr, "%s", st->message);
+    }
+
+    int grid_cols = scr->cols / TOP_CELL_WIDTH;
+    if (grid_cols < 1) {
+        grid_cols = 1;
+    }
+    for (int gc = 0; gc < grid_cols && (size_t)gc < s->count; gc++) {
+        top_put(scr, 8, gc * TOP_CELL_WIDTH, ATTR_BOLD, "CPU T Ratio   MHz Temp Throttle");
+    }
+    for (size_t i = 0; i < s->count; i++) {
+        const struct core_sample *cs = &s->cores[i];
+        int y = 9 + (int)(i / (size_t)grid_cols);
+        int x = (int)(i % (size_t)grid_cols) * TOP_CELL_WIDTH;
+        int temp = thermal_temp_c(cs->thermal, s->tjmax);
+        unsigned char tattr = ATTR_NORMAL;
+        const char *thr = throttle_text(cs->thermal, &tattr);
+        top_put(scr, y, x, ATTR_NORMAL, "%3d %c  x%-3u %5u", cs->cpu, cs->type, cs->ratio, cs->ratio * 100u);
+        if (temp >= 0) {
+            unsigned char attr = temp >= s->tjmax - 5 ? ATTR_RED : temp >= s->tjmax - 15 ? ATTR_YELLOW : ATTR_NORMAL;
+            top_put(scr, y, x + 19, attr, "%3dC", temp);
+        } else {
+            top_put(scr, y, x + 19, ATTR_DIM, "   -");
+        }
+        top_put(scr, y, x + 24, tattr, "%s", thr);
+    }
+}
+
+static int cmd_top(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    struct top_state st;
+    memset(&st, 0, sizeof(st));
+    st.interval_ms = 500;
+    st.pending_profile = -1;
+    ld_thermal_model_init(&st.thermal.model);
+    char err[1024];
+
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--interval") && i + 1 < argc && parse_int(argv[i + 1], &st.interval_ms) &&
+            st.interval_ms >= 100) {
+            i++;
+        } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            if (st.profile_count == TOP_MAX_PROFILES) {
+                return json_error("top", "at most 9 profiles");
+            }
+            if (load_profile(argv[++i], &st.profiles[st.profile_count], err, sizeof(err)) != 0) {
+                return json_error("top", err);
+            }
+            st.profile_count++;
+        } else if (!strcmp(argv[i], "--apply-uv")) {
+            st.apply_uv = 1;
+        } else {
+            return json_error("top", "usage: top [--interval ms (>=100)] [--profile FILE]... [--apply-uv]");
+        }
+    }
+    if (st.profile_count == 0) {
+        st.profile_count = discover_profiles(st.profiles, TOP_MAX_PROFILES);
+    }
+
+    static struct top_screen scr;
+    if (top_setup_terminal(err, sizeof(err)) != 0) {
+        return json_error("top", err);
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_winch;
+    sigaction(SIGWINCH, &sa, NULL);
+    top_update_size(&scr);
+
+    struct sensor_sample prev = { 0 };
+    struct sensor_sample cur = { 0 };
+    int rc = 0;
+    double next_sample = 0.0;
+
+    while (!stop_requested) {
+        double now = now_seconds();
+        if (now >= next_sample) {
+            if (read_sensor_sample(c, r, &cur, err, sizeof(err)) != 0) {
+                rc = 1;
+                break;
+            }
+            if (st.have_prev) {
+                st.power_w = sample_power_w(&prev, &cur);
+                long smis = sample_smis(&prev, &cur);
+                st.smi_per_s = smis >= 0 && cur.t > prev.t ? (double)smis / (cur.t - prev.t) : -1.0;
+                thermal_view_feed(&st.thermal, &prev, &cur);
+            }
+            if (!st.have_limits || cur.t - st.limits_read_at >= 1.0) {
+                if (helper_call(c, r, err, sizeof(err), "READ") == 0) {
+                    st.unit_watts = reply_double(r, "UNIT_WATTS");
+                    st.msr = reply_u64(r, "MSR");
+                    st.mmio = reply_u64(r, "MMIO");
+                    st.have_limits = 1;
+                    st.thermal.pl1_w = (double)ld_pl1_units(st.msr) * st.unit_watts;
+                    st.thermal.pl2_w = (double)ld_pl2_units(st.msr) * st.unit_watts;
+                }
+                st.limits_read_at = cur.t;
+            }
+            struct sensor_sample tmp = prev;
+            prev = cur;
+            cur = tmp;
+            st.have_prev = 1;
+            next_sample = now + st.interval_ms / 1000.0;
+
+            if (top_resized) {
+                top_resized = 0;
+                top_update_size(&scr);
+            }
+            top_render(&scr, &st, &prev, c->transport);
+            top_flush(&scr);
+        }
+
+        int wait_ms = (int)((next_sample - now_seconds()) * 1000.0);
+        struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+        if (poll(&pfd, 1, wait_ms > 0 ? wait_ms : 0) <= 0 || !(pfd.revents & POLLIN)) {
+            continue;
+        }
+        char keys[16];
+        ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+        for (ssize_t k = 0; k < n; k++) {
+            char key = keys[k];
+            if (st.pending_profile >= 0) {
+                if (key == 'y' || key == 'Y') {
+                    int ok = apply_profile(c, r, &st.profiles[st.pending_profile], st.apply_uv,
+                                           st.message, sizeof(st.message)) == 0;
+                    st.message_attr = ok ? ATTR_GREEN : ATTR_RED;
+                    st.have_limits = 0;
+                } else {
+                    snprintf(st.message, sizeof(st.message), "Cancelled");
+                    st.message_attr = ATTR_DIM;
+                }
+                st.pending_profile = -1;
+            } else if (key == 'q' || key == 'Q') {
+                stop_requested = 1;
+            } else if (key == '+' && st.interval_ms > 100) {
+                st.interval_ms = st.interval_ms > 200 ? st.interval_ms / 2 : 100;
+            } else if (key == '-' && st.interval_ms < 5000) {
+                st.interval_ms *= 2;
+            } else if (key == 'r' || key == 'R') {
+                scr.full_redraw = 1;
+            } else if (key >= '1' && key <= '9' && (size_t)(key - '1') < st.profile_count) {
+                st.pending_profile = key - '1';
+            }
+        }
+        next_sample = now_seconds();
+    }
+
+    sensor_sample_free(&prev);
+    sensor_sample_free(&cur);
+    top_restore_terminal();
+    if (rc != 0) {
+        return json_error("top", err);
+    }
+    return 0;
+}
+
+/* ---- tune: search limits, ratios and UV for throughput under caps ---- */
+
+#define TUNE_MAX_TRIALS 243
+#define TUNE_MAX_TAUS 8
+#define TUNE_ETA 3
+#define TUNE_SAMPLE_MS 250
+#define TUNE_SETTLE_MAX_S 60.0
+#define TUNE_COUNTER_STRIDE 8   /* uint64_t per worker counter: one cache line */
+
+enum tune_kernel {
+    TUNE_KERNEL_FMA,
+    TUNE_KERNEL_MEM,
+};
+
+/* One searched dimension; min == max holds it at one value. */
+struct tune_range {
+    double min;
+    double max;
+    int set;
+};
+
+struct tune_space {
+    struct tune_range pl1;
+    struct tune_range pl2;
+    struct tune_range p_ratio;
+    struct tune_range e_ratio;
+    struct tune_range uv;
+    double taus[TUNE_MAX_TAUS];
+    int tau_count;
+};
+
+struct tune_config {
+    double pl1_w;
+    double pl2_w;
+    double tau_s;               /* 0: left alone */
+    int p_ratio;
+    int e_ratio;
+    double uv_mv;
+};
+
+struct tune_candidate {
+    struct tune_config cfg;
+    int rung;                   /* last rung it was measured at */
+    double score;               /* at that rung */
+    int feasible;               /* 0 once any evaluation broke a cap */
+};
+
+struct tune_result {
+    double elapsed_s;
+    double throughput;
+    const char *unit;
+    double joules;
+    double avg_power_w;
+    double peak_power_w;
+    int peak_temp_c;
+    double steady_c;            /* model's settling temperature at the sustained power; NAN without a fit */
+    int runs;                   /* completed benchmark command runs */
+    double score;
+    const char *violation;      /* NULL when the evaluation stayed within the caps */
+};
+
+struct tune_state {
+    const char *cmd;            /* benchmark command; NULL runs the built-in kernel */
+    enum tune_kernel kernel;
+    int threads;
+    double max_temp_c;
+    double max_power_w;         /* 0: no power cap */
+    double settle_c;            /* each evaluation starts once the package is back down to this */
+    int set_p_ratio;
+    int set_e_ratio;
+    int set_uv;
+    int efficiency;             /* score work per joule instead of work per second */
+    struct thermal_view thermal;
+};
+
+/* Forked busy workers with a shared progress counter each. */
+struct tune_load {
+    pid_t *pids;
+    int count;
+    volatile uint64_t *counters;
+    size_t counters_sz;
+};
+
+/* One run of the benchmark command: stdout is kept for its last line. */
+struct tune_run {
+    pid_t pid;                  /* -1 once reaped */
+    int out_fd;
+    int status;
+    double started;
+    double ended;
+    char line[256];             /* line being read */
+    size_t line_len;
+    char last[256];             /* last complete non-empty line */
+};
+
+static double tune_random(uint64_t *state) {
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (double)((x * UINT64_C(0x2545F4914F6CDD1D)) >> 11) * 0x1.0p-53;
+}
+
+/* "MIN:MAX" or a single value. */
+static int parse_range(const char *s, struct tune_range *out) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s", s);
+    char *colon = strchr(buf, ':');
+    if (colon) {
+        *colon = '\0';
+    }
+    if (!parse_double(buf, &out->min)) {
+        return 0;
+    }
+    out->max = out->min;
+    if (colon && !parse_double(colon + 1, &out->max)) {
+        return 0;
+    }
+    out->set = 1;
+    return out->max >= out->min;
+}
+
+static int parse_tau_list(const char *s, struct tune_space *sp) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", s);
+    sp->tau_count = 0;
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        double tau = 0.0;
+        if (sp->tau_count == TUNE_MAX_TAUS || !parse_double(tok, &tau) || tau <= 0.0) {
+            return 0;
+        }
+        sp->taus[sp->tau_count++] = tau;
+    }
+    return sp->tau_count > 0;
+}
+
+static void tune_shuffle(int *perm, int n, uint64_t *rng) {
+    for (int i = 0; i < n; i++) {
+        perm[i] = i;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(tune_random(rng) * (i + 1));
+        int tmp = perm[i];
+        perm[i] = perm[j];
+        perm[j] = tmp;
+    }
+}
+
+/* Value in stratum perm[i] of n equal slices of the range. */
+static double tune_stratum(const struct tune_range *range, const int *perm, int i, int n, uint64_t *rng) {
+    return range->min + (range->max - range->min) * ((double)perm[i] + tune_random(rng)) / (double)n;
+}
+
+/*
+ * Latin hypercube over the space: every dimension's range is cut into n
+ * slices and each slice is used by exactly one candidate, so a small n still
+ * covers every range end to end.
+ */
+static int tune_sample_configs(struct tune_candidate *cands, int n, const struct tune_space *sp, double max_power_w,
+                               uint64_t *rng) {
+    int *perm = malloc(6 * (size_t)n * sizeof(*perm));
+    if (!perm) {
+        return -1;
+    }
+    for (int d = 0; d < 6; d++) {
+        tune_shuffle(perm + d * n, n, rng);
+    }
+    for (int i = 0; i < n; i++) {
+        struct tune_config *cfg = &cands[i].cfg;
+        cfg->pl1_w = round(tune_stratum(&sp->pl1, perm, i, n, rng) * 2.0) / 2.0;
+        cfg->pl2_w = round(tune_stratum(&sp->pl2, perm + n, i, n, rng) * 2.0) / 2.0;
+        cfg->p_ratio = (int)lround(tune_stratum(&sp->p_ratio, perm + 2 * n, i, n, rng));
+        cfg->e_ratio = (int)lround(tune_stratum(&sp->e_ratio, perm + 3 * n, i, n, rng));
+        // + 0.0 turns a rounded -0 into 0.
+        cfg->uv_mv = round(tune_stratum(&sp->uv, perm + 4 * n, i, n, rng)) + 0.0;
+        cfg->tau_s = sp->tau_count ? sp->taus[perm[5 * n + i] % sp->tau_count] : 0.0;
+        if (max_power_w > 0.0) {
+            cfg->pl1_w = fmin(cfg->pl1_w, max_power_w);
+            cfg->pl2_w = fmin(cfg->pl2_w, max_power_w);
+        }
+        cfg->pl2_w = fmax(cfg->pl2_w, cfg->pl1_w);
+        cands[i].rung = -1;
+        cands[i].feasible = 1;
+    }
+    free(perm);
+    return 0;
+}
+
+static void tune_worker(enum tune_kernel kernel, volatile uint64_t *counter) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    if (kernel == TUNE_KERNEL_MEM) {
+        // 32 MiB per worker is past any last-level cache; one count per MiB written and read back.
+        size_t words = (size_t)32 << 17;
+        uint64_t *buf = calloc(words, sizeof(*buf));
+        if (!buf) {
+            _exit(1);
+        }
+        for (uint64_t n = 1;; n++) {
+            size_t base = (size_t)(n % 32) << 17;
+            for (size_t k = 0; k < ((size_t)1 << 17); k++) {
+                buf[base + k] += k;
+            }
+            *counter = n;
+        }
+    }
+    // Eight independent multiply-add chains; one count per million multiply-adds. The fixed point is 1.0,
+    // so nothing overflows or goes denormal.
+    double a[8];
+    for (int j = 0; j < 8; j++) {
+        a[j] = 1.0 + j * 0.125;
+    }
+    volatile double sink = 0.0;
+    for (uint64_t n = 1;; n++) {
+        for (int k = 0; k < 125000; k++) {
+            for (int j = 0; j < 8; j++) {
+                a[j] = a[j] * 0.999999 + 1e-6;
+            }
+        }
+        sink = a[0] + a[1] + a[2] + a[3] + a[4] + a[5] + a[6] + a[7];
+        *counter = n;
+    }
+    (void)sink;
+}
+
+static void tune_load_stop(struct tune_load *l) {
+    for (int i = 0; i < l->count; i++) {
+        kill(l->pids[i], SIGKILL);
+    }
+    for (int i = 0; i < l->count; i++) {
+        waitpid(l->pids[i], NULL, 0);
+    }
+    if (l->counters) {
+        munmap((void *)l->counters, l->counters_sz);
+    }
+    free(l->pids);
+    memset(l, 0, sizeof(*l));
+}
+
+static int tune_load_start(struct tune_load *l, enum tune_kernel kernel, int threads, char *err, size_t err_sz) {
+    memset(l, 0, sizeof(*l));
+    l->counters_sz = (size_t)threads * TUNE_COUNTER_STRIDE * sizeof(uint64_t);
+    void *shared = mmap(NULL, l->counters_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    l->pids = calloc((size_t)threads, sizeof(*l->pids));
+    if (shared == MAP_FAILED || !l->pids) {
+        snprintf(err, err_sz, "cannot set up load workers: %s", strerror(errno));
+        if (shared != MAP_FAILED) {
+            munmap(shared, l->counters_sz);
+        }
+        free(l->pids);
+        l->pids = NULL;
+        return -1;
+    }
+    l->counters = shared;
+    for (int i = 0; i < threads; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            snprintf(err, err_sz, "fork failed: %s", strerror(errno));
+            tune_load_stop(l);
+            return -1;
+        }
+        if (pid == 0) {
+            tune_worker(kernel, l->counters + (size_t)i * TUNE_COUNTER_STRIDE);
+            _exit(0);
+        }
+        l->pids[l->count++] = pid;
+    }
+    return 0;
+}
+
+static uint64_t tune_load_work(const struct tune_load *l) {
+    uint64_t sum = 0;
+    for (int i = 0; i < l->count; i++) {
+        sum += l->counters[(size_t)i * TUNE_COUNTER_STRIDE];
+    }
+    return sum;
+}
+
+static int tune_run_start(struct tune_run *run, const char *cmd, char *err, size_t err_sz) {
+    memset(run, 0, sizeof(*run));
+    run->pid = -1;
+    run->out_fd = -1;
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        snprintf(err, err_sz, "pipe failed: %s", strerror(errno));
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        snprintf(err, err_sz, "fork failed: %s", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // Own process group, so a cap violation can kill everything the command started.
+        setpgid(0, 0);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull < 0 || dup2(devnull, STDIN_FILENO) < 0 || dup2(fds[1], STDOUT_FILENO) < 0) {
+            _exit(127);
+        }
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    setpgid(pid, pid);
+    close(fds[1]);
+    run->pid = pid;
+    run->out_fd = fds[0];
+    run->started = now_seconds();
+    return 0;
+}
+
+static void tune_run_read(struct tune_run *run) {
+    char buf[4096];
+    ssize_t n = read(run->out_fd, buf, sizeof(buf));
+    if (n <= 0) {
+        if (n == 0 || errno != EINTR) {
+            close(run->out_fd);
+            run->out_fd = -1;
+        }
+        return;
+    }
+    for (ssize_t i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+            if (run->line_len) {
+                memcpy(run->last, run->line, run->line_len);
+                run->last[run->line_len] = '\0';
+            }
+            run->line_len = 0;
+        } else if (run->line_len + 1 < sizeof(run->line)) {
+            run->line[run->line_len++] = buf[i];
+        }
+    }
+}
+
+/* Drains output until deadline; 1 when the command finished (and was reaped) before it. */
+static int tune_run_wait(struct tune_run *run, double deadline) {
+    while (run->pid > 0) {
+        if (waitpid(run->pid, &run->status, WNOHANG) == run->pid) {
+            run->ended = now_seconds();
+            // Anything it left running in the background would load the next evaluation.
+            kill(-run->pid, SIGKILL);
+            run->pid = -1;
+            while (run->out_fd >= 0) {
+                struct pollfd pfd = { run->out_fd, POLLIN, 0 };
+                if (poll(&pfd, 1, 0) <= 0) {
+                    close(run->out_fd);
+                    run->out_fd = -1;
+                    break;
+                }
+                tune_run_read(run);
+            }
+            if (run->line_len) {
+                memcpy(run->last, run->line, run->line_len);
+                run->last[run->line_len] = '\0';
+            }
+            return 1;
+        }
+        int wait_ms = (int)((deadline - now_seconds()) * 1000.0);
+        if (wait_ms <= 0 || stop_requested) {
+            return 0;
+        }
+        if (run->out_fd >= 0) {
+            struct pollfd pfd = { run->out_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, wait_ms) > 0) {
+                tune_run_read(run);
+            }
+        } else {
+            sleep_ms(wait_ms < 10 ? wait_ms : 10);
+        }
+    }
+    return 0;
+}
+
+static void tune_run_kill(struct tune_run *run) {
+    if (run->pid > 0) {
+        kill(-run->pid, SIGKILL);
+        kill(run->pid, SIGKILL);
+        waitpid(run->pid, NULL, 0);
+        run->pid = -1;
+    }
+    if (run->out_fd >= 0) {
+        close(run->out_fd);
+        run->out_fd = -1;
+    }
+}
+
+static int tune_apply(struct helper_conn *c, struct reply *r, const struct tune_state *ts,
+                      const struct tune_config *cfg, char *err, size_t err_sz) {
+    struct limits_write w;
+    if (write_limits(c, r, cfg->pl1_w, cfg->pl2_w, cfg->tau_s, 3, 0, &w, err, err_sz) != 0) {
+        return -1;
+    }
+    if (set_ratio_targets(c, r, ts->set_p_ratio ? cfg->p_ratio : 0, ts->set_e_ratio ? cfg->e_ratio : 0, err,
+                          err_sz) != 0) {
+        return -1;
+    }
+    if (ts->set_uv && helper_call(c, r, err, err_sz, "SET-CORE-UV %.3f", cfg->uv_mv) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Idles until the package is back down to settle_c, so every evaluation starts from about the same temperature. */
+static int tune_settle(struct helper_conn *c, struct reply *r, struct tune_state *ts, char *err, size_t err_sz) {
+    struct sensor_sample prev = { 0 };
+    struct sensor_sample cur = { 0 };
+    int rc = read_sensor_sample(c, r, &prev, err, err_sz);
+    double deadline = prev.t + TUNE_SETTLE_MAX_S;
+    while (rc == 0 && !stop_requested && prev.pkg_temp_valid && prev.pkg_temp_c > ts->settle_c && prev.t < deadline) {
+        sleep_ms(500);
+        rc = read_sensor_sample(c, r, &cur, err, err_sz);
+        if (rc == 0) {
+            thermal_view_feed(&ts->thermal, &prev, &cur);
+            struct sensor_sample tmp = prev;
+            prev = cur;
+            cur = tmp;
+        }
+    }
+    sensor_sample_free(&prev);
+    sensor_sample_free(&cur);
+    return rc;
+}
+
+/* A run's score: the number its last output line starts with, or NAN. */
+static double tune_run_value(const struct tune_run *run) {
+    char *end = NULL;
+    double v = strtod(run->last, &end);
+    return end != run->last && isfinite(v) && v > 0.0 ? v : NAN;
+}
+
+/*
+ * Applies cfg, runs the load for budget_s (the command runs back to back
+ * until then, at least once) and samples the package every TUNE_SAMPLE_MS,
+ * stopping the load on the first sample over a cap. Returns -1 only when the
+ * helper or the load could not be driven.
+ */
+static int tune_evaluate(struct helper_conn *c, struct reply *r, struct tune_state *ts,
+                         const struct tune_config *cfg, double budget_s, struct tune_result *res, char *err,
+                         size_t err_sz) {
+    memset(res, 0, sizeof(*res));
+    res->steady_c = NAN;
+    res->peak_temp_c = -1;
+    if (tune_settle(c, r, ts, err, err_sz) != 0 || tune_apply(c, r, ts, cfg, err, err_sz) != 0) {
+        return -1;
+    }
+
+    struct sensor_sample prev = { 0 };
+    struct sensor_sample cur = { 0 };
+    struct tune_load load = { 0 };
+    struct tune_run run = { .pid = -1, .out_fd = -1 };
+    if (read_sensor_sample(c, r, &prev, err, err_sz) != 0) {
+        sensor_sample_free(&prev);
+        return -1;
+    }
+    int rc = ts->cmd ? tune_run_start(&run, ts->cmd, err, err_sz)
+                     : tune_load_start(&load, ts->kernel, ts->threads, err, err_sz);
+    double start = prev.t;
+    double run_s = 0.0;
+    double value_sum = 0.0;
+    int valued_runs = 0;
+    int done = rc != 0;
+
+    while (!done && !stop_requested) {
+        double deadline = now_seconds() + TUNE_SAMPLE_MS / 1000.0;
+        if (ts->cmd) {
+            while (!done && tune_run_wait(&run, deadline)) {
+                if (!WIFEXITED(run.status) || WEXITSTATUS(run.status) != 0) {
+                    res->violation = "command failed";
+                    done = 1;
+                    break;
+                }
+                res->runs++;
+                run_s += run.ended - run.started;
+                double v = tune_run_value(&run);
+                if (!isnan(v)) {
+                    value_sum += v;
+                    valued_runs++;
+                }
+                if (run.ended - start >= budget_s) {
+                    done = 1;
+                } else if (tune_run_start(&run, ts->cmd, err, err_sz) != 0) {
+                    rc = -1;
+                    done = 1;
+                }
+            }
+        } else {
+            sleep_ms(TUNE_SAMPLE_MS);
+        }
+        if (read_sensor_sample(c, r, &cur, err, err_sz) != 0) {
+            rc = -1;
+            break;
+        }
+        double power = sample_power_w(&prev, &cur);
+        res->joules += power * (cur.t - prev.t);
+        res->peak_power_w = fmax(res->peak_power_w, power);
+        thermal_view_feed(&ts->thermal, &prev, &cur);
+        if (cur.pkg_temp_valid && cur.pkg_temp_c > res->peak_temp_c) {
+            res->peak_temp_c = cur.pkg_temp_c;
+        }
+        struct sensor_sample tmp = prev;
+        prev = cur;
+        cur = tmp;
+
+        if (prev.pkg_temp_valid && prev.pkg_temp_c > ts->max_temp_c) {
+            res->violation = "temperature";
+            done = 1;
+        } else if (ts->max_power_w > 0.0 && power > ts->max_power_w) {
+            res->violation = "power";
+            done = 1;
+        } else if (!ts->cmd && prev.t - start >= budget_s) {
+            done = 1;
+        }
+    }
+
+    res->elapsed_s = prev.t - start;
+    if (ts->cmd) {
+        tune_run_kill(&run);
+        if (valued_runs == res->runs && res->runs > 0) {
+            res->throughput = value_sum / valued_runs;
+            res->unit = "score";
+        } else {
+            res->throughput = run_s > 0.0 ? res->runs / run_s : 0.0;
+            res->unit = "runs/s";
+        }
+    } else if (load.count) {
+        res->throughput = res->elapsed_s > 0.0 ? (double)tune_load_work(&load) / res->elapsed_s : 0.0;
+        res->unit = ts->kernel == TUNE_KERNEL_MEM ? "MiB/s" : "Mmadd/s";
+        tune_load_stop(&load);
+    }
+    sensor_sample_free(&prev);
+    sensor_sample_free(&cur);
+    if (rc != 0) {
+        return -1;
+    }
+    if (stop_requested && !res->violation) {
+        res->violation = "interrupted";
+    }
+
+    res->avg_power_w = res->elapsed_s > 0.0 ? res->joules / res->elapsed_s : 0.0;
+    // A short evaluation ends before the package settles: hold the fitted model to the cap as well, at the
+    // power the load would sustain once tau runs out.
+    struct ld_thermal_params p;
+    if (ld_thermal_model_params(&ts->thermal.model, &p) == 0) {
+        res->steady_c = ld_thermal_steady_c(&p, fmin(cfg->pl1_w, res->avg_power_w));
+        if (!res->violation && res->steady_c > ts->max_temp_c) {
+            res->violation = "predicted temperature";
+        }
+    }
+    res->score = res->violation ? -1.0
+                 : ts->efficiency ? (res->avg_power_w > 0.0 ? res->throughput / res->avg_power_w : 0.0)
+                                  : res->throughput;
+    return 0;
+}
+
+static void json_tune_config(const struct tune_config *cfg) {
+    printf("{\"pl1_w\":%.3f,\"pl2_w\":%.3f,\"tau_s\":", cfg->pl1_w, cfg->pl2_w);
+    if (cfg->tau_s > 0.0) {
+        printf("%.3f", cfg->tau_s);
+    } else {
+        printf("null");
+    }
+    printf(",\"p_ratio\":%d,\"e_ratio\":%d,\"core_uv_mv\":%.3f}", cfg->p_ratio, cfg->e_ratio, cfg->uv_mv);
+}
+
+static void tune_report(FILE *log, int eval, int rung, double budget_s, const struct tune_config *cfg,
+                        const struct tune_result *res) {
+    printf("{\"cmd\":\"tune\",\"eval\":%d,\"rung\":%d,\"budget_s\":%.1f,\"config\":", eval, rung, budget_s);
+    json_tune_config(cfg);
+    printf(",\"elapsed_s\":%.3f,\"runs\":%d,\"throughput\":%.6g,\"unit\":\"%s\",\"joules\":%.3f,"
+           "\"avg_power_w\":%.3f,\"peak_power_w\":%.3f,\"peak_temp_c\":",
+           res->elapsed_s, res->runs, res->throughput, res->unit ? res->unit : "", res->joules, res->avg_power_w,
+           res->peak_power_w);
+    if (res->peak_temp_c >= 0) {
+        printf("%d", res->peak_temp_c);
+    } else {
+        printf("null");
+    }
+    printf(",\"steady_c\":");
+    if (isnan(res->steady_c)) {
+        printf("null");
+    } else {
+        printf("%.1f", res->steady_c);
+    }
+    printf(",\"score\":%.6g,\"violation\":", res->score);
+    if (res->violation) {
+        json_string(res->violation);
+    } else {
+        printf("null");
+    }
+    printf("}\n");
+    fflush(stdout);
+
+    if (log) {
+        char peak[16] = "";
+        char steady[32] = "";
+        if (res->peak_temp_c >= 0) {
+            snprintf(peak, sizeof(peak), "%d", res->peak_temp_c);
+        }
+        if (!isnan(res->steady_c)) {
+            snprintf(steady, sizeof(steady), "%.1f", res->steady_c);
+        }
+        fprintf(log, "%d,%d,%.1f,%.3f,%.3f,%.3f,%d,%d,%.3f,%.3f,%d,%.6g,%s,%.3f,%.3f,%.3f,%s,%s,%.6g,%s\n", eval,
+                rung, budget_s, cfg->pl1_w, cfg->pl2_w, cfg->tau_s, cfg->p_ratio, cfg->e_ratio, cfg->uv_mv,
+                res->elapsed_s, res->runs, res->throughput, res->unit ? res->unit : "", res->joules,
+                res->avg_power_w, res->peak_power_w, peak, steady, res->score, res->violation ? res->violation : "");
+        fflush(log);
+    }
+}
+
+static int compare_candidate_score(const void *a, const void *b) {
+    const struct tune_candidate *x = *(const struct tune_candidate *const *)a;
+    const struct tune_candidate *y = *(const struct tune_candidate *const *)b;
+    return (x->score < y->score) - (x->score > y->score);
+}
+
+static int make_parent_dirs(const char *path, char *err, size_t err_sz) {
+    char buf[4096];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char *p = buf + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if (mkdir(buf, 0755) != 0 && errno != EEXIST) {
+            snprintf(err, err_sz, "mkdir %.*s failed: %s", (int)(p - buf), path, strerror(errno));
+            return -1;
+        }
+        *p = '/';
+    }
+    return 0;
+}
+
+/* Writes a GUI profile (version 1); tau_s is an extra key the GUI ignores and load_profile applies. */
+static int write_tune_profile(const char *path, const struct tune_config *cfg, char *err, size_t err_sz) {
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (make_parent_dirs(path, err, err_sz) != 0) {
+        return -1;
+    }
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        snprintf(err, err_sz, "open %s.tmp failed: %s", path, strerror(errno));
+        return -1;
+    }
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm));
+    fprintf(f, "{\n    \"version\": 1,\n    \"pl1_w\": %.3f,\n    \"pl2_w\": %.3f,\n    \"p_ratio\": %d,\n"
+               "    \"e_ratio\": %d,\n    \"core_uv_mv\": %.3f,\n",
+            cfg->pl1_w, cfg->pl2_w, cfg->p_ratio, cfg->e_ratio, cfg->uv_mv);
+    if (cfg->tau_s > 0.0) {
+        fprintf(f, "    \"tau_s\": %.3f,\n", cfg->tau_s);
+    }
+    fprintf(f, "    \"saved_at\": \"%s\"\n}\n", stamp);
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        snprintf(err, err_sz, "write %s failed: %s", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * tune: successive halving over PL1, PL2, tau, P/E ratios and core UV.
+ * Every candidate is measured for --seconds, the best third goes on to an
+ * evaluation three times as long, and so on until one is left; the longer
+ * rungs average out the noise the short ones rank by. Limits, ratios and UV
+ * are restored afterwards and the winner is saved as a GUI profile.
+ */
+static int cmd_tune(struct helper_conn *c, struct reply *r, int argc, char **argv) {
+    const char *usage_text =
+        "usage: tune [--cmd CMD | --kernel fma|mem] [--threads N] [--pl1 MIN:MAX] [--pl2 MIN:MAX] [--tau S,S,...] "
+        "[--p-ratio MIN:MAX] [--e-ratio MIN:MAX] [--uv MIN:MAX] [--max-temp C] [--max-power W] [--settle C] "
+        "[--trials N] [--seconds S] [--seed N] [--objective throughput|efficiency] [--out FILE] [--log CSV]";
+    struct tune_state ts;
+    struct tune_space sp;
+    memset(&ts, 0, sizeof(ts));
+    memset(&sp, 0, sizeof(sp));
+    ld_thermal_model_init(&ts.thermal.model);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ts.threads = cpus > 0 ? (int)cpus : 1;
+    ts.max_temp_c = NAN;
+    ts.settle_c = NAN;
+    int trials = 27;
+    double seconds = 5.0;
+    uint64_t rng = (uint64_t)time(NULL) * 2654435761u + (uint64_t)getpid();
+    const char *out_path = NULL;
+    const char *log_path = NULL;
+    char err[1024];
+
+    for (int i = 0; i < argc; i++) {
+        int ok = i + 1 < argc;
+        const char *val = ok ? argv[i + 1] : "";
+        int seed = 0;
+        if (!strcmp(argv[i], "--cmd")) {
+            ts.cmd = val;
+        } else if (!strcmp(argv[i], "--kernel")) {
+            ok = ok && (!strcmp(val, "fma") || !strcmp(val, "mem"));
+            ts.kernel = !strcmp(val, "mem") ? TUNE_KERNEL_MEM : TUNE_KERNEL_FMA;
+        } else if (!strcmp(argv[i], "--threads")) {
+            ok = ok && parse_int(val, &ts.threads) && ts.threads > 0;
+        } else if (!strcmp(argv[i], "--pl1")) {
+            ok = ok && parse_range(val, &sp.pl1) && sp.pl1.min > 0.0;
+        } else if (!strcmp(argv[i], "--pl2")) {
+            ok = ok && parse_range(val, &sp.pl2) && sp.pl2.min > 0.0;
+        } else if (!strcmp(argv[i], "--tau")) {
+            ok = ok && parse_tau_list(val, &sp);
+        } else if (!strcmp(argv[i], "--p-ratio")) {
+            ok = ok && parse_range(val, &sp.p_ratio) && sp.p_ratio.min >= 1.0;
+        } else if (!strcmp(argv[i], "--e-ratio")) {
+            ok = ok && parse_range(val, &sp.e_ratio) && sp.e_ratio.min >= 1.0;
+        } else if (!strcmp(argv[i], "--uv")) {
+            ok = ok && parse_range(val, &sp.uv);
+        } else if (!strcmp(argv[i], "--max-temp")) {
+            ok = ok && parse_double(val, &ts.max_temp_c) && ts.max_temp_c > 0.0;
+        } else if (!strcmp(argv[i], "--max-power")) {
+            ok = ok && parse_double(val, &ts.max_power_w) && ts.max_power_w > 0.0;
+        } else if (!strcmp(argv[i], "--settle")) {
+            ok = ok && parse_double(val, &ts.settle_c) && ts.settle_c > 0.0;
+        } else if (!strcmp(argv[i], "--trials")) {
+            ok = ok && parse_int(val, &trials) && trials >= 1 && trials <= TUNE_MAX_TRIALS;
+        } else if (!strcmp(argv[i], "--seconds")) {
+            ok = ok && parse_double(val, &seconds) && seconds >= 1.0;
+        } else if (!strcmp(argv[i], "--seed")) {
+            ok = ok && parse_int(val, &seed) && seed >= 0;
+            rng = (uint64_t)seed * 2654435761u + 1;
+        } else if (!strcmp(argv[i], "--objective")) {
+            ok = ok && (!strcmp(val, "throughput") || !strcmp(val, "efficiency"));
+            ts.efficiency = !strcmp(val, "efficiency");
+        } else if (!strcmp(argv[i], "--out")) {
+            out_path = val;
+        } else if (!strcmp(argv[i], "--log")) {
+            log_path = val;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            return json_error("tune", usage_text);
+        }
+        i++;
+    }
+    if (!sp.pl1.set && !sp.pl2.set && !sp.tau_count && !sp.p_ratio.set && !sp.e_ratio.set && !sp.uv.set) {
+        return json_error("tune", "nothing to search: give at least one of --pl1, --pl2, --tau, --p-ratio, "
+                                  "--e-ratio, --uv");
+    }
+
+    // What the search starts from and restores: raw limit registers (tau included), ratio targets, UV.
+    if (helper_call(c, r, err, sizeof(err), "READ") != 0) {
+        return json_error("tune", err);
+    }
+    double unit_watts = reply_double(r, "UNIT_WATTS");
+    uint64_t saved_msr = reply_u64(r, "MSR");
+    uint64_t saved_mmio = reply_u64(r, "MMIO");
+    int saved_p = reply_int(r, "P_RATIO_TARGET");
+    int saved_e = reply_int(r, "E_RATIO_TARGET");
+    int uv_valid = reply_int(r, "CORE_UV_VALID");
+    double saved_uv = uv_valid ? reply_double(r, "CORE_UV_MV") : 0.0;
+    // A ratio is only needed when it is searched; otherwise an unreadable one (no E-cores, parked E-cores) is saved
+    // as 0, which profile loaders take as "leave alone".
+    if (!reply_int(r, "P_RATIO_VALID")) {
+        saved_p = 0;
+    }
+    if (!reply_int(r, "E_RATIO_VALID")) {
+        saved_e = 0;
+    }
+    if (sp.p_ratio.set && saved_p <= 0) {
+        return json_error("tune", "P ratio target is not readable, so --p-ratio could not be restored");
+    }
+    if (sp.e_ratio.set && saved_e <= 0) {
+        return json_error("tune", "E ratio target is not readable (no online E-cores?), so --e-ratio could not be "
+                                  "restored");
+    }
+    if (sp.uv.set && !uv_valid) {
+        return json_error("tune", "core voltage offset is not readable, so --uv could not be restored");
+    }
+    ts.set_p_ratio = sp.p_ratio.set;
+    ts.set_e_ratio = sp.e_ratio.set;
+    ts.set_uv = sp.uv.set;
+    // Dimensions not searched are held where they are.
+    double pl1_now = (double)ld_pl1_units(saved_msr) * unit_watts;
+    double pl2_now = (double)ld_pl2_units(saved_msr) * unit_watts;
+    if (!sp.pl1.set) {
+        sp.pl1 = (struct tune_range){ pl1_now, pl1_now, 0 };
+    }
+    if (!sp.pl2.set) {
+        sp.pl2 = (struct tune_range){ pl2_now, pl2_now, 0 };
+    }
+    if (!sp.p_ratio.set) {
+        sp.p_ratio = (struct tune_range){ saved_p, saved_p, 0 };
+    }
+    if (!sp.e_ratio.set) {
+        sp.e_ratio = (struct tune_range){ saved_e, saved_e, 0 };
+    }
+    if (!sp.uv.set) {
+        sp.uv = (struct tune_range){ saved_uv, saved_uv, 0 };
+    }
+
+    struct sensor_sample idle = { 0 };
+    if (read_sensor_sample(c, r, &idle, err, sizeof(err)) != 0) {
+        sensor_sample_free(&idle);
+        return json_error("tune", err);
+    }
+    if (!idle.pkg_temp_valid) {
+        sensor_sample_free(&idle);
+        return json_error("tune", "package temperature is not readable, so the temperature cap cannot be held");
+    }
+    if (isnan(ts.max_temp_c)) {
+        ts.max_temp_c = idle.tjmax - 5;
+    }
+    if (isnan(ts.settle_c)) {
+        ts.settle_c = idle.pkg_temp_c + 5;
+    }
+    sensor_sample_free(&idle);
+
+    char default_out[4096];
+    if (!out_path) {
+        if (profile_dir(default_out, sizeof(default_out)) != 0) {
+            return json_error("tune", "no profile directory (HOME unset); pass --out");
+        }
+        strncat(default_out, "/tuned.json", sizeof(default_out) - strlen(default_out) - 1);
+        out_path = default_out;
+    }
+    FILE *log = NULL;
+    if (log_path) {
+        log = fopen(log_path, "w");
+        if (!log) {
+            snprintf(err, sizeof(err), "open %s failed: %s", log_path, strerror(errno));
+            return json_error("tune", err);
+        }
+        fprintf(log, "eval,rung,budget_s,pl1_w,pl2_w,tau_s,p_ratio,e_ratio,core_uv_mv,elapsed_s,runs,throughput,unit,"
+                     "joules,avg_power_w,peak_power_w,peak_temp_c,steady_c,score,violation\n");
+    }
+
+    struct tune_candidate *cands = calloc((size_t)trials, sizeof(*cands));
+    struct tune_candidate **alive = calloc((size_t)trials, sizeof(*alive));
+    if (!cands || !alive || tune_sample_configs(cands, trials, &sp, ts.max_power_w, &rng) != 0) {
+        free(cands);
+        free(alive);
+        if (log) {
+            fclose(log);
+        }
+        return json_error("tune", "out of memory");
+    }
+    for (int i = 0; i < trials; i++) {
+        alive[i] = &cands[i];
+    }
+
+    int alive_count = trials;
+    int evals = 0;
+    int failed = 0;
+    double budget = seconds;
+    for (int rung = 0; alive_count > 0 && !failed && !stop_requested; rung++, budget *= TUNE_ETA) {
+        for (int i = 0; i < alive_count && !stop_requested; i++) {
+            struct tune_candidate *cand = alive[i];
+            struct tune_result res;
+            if (tune_evaluate(c, r, &ts, &cand->cfg, budget, &res, err, sizeof(err)) != 0) {
+                failed = 1;
+                break;
+            }
+            if (stop_requested) {
+                break;
+            }
+            cand->rung = rung;
+            cand->score = res.score;
+            cand->feasible = !res.violation;
+            tune_report(log, ++evals, rung, budget, &cand->cfg, &res);
+        }
+        if (failed || stop_requested || alive_count == 1) {
+            break;
+        }
+        qsort(alive, (size_t)alive_count, sizeof(*alive), compare_candidate_score);
+        int keep = alive_count / TUNE_ETA > 0 ? alive_count / TUNE_ETA : 1;
+        int feasible = 0;
+        while (feasible < alive_count && alive[feasible]->feasible) {
+            feasible++;
+        }
+        alive_count = keep < feasible ? keep : feasible;
+    }
+
+    // Put everything back whatever happened above; every step is tried even when one fails.
+    char restore_err[768] = "";
+    char step_err[512];
+    if (helper_call(c, r, step_err, sizeof(step_err), "WRITE-MSR 0x%016" PRIx64, saved_msr) != 0 ||
+        helper_call(c, r, step_err, sizeof(step_err), "WRITE-MMIO 0x%016" PRIx64, saved_mmio) != 0) {
+        snprintf(restore_err, sizeof(restore_err), "limits: %s", step_err);
+    }
+    if (set_ratio_targets(c, r, ts.set_p_ratio ? saved_p : 0, ts.set_e_ratio ? saved_e : 0, step_err,
+                          sizeof(step_err)) != 0) {
+        snprintf(restore_err, sizeof(restore_err), "ratios: %s", step_err);
+    }
+    if (ts.set_uv && helper_call(c, r, step_err, sizeof(step_err), "SET-CORE-UV %.3f", saved_uv) != 0) {
+        snprintf(restore_err, sizeof(restore_err), "core UV: %s", step_err);
+    }
+    if (log) {
+        fclose(log);
+    }
+
+    // Best: furthest rung reached, then score there; only candidates that never broke a cap.
+    const struct tune_candidate *best = NULL;
+    for (int i = 0; i < trials; i++) {
+        const struct tune_candidate *cand = &cands[i];
+        if (cand->rung >= 0 && cand->feasible &&
+            (!best || cand->rung > best->rung || (cand->rung == best->rung && cand->score > best->score))) {
+            best = cand;
+        }
+    }
+    int rc = 0;
+    if (failed) {
+        rc = json_error("tune", err);
+    } else if (restore_err[0]) {
+        snprintf(err, sizeof(err), "restoring the starting settings failed: %s", restore_err);
+        rc = json_error("tune", err);
+    } else if (stop_requested) {
+        rc = json_error("tune", "interrupted; no profile written");
+    } else if (!best) {
+        rc = json_error("tune", "no configuration stayed within the caps");
+    } else if (write_tune_profile(out_path, &best->cfg, err, sizeof(err)) != 0) {
+        rc = json_error("tune", err);
+    } else {
+        printf("{\"cmd\":\"tune\",\"ok\":true,\"objective\":\"%s\",\"evaluations\":%d,\"best\":{\"config\":",
+               ts.efficiency ? "efficiency" : "throughput", evals);
+        json_tune_config(&best->cfg);
+        printf(",\"rung\":%d,\"score\":%.6g},\"profile\":", best->rung, best->score);
+        json_string(out_path);
+        printf(",\"log\":");
+        if (log_path) {
+            json_string(log_path);
+        } else {
+            printf("null");
+        }
+        printf("}\n");
+        fflush(stdout);
+    }
+    free(cands);
+    free(alive);
+    return rc;
+}
+
+/* ---- workload placement ---- */
+
+static void json_cpu_list(const char *key, const struct ld_cpu_list *list) {
+    printf("\"%s\":[", key);
+    for (size_t i = 0; i < list->count; i++) {
+        printf("%s%d", i ? "," : "", list->ids[i]);
+    }
+    printf("]");
+}
+
+/*
+ * run-on <P|E|favored> [--cgroup NAME] [--] <command> [args]: pins this
+ * process (and optionally a new cpuset cgroup) to the class, then execs the
+ * command, which inherits both. Nothing is printed on success: stdout
+ * belongs to the command.
+ */
+static int cmd_run_on(int argc, char **argv) {
+    const char *usage_text = "usage: run-on P|E|favored [--cgroup NAME] [--] <command> [args]";
+    enum ld_core_class cls;
+    if (argc < 2 || ld_core_class_parse(argv[0], &cls) != 0) {
+        return json_error("run-on", usage_text);
+    }
+    const char *cgroup = NULL;
+    int i = 1;
+    for (; i < argc; i++) {
+        if (!strcmp(argv[i], "--cgroup") && i + 1 < argc) {
+            cgroup = argv[++i];
+        } else if (!strcmp(argv[i], "--")) {
+            i++;
+            break;
+        } else {
+            break;
+        }
+    }
+    if (i >= argc) {
+        return json_error("run-on", usage_text);
+    }
+
+    char err[512] = {0};
+    struct ld_cpu_list cpus;
+    ld_cpu_list_init(&cpus);
+    if (ld_core_class_cpus(cls, &cpus, err, sizeof(err)) != 0 ||
+        (cgroup && ld_cgroup_enter(cgroup, &cpus, getpid(), err, sizeof(err)) != 0) ||
+        ld_affinity_set_pid(getpid(), &cpus, NULL, err, sizeof(err)) != 0) {
+        ld_cpu_list_free(&cpus);
+        return json_error("run-on", err);
+    }
+    ld_cpu_list_free(&cpus);
+
+    execvp(argv[i], argv + i);
+    snprintf(err, sizeof(err), "exec %s failed: %s", argv[i], strerror(errno));
+    json_error("run-on", err);
+    return 127;
+}
+
+/* pin <P|E|favored> --pid PID | --cgroup PATH: re-pins a running process (all threads) or cgroup. */
+static int cmd_pin(int argc, char **argv) {
+    const char *usage_text = "usage: pin P|E|favored --pid PID | --cgroup PATH";
+    enum ld_core_class cls;
+    int pid = 0;
+    const char *cgroup = NULL;
+    if (argc != 3 || ld_core_class_parse(argv[0], &cls) != 0) {
+        return json_error("pin", usage_text);
+    }
+    if (!strcmp(argv[1], "--pid")) {
+        if (!parse_int(argv[2], &pid) || pid <= 0) {
+            return json_error("pin", usage_text);
+        }
+    } else if (!strcmp(argv[1], "--cgroup")) {
+        cgroup = argv[2];
+    } else {
+        return json_error("pin", usage_text);
+    }
+
+    char err[512] = {0};
+    struct ld_cpu_list cpus;
+    ld_cpu_list_init(&cpus);
+    size_t threads = 0;
+    const char *via = "affinity";
+    int rc = ld_core_class_cpus(cls, &cpus, err, sizeof(err));
+    if (rc == 0) {
+        rc = cgroup ? ld_cgroup_pin(cgroup, &cpus, &via, &threads, err, sizeof(err))
+                    : ld_affinity_set_pid((pid_t)pid, &cpus, &threads, err, sizeof(err));
+    }
+    if (rc != 0) {
+        ld_cpu_list_free(&cpus);
+        return json_error("pin", err);
+    }
+    printf("{\"cmd\":\"pin\",\"ok\":true,\"class\":");
+    json_string(ld_core_class_name(cls));
+    printf(",");
+    json_cpu_list("cpus", &cpus);
+    if (cgroup) {
+        printf(",\"cgroup\":");
+        json_string(cgroup);
+    } else {
+        printf(",\"pid\":%d", pid);
+    }
+    printf(",\"via\":\"%s\",\"threads\":%zu}\n", via, threads);
+    ld_cpu_list_free(&cpus);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [--socket PATH] [--helper PATH] [--direct] [--backend auto|direct|powercap] <command> [args]\n"
+        "Commands (all print JSON):\n"
+        "  read                                  limits, ratios, voltage offset\n"
+        "  set pl1=W pl2=W [target=msr|mmio|both] [powercap=yes|no]\n"
+        "  sync msr->mmio | mmio->msr\n"
+        "  ratio p|e|all <ratio> | pe <p> <e> | cpu <cpu> <ratio>\n"
+        "  uv <offset_mv>\n"
+        "  vf [point <n> <mV> | band <min_ratio> <max_ratio> <mV>]   per-point V/F curve offsets\n"
+        "  sensors                               one package + per-core sample\n"
+        "  residency [reset] [--seconds N]       per-core time at each ratio and temperature band\n"
+        "  ledger [profile <name>]               energy per day/week/profile from the helper daemon\n"
+        "  watch [--interval ms] [--count N] [--pl1 W] [--pl2 W]   JSON line per sample, with thermal predictions\n"
+        "  record --out FILE [--interval ms] [--count N]   CSV samples\n"
+        "       watch/record: [--adaptive] [--max-interval ms] sample every --interval ms while power, ratios or\n"
+        "       throttling change, backing off to --max-interval (default 2000) while they hold\n"
+        "  bench [--count N]                     helper round-trip latency\n"
+        "  energy [--seconds N] [--interval ms] [--top N] [--csv FILE]   per-process energy ranking\n"
+        "  top [--interval ms] [--profile FILE]... [--apply-uv]   live terminal dashboard\n"
+        "  tune [--cmd CMD | --kernel fma|mem] [--pl1|--pl2|--p-ratio|--e-ratio|--uv MIN:MAX] [--tau S,...]\n"
+        "       [--max-temp C] [--max-power W] [--trials N] [--seconds S] [--objective throughput|efficiency]\n"
+        "       [--out FILE] [--log CSV]          search limits for throughput under caps, save a profile\n"
+        "  powercap [list] | set <zone> <constraint> <W> [window_s] | watch [--interval ms] [--count N]\n"
+        "  decode <register> <value> [<new>] [units=0xRAW] [tjmax=C]   decode/diff raw values offline\n"
+        "  run-on P|E|favored [--cgroup NAME] [--] <cmd> [args]   exec cmd on that core class\n"
+        "  pin P|E|favored --pid PID | --cgroup PATH   re-pin a running process or cgroup\n"
+        "Connects to %s when a helper is listening, otherwise starts one directly.\n",
+        argv0, DEFAULT_SOCKET_PATH);
+}
+
+int main(int argc, char **argv) {
+    struct options opt = { DEFAULT_SOCKET_PATH, NULL, NULL, 0 };
+    const char *env_socket = getenv("LIMITS_HELPER_SOCKET");
+    if (env_socket && *env_socket) {
+        opt.socket_path = env_socket;
+    }
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "--socket") && i + 1 < argc) {
+            opt.socket_path = argv[++i];
+        } else if (!strcmp(argv[i], "--helper") && i + 1 < argc) {
+            opt.helper_path = argv[++i];
+        } else if (!strcmp(argv[i], "--direct")) {
+            opt.direct = 1;
+        } else if (!strcmp(argv[i], "--backend") && i + 1 < argc) {
+            opt.backend = argv[++i];
+        } else if (!strcmp(argv[i], "--run-on")) {
+            break;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (i >= argc || !strcmp(argv[i], "help")) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *cmd = !strcmp(argv[i], "--run-on") ? "run-on" : argv[i];
+    int sub_argc = argc - i - 1;
+    char **sub_argv = argv + i + 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!strcmp(cmd, "decode")) {
+        return cmd_decode(sub_argc, sub_argv);
+    }
+    // Placement runs as the calling user and needs no helper.
+    if (!strcmp(cmd, "run-on")) {
+        return cmd_run_on(sub_argc, sub_argv);
+    }
+    if (!strcmp(cmd, "pin")) {
+        return cmd_pin(sub_argc, sub_argv);
+    }
+
+    char err[512];
+    struct helper_conn conn;
+    if (conn_open(&conn, &opt, err, sizeof(err)) != 0) {
+        return json_error(cmd, err);
+    }
+    struct reply r;
+    reply_init(&r);
+
+    int rc;
+    if (!strcmp(cmd, "read")) {
+        rc = cmd_read(&conn, &r);
+    } else if (!strcmp(cmd, "set")) {
+        rc = cmd_set(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "sync")) {
+        rc = cmd_sync(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "ratio")) {
+        rc = cmd_ratio(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "uv")) {
+        rc = cmd_uv(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "vf")) {
+        rc = cmd_vf(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "sensors")) {
+        rc = cmd_sensors(&conn, &r);
+    } else if (!strcmp(cmd, "residency")) {
+        rc = cmd_residency(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "ledger")) {
+        rc = cmd_ledger(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "watch")) {
+        rc = cmd_watch(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "record")) {
+        rc = cmd_record(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "bench")) {
+        rc = cmd_bench(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "energy")) {
+        rc = cmd_energy(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "powercap")) {
+        rc = cmd_powercap(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "top")) {
+        rc = cmd_top(&conn, &r, sub_argc, sub_argv);
+    } else if (!strcmp(cmd, "tune")) {
+        rc = cmd_tune(&conn, &r, sub_argc, sub_argv);
+    } else {
+        snprintf(err, sizeof(err), "unknown command '%s'", cmd);
+        rc = json_error(cmd, err);
+    }
+
+    reply_free(&r);
+    conn_close(&conn);
+    return rc;
+}
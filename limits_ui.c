@@ -1,141 +1,15 @@
 #define _GNU_SOURCE
 
 #include <errno.h>
-#include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <unistd.h>
 
-#define MAP_SIZE    (2 * 1024 * 1024)
-#define PL_OFF      0x59A0
-
-#include "mchbar_base.h"
-
-#define MSR_RAPL_POWER_UNIT  0x606
-#define MSR_PKG_POWER_LIMIT  0x610
-
-struct mmio_ctx {
-    int fd;
-    volatile uint8_t *base;
-};
-
-static uint64_t rd64(volatile uint8_t *base, uint32_t off) {
-    volatile uint32_t *p32 = (volatile uint32_t *)(base + off);
-    uint64_t lo = p32[0];
-    uint64_t hi = p32[1];
-    return lo | (hi << 32);
-}
-
-static void wr64(volatile uint8_t *base, uint32_t off, uint64_t v) {
-    volatile uint32_t *p32 = (volatile uint32_t *)(base + off);
-    p32[0] = (uint32_t)(v & 0xffffffffu);
-    p32[1] = (uint32_t)(v >> 32);
-    (void)p32[1];
-}
-
-static int write_text_file(const char *path, const char *text) {
-    int fd = open(path, O_WRONLY);
-    if (fd < 0) {
-        return -1;
-    }
-    size_t len = strlen(text);
-    ssize_t n = write(fd, text, len);
-    int saved_errno = errno;
-    close(fd);
-    if (n != (ssize_t)len) {
-        errno = saved_errno;
-        return -1;
-    }
-    return 0;
-}
-
-static int write_powercap_uw(uint64_t pl1_uw, uint64_t pl2_uw) {
-    char buf[32];
-    const char *pl1_path = "/sys/class/powercap/intel-rapl:0/constraint_0_power_limit_uw";
-    const char *pl2_path = "/sys/class/powercap/intel-rapl:0/constraint_1_power_limit_uw";
-
-    snprintf(buf, sizeof(buf), "%" PRIu64, pl1_uw);
-    if (write_text_file(pl1_path, buf) != 0) {
-        return -1;
-    }
-    snprintf(buf, sizeof(buf), "%" PRIu64, pl2_uw);
-    if (write_text_file(pl2_path, buf) != 0) {
-        return -1;
-    }
-    return 0;
-}
-
-static int open_mmio(struct mmio_ctx *ctx) {
-    uint64_t mchbar_base = 0;
-    char err[256] = {0};
-    if (mchbar_get_base(&mchbar_base, err, sizeof(err)) != 0) {
-        fprintf(stderr, "MCHBAR base discovery failed: %s\n", err[0] ? err : "unknown error");
-        return -1;
-    }
-
-    ctx->fd = open("/dev/mem", O_RDWR | O_SYNC);
-    if (ctx->fd < 0) {
-        perror("open(/dev/mem)");
-        return -1;
-    }
-
-    ctx->base = mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->fd, mchbar_base);
-    if (ctx->base == MAP_FAILED) {
-        perror("mmap");
-        close(ctx->fd);
-        ctx->fd = -1;
-        return -1;
-    }
-    return 0;
-}
-
-static void close_mmio(struct mmio_ctx *ctx) {
-    if (ctx->base && ctx->base != MAP_FAILED) {
-        munmap((void *)ctx->base, MAP_SIZE);
-        ctx->base = NULL;
-    }
-    if (ctx->fd >= 0) {
-        close(ctx->fd);
-        ctx->fd = -1;
-    }
-}
-
-static int open_msr(int cpu) {
-    char path[64];
-    snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
-    return open(path, O_RDWR);
-}
-
-static int rdmsr(int fd, uint32_t reg, uint64_t *out) {
-    ssize_t n = pread(fd, out, sizeof(*out), reg);
-    if (n != (ssize_t)sizeof(*out)) {
-        return -1;
-    }
-    return 0;
-}
-
-static int wrmsr(int fd, uint32_t reg, uint64_t val) {
-    ssize_t n = pwrite(fd, &val, sizeof(val), reg);
-    if (n != (ssize_t)sizeof(val)) {
-        return -1;
-    }
-    return 0;
-}
-
-static uint64_t set_pl_units(uint64_t cur, uint16_t pl1_units, uint16_t pl2_units) {
-    uint32_t lo = (uint32_t)(cur & 0xffffffffu);
-    uint32_t hi = (uint32_t)(cur >> 32);
-
-    lo = (lo & ~0x7FFFu) | ((uint32_t)pl1_units & 0x7FFFu);
-    hi = (hi & ~0x7FFFu) | ((uint32_t)pl2_units & 0x7FFFu);
-
-    return ((uint64_t)hi << 32) | lo;
-}
+#include "core/ld_core.h"
 
 static int read_line(char *buf, size_t sz) {
     if (!fgets(buf, (int)sz, stdin)) {
@@ -220,8 +94,8 @@ static int confirm(const char *label) {
 }
 
 static void print_pl(const char *label, uint64_t val, double unit_watts) {
-    uint16_t pl1 = (uint16_t)(val & 0x7FFFu);
-    uint16_t pl2 = (uint16_t)((val >> 32) & 0x7FFFu);
+    uint16_t pl1 = ld_pl1_units(val);
+    uint16_t pl2 = ld_pl2_units(val);
     double pl1_w = (double)pl1 * unit_watts;
     double pl2_w = (double)pl2 * unit_watts;
 
@@ -231,12 +105,12 @@ static void print_pl(const char *label, uint64_t val, double unit_watts) {
     printf("  PL2 = %u (%.2f W)\n", pl2, pl2_w);
 }
 
-static void show_status(int msr_fd, struct mmio_ctx *mmio, double unit_watts) {
+static void show_status(int msr_fd, struct ld_mmio *mmio, double unit_watts) {
     uint64_t msr = 0;
-    uint64_t mmio_val = rd64(mmio->base, PL_OFF);
+    uint64_t mmio_val = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
 
-    if (rdmsr(msr_fd, MSR_PKG_POWER_LIMIT, &msr) != 0) {
-        fprintf(stderr, "read MSR 0x%X failed: %s\n", MSR_PKG_POWER_LIMIT, strerror(errno));
+    if (ld_rdmsr(msr_fd, LD_MSR_PKG_POWER_LIMIT, &msr) != 0) {
+        fprintf(stderr, "read MSR 0x%X failed: %s\n", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
         return;
     }
 
@@ -244,7 +118,7 @@ static void show_status(int msr_fd, struct mmio_ctx *mmio, double unit_watts) {
     print_pl("MMIO MCHBAR PL (0x59A0)", mmio_val, unit_watts);
 }
 
-static int set_limits(int msr_fd, struct mmio_ctx *mmio, double unit_watts) {
+static int set_limits(int msr_fd, struct ld_mmio *mmio, double unit_watts) {
     double pl1_w = 0.0;
     double pl2_w = 0.0;
     int target = 0;
@@ -273,36 +147,36 @@ static int set_limits(int msr_fd, struct mmio_ctx *mmio, double unit_watts) {
         return -1;
     }
 
-    uint16_t pl1_units = (uint16_t)llround(pl1_w / unit_watts);
-    uint16_t pl2_units = (uint16_t)llround(pl2_w / unit_watts);
-
-    if (pl1_units == 0 || pl2_units == 0 || pl1_units > 0x7FFFu || pl2_units > 0x7FFFu) {
+    uint16_t pl1_units = 0;
+    uint16_t pl2_units = 0;
+    if (ld_watts_to_units(pl1_w, unit_watts, &pl1_units) != 0 ||
+        ld_watts_to_units(pl2_w, unit_watts, &pl2_units) != 0) {
         fprintf(stderr, "Converted units out of range.\n");
         return -1;
     }
 
     if (target == 1 || target == 3) {
         uint64_t cur = 0;
-        if (rdmsr(msr_fd, MSR_PKG_POWER_LIMIT, &cur) != 0) {
-            fprintf(stderr, "read MSR 0x%X failed: %s\n", MSR_PKG_POWER_LIMIT, strerror(errno));
+        if (ld_rdmsr(msr_fd, LD_MSR_PKG_POWER_LIMIT, &cur) != 0) {
+            fprintf(stderr, "read MSR 0x%X failed: %s\n", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
             return -1;
         }
-        uint64_t next = set_pl_units(cur, pl1_units, pl2_units);
+        uint64_t next = ld_pl_set_units(cur, pl1_units, pl2_units);
         printf("MSR  new = 0x%016" PRIx64 "\n", next);
         if (confirm("Write MSR?")) {
-            if (wrmsr(msr_fd, MSR_PKG_POWER_LIMIT, next) != 0) {
-                fprintf(stderr, "write MSR 0x%X failed: %s\n", MSR_PKG_POWER_LIMIT, strerror(errno));
+            if (ld_wrmsr(msr_fd, LD_MSR_PKG_POWER_LIMIT, next) != 0) {
+                fprintf(stderr, "write MSR 0x%X failed: %s\n", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
                 return -1;
             }
         }
     }
 
     if (target == 2 || target == 3) {
-        uint64_t cur = rd64(mmio->base, PL_OFF);
-        uint64_t next = set_pl_units(cur, pl1_units, pl2_units);
+        uint64_t cur = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
+        uint64_t next = ld_pl_set_units(cur, pl1_units, pl2_units);
         printf("MMIO new = 0x%016" PRIx64 "\n", next);
         if (confirm("Write MMIO?")) {
-            wr64(mmio->base, PL_OFF, next);
+            ld_wr64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT, next);
         }
     }
 
@@ -313,8 +187,9 @@ static int set_limits(int msr_fd, struct mmio_ctx *mmio, double unit_watts) {
             fprintf(stderr, "Invalid powercap values.\n");
             return -1;
         }
-        if (write_powercap_uw(pl1_uw, pl2_uw) != 0) {
-            fprintf(stderr, "write powercap failed: %s\n", strerror(errno));
+        char err[256] = {0};
+        if (ld_write_powercap_uw(pl1_uw, pl2_uw, err, sizeof(err)) != 0) {
+            fprintf(stderr, "write powercap failed: %s\n", err);
             return -1;
         }
         printf("Wrote powercap PL1=%" PRIu64 "uW PL2=%" PRIu64 "uW\n", pl1_uw, pl2_uw);
@@ -323,7 +198,7 @@ static int set_limits(int msr_fd, struct mmio_ctx *mmio, double unit_watts) {
     return 0;
 }
 
-static int sync_limits(int msr_fd, struct mmio_ctx *mmio) {
+static int sync_limits(int msr_fd, struct ld_mmio *mmio) {
     int dir = 0;
 
     printf("Sync: 1) MSR -> MMIO  2) MMIO -> MSR\n");
@@ -334,20 +209,20 @@ static int sync_limits(int msr_fd, struct mmio_ctx *mmio) {
 
     if (dir == 1) {
         uint64_t msr = 0;
-        if (rdmsr(msr_fd, MSR_PKG_POWER_LIMIT, &msr) != 0) {
-            fprintf(stderr, "read MSR 0x%X failed: %s\n", MSR_PKG_POWER_LIMIT, strerror(errno));
+        if (ld_rdmsr(msr_fd, LD_MSR_PKG_POWER_LIMIT, &msr) != 0) {
+            fprintf(stderr, "read MSR 0x%X failed: %s\n", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
             return -1;
         }
         printf("MMIO <- 0x%016" PRIx64 "\n", msr);
         if (confirm("Write MMIO?")) {
-            wr64(mmio->base, PL_OFF, msr);
+            ld_wr64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT, msr);
         }
     } else if (dir == 2) {
-        uint64_t mmio_val = rd64(mmio->base, PL_OFF);
+        uint64_t mmio_val = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
         printf("MSR  <- 0x%016" PRIx64 "\n", mmio_val);
         if (confirm("Write MSR?")) {
-            if (wrmsr(msr_fd, MSR_PKG_POWER_LIMIT, mmio_val) != 0) {
-                fprintf(stderr, "write MSR 0x%X failed: %s\n", MSR_PKG_POWER_LIMIT, strerror(errno));
+            if (ld_wrmsr(msr_fd, LD_MSR_PKG_POWER_LIMIT, mmio_val) != 0) {
+                fprintf(stderr, "write MSR 0x%X failed: %s\n", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
                 return -1;
             }
         }
@@ -359,33 +234,434 @@ static int sync_limits(int msr_fd, struct mmio_ctx *mmio) {
     return 0;
 }
 
-int main(void) {
-    struct mmio_ctx mmio = { .fd = -1, .base = NULL };
+/*
+ * Non-interactive mode. Each command prints exactly one JSON object on its
+ * own line so provisioning scripts can parse results without scraping text.
+ */
+
+struct batch_ctx {
+    int msr_fd;
+    struct ld_mmio *mmio;       /* opened by batch_mmio() on first use: target=msr must not need MCHBAR */
+    int mmio_tried;
+    char mmio_err[256];
+    int power_unit;
+    double unit_watts;
+};
+
+/* MCHBAR mapping, opened once on demand; NULL (reason in ctx->mmio_err) when it cannot be mapped. */
+static struct ld_mmio *batch_mmio(struct batch_ctx *ctx) {
+    if (!ctx->mmio_tried) {
+        ctx->mmio_tried = 1;
+        if (ld_mmio_open(ctx->mmio, 1, ctx->mmio_err, sizeof(ctx->mmio_err)) != 0) {
+            ld_mmio_close(ctx->mmio);
+        }
+    }
+    return ctx->mmio->base ? ctx->mmio : NULL;
+}
+
+static void json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c == '\n') {
+            printf("\\n");
+        } else if (c == '\t') {
+            printf("\\t");
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+static void json_error(const char *cmd, const char *err) {
+    printf("{\"cmd\":");
+    json_string(cmd);
+    printf(",\"ok\":false,\"error\":");
+    json_string(err);
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void json_pl(const char *key, uint64_t val, double unit_watts) {
+    uint16_t pl1 = ld_pl1_units(val);
+    uint16_t pl2 = ld_pl2_units(val);
+    printf("\"%s\":{\"raw\":\"0x%016" PRIx64 "\",\"pl1_units\":%u,\"pl1_w\":%.3f,"
+           "\"pl1_enabled\":%s,\"pl2_units\":%u,\"pl2_w\":%.3f,\"pl2_enabled\":%s}",
+           key, val,
+           pl1, (double)pl1 * unit_watts, LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL1_EN) ? "true" : "false",
+           pl2, (double)pl2 * unit_watts, LD_FIELD_GET(val, LD_PKG_POWER_LIMIT_PL2_EN) ? "true" : "false");
+}
+
+static void json_write_result(const char *key, uint64_t before, uint64_t target, uint64_t after) {
+    printf("\"%s\":{\"before\":\"0x%016" PRIx64 "\",\"target\":\"0x%016" PRIx64 "\","
+           "\"after\":\"0x%016" PRIx64 "\",\"verified\":%s}",
+           key, before, target, after, after == target ? "true" : "false");
+}
+
+static int parse_bool_word(const char *s, int *out) {
+    if (!strcmp(s, "yes") || !strcmp(s, "true") || !strcmp(s, "1") || !strcmp(s, "on")) {
+        *out = 1;
+        return 1;
+    }
+    if (!strcmp(s, "no") || !strcmp(s, "false") || !strcmp(s, "0") || !strcmp(s, "off")) {
+        *out = 0;
+        return 1;
+    }
+    return 0;
+}
+
+static int batch_show(struct batch_ctx *ctx) {
+    uint64_t msr = 0;
+    if (ld_rdmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, &msr) != 0) {
+        char err[128];
+        snprintf(err, sizeof(err), "read MSR 0x%X failed: %s", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
+        json_error("show", err);
+        return -1;
+    }
+    struct ld_mmio *mmio = batch_mmio(ctx);
+
+    printf("{\"cmd\":\"show\",\"ok\":true,\"power_unit\":%d,\"unit_watts\":%.6f,",
+           ctx->power_unit, ctx->unit_watts);
+    json_pl("msr", msr, ctx->unit_watts);
+    if (mmio) {
+        uint64_t mmio_val = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
+        putchar(',');
+        json_pl("mmio", mmio_val, ctx->unit_watts);
+        printf(",\"in_sync\":%s}\n", msr == mmio_val ? "true" : "false");
+    } else {
+        printf(",\"mmio\":null,\"mmio_error\":");
+        json_string(ctx->mmio_err);
+        printf(",\"in_sync\":null}\n");
+    }
+    fflush(stdout);
+    return 0;
+}
+
+static int batch_set(struct batch_ctx *ctx, char **args, int nargs) {
+    double pl1_w = 0.0;
+    double pl2_w = 0.0;
+    int target = 3;
+    int powercap = 0;
+    char err[256];
+
+    for (int i = 0; i < nargs; i++) {
+        char *eq = strchr(args[i], '=');
+        if (!eq) {
+            snprintf(err, sizeof(err), "expected key=value, got '%s'", args[i]);
+            json_error("set", err);
+            return -1;
+        }
+        *eq = '\0';
+        const char *key = args[i];
+        const char *val = eq + 1;
+        int ok = 1;
+        if (!strcmp(key, "pl1")) {
+            ok = parse_double(val, &pl1_w);
+        } else if (!strcmp(key, "pl2")) {
+            ok = parse_double(val, &pl2_w);
+        } else if (!strcmp(key, "target")) {
+            if (!strcmp(val, "msr")) {
+                target = 1;
+            } else if (!strcmp(val, "mmio")) {
+                target = 2;
+            } else if (!strcmp(val, "both")) {
+                target = 3;
+            } else {
+                ok = 0;
+            }
+        } else if (!strcmp(key, "powercap")) {
+            ok = parse_bool_word(val, &powercap);
+        } else {
+            snprintf(err, sizeof(err), "unknown key '%s'", key);
+            json_error("set", err);
+            return -1;
+        }
+        if (!ok) {
+            snprintf(err, sizeof(err), "invalid value for %s: '%s'", key, val);
+            json_error("set", err);
+            return -1;
+        }
+    }
+
+    if (pl1_w <= 0.0 || pl2_w <= 0.0 || pl1_w > 5000.0 || pl2_w > 5000.0) {
+        json_error("set", "pl1 and pl2 are required and must be in (0, 5000] W");
+        return -1;
+    }
+
+    uint16_t pl1_units = 0;
+    uint16_t pl2_units = 0;
+    if (ld_watts_to_units(pl1_w, ctx->unit_watts, &pl1_units) != 0 ||
+        ld_watts_to_units(pl2_w, ctx->unit_watts, &pl2_units) != 0) {
+        json_error("set", "converted units out of range");
+        return -1;
+    }
+
+    uint64_t msr_before = 0, msr_next = 0, msr_after = 0;
+    uint64_t mmio_before = 0, mmio_next = 0, mmio_after = 0;
+    int want_msr = target == 1 || target == 3;
+    struct ld_mmio *mmio = NULL;
+
+    // Everything that can be checked is checked before the first write, so a failure leaves the limits untouched.
+    if (want_msr && ld_rdmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, &msr_before) != 0) {
+        snprintf(err, sizeof(err), "read MSR 0x%X failed: %s", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
+        json_error("set", err);
+        return -1;
+    }
+    if (target == 2 || target == 3) {
+        mmio = batch_mmio(ctx);
+        if (!mmio) {
+            json_error("set", ctx->mmio_err);
+            return -1;
+        }
+        mmio_before = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
+    }
+
+    // Powercap first: it is the step most likely to fail (no intel-rapl zone, read-only sysfs), and after it only
+    // the register writes remain.
+    uint64_t pl1_uw = (uint64_t)llround(pl1_w * 1000000.0);
+    uint64_t pl2_uw = (uint64_t)llround(pl2_w * 1000000.0);
+    if (powercap) {
+        char pc_err[200] = {0};
+        if (ld_write_powercap_uw(pl1_uw, pl2_uw, pc_err, sizeof(pc_err)) != 0) {
+            snprintf(err, sizeof(err), "write powercap failed: %s (MSR/MMIO not written)", pc_err);
+            json_error("set", err);
+            return -1;
+        }
+    }
+    const char *partial = powercap ? " (powercap was already written)" : "";
+
+    if (want_msr) {
+        // Re-read: the powercap write goes through the same register, and only PL1/PL2 of the live value change.
+        uint64_t base = msr_before;
+        if (powercap && ld_rdmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, &base) != 0) {
+            snprintf(err, sizeof(err), "read MSR 0x%X failed: %s%s", LD_MSR_PKG_POWER_LIMIT, strerror(errno), partial);
+            json_error("set", err);
+            return -1;
+        }
+        msr_next = ld_pl_set_units(base, pl1_units, pl2_units);
+        if (ld_wrmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, msr_next) != 0) {
+            snprintf(err, sizeof(err), "write MSR 0x%X failed: %s%s", LD_MSR_PKG_POWER_LIMIT, strerror(errno), partial);
+            json_error("set", err);
+            return -1;
+        }
+        if (ld_rdmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, &msr_after) != 0) {
+            snprintf(err, sizeof(err), "read back MSR 0x%X failed: %s (MSR%s written)", LD_MSR_PKG_POWER_LIMIT,
+                     strerror(errno), powercap ? " and powercap" : "");
+            json_error("set", err);
+            return -1;
+        }
+    }
+
+    if (mmio) {
+        mmio_next = ld_pl_set_units(mmio_before, pl1_units, pl2_units);
+        ld_wr64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT, mmio_next);
+        mmio_after = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
+    }
+
+    int verified = (!want_msr || msr_after == msr_next) && (!mmio || mmio_after == mmio_next);
+    printf("{\"cmd\":\"set\",\"ok\":%s,\"pl1_w\":%.3f,\"pl2_w\":%.3f,\"pl1_units\":%u,\"pl2_units\":%u",
+           verified ? "true" : "false", pl1_w, pl2_w, pl1_units, pl2_units);
+    if (want_msr) {
+        putchar(',');
+        json_write_result("msr", msr_before, msr_next, msr_after);
+    }
+    if (mmio) {
+        putchar(',');
+        json_write_result("mmio", mmio_before, mmio_next, mmio_after);
+    }
+    if (powercap) {
+        printf(",\"powercap\":{\"pl1_uw\":%" PRIu64 ",\"pl2_uw\":%" PRIu64 "}", pl1_uw, pl2_uw);
+    }
+    printf(",\"verified\":%s}\n", verified ? "true" : "false");
+    fflush(stdout);
+    return verified ? 0 : -1;
+}
+
+static int batch_sync(struct batch_ctx *ctx, char **args, int nargs) {
+    if (nargs != 1 || (strcmp(args[0], "msr->mmio") != 0 && strcmp(args[0], "mmio->msr") != 0)) {
+        json_error("sync", "expected 'msr->mmio' or 'mmio->msr'");
+        return -1;
+    }
+    int to_mmio = strcmp(args[0], "msr->mmio") == 0;
+
+    char err[128];
+    uint64_t msr = 0;
+    if (ld_rdmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, &msr) != 0) {
+        snprintf(err, sizeof(err), "read MSR 0x%X failed: %s", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
+        json_error("sync", err);
+        return -1;
+    }
+    struct ld_mmio *mmio = batch_mmio(ctx);
+    if (!mmio) {
+        json_error("sync", ctx->mmio_err);
+        return -1;
+    }
+    uint64_t mmio_val = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
+
+    uint64_t before = to_mmio ? mmio_val : msr;
+    uint64_t target = to_mmio ? msr : mmio_val;
+    uint64_t after = 0;
+    if (to_mmio) {
+        ld_wr64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT, target);
+        after = ld_rd64(mmio->base, LD_MCHBAR_PKG_POWER_LIMIT);
+    } else {
+        if (ld_wrmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, target) != 0 ||
+            ld_rdmsr(ctx->msr_fd, LD_MSR_PKG_POWER_LIMIT, &after) != 0) {
+            snprintf(err, sizeof(err), "write MSR 0x%X failed: %s", LD_MSR_PKG_POWER_LIMIT, strerror(errno));
+            json_error("sync", err);
+            return -1;
+        }
+    }
+
+    printf("{\"cmd\":\"sync\",\"ok\":%s,\"direction\":\"%s\",", after == target ? "true" : "false", args[0]);
+    json_write_result(to_mmio ? "mmio" : "msr", before, target, after);
+    printf("}\n");
+    fflush(stdout);
+    return after == target ? 0 : -1;
+}
+
+static int batch_execute(struct batch_ctx *ctx, char **argv, int argc) {
+    if (argc == 0) {
+        return 0;
+    }
+    const char *cmd = argv[0];
+    if (!strcmp(cmd, "show")) {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--json") != 0) {
+                json_error("show", "unexpected argument");
+                return -1;
+            }
+        }
+        return batch_show(ctx);
+    }
+    if (!strcmp(cmd, "set")) {
+        return batch_set(ctx, argv + 1, argc - 1);
+    }
+    if (!strcmp(cmd, "sync")) {
+        return batch_sync(ctx, argv + 1, argc - 1);
+    }
+    json_error(cmd, "unknown command (expected show, set or sync)");
+    return -1;
+}
+
+static int run_batch_stdin(struct batch_ctx *ctx) {
+    char line[1024];
+    int rc = 0;
+    while (fgets(line, sizeof(line), stdin)) {
+        if (!strchr(line, '\n') && !feof(stdin)) {
+            // Executing the two halves of a split line as separate commands would be worse than refusing it.
+            int c;
+            while ((c = getchar()) != EOF && c != '\n') {
+            }
+            char err[64];
+            snprintf(err, sizeof(err), "line longer than %zu bytes", sizeof(line) - 2);
+            json_error("batch", err);
+            rc = 1;
+            continue;
+        }
+        char *tokens[32];
+        int ntok = 0;
+        int too_many = 0;
+        char *save = NULL;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        for (char *tok = strtok_r(line, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save)) {
+            if (ntok == (int)(sizeof(tokens) / sizeof(tokens[0]))) {
+                too_many = 1;
+                break;
+            }
+            tokens[ntok++] = tok;
+        }
+        if (too_many) {
+            // Same as an overlong line: running the first 32 tokens as a shorter command is worse than refusing.
+            char err[64];
+            snprintf(err, sizeof(err), "more than %zu tokens on one line", sizeof(tokens) / sizeof(tokens[0]));
+            json_error("batch", err);
+            rc = 1;
+            continue;
+        }
+        if (batch_execute(ctx, tokens, ntok) != 0) {
+            rc = 1;
+        }
+    }
+    return rc;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s                      interactive menu\n"
+        "  %s show [--json]\n"
+        "  %s set pl1=W pl2=W [target=msr|mmio|both] [powercap=yes|no]\n"
+        "  %s sync msr->mmio|mmio->msr\n"
+        "  %s --batch              read commands from stdin, one per line\n"
+        "\n"
+        "Non-interactive commands print one JSON object per line and exit non-zero\n"
+        "if any command fails or a written value does not read back.\n",
+        argv0, argv0, argv0, argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+    struct ld_mmio mmio = { .fd = -1, .base = NULL };
     int msr_fd = -1;
     uint64_t rapl_units = 0;
-    int power_unit = 0;
-    double unit_watts = 0.0;
+    struct ld_rapl_units units;
+    int batch = argc > 1;
+    char err[256] = {0};
 
-    if (open_mmio(&mmio) != 0) {
-        return 1;
+    if (batch && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-h"))) {
+        usage(argv[0]);
+        return 2;
     }
 
-    msr_fd = open_msr(0);
-    if (msr_fd < 0) {
-        fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
-        close_mmio(&mmio);
+    // Batch commands map MCHBAR only when they touch it (batch_mmio()).
+    if (!batch && ld_mmio_open(&mmio, 1, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
         return 1;
     }
 
-    if (rdmsr(msr_fd, MSR_RAPL_POWER_UNIT, &rapl_units) != 0) {
-        fprintf(stderr, "read MSR 0x%X failed: %s\n", MSR_RAPL_POWER_UNIT, strerror(errno));
-        close(msr_fd);
-        close_mmio(&mmio);
+    msr_fd = ld_msr_fd(0, 1);
+    if (msr_fd < 0 || ld_rdmsr(msr_fd, LD_MSR_RAPL_POWER_UNIT, &rapl_units) != 0) {
+        snprintf(err, sizeof(err), "%s failed: %s",
+                 msr_fd < 0 ? "open(/dev/cpu/0/msr)" : "read MSR 0x606", strerror(errno));
+        if (batch) {
+            json_error("init", err);
+        } else {
+            fprintf(stderr, "%s\n", err);
+        }
+        ld_mmio_close(&mmio);
+        ld_close_all();
         return 1;
     }
 
-    power_unit = (int)(rapl_units & 0x0F);
-    unit_watts = 1.0 / (double)(1u << power_unit);
+    ld_rapl_units_decode(rapl_units, &units);
+    int power_unit = units.power_unit;
+    double unit_watts = units.unit_watts;
+
+    if (batch) {
+        struct batch_ctx ctx = {
+            .msr_fd = msr_fd,
+            .mmio = &mmio,
+            .power_unit = power_unit,
+            .unit_watts = unit_watts,
+        };
+        int rc = 0;
+        if (!strcmp(argv[1], "--batch")) {
+            rc = run_batch_stdin(&ctx);
+        } else {
+            rc = batch_execute(&ctx, argv + 1, argc - 1) != 0 ? 1 : 0;
+        }
+        ld_mmio_close(&mmio);
+        ld_close_all();
+        return rc;
+    }
 
     printf("Limits UI (MSR 0x610 + MCHBAR 0x59A0)\n");
     printf("Power unit: 2^-%d W = %.6f W\n\n", power_unit, unit_watts);
@@ -423,7 +699,7 @@ int main(void) {
         printf("\n");
     }
 
-    close(msr_fd);
-    close_mmio(&mmio);
+    ld_mmio_close(&mmio);
+    ld_close_all();
     return 0;
 }
@@ -1,41 +1,11 @@
 #include <errno.h>
 #include <inttypes.h>
-#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <unistd.h>
 
-#include "mchbar_base.h"
-
-#define MAP_SIZE    (2 * 1024 * 1024)
-#define MSR_RAPL_POWER_UNIT 0x606
-
-static uint64_t rd64(volatile uint8_t *base, uint32_t off) {
-    volatile uint32_t *p32 = (volatile uint32_t *)(base + off);
-    uint64_t lo = p32[0];
-    uint64_t hi = p32[1];
-    return lo | (hi << 32);
-}
-
-static int open_msr(int cpu) {
-    char path[64];
-    snprintf(path, sizeof(path), "/dev/cpu/%d/msr", cpu);
-    return open(path, O_RDONLY);
-}
-
-static int rdmsr(int fd, uint32_t reg, uint64_t *out) {
-    if (lseek(fd, (off_t)reg, SEEK_SET) < 0) {
-        return -1;
-    }
-    ssize_t n = read(fd, out, sizeof(*out));
-    if (n != (ssize_t)sizeof(*out)) {
-        return -1;
-    }
-    return 0;
-}
+#include "core/ld_core.h"
 
 static int parse_u16(const char *s, uint16_t *out) {
     char *end = NULL;
@@ -124,49 +94,32 @@ int main(int argc, char **argv) {
 
     double unit_watts = 0.0;
     if (!use_units) {
-        int msr_fd = open_msr(0);
-        if (msr_fd < 0) {
-            fprintf(stderr, "open(/dev/cpu/0/msr) failed: %s\n", strerror(errno));
+        struct ld_rapl_units units;
+        if (ld_rapl_units_read(&units) != 0) {
+            fprintf(stderr, "read MSR 0x%X failed: %s\n", LD_MSR_RAPL_POWER_UNIT, strerror(errno));
             return 1;
         }
-        uint64_t rapl_units = 0;
-        if (rdmsr(msr_fd, MSR_RAPL_POWER_UNIT, &rapl_units) != 0) {
-            fprintf(stderr, "read MSR 0x%X failed: %s\n", MSR_RAPL_POWER_UNIT, strerror(errno));
-            close(msr_fd);
+        unit_watts = units.unit_watts;
+        if (ld_watts_to_units(pl1_w, unit_watts, &pl1_units) != 0 ||
+            ld_watts_to_units(pl2_w, unit_watts, &pl2_units) != 0) {
+            fprintf(stderr, "Computed units out of range for PL1=%.3fW PL2=%.3fW\n", pl1_w, pl2_w);
             return 1;
         }
-        close(msr_fd);
-
-        int power_unit = (int)(rapl_units & 0x0F);
-        unit_watts = 1.0 / (double)(1u << power_unit);
-        pl1_units = (uint16_t)llround(pl1_w / unit_watts);
-        pl2_units = (uint16_t)llround(pl2_w / unit_watts);
     }
 
-    if (pl1_units == 0 || pl2_units == 0 || pl1_units > 0x7FFFu || pl2_units > 0x7FFFu) {
+    if (pl1_units == 0 || pl2_units == 0 || pl1_units > LD_FIELD_GET(~0ULL, LD_PKG_POWER_LIMIT_PL1) ||
+        pl2_units > LD_FIELD_GET(~0ULL, LD_PKG_POWER_LIMIT_PL2)) {
         fprintf(stderr, "Computed units out of range. PL1=0x%X PL2=0x%X\n", pl1_units, pl2_units);
         return 1;
     }
 
-    uint64_t mchbar_base = 0;
+    struct ld_mmio mmio;
     char err[256] = {0};
-    if (mchbar_get_base(&mchbar_base, err, sizeof(err)) != 0) {
-        fprintf(stderr, "MCHBAR base discovery failed: %s\n", err[0] ? err : "unknown error");
-        return 1;
-    }
-
-    int mem_fd = open("/dev/mem", O_RDONLY | O_SYNC);
-    if (mem_fd < 0) {
-        fprintf(stderr, "open(/dev/mem) failed: %s\n", strerror(errno));
-        return 1;
-    }
-
-    volatile uint8_t *mmio = mmap(NULL, MAP_SIZE, PROT_READ, MAP_SHARED, mem_fd, mchbar_base);
-    if (mmio == MAP_FAILED) {
-        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
-        close(mem_fd);
+    if (ld_mmio_open(&mmio, 0, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
         return 1;
     }
+    uint64_t mchbar_base = mmio.phys;
 
     if (use_units) {
         printf("Scanning MCHBAR @ 0x%016" PRIx64 " for units PL1=0x%X PL2=0x%X (require_enable=%d)\n",
@@ -177,21 +130,18 @@ int main(int argc, char **argv) {
     }
 
     int found = 0;
-    for (uint32_t off = 0; off + 8 <= MAP_SIZE; off += 8) {
-        uint64_t v = rd64(mmio, off);
-        uint32_t lo = (uint32_t)(v & 0xffffffffu);
-        uint32_t hi = (uint32_t)(v >> 32);
-        if ((lo & 0x7FFFu) != pl1_units) {
-            continue;
-        }
-        if ((hi & 0x7FFFu) != pl2_units) {
+    for (uint32_t off = 0; off + 8 <= LD_MCHBAR_MAP_SIZE; off += 8) {
+        uint64_t v = ld_rd64(mmio.base, off);
+        if (ld_pl1_units(v) != pl1_units || ld_pl2_units(v) != pl2_units) {
             continue;
         }
         if (require_enable) {
-            if ((lo & 0x8000u) == 0 || (hi & 0x8000u) == 0) {
+            if (!LD_FIELD_GET(v, LD_PKG_POWER_LIMIT_PL1_EN) || !LD_FIELD_GET(v, LD_PKG_POWER_LIMIT_PL2_EN)) {
                 continue;
             }
         }
+        uint32_t lo = (uint32_t)(v & 0xffffffffu);
+        uint32_t hi = (uint32_t)(v >> 32);
         printf("match off=0x%05X val=0x%016" PRIx64 " lo=0x%08X hi=0x%08X\n", off, v, lo, hi);
         found++;
     }
@@ -200,7 +150,7 @@ int main(int argc, char **argv) {
         printf("No matches found.\n");
     }
 
-    munmap((void *)mmio, MAP_SIZE);
-    close(mem_fd);
+    ld_mmio_close(&mmio);
+    ld_close_all();
     return 0;
 }
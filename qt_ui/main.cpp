@@ -6,6 +6,7 @@
 #include <QDateTime>
 #include <QDir>
 #include <QDoubleSpinBox>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
@@ -60,11 +61,18 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <cstdlib>
+#include <iterator>
+
+#include "../core/ld_core.hpp"
+#include "../core/ld_sampler.h"
+#include "../core/ld_thermal.h"
+#include "../core/ld_throttle.h"
 
 namespace {
 
-constexpr std::uint32_t kMsrPkgPowerLimit = 0x610;
-constexpr std::uint32_t kMchbarPlOffset = 0x59A0;
+constexpr std::uint32_t kMsrPkgPowerLimit = ld::pkg_power_limit::kAddr;
+constexpr std::uint32_t kMchbarPlOffset = ld::mchbar_pkg_power_limit::kAddr;
 constexpr double kUvMvScale = 1.024;
 constexpr double kMinFontScale = 0.8;
 
@@ -72,20 +80,17 @@ double quantize_uv_mv(double mv) {
     return std::llround(mv * kUvMvScale) / kUvMvScale;
 }
 
-std::uint64_t apply_pl_units(std::uint64_t cur, std::uint16_t pl1_units, std::uint16_t pl2_units) {
-    std::uint32_t lo = static_cast<std::uint32_t>(cur & 0xffffffffu);
-    std::uint32_t hi = static_cast<std::uint32_t>(cur >> 32);
-
-    lo = (lo & ~0x7FFFu) | (static_cast<std::uint32_t>(pl1_units) & 0x7FFFu);
-    hi = (hi & ~0x7FFFu) | (static_cast<std::uint32_t>(pl2_units) & 0x7FFFu);
-
-    return (static_cast<std::uint64_t>(hi) << 32) | lo;
-}
-
 QString hex64(std::uint64_t v) {
     return QString("0x%1").arg(v, 16, 16, QLatin1Char('0'));
 }
 
+QString pl_diff_text(std::uint64_t before, std::uint64_t after, double unit_watts) {
+    ld_reg_ctx ctx{};
+    ctx.unit_watts = unit_watts;
+    std::string text = ld::diff(LD_REG_PKG_POWER_LIMIT, before, after, &ctx);
+    return text.empty() ? QString("no field changes") : QString::fromStdString(text);
+}
+
 QString units_to_text(std::uint16_t units, double unit_watts) {
     double watts = static_cast<double>(units) * unit_watts;
     return QString("units %1 (%2 W)").arg(units).arg(watts, 0, 'f', 2);
@@ -268,6 +273,7 @@ struct HwmonTemp {
     int index = -1;
     QString label;
     QString input_path;
+    QString crit_path;  // TjMax on coretemp
 };
 
 QList<HwmonTemp> discover_coretemp_inputs() {
@@ -293,6 +299,7 @@ QList<HwmonTemp> discover_coretemp_inputs() {
             HwmonTemp t;
             t.index = idx;
             t.input_path = base + "/" + entry;
+            t.crit_path = base + "/temp" + num_part + "_crit";
             t.label = read_text_file(base + "/temp" + num_part + "_label");
             result.append(t);
         }
@@ -325,16 +332,16 @@ int read_temp_millidegrees(const QString &path) {
 
 QString thermal_status_summary(std::uint64_t status) {
     QStringList flags;
-    if (status & 0x01u) {
+    if (ld::therm_status::thermal::get(status)) {
         flags.append("THERMAL");
     }
-    if (status & 0x04u) {
+    if (ld::therm_status::prochot::get(status)) {
         flags.append("PROCHOT");
     }
-    if (status & 0x20u) {
+    if (ld::therm_status::power::get(status)) {
         flags.append("PWR");
     }
-    if (status & 0x40u) {
+    if (ld::therm_status::current::get(status)) {
         flags.append("CUR");
     }
     if (flags.isEmpty()) {
@@ -397,10 +404,18 @@ struct ReadState {
     double unit_watts = 0.0;
     std::uint64_t msr = 0;
     std::uint64_t mmio = 0;
+    QString msr_backend;
+    QString mmio_backend;
+    QString ratio_path;
+    QString pstate_mode;
+    bool pstate_hwp = false;
     bool core_type_supported = false;
     QString p_cpus;
     QString e_cpus;
     QString u_cpus;
+    QString offline_cpus;
+    QString parked_p;
+    QString parked_e;
     bool p_ratio_valid = false;
     bool e_ratio_valid = false;
     int p_ratio = 0;
@@ -421,8 +436,155 @@ struct CoreSensor {
     bool ratio_valid = false;
     std::uint64_t thermal = 0;
     bool thermal_valid = false;
+    double volts = 0.0;
+    bool volts_valid = false;  // PERF_STATUS VID; not every CPU reports one
+    // Cumulative thermal_throttle counters (or MSR log-bit events), indexed by ld_throttle_counter.
+    std::uint64_t throttle[LD_THROTTLE_COUNTER_COUNT] = {};
+    unsigned int throttle_have = 0;
+};
+
+// One point of the core plane's V/F curve as the OC mailbox reports it.
+struct VfCurvePoint {
+    int index = 0;
+    int ratio = 0;
+    double offset_mv = 0.0;
+};
+
+// One RESIDENCY_CPU_<n> line: seconds at each ratio and in each temperature band (keyed by its lowest °C).
+struct CoreResidency {
+    int cpu = -1;
+    char type = 'U';
+    double total_s = 0.0;
+    QList<QPair<int, double>> ratios;
+    QList<QPair<int, double>> temps;
+};
+
+// Package and DRAM energy of one profile (or the whole machine) from READ-LEDGER.
+struct LedgerTotals {
+    QString name;
+    double today_wh[2] = {};        // package, DRAM
+    double week_wh[2] = {};
+    double last_week_wh[2] = {};
+    double total_kwh[2] = {};
+};
+
+struct LedgerReport {
+    bool recording = false;
+    QString active_profile;
+    QString today;
+    QString week_start;
+    bool dram = false;
+    LedgerTotals machine;
+    QList<LedgerTotals> profiles;
+    QList<QPair<QString, double>> days;     // date, package + DRAM Wh; newest first
+};
+
+struct PowercapConstraint {
+    QString name;
+    std::uint64_t limit_uw = 0;
+    bool has_window = false;
+    std::uint64_t window_us = 0;
+    bool has_max = false;
+    std::uint64_t max_uw = 0;
+};
+
+struct PowercapZone {
+    QString id;
+    QString name;
+    QString parent;
+    bool enabled = false;
+    QList<PowercapConstraint> constraints;
+};
+
+struct PowercapEnergy {
+    QString id;
+    bool valid = false;
+    std::uint64_t energy_uj = 0;
+    std::uint64_t max_energy_range_uj = 0;
+};
+
+struct IrqInfo {
+    int irq = -1;
+    QString name;
+    QString affinity;
+    double rate = 0.0;
+    double p_rate = 0.0;
+    bool steered = false;
+};
+
+struct CgroupPower {
+    QString cgroup;
+    bool valid = false;
+    double watts = 0.0;
+    double avg_w = 0.0;
+    double cpu_load = 0.0;
+    int cpus = 0;
+    QString mode;
+    double budget_w = 0.0;
+    QString limit;
+    QString error;
+};
+
+struct ServiceJob {
+    quint32 id = 0;
+    QString action;
+    QString unit;
+    QString state;
+    QString result;
+    int elapsed_ms = 0;
+
+    bool finished() const {
+        return state == "done" || state == "failed" || state == "skipped";
+    }
 };
 
+struct ConflictSource {
+    QString name;
+    QString value;
+    int changes = 0;
+    int reverts = 0;
+    double last_change_s = -1.0;
+};
+
+struct ConflictService {
+    QString name;
+    bool active = false;
+    double last_active_s = -1.0;
+    int correlated = 0;
+    int reverts = 0;
+    double lift = 0.0;
+};
+
+struct ConflictReport {
+    double elapsed_s = 0.0;
+    int events = 0;
+    int revert_events = 0;
+    double changes_per_min = 0.0;
+    QList<ConflictSource> sources;
+    QList<ConflictService> services;
+    QString culprit;
+    double confidence = 0.0;
+    bool proven = false;
+    // Intervals with SMIs scored like a writer: firmware rewrites limits from SMM.
+    bool smi_valid = false;
+    std::uint64_t smi_total = 0;
+    int smi_correlated = 0;
+    int smi_reverts = 0;
+    double smi_lift = 0.0;
+};
+
+// "k=v,k=v" payload of a helper line.
+QHash<QString, QString> parse_kv_list(const QString &payload) {
+    QHash<QString, QString> out;
+    for (const QString &part : payload.split(',', Qt::SkipEmptyParts)) {
+        int sep = part.indexOf('=');
+        if (sep > 0) {
+            out.insert(part.left(sep).trimmed(), part.mid(sep + 1).trimmed());
+        }
+    }
+    return out;
+}
+
 } // namespace
 
 class CollapsibleSection : public QFrame {
@@ -480,6 +642,142 @@ private:
     QWidget *content_ = nullptr;
 };
 
+// Live ratio/voltage scatter, one point per core and sample with older points fading out. A kept reference
+// (say, before changing the core voltage offset) is drawn hollow underneath.
+class VfPlot : public QWidget {
+public:
+    explicit VfPlot(QWidget *parent = nullptr) : QWidget(parent) {
+        setMinimumHeight(220);
+        setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    }
+
+    void add_point(int ratio, double volts, char type) {
+        if (ratio <= 0 || volts <= 0.0) {
+            return;
+        }
+        points_.push_back({ratio, volts, type});
+        if (points_.size() > kMaxPoints + kMaxPoints / 4) {
+            points_.erase(points_.begin(), points_.end() - kMaxPoints);
+        }
+    }
+
+    void keep_reference() {
+        reference_ = points_;
+        update();
+    }
+
+    void clear() {
+        points_.clear();
+        reference_.clear();
+        update();
+    }
+
+    // Marks each V/F point's ratio with its offset.
+    void set_curve(const QList<VfCurvePoint> &curve) {
+        curve_.assign(curve.begin(), curve.end());
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent *) override {
+        QPainter p(this);
+        p.setRenderHint(QPainter::Antialiasing);
+        p.fillRect(rect(), palette().color(QPalette::Base));
+        if (points_.empty() && reference_.empty()) {
+            p.setPen(palette().color(QPalette::Text));
+            p.drawText(rect(), Qt::AlignCenter, "No core voltage samples yet (IA32_PERF_STATUS VID)");
+            return;
+        }
+
+        // Axes cover everything drawn, padded to a whole ratio and 50 mV.
+        const Point &first = points_.empty() ? reference_.front() : points_.front();
+        int r_min = first.ratio;
+        int r_max = first.ratio;
+        double v_min = first.volts;
+        double v_max = first.volts;
+        for (const std::vector<Point> *set : {&points_, &reference_}) {
+            for (const Point &pt : *set) {
+                r_min = std::min(r_min, pt.ratio);
+                r_max = std::max(r_max, pt.ratio);
+                v_min = std::min(v_min, pt.volts);
+                v_max = std::max(v_max, pt.volts);
+            }
+        }
+        for (const VfCurvePoint &cp : curve_) {
+            r_min = std::min(r_min, cp.ratio);
+            r_max = std::max(r_max, cp.ratio);
+        }
+        r_min = std::max(0, r_min - 1);
+        r_max += 1;
+        v_min = std::floor(v_min * 20.0) / 20.0;
+        v_max = std::max(std::ceil(v_max * 20.0) / 20.0, v_min + 0.1);
+
+        QRectF area = QRectF(rect()).adjusted(52, 12, -12, -30);
+        auto map = [&](double ratio, double volts) {
+            return QPointF(area.left() + (ratio - r_min) * area.width() / (r_max - r_min),
+                           area.bottom() - (volts - v_min) * area.height() / (v_max - v_min));
+        };
+
+        p.setPen(palette().color(QPalette::Mid));
+        p.drawRect(area);
+        p.setPen(palette().color(QPalette::Text));
+        int r_step = std::max(1, (r_max - r_min) / 10);
+        for (int r = r_min; r <= r_max; r += r_step) {
+            QPointF at = map(r, v_min);
+            p.drawLine(at, at + QPointF(0, 4));
+            p.drawText(QRectF(at.x() - 20, area.bottom() + 6, 40, 16), Qt::AlignHCenter | Qt::AlignTop,
+                       QString("x%1").arg(r));
+        }
+        double v_step = std::max(0.05, std::ceil((v_max - v_min) / 0.05 / 8.0) * 0.05);
+        for (double v = v_min; v <= v_max + 1e-9; v += v_step) {
+            QPointF at = map(r_min, v);
+            p.drawLine(at, at - QPointF(4, 0));
+            p.drawText(QRectF(0, at.y() - 8, area.left() - 8, 16), Qt::AlignRight | Qt::AlignVCenter,
+                       QString("%1 V").arg(v, 0, 'f', 2));
+        }
+
+        QPen curve_pen(palette().color(QPalette::Mid), 1.0, Qt::DashLine);
+        for (const VfCurvePoint &cp : curve_) {
+            QPointF top = map(cp.ratio, v_max);
+            p.setPen(curve_pen);
+            p.drawLine(top, map(cp.ratio, v_min));
+            p.setPen(palette().color(QPalette::Text));
+            p.drawText(QRectF(top.x() - 30, top.y() + 18, 60, 16), Qt::AlignHCenter | Qt::AlignTop,
+                       QString("%1").arg(cp.offset_mv, 0, 'f', 0));
+        }
+
+        p.setBrush(Qt::NoBrush);
+        p.setPen(QPen(palette().color(QPalette::Mid), 1.0));
+        for (const Point &pt : reference_) {
+            p.drawEllipse(map(pt.ratio, pt.volts), 3.5, 3.5);
+        }
+        p.setPen(Qt::NoPen);
+        for (size_t i = 0; i < points_.size(); ++i) {
+            const Point &pt = points_[i];
+            QColor c = pt.type == 'P' ? QColor(40, 110, 220) : pt.type == 'E' ? QColor(40, 170, 80) : QColor(128, 128, 128);
+            c.setAlpha(static_cast<int>(40 + 215 * (i + 1) / points_.size()));
+            p.setBrush(c);
+            p.drawEllipse(map(pt.ratio, pt.volts), 2.5, 2.5);
+        }
+
+        p.setPen(palette().color(QPalette::Text));
+        p.drawText(area.adjusted(8, 4, -8, -4), Qt::AlignTop | Qt::AlignLeft,
+                   reference_.empty() ? "blue: P-cores, green: E-cores"
+                                      : "blue: P-cores, green: E-cores, hollow: reference");
+    }
+
+private:
+    struct Point {
+        int ratio;
+        double volts;
+        char type;
+    };
+    static constexpr size_t kMaxPoints = 4096;
+    std::vector<Point> points_;
+    std::vector<Point> reference_;
+    std::vector<VfCurvePoint> curve_;
+};
+
 class HelperBackend {
 public:
     HelperBackend() : helper_path_(resolve_helper_path()) {}
@@ -526,52 +824,142 @@ public:
         return run_simple(QString("WRITE-POWERCAP %1 %2").arg(pl1_uw).arg(pl2_uw), err);
     }
 
-    bool start_thermald(QString *err) const {
-        return run_simple("START-THERMALD", err);
+    bool start_thermald(bool *queued, QString *err) const {
+        return run_service("START-THERMALD", queued, err);
+    }
+
+    bool stop_thermald(bool *queued, QString *err) const {
+        return run_service("STOP-THERMALD", queued, err);
+    }
+
+    bool disable_thermald(bool *queued, QString *err) const {
+        return run_service("DISABLE-THERMALD", queued, err);
+    }
+
+    bool enable_thermald(bool *queued, QString *err) const {
+        return run_service("ENABLE-THERMALD", queued, err);
     }
 
-    bool stop_thermald(QString *err) const {
-        return run_simple("STOP-THERMALD", err);
+    bool start_tuned(bool *queued, QString *err) const {
+        return run_service("START-TUNED", queued, err);
     }
 
-    bool disable_thermald(QString *err) const {
-        return run_simple("DISABLE-THERMALD", err);
+    bool stop_tuned(bool *queued, QString *err) const {
+        return run_service("STOP-TUNED", queued, err);
     }
 
-    bool enable_thermald(QString *err) const {
-        return run_simple("ENABLE-THERMALD", err);
+    bool disable_tuned(bool *queued, QString *err) const {
+        return run_service("DISABLE-TUNED", queued, err);
     }
 
-    bool start_tuned(QString *err) const {
-        return run_simple("START-TUNED", err);
+    bool enable_tuned(bool *queued, QString *err) const {
+        return run_service("ENABLE-TUNED", queued, err);
     }
 
-    bool stop_tuned(QString *err) const {
-        return run_simple("STOP-TUNED", err);
+    bool start_tuned_ppd(bool *queued, QString *err) const {
+        return run_service("START-TUNED-PPD", queued, err);
     }
 
-    bool disable_tuned(QString *err) const {
-        return run_simple("DISABLE-TUNED", err);
+    bool stop_tuned_ppd(bool *queued, QString *err) const {
+        return run_service("STOP-TUNED-PPD", queued, err);
     }
 
-    bool enable_tuned(QString *err) const {
-        return run_simple("ENABLE-TUNED", err);
+    bool disable_tuned_ppd(bool *queued, QString *err) const {
+        return run_service("DISABLE-TUNED-PPD", queued, err);
     }
 
-    bool start_tuned_ppd(QString *err) const {
-        return run_simple("START-TUNED-PPD", err);
+    bool enable_tuned_ppd(bool *queued, QString *err) const {
+        return run_service("ENABLE-TUNED-PPD", queued, err);
     }
 
-    bool stop_tuned_ppd(QString *err) const {
-        return run_simple("STOP-TUNED-PPD", err);
+    bool stop_powercap_writers(bool *queued, QString *err) const {
+        return run_service("STOP-POWERCAP-WRITERS", queued, err);
     }
 
-    bool disable_tuned_ppd(QString *err) const {
-        return run_simple("DISABLE-TUNED-PPD", err);
+    bool read_conflicts(ConflictReport &report, QString *err) const {
+        QString out;
+        if (!run_command("READ-CONFLICTS", &out, err)) {
+            return false;
+        }
+        report = ConflictReport();
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            int eq = line.indexOf('=');
+            if (eq <= 0) {
+                continue;
+            }
+            QString key = line.left(eq);
+            QString value = line.mid(eq + 1);
+            if (key == "CONFLICT_ELAPSED_S") {
+                report.elapsed_s = value.toDouble();
+            } else if (key == "CONFLICT_EVENTS") {
+                report.events = value.toInt();
+            } else if (key == "CONFLICT_REVERT_EVENTS") {
+                report.revert_events = value.toInt();
+            } else if (key == "CONFLICT_CHANGES_PER_MIN") {
+                report.changes_per_min = value.toDouble();
+            } else if (key == "CONFLICT_CULPRIT") {
+                report.culprit = value == "none" ? QString() : value;
+            } else if (key == "CONFLICT_CONFIDENCE") {
+                report.confidence = value.toDouble();
+            } else if (key == "CONFLICT_PROVEN") {
+                report.proven = value == "1";
+            } else if (key.startsWith("CONFLICT_SOURCE_") && key != "CONFLICT_SOURCE_COUNT") {
+                QHash<QString, QString> kv = parse_kv_list(value);
+                ConflictSource src;
+                src.name = kv.value("name");
+                src.value = kv.value("value");
+                src.changes = kv.value("changes").toInt();
+                src.reverts = kv.value("reverts").toInt();
+                src.last_change_s = kv.value("last_change_s").toDouble();
+                report.sources.append(src);
+            } else if (key == "CONFLICT_SMI") {
+                QHash<QString, QString> kv = parse_kv_list(value);
+                report.smi_valid = kv.value("valid") == "1";
+                report.smi_total = kv.value("total").toULongLong();
+                report.smi_correlated = kv.value("correlated").toInt();
+                report.smi_reverts = kv.value("reverts").toInt();
+                report.smi_lift = kv.value("lift").toDouble();
+            } else if (key.startsWith("CONFLICT_SERVICE_") && key != "CONFLICT_SERVICE_COUNT") {
+                QHash<QString, QString> kv = parse_kv_list(value);
+                ConflictService svc;
+                svc.name = kv.value("name");
+                svc.active = kv.value("active") == "1";
+                svc.last_active_s = kv.value("last_active_s").toDouble();
+                svc.correlated = kv.value("correlated").toInt();
+                svc.reverts = kv.value("reverts").toInt();
+                svc.lift = kv.value("lift").toDouble();
+                report.services.append(svc);
+            }
+        }
+        return true;
     }
 
-    bool enable_tuned_ppd(QString *err) const {
-        return run_simple("ENABLE-TUNED-PPD", err);
+    bool read_service_jobs(QList<ServiceJob> &jobs, int &pending, QString *err) const {
+        QString out;
+        if (!run_command("READ-SERVICE-JOBS", &out, err)) {
+            return false;
+        }
+        jobs.clear();
+        pending = 0;
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            if (line.startsWith("SERVICE_JOBS_PENDING=")) {
+                pending = line.mid(21).toInt();
+                continue;
+            }
+            if (!line.startsWith("SERVICE_JOB_") || line.startsWith("SERVICE_JOB_COUNT=")) {
+                continue;
+            }
+            QHash<QString, QString> kv = parse_kv_list(line.mid(line.indexOf('=') + 1));
+            ServiceJob job;
+            job.id = kv.value("id").toUInt();
+            job.action = kv.value("action");
+            job.unit = kv.value("unit");
+            job.state = kv.value("state");
+            job.result = kv.value("result");
+            job.elapsed_ms = kv.value("elapsed_ms").toInt();
+            jobs.append(job);
+        }
+        return true;
     }
 
     bool set_p_ratio(int ratio, QString *err) const {
@@ -594,18 +982,346 @@ public:
         return run_simple(QString("SET-CORE-UV %1").arg(mv, 0, 'f', 3), err);
     }
 
+    // supported is false when the CPU has no per-point V/F offsets; points is then empty.
+    bool read_vf_curve(QList<VfCurvePoint> &points, bool &supported, QString *err) const {
+        QString out;
+        if (!run_command("READ-VF-CURVE", &out, err)) {
+            return false;
+        }
+        points.clear();
+        supported = false;
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            if (line.startsWith("VF_SUPPORTED=")) {
+                supported = line.mid(13).trimmed() == "1";
+                continue;
+            }
+            if (!line.startsWith("VF_POINT_") || line.startsWith("VF_POINT_COUNT=")) {
+                continue;
+            }
+            int eq = line.indexOf('=');
+            QHash<QString, QString> kv = parse_kv_list(line.mid(eq + 1));
+            VfCurvePoint pt;
+            pt.index = line.mid(9, eq - 9).toInt();
+            pt.ratio = kv.value("ratio").toInt();
+            pt.offset_mv = kv.value("offset_mv").toDouble();
+            points.append(pt);
+        }
+        return true;
+    }
+
+    bool set_vf_point_offset(int point, double mv, QString *err) const {
+        return run_simple(QString("SET-VF-OFFSET point %1 %2").arg(point).arg(mv, 0, 'f', 3), err);
+    }
+
+    bool set_vf_band_offset(int min_ratio, int max_ratio, double mv, QString *err) const {
+        return run_simple(QString("SET-VF-OFFSET band %1 %2 %3").arg(min_ratio).arg(max_ratio).arg(mv, 0, 'f', 3), err);
+    }
+
+    // The helper starts sampling on the first call; elapsed_s is the time since then or since the last reset.
+    bool read_residency(QList<CoreResidency> &out, double &elapsed_s, int &band_c, QString *err) const {
+        QString text;
+        if (!run_command("READ-RESIDENCY", &text, err)) {
+            return false;
+        }
+        out.clear();
+        auto bins = [](const QString &payload) {
+            QList<QPair<int, double>> list;
+            for (const QString &bin : payload.split(';', Qt::SkipEmptyParts)) {
+                int sep = bin.indexOf(':');
+                if (sep > 0) {
+                    list.append(qMakePair(bin.left(sep).toInt(), bin.mid(sep + 1).toDouble()));
+                }
+            }
+            return list;
+        };
+        for (const QString &line : text.split('\n', Qt::SkipEmptyParts)) {
+            if (line.startsWith("RESIDENCY_ELAPSED_S=")) {
+                elapsed_s = line.mid(20).toDouble();
+                continue;
+            }
+            if (line.startsWith("RESIDENCY_TEMP_BAND_C=")) {
+                band_c = line.mid(22).toInt();
+                continue;
+            }
+            if (!line.startsWith("RESIDENCY_CPU_") || line.startsWith("RESIDENCY_CPU_COUNT=")) {
+                continue;
+            }
+            QHash<QString, QString> kv = parse_kv_list(line.mid(line.indexOf('=') + 1));
+            CoreResidency r;
+            r.cpu = kv.value("cpu").toInt();
+            r.type = kv.value("type", "U").at(0).toLatin1();
+            r.total_s = kv.value("total_s").toDouble();
+            r.ratios = bins(kv.value("ratios"));
+            r.temps = bins(kv.value("temps"));
+            out.append(r);
+        }
+        return true;
+    }
+
+    bool reset_residency(QString *err) const {
+        return run_simple("RESET-RESIDENCY", err);
+    }
+
+    bool read_ledger(LedgerReport &report, QString *err) const {
+        QString text;
+        if (!run_command("READ-LEDGER", &text, err)) {
+            return false;
+        }
+        report = LedgerReport();
+        auto totals = [](const QHash<QString, QString> &kv) {
+            LedgerTotals t;
+            t.name = kv.value("name");
+            t.today_wh[0] = kv.value("today_pkg_wh").toDouble();
+            t.today_wh[1] = kv.value("today_dram_wh").toDouble();
+            t.week_wh[0] = kv.value("week_pkg_wh").toDouble();
+            t.week_wh[1] = kv.value("week_dram_wh").toDouble();
+            t.last_week_wh[0] = kv.value("last_week_pkg_wh").toDouble();
+            t.last_week_wh[1] = kv.value("last_week_dram_wh").toDouble();
+            t.total_kwh[0] = kv.value("total_pkg_kwh").toDouble();
+            t.total_kwh[1] = kv.value("total_dram_kwh").toDouble();
+            return t;
+        };
+        for (const QString &line : text.split('\n', Qt::SkipEmptyParts)) {
+            int eq = line.indexOf('=');
+            QString key = line.left(eq);
+            QString value = line.mid(eq + 1).trimmed();
+            if (key == "LEDGER_RECORDING") {
+                report.recording = value == "1";
+            } else if (key == "LEDGER_ACTIVE_PROFILE") {
+                report.active_profile = value;
+            } else if (key == "LEDGER_TODAY") {
+                report.today = value;
+            } else if (key == "LEDGER_WEEK_START") {
+                report.week_start = value;
+            } else if (key == "LEDGER_DRAM_VALID") {
+                report.dram = value == "1";
+            } else if (key == "LEDGER_MACHINE") {
+                report.machine = totals(parse_kv_list(value));
+            } else if (key.startsWith("LEDGER_PROFILE_") && key != "LEDGER_PROFILE_COUNT") {
+                report.profiles.append(totals(parse_kv_list(value)));
+            } else if (key.startsWith("LEDGER_DAY_") && key != "LEDGER_DAY_COUNT") {
+                QHash<QString, QString> kv = parse_kv_list(value);
+                report.days.append(qMakePair(kv.value("date"), kv.value("pkg_wh").toDouble() + kv.value("dram_wh").toDouble()));
+            }
+        }
+        return true;
+    }
+
+    // Energy from now on is charged to name in the ledger; see ledger_profile_name() for what the helper accepts.
+    bool set_profile(const QString &name, QString *err) const {
+        return run_simple("SET-PROFILE " + name, err);
+    }
+
     bool set_cpu_ratio(int cpu, int ratio, QString *err) const {
         return run_simple(QString("SET-CPU-RATIO %1 %2").arg(cpu).arg(ratio), err);
     }
 
-    bool read_core_sensors(QList<CoreSensor> &out, QString *err) const {
+    // group: "P", "E" (park) or "P", "E", "ALL" (unpark).
+    bool park(const QString &group, QString *err) const {
+        return run_simple("PARK " + group, err);
+    }
+
+    bool unpark(const QString &group, QString *err) const {
+        return run_simple("UNPARK " + group, err);
+    }
+
+    // Rates since the previous call; the first call after start reports zeros.
+    bool read_irqs(QList<IrqInfo> &irqs, bool &irqbalance, QString *err) const {
+        QString out;
+        if (!run_command("READ-IRQS", &out, err)) {
+            return false;
+        }
+        irqs.clear();
+        irqbalance = false;
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            if (line.startsWith("IRQBALANCE_RUNNING=")) {
+                irqbalance = line.mid(19) == "1";
+                continue;
+            }
+            if (!line.startsWith("IRQ_") || line.startsWith("IRQ_COUNT=") || line.startsWith("IRQ_INTERVAL_MS=")) {
+                continue;
+            }
+            // name is last and may itself contain commas ("ahci, xhci_hcd").
+            QString payload = line.mid(line.indexOf('=') + 1);
+            int name_at = payload.indexOf(",name=");
+            QHash<QString, QString> kv = parse_kv_list(payload.left(name_at));
+            IrqInfo info;
+            info.irq = kv.value("irq", "-1").toInt();
+            info.name = name_at >= 0 ? payload.mid(name_at + 6) : QString();
+            info.affinity = kv.value("affinity");
+            info.rate = kv.value("rate").toDouble();
+            info.p_rate = kv.value("p_rate").toDouble();
+            info.steered = kv.value("steered") == "1";
+            irqs.append(info);
+        }
+        return true;
+    }
+
+    // target: "P", "E", "favored" or a CPU list; match: space-separated IRQ numbers or names, empty for all.
+    bool steer_irqs(const QString &target, const QString &match, int &steered, int &skipped, QString *err) const {
+        QString out;
+        if (!run_command(QString("STEER-IRQS %1 %2").arg(target, match).trimmed(), &out, err)) {
+            return false;
+        }
+        steered = 0;
+        skipped = 0;
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            if (line.startsWith("IRQ_STEERED_COUNT=")) {
+                steered = line.mid(18).toInt();
+            } else if (line.startsWith("IRQ_SKIPPED_COUNT=")) {
+                skipped = line.mid(18).toInt();
+            }
+        }
+        return true;
+    }
+
+    bool restore_irqs(QString *err) const {
+        return run_simple("RESTORE-IRQS", err);
+    }
+
+    // Watches the first cgroup level by default; pkg_w is the whole package over the same interval.
+    bool read_cgroup_power(QList<CgroupPower> &groups, double &pkg_w, QString &weight, QString *err) const {
+        QString out;
+        if (!run_command("READ-CGROUP-POWER", &out, err)) {
+            return false;
+        }
+        groups.clear();
+        pkg_w = 0.0;
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            if (line.startsWith("CGPOWER_PKG_W=")) {
+                pkg_w = line.mid(14).toDouble();
+            } else if (line.startsWith("CGPOWER_WEIGHT=")) {
+                weight = line.mid(15);
+            } else if (line.startsWith("CGROUP_ERROR_") && !groups.isEmpty()) {
+                groups.last().error = line.mid(line.indexOf('=') + 1);
+            } else if (line.startsWith("CGROUP_") && !line.startsWith("CGROUP_COUNT=")) {
+                // cgroup is last: paths may contain commas.
+                QString payload = line.mid(line.indexOf('=') + 1);
+                int path_at = payload.indexOf(",cgroup=");
+                QHash<QString, QString> kv = parse_kv_list(payload.left(path_at));
+                CgroupPower g;
+                g.cgroup = path_at >= 0 ? payload.mid(path_at + 8) : QString();
+                g.valid = kv.value("valid") == "1";
+                g.watts = kv.value("watts").toDouble();
+                g.avg_w = kv.value("avg_w").toDouble();
+                g.cpu_load = kv.value("cpu_load").toDouble();
+                g.cpus = kv.value("cpus").toInt();
+                g.mode = kv.value("mode");
+                g.budget_w = kv.value("budget_w").toDouble();
+                g.limit = kv.value("limit");
+                groups.append(g);
+            }
+        }
+        return true;
+    }
+
+    // mode: "quota" (cpu.max) or "ratio" (the cgroup's cpuset cores).
+    bool set_cgroup_budget(const QString &cgroup, double watts, const QString &mode, QString *err) const {
+        return run_simple(QString("SET-CGROUP-BUDGET %1 %2 %3").arg(cgroup).arg(watts, 0, 'f', 1).arg(mode), err);
+    }
+
+    bool clear_cgroup_budget(const QString &cgroup, QString *err) const {
+        return run_simple("CLEAR-CGROUP-BUDGET " + cgroup, err);
+    }
+
+    // smi_count, when given, is MSR_SMI_COUNT from the same sample or -1 when the MSR is unreadable.
+    bool read_core_sensors(QList<CoreSensor> &out, QString *err, std::int64_t *smi_count = nullptr) const {
         QString out_text;
         if (!run_command("READ-CORE-SENSORS", &out_text, err)) {
             return false;
         }
+        if (smi_count) {
+            bool valid = false;
+            *smi_count = -1;
+            for (const QString &line : out_text.split('\n', Qt::SkipEmptyParts)) {
+                if (line.startsWith("SMI_COUNT_VALID=")) {
+                    valid = line.mid(16).trimmed() == "1";
+                } else if (line.startsWith("SMI_COUNT=") && valid) {
+                    *smi_count = line.mid(10).trimmed().toLongLong();
+                }
+            }
+        }
         return parse_core_sensors(out_text, out, err);
     }
 
+    bool read_powercap(QList<PowercapZone> &zones, QString *err) const {
+        QString out;
+        if (!run_command("READ-POWERCAP", &out, err)) {
+            return false;
+        }
+        zones.clear();
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            if (!line.startsWith("POWERCAP_ZONE_") || line.startsWith("POWERCAP_ZONE_COUNT=")) {
+                continue;
+            }
+            int eq = line.indexOf('=');
+            QStringList index = line.mid(14, eq - 14).split("_CONSTRAINT_");
+            QHash<QString, QString> kv = parse_kv_list(line.mid(eq + 1));
+            bool ok = false;
+            int zone_idx = index.value(0).toInt(&ok);
+            if (!ok) {
+                continue;
+            }
+            if (index.size() == 1) {
+                PowercapZone z;
+                z.id = kv.value("id");
+                z.name = kv.value("name");
+                z.parent = kv.value("parent");
+                z.enabled = kv.value("enabled") == "1";
+                zones.append(z);
+                continue;
+            }
+            if (zone_idx != zones.size() - 1) {
+                continue;
+            }
+            PowercapConstraint c;
+            c.name = kv.value("name");
+            c.limit_uw = kv.value("limit_uw").toULongLong();
+            c.has_window = kv.contains("time_window_us");
+            c.window_us = kv.value("time_window_us").toULongLong();
+            c.has_max = kv.contains("max_power_uw");
+            c.max_uw = kv.value("max_power_uw").toULongLong();
+            zones.last().constraints.append(c);
+        }
+        return true;
+    }
+
+    bool read_powercap_energy(QList<PowercapEnergy> &energy, std::uint64_t &t_ns, QString *err) const {
+        QString out;
+        if (!run_command("READ-POWERCAP-ENERGY", &out, err)) {
+            return false;
+        }
+        energy.clear();
+        t_ns = 0;
+        for (const QString &line : out.split('\n', Qt::SkipEmptyParts)) {
+            if (line.startsWith("POWERCAP_T_NS=")) {
+                t_ns = line.mid(14).toULongLong();
+                continue;
+            }
+            if (!line.startsWith("POWERCAP_ENERGY_") || line.startsWith("POWERCAP_ENERGY_COUNT=")) {
+                continue;
+            }
+            QHash<QString, QString> kv = parse_kv_list(line.mid(line.indexOf('=') + 1));
+            PowercapEnergy e;
+            e.id = kv.value("id");
+            e.valid = kv.value("valid") == "1";
+            e.energy_uj = kv.value("energy_uj").toULongLong();
+            e.max_energy_range_uj = kv.value("max_energy_range_uj").toULongLong();
+            energy.append(e);
+        }
+        return true;
+    }
+
+    // window_us == 0 leaves the time window untouched.
+    bool write_powercap_zone(const QString &zone, const QString &constraint, std::uint64_t limit_uw,
+                             std::uint64_t window_us, QString *err) const {
+        QString cmd = QString("WRITE-POWERCAP-ZONE %1 %2 %3").arg(zone, constraint).arg(limit_uw);
+        if (window_us > 0) {
+            cmd += QString(" %1").arg(window_us);
+        }
+        return run_simple(cmd, err);
+    }
+
 private:
     QString resolve_helper_path() const {
         QString env = qEnvironmentVariable("LIMITS_HELPER_PATH");
@@ -630,7 +1346,17 @@ private:
         server_ = new QProcess();
         server_->setProgram("pkexec");
         QStringList args;
-        args << helper_path_ << "--server";
+        args << helper_path_;
+        // pkexec clears the environment, so forward the backend choice explicitly.
+        QString backend = qEnvironmentVariable("LIMITS_HELPER_BACKEND");
+        if (!backend.isEmpty()) {
+            args << "--backend" << backend;
+        }
+        QString ratio_backend = qEnvironmentVariable("LIMITS_HELPER_RATIO_BACKEND");
+        if (!ratio_backend.isEmpty()) {
+            args << "--ratio-backend" << ratio_backend;
+        }
+        args << "--server";
         server_->setArguments(args);
         server_->start();
 
@@ -675,6 +1401,17 @@ private:
         server_ = nullptr;
     }
 
+    // *queued: the helper handed the jobs to systemd over D-Bus and they
+    // finish later (READ-SERVICE-JOBS); otherwise systemctl already ran.
+    bool run_service(const QString &command, bool *queued, QString *err) const {
+        QString out;
+        if (!run_command(command, &out, err)) {
+            return false;
+        }
+        *queued = out.contains("SERVICE_BUS=dbus");
+        return true;
+    }
+
     bool run_simple(const QString &command, QString *err) const {
         QString out;
         if (!run_command(command, &out, err)) {
@@ -793,6 +1530,19 @@ private:
                 } else if (key == "thermal") {
                     s.thermal = value.toULongLong(&ok, 0);
                     s.thermal_valid = ok;
+                } else if (key.endsWith("_thr") || key.endsWith("_thr_ms")) {
+                    for (int k = 0; k < LD_THROTTLE_COUNTER_COUNT; ++k) {
+                        if (key == ld_throttle_counter_name(static_cast<ld_throttle_counter>(k))) {
+                            s.throttle[k] = value.toULongLong(&ok);
+                            if (ok) {
+                                s.throttle_have |= 1u << k;
+                            }
+                        }
+                    }
+                } else if (key == "vid") {
+                    unsigned int vid = value.toUInt(&ok);
+                    s.volts = ld_vid_volts(vid);
+                    s.volts_valid = ok && vid != 0;
                 }
             }
             by_index.insert(idx, s);
@@ -859,10 +1609,18 @@ private:
             return false;
         }
 
+        state.msr_backend = values.value("MSR_BACKEND");
+        state.mmio_backend = values.value("MMIO_BACKEND");
+        state.ratio_path = values.value("RATIO_PATH");
+        state.pstate_mode = values.value("PSTATE_MODE");
+        state.pstate_hwp = values.value("PSTATE_HWP").toInt() == 1;
         state.core_type_supported = values.value("CORE_TYPE_SUPPORTED").toInt(&ok) == 1;
         state.p_cpus = values.value("P_CPUS");
         state.e_cpus = values.value("E_CPUS");
         state.u_cpus = values.value("U_CPUS");
+        state.offline_cpus = values.value("OFFLINE_CPUS");
+        state.parked_p = values.value("PARKED_P");
+        state.parked_e = values.value("PARKED_E");
         state.p_ratio_valid = values.value("P_RATIO_VALID").toInt(&ok) == 1;
         state.e_ratio_valid = values.value("E_RATIO_VALID").toInt(&ok) == 1;
         state.p_ratio_cur_valid = values.value("P_RATIO_CUR_VALID").toInt(&ok) == 1;
@@ -971,6 +1729,10 @@ public:
         msr_raw_ = make_readonly_line();
         mmio_raw_ = make_readonly_line();
 
+        limits_backend_ = new QLabel("-");
+        limits_backend_->setToolTip("How each limit copy is accessed: msr / mchbar directly, or through the kernel "
+                                    "intel-rapl / intel-rapl-mmio powercap zones. Ratios go to IA32_PERF_CTL, or to "
+                                    "the cpufreq scaling_max_freq cap when a cpufreq driver owns PERF_CTL.");
         msr_pl1_ = new QLabel("-");
         msr_pl2_ = new QLabel("-");
         mmio_pl1_ = new QLabel("-");
@@ -986,6 +1748,7 @@ public:
         };
 
         add_status_row("Power unit", unit_label_);
+        add_status_row("Access", limits_backend_);
         add_status_row("MSR raw", msr_raw_);
         add_status_row("MSR PL1", msr_pl1_);
         add_status_row("MSR PL2", msr_pl2_);
@@ -1203,6 +1966,26 @@ public:
         service_controls_layout_->addWidget(tuned_controls_);
         service_controls_layout_->addWidget(tuned_ppd_controls_);
         services_layout->addLayout(service_controls_layout_);
+        stop_writers_btn_ = new QPushButton("Stop all power limit writers");
+        stop_writers_btn_->setToolTip("Stops thermald, tuned, tuned-ppd and power-profiles-daemon concurrently.");
+        conflict_label_ = new QLabel("Limit conflicts: not monitored yet");
+        conflict_label_->setWordWrap(true);
+        stop_culprit_btn_ = new QPushButton("Stop culprit");
+        stop_culprit_btn_->setEnabled(false);
+        stop_culprit_btn_->setToolTip("Enabled once a service has been seen reverting limits written here.");
+        auto *writers_row = new QHBoxLayout();
+        writers_row->addWidget(conflict_label_, 1);
+        writers_row->addWidget(stop_culprit_btn_);
+        writers_row->addWidget(stop_writers_btn_);
+        services_layout->addLayout(writers_row);
+
+        conflict_timer_ = new QTimer(this);
+        conflict_timer_->setInterval(2000);
+        connect(conflict_timer_, &QTimer::timeout, this, &MainWindow::update_conflicts);
+
+        service_jobs_timer_ = new QTimer(this);
+        service_jobs_timer_->setInterval(250);
+        connect(service_jobs_timer_, &QTimer::timeout, this, &MainWindow::poll_service_jobs);
         services_group_->setLayout(services_layout);
         services_section_ = new CollapsibleSection("Services", services_group_, spacing);
         main_layout->addWidget(services_section_);
@@ -1336,10 +2119,18 @@ public:
         main_scroll->setWidget(central);
 
         build_sensors_tab();
+        build_powercap_tab();
+        build_irq_tab();
+        build_cgroup_tab();
+        build_energy_tab();
 
         tab_widget_ = new QTabWidget();
         tab_widget_->addTab(main_scroll, "Main");
         tab_widget_->addTab(sensors_tab_, "Sensors");
+        tab_widget_->addTab(powercap_tab_, "Powercap");
+        tab_widget_->addTab(irq_tab_, "Interrupts");
+        tab_widget_->addTab(cgroup_tab_, "Cgroups");
+        tab_widget_->addTab(energy_tab_, "Energy");
         setCentralWidget(tab_widget_);
 
         central->layout()->activate();
@@ -1363,6 +2154,8 @@ public:
         connect(sync_msr_to_mmio_btn_, &QPushButton::clicked, this, &MainWindow::sync_msr_to_mmio);
         connect(sync_mmio_to_msr_btn_, &QPushButton::clicked, this, &MainWindow::sync_mmio_to_msr);
         connect(start_thermald_btn_, &QPushButton::clicked, this, &MainWindow::start_thermald);
+        connect(stop_writers_btn_, &QPushButton::clicked, this, &MainWindow::stop_powercap_writers);
+        connect(stop_culprit_btn_, &QPushButton::clicked, this, &MainWindow::stop_conflict_culprit);
         connect(stop_thermald_btn_, &QPushButton::clicked, this, &MainWindow::stop_thermald);
         connect(disable_thermald_btn_, &QPushButton::clicked, this, &MainWindow::disable_thermald);
         connect(enable_thermald_btn_, &QPushButton::clicked, this, &MainWindow::enable_thermald);
@@ -1408,6 +2201,10 @@ public:
         connect(qApp, &QCoreApplication::aboutToQuit, this, &MainWindow::on_about_to_quit);
         connect(tab_widget_, &QTabWidget::currentChanged, this, [this](int) {
             maybe_start_sensor_timer();
+            // Checkpoints change every few minutes at most; a read on every visit is enough.
+            if (tab_widget_->currentWidget() == energy_tab_) {
+                update_ledger();
+            }
         });
 
         create_tray_icon(app_icon);
@@ -1505,6 +2302,7 @@ private:
         set_controls_enabled(true);
         backend_ready_ = true;
         refresh();
+        maybe_start_sensor_timer();
     }
 
     struct Profile {
@@ -1513,6 +2311,8 @@ private:
         int p_ratio = 0;
         int e_ratio = 0;
         double core_uv_mv = 0.0;
+        QString irq_target;     // empty: the profile does not steer IRQs
+        QString irq_match;
     };
 
     struct Row {
@@ -1522,6 +2322,7 @@ private:
 
     struct PerCoreRow {
         int cpu = -1;
+        bool online = true;
         QLabel *type_label = nullptr;
         QLabel *cur_label = nullptr;
         QSpinBox *target_spin = nullptr;
@@ -1534,8 +2335,23 @@ private:
         QTableWidgetItem *target_item = nullptr;
         QTableWidgetItem *ratio_item = nullptr;
         QTableWidgetItem *freq_item = nullptr;
+        QTableWidgetItem *volt_item = nullptr;
         QTableWidgetItem *temp_item = nullptr;
+        QTableWidgetItem *tjmax_item = nullptr;
         QTableWidgetItem *throttle_item = nullptr;
+        ld_thermal_model thermal{};  // this core's temperature against package power
+        std::uint64_t throttle_prev[LD_THROTTLE_COUNTER_COUNT] = {};
+        unsigned int throttle_prev_have = 0;
+    };
+
+    struct PowercapRow {
+        QString zone_id;
+        QString constraint;
+        std::uint64_t limit_uw = 0;
+        std::uint64_t window_us = 0;
+        QDoubleSpinBox *limit_spin = nullptr;
+        QDoubleSpinBox *window_spin = nullptr;
+        QTableWidgetItem *power_item = nullptr;
     };
 
     void set_controls_enabled(bool enabled) {
@@ -1551,6 +2367,8 @@ private:
         sync_msr_to_mmio_btn_->setEnabled(enabled);
         sync_mmio_to_msr_btn_->setEnabled(enabled);
         start_thermald_btn_->setEnabled(enabled);
+        stop_writers_btn_->setEnabled(enabled);
+        stop_culprit_btn_->setEnabled(enabled && !conflict_culprit_.isEmpty());
         stop_thermald_btn_->setEnabled(enabled);
         disable_thermald_btn_->setEnabled(enabled);
         enable_thermald_btn_->setEnabled(enabled);
@@ -1575,12 +2393,17 @@ private:
         if (per_core_reset_btn_) {
             per_core_reset_btn_->setEnabled(enabled);
         }
+        if (park_p_btn_) {
+            park_p_btn_->setEnabled(enabled);
+            park_e_btn_->setEnabled(enabled);
+            unpark_all_btn_->setEnabled(enabled);
+        }
         for (const PerCoreRow &row : per_core_rows_) {
             if (row.target_spin) {
-                row.target_spin->setEnabled(enabled);
+                row.target_spin->setEnabled(enabled && row.online);
             }
             if (row.set_btn) {
-                row.set_btn->setEnabled(enabled);
+                row.set_btn->setEnabled(enabled && row.online);
             }
         }
     }
@@ -1735,6 +2558,8 @@ private:
         p.p_ratio = p_ratio_spin_->value();
         p.e_ratio = e_ratio_spin_->value();
         p.core_uv_mv = core_uv_spin_->value();
+        p.irq_target = irq_target_edit_->text().trimmed();
+        p.irq_match = irq_match_edit_->text().trimmed();
         return p;
     }
 
@@ -1744,6 +2569,8 @@ private:
         p_ratio_spin_->setValue(std::clamp(p.p_ratio, p_ratio_spin_->minimum(), p_ratio_spin_->maximum()));
         e_ratio_spin_->setValue(std::clamp(p.e_ratio, e_ratio_spin_->minimum(), e_ratio_spin_->maximum()));
         core_uv_spin_->setValue(std::clamp(p.core_uv_mv, core_uv_spin_->minimum(), core_uv_spin_->maximum()));
+        irq_target_edit_->setText(p.irq_target);
+        irq_match_edit_->setText(p.irq_match);
     }
 
     bool save_profile_file(const QString &path, const Profile &p, QString *err) const {
@@ -1760,6 +2587,10 @@ private:
         obj["p_ratio"] = p.p_ratio;
         obj["e_ratio"] = p.e_ratio;
         obj["core_uv_mv"] = p.core_uv_mv;
+        if (!p.irq_target.isEmpty()) {
+            obj["irq_target"] = p.irq_target;
+            obj["irq_match"] = p.irq_match;
+        }
         obj["saved_at"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
         QJsonDocument doc(obj);
 
@@ -1868,6 +2699,9 @@ private:
         p.p_ratio = p_ratio;
         p.e_ratio = e_ratio;
         p.core_uv_mv = core_uv;
+        // IRQ steering is optional; older profiles have none.
+        p.irq_target = obj.value("irq_target").toString().trimmed();
+        p.irq_match = obj.value("irq_match").toString().trimmed();
         return true;
     }
 
@@ -1929,6 +2763,7 @@ private:
             return;
         }
         apply_profile_to_ui(p);
+        record_active_profile(path);
         log_message(QString("Loaded profile from %1").arg(path));
     }
 
@@ -1958,6 +2793,12 @@ private:
         autostart_enabled_->setChecked(settings.value("autostart", false).toBool());
         update_autostart_file();
         settings.endGroup();
+
+        settings.beginGroup("sensors");
+        sensor_fastest_spin_->setValue(settings.value("fastest_ms", 200).toInt());
+        sensor_adaptive_check_->setChecked(settings.value("adaptive", true).toBool());
+        sensor_fastest_spin_->setEnabled(sensor_adaptive_check_->isChecked());
+        settings.endGroup();
         loading_prefs_ = false;
     }
 
@@ -1986,6 +2827,11 @@ private:
         settings.setValue("close_to_tray", close_to_tray_->isChecked());
         settings.setValue("autostart", autostart_enabled_->isChecked());
         settings.endGroup();
+
+        settings.beginGroup("sensors");
+        settings.setValue("adaptive", sensor_adaptive_check_->isChecked());
+        settings.setValue("fastest_ms", sensor_fastest_spin_->value());
+        settings.endGroup();
     }
 
     void update_autostart_file() {
@@ -2064,12 +2910,13 @@ private:
         double pl2_w = pl2_spin_->value();
 
         if (target == Target::Msr || target == Target::Both) {
-            std::uint64_t next = apply_pl_units(state.msr, pl1_units, pl2_units);
+            std::uint64_t next = ld::apply_pl_units(state.msr, pl1_units, pl2_units);
             if (confirm) {
                 if (!confirm_action("Write MSR?",
-                                    QString("MSR (0x%1) new value: %2")
+                                    QString("MSR (0x%1) new value: %2\n%3")
                                         .arg(kMsrPkgPowerLimit, 0, 16)
-                                        .arg(hex64(next)))) {
+                                        .arg(hex64(next))
+                                        .arg(pl_diff_text(state.msr, next, state.unit_watts)))) {
                     return false;
                 }
             }
@@ -2077,16 +2924,17 @@ private:
                 show_error("Write MSR failed", err);
                 return false;
             }
-            log_message(QString("Wrote MSR %1").arg(hex64(next)));
+            log_message(QString("Wrote MSR %1 (%2)").arg(hex64(next), pl_diff_text(state.msr, next, state.unit_watts)));
         }
 
         if (target == Target::Mmio || target == Target::Both) {
-            std::uint64_t next = apply_pl_units(state.mmio, pl1_units, pl2_units);
+            std::uint64_t next = ld::apply_pl_units(state.mmio, pl1_units, pl2_units);
             if (confirm) {
                 if (!confirm_action("Write MMIO?",
-                                    QString("MMIO (0x%1) new value: %2")
+                                    QString("MMIO (0x%1) new value: %2\n%3")
                                         .arg(kMchbarPlOffset, 0, 16)
-                                        .arg(hex64(next)))) {
+                                        .arg(hex64(next))
+                                        .arg(pl_diff_text(state.mmio, next, state.unit_watts)))) {
                     return false;
                 }
             }
@@ -2094,7 +2942,7 @@ private:
                 show_error("Write MMIO failed", err);
                 return false;
             }
-            log_message(QString("Wrote MMIO %1").arg(hex64(next)));
+            log_message(QString("Wrote MMIO %1 (%2)").arg(hex64(next), pl_diff_text(state.mmio, next, state.unit_watts)));
         }
 
         if (powercap_check_ && powercap_check_->isChecked()) {
@@ -2249,6 +3097,7 @@ private:
                     clear_startup_guard();
                     return;
                 }
+                record_active_profile(fallback_path_->text().trimmed());
                 log_message(QString("Applied fallback profile from %1").arg(fallback_path_->text().trimmed()));
             } else {
                 show_error("Startup crash detected",
@@ -2279,6 +3128,7 @@ private:
             clear_startup_guard();
             return;
         }
+        record_active_profile(profile_path);
         log_message(QString("Applied startup profile from %1").arg(profile_path));
     }
 
@@ -2293,6 +3143,9 @@ private:
         if (ok && startup_apply_core_uv_->isChecked()) {
             ok = apply_core_uv_internal(false, false);
         }
+        if (ok && !irq_target_edit_->text().trimmed().isEmpty()) {
+            ok = steer_irqs_internal(false);
+        }
         if (ok) {
             refresh();
         }
@@ -2666,22 +3519,31 @@ protected:
 
         update_msr(state.msr);
         update_mmio(state.mmio);
+        QString access = state.msr_backend.isEmpty()
+                             ? QString("-")
+                             : QString("MSR via %1, MMIO via %2").arg(state.msr_backend, state.mmio_backend);
+        if (!state.ratio_path.isEmpty()) {
+            QString pstate = state.pstate_mode == "none" ? QString() : QString(", intel_pstate %1%2").arg(
+                                 state.pstate_mode, state.pstate_hwp ? " (HWP)" : "");
+            access += QString("; ratios via %1%2").arg(state.ratio_path, pstate);
+        }
+        limits_backend_->setText(access);
         update_core_info(state);
         maybe_init_limits(state);
     }
 
     void update_msr(std::uint64_t val) {
         msr_raw_->setText(hex64(val));
-        std::uint16_t pl1 = static_cast<std::uint16_t>(val & 0x7FFFu);
-        std::uint16_t pl2 = static_cast<std::uint16_t>((val >> 32) & 0x7FFFu);
+        std::uint16_t pl1 = ld::pl1_units(val);
+        std::uint16_t pl2 = ld::pl2_units(val);
         msr_pl1_->setText(units_to_text(pl1, unit_watts_));
         msr_pl2_->setText(units_to_text(pl2, unit_watts_));
     }
 
     void update_mmio(std::uint64_t val) {
         mmio_raw_->setText(hex64(val));
-        std::uint16_t pl1 = static_cast<std::uint16_t>(val & 0x7FFFu);
-        std::uint16_t pl2 = static_cast<std::uint16_t>((val >> 32) & 0x7FFFu);
+        std::uint16_t pl1 = ld::pl1_units(val);
+        std::uint16_t pl2 = ld::pl2_units(val);
         mmio_pl1_->setText(units_to_text(pl1, unit_watts_));
         mmio_pl2_->setText(units_to_text(pl2, unit_watts_));
     }
@@ -2709,9 +3571,30 @@ protected:
                 per_core_rows_populated_ = true;
             }
         }
+        // CPUs brought online after startup (unparked) need rows too.
+        QList<int> offline = parse_cpu_list(state.offline_cpus);
         if (per_core_rows_populated_) {
+            QSet<int> have;
+            for (const PerCoreRow &row : per_core_rows_) {
+                have.insert(row.cpu);
+            }
+            QList<int> missing;
+            for (int cpu : parse_cpu_list(state.p_cpus) + parse_cpu_list(state.e_cpus) + parse_cpu_list(state.u_cpus) +
+                               offline) {
+                if (!have.contains(cpu)) {
+                    missing.append(cpu);
+                    have.insert(cpu);
+                }
+            }
+            std::sort(missing.begin(), missing.end());
+            populate_per_core_rows(missing, "?");
             reset_per_core_ratios();
         }
+        if (known_offline_ != offline) {
+            // Park/unpark changed the topology: the sensor table is rebuilt on the next update.
+            known_offline_ = offline;
+            sensor_rows_.clear();
+        }
 
         int p_count = count_list(state.p_cpus);
         int e_count = count_list(state.e_cpus);
@@ -2764,11 +3647,33 @@ protected:
             for (int cpu : parse_cpu_list(state.u_cpus)) {
                 u_set.insert(cpu);
             }
+            QSet<int> parked_p;
+            QSet<int> parked_e;
+            for (int cpu : parse_cpu_list(state.parked_p)) {
+                parked_p.insert(cpu);
+            }
+            for (int cpu : parse_cpu_list(state.parked_e)) {
+                parked_e.insert(cpu);
+            }
             for (PerCoreRow &row : per_core_rows_) {
                 if (!row.type_label) {
                     continue;
                 }
-                if (p_set.contains(row.cpu)) {
+                row.online = !offline.contains(row.cpu);
+                if (row.target_spin) {
+                    row.target_spin->setEnabled(row.online);
+                }
+                if (row.set_btn) {
+                    row.set_btn->setEnabled(row.online);
+                }
+                if (!row.online) {
+                    row.type_label->setText(parked_p.contains(row.cpu)   ? "P off"
+                                            : parked_e.contains(row.cpu) ? "E off"
+                                                                         : "off");
+                    if (row.cur_label) {
+                        row.cur_label->setText("-");
+                    }
+                } else if (p_set.contains(row.cpu)) {
                     row.type_label->setText("P");
                 } else if (e_set.contains(row.cpu)) {
                     row.type_label->setText("E");
@@ -2795,8 +3700,8 @@ protected:
             return;
         }
         std::uint64_t base = state.msr != 0 ? state.msr : state.mmio;
-        std::uint16_t pl1 = static_cast<std::uint16_t>(base & 0x7FFFu);
-        std::uint16_t pl2 = static_cast<std::uint16_t>((base >> 32) & 0x7FFFu);
+        std::uint16_t pl1 = ld::pl1_units(base);
+        std::uint16_t pl2 = ld::pl2_units(base);
         if (pl1 == 0 || pl2 == 0 || unit_watts_ <= 0.0) {
             return;
         }
@@ -2819,7 +3724,7 @@ protected:
         std::uint64_t pl1_calc = static_cast<std::uint64_t>(std::llround(pl1_w / unit_watts));
         std::uint64_t pl2_calc = static_cast<std::uint64_t>(std::llround(pl2_w / unit_watts));
 
-        if (pl1_calc == 0 || pl2_calc == 0 || pl1_calc > 0x7FFFu || pl2_calc > 0x7FFFu) {
+        if (pl1_calc == 0 || pl2_calc == 0 || pl1_calc > ld::pkg_power_limit::pl1::max() || pl2_calc > ld::pkg_power_limit::pl2::max()) {
             show_error("Invalid values", "Converted units out of range.");
             return false;
         }
@@ -2891,11 +3796,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.start_thermald(&err)) {
+        bool queued = false;
+        if (!backend_.start_thermald(&queued, &err)) {
             show_error("Start thermald failed", err);
             return;
         }
-        log_message("Started thermald.");
+        service_requested("Started thermald.", queued);
     }
 
     void stop_thermald() {
@@ -2904,11 +3810,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.stop_thermald(&err)) {
+        bool queued = false;
+        if (!backend_.stop_thermald(&queued, &err)) {
             show_error("Stop thermald failed", err);
             return;
         }
-        log_message("Stopped thermald.");
+        service_requested("Stopped thermald.", queued);
     }
 
     void disable_thermald() {
@@ -2918,11 +3825,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.disable_thermald(&err)) {
+        bool queued = false;
+        if (!backend_.disable_thermald(&queued, &err)) {
             show_error("Disable thermald failed", err);
             return;
         }
-        log_message("Disabled thermald.");
+        service_requested("Disabled thermald.", queued);
     }
 
     void enable_thermald() {
@@ -2932,11 +3840,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.enable_thermald(&err)) {
+        bool queued = false;
+        if (!backend_.enable_thermald(&queued, &err)) {
             show_error("Enable thermald failed", err);
             return;
         }
-        log_message("Enabled thermald.");
+        service_requested("Enabled thermald.", queued);
     }
 
     void start_tuned() {
@@ -2945,11 +3854,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.start_tuned(&err)) {
+        bool queued = false;
+        if (!backend_.start_tuned(&queued, &err)) {
             show_error("Start tuned failed", err);
             return;
         }
-        log_message("Started tuned.");
+        service_requested("Started tuned.", queued);
     }
 
     void stop_tuned() {
@@ -2958,11 +3868,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.stop_tuned(&err)) {
+        bool queued = false;
+        if (!backend_.stop_tuned(&queued, &err)) {
             show_error("Stop tuned failed", err);
             return;
         }
-        log_message("Stopped tuned.");
+        service_requested("Stopped tuned.", queued);
     }
 
     void disable_tuned() {
@@ -2972,11 +3883,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.disable_tuned(&err)) {
+        bool queued = false;
+        if (!backend_.disable_tuned(&queued, &err)) {
             show_error("Disable tuned failed", err);
             return;
         }
-        log_message("Disabled tuned.");
+        service_requested("Disabled tuned.", queued);
     }
 
     void enable_tuned() {
@@ -2986,11 +3898,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.enable_tuned(&err)) {
+        bool queued = false;
+        if (!backend_.enable_tuned(&queued, &err)) {
             show_error("Enable tuned failed", err);
             return;
         }
-        log_message("Enabled tuned.");
+        service_requested("Enabled tuned.", queued);
     }
 
     void start_tuned_ppd() {
@@ -2999,11 +3912,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.start_tuned_ppd(&err)) {
+        bool queued = false;
+        if (!backend_.start_tuned_ppd(&queued, &err)) {
             show_error("Start tuned-ppd failed", err);
             return;
         }
-        log_message("Started tuned-ppd.");
+        service_requested("Started tuned-ppd.", queued);
     }
 
     void stop_tuned_ppd() {
@@ -3012,11 +3926,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.stop_tuned_ppd(&err)) {
+        bool queued = false;
+        if (!backend_.stop_tuned_ppd(&queued, &err)) {
             show_error("Stop tuned-ppd failed", err);
             return;
         }
-        log_message("Stopped tuned-ppd.");
+        service_requested("Stopped tuned-ppd.", queued);
     }
 
     void disable_tuned_ppd() {
@@ -3026,11 +3941,12 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.disable_tuned_ppd(&err)) {
+        bool queued = false;
+        if (!backend_.disable_tuned_ppd(&queued, &err)) {
             show_error("Disable tuned-ppd failed", err);
             return;
         }
-        log_message("Disabled tuned-ppd.");
+        service_requested("Disabled tuned-ppd.", queued);
     }
 
     void enable_tuned_ppd() {
@@ -3040,25 +3956,167 @@ protected:
             return;
         }
         QString err;
-        if (!backend_.enable_tuned_ppd(&err)) {
+        bool queued = false;
+        if (!backend_.enable_tuned_ppd(&queued, &err)) {
             show_error("Enable tuned-ppd failed", err);
             return;
         }
-        log_message("Enabled tuned-ppd.");
-    }
-
-    bool confirm_action(const QString &title, const QString &detail) {
-        QMessageBox box(this);
-        box.setWindowTitle(title);
-        box.setText(title);
-        box.setInformativeText(detail);
-        box.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
-        box.setDefaultButton(QMessageBox::No);
-        return box.exec() == QMessageBox::Yes;
+        service_requested("Enabled tuned-ppd.", queued);
     }
 
-    void show_error(const QString &title, const QString &detail) {
-        QMessageBox::critical(this, title, detail);
+    void stop_powercap_writers() {
+        QString detail = "This will stop thermald, tuned, tuned-ppd and power-profiles-daemon.\n"
+                         "Units that are not installed are skipped.";
+        if (!confirm_action("Stop all power limit writers?", detail)) {
+            return;
+        }
+        QString err;
+        bool queued = false;
+        if (!backend_.stop_powercap_writers(&queued, &err)) {
+            show_error("Stop writers failed", err);
+            return;
+        }
+        service_requested("Stopped power limit writers.", queued);
+    }
+
+    void update_conflicts() {
+        ConflictReport report;
+        QString err;
+        if (!backend_.read_conflicts(report, &err)) {
+            conflict_label_->setText("Limit conflicts: unavailable");
+            conflict_label_->setToolTip(err);
+            stop_culprit_btn_->setEnabled(false);
+            return;
+        }
+
+        QString minutes = QString::number(report.elapsed_s / 60.0, 'f', 1);
+        QString text;
+        if (report.events == 0) {
+            text = QString("Limit conflicts: no foreign changes in %1 min").arg(minutes);
+        } else if (report.culprit.isEmpty() && report.smi_correlated >= 2 && report.smi_lift >= 0.5) {
+            text = QString("Limit conflicts: probably firmware (SMM) - %1 changes (%2/min) coincide with SMIs, %3 reverted ours, lift %4")
+                       .arg(report.events)
+                       .arg(report.changes_per_min, 0, 'f', 1)
+                       .arg(report.smi_reverts)
+                       .arg(report.smi_lift, 0, 'f', 2);
+        } else if (report.culprit.isEmpty()) {
+            text = QString("Limit conflicts: %1 foreign changes (%2/min), culprit unclear")
+                       .arg(report.events)
+                       .arg(report.changes_per_min, 0, 'f', 1);
+        } else {
+            text = QString("Limit conflicts: probably %1 - %2 changes (%3/min), %4 reverted ours, confidence %5%6")
+                       .arg(report.culprit)
+                       .arg(report.events)
+                       .arg(report.changes_per_min, 0, 'f', 1)
+                       .arg(report.revert_events)
+                       .arg(report.confidence, 0, 'f', 2)
+                       .arg(report.proven ? " (proven)" : "");
+        }
+        conflict_label_->setText(text);
+
+        QStringList detail;
+        for (const ConflictSource &src : report.sources) {
+            if (src.changes > 0) {
+                detail << QString("%1: %2 changes, %3 reverts, last %4 s ago")
+                              .arg(src.name)
+                              .arg(src.changes)
+                              .arg(src.reverts)
+                              .arg(src.last_change_s, 0, 'f', 0);
+            }
+        }
+        for (const ConflictService &svc : report.services) {
+            if (!svc.active) {
+                detail << QString("%1: not running").arg(svc.name);
+                continue;
+            }
+            QString last = svc.last_active_s < 0.0 ? QString("idle") :
+                           QString("active %1 s ago").arg(svc.last_active_s, 0, 'f', 0);
+            detail << QString("%1: %2, %3 coinciding changes, lift %4")
+                          .arg(svc.name, last)
+                          .arg(svc.correlated)
+                          .arg(svc.lift, 0, 'f', 2);
+        }
+        if (report.smi_valid) {
+            detail << QString("SMIs: %1 since monitoring started, %2 coinciding changes, lift %3")
+                          .arg(report.smi_total)
+                          .arg(report.smi_correlated)
+                          .arg(report.smi_lift, 0, 'f', 2);
+        }
+        conflict_label_->setToolTip(detail.join('\n'));
+
+        conflict_culprit_ = report.proven ? report.culprit : QString();
+        stop_culprit_btn_->setEnabled(!conflict_culprit_.isEmpty());
+        stop_culprit_btn_->setText(conflict_culprit_.isEmpty() ? QString("Stop culprit")
+                                                               : QString("Stop %1").arg(conflict_culprit_));
+        if (!conflict_culprit_.isEmpty() && conflict_culprit_ != conflict_logged_) {
+            log_message(QString("%1 keeps reverting the power limits (%2 reverts).")
+                            .arg(conflict_culprit_)
+                            .arg(report.revert_events));
+        }
+        conflict_logged_ = conflict_culprit_;
+    }
+
+    void stop_conflict_culprit() {
+        if (conflict_culprit_ == "thermald") {
+            stop_thermald();
+        } else if (conflict_culprit_ == "tuned") {
+            stop_tuned();
+        } else if (conflict_culprit_ == "tuned-ppd") {
+            stop_tuned_ppd();
+        } else if (!conflict_culprit_.isEmpty()) {
+            stop_powercap_writers();
+        }
+    }
+
+    // Queued jobs are reported by poll_service_jobs() once systemd finishes them.
+    void service_requested(const QString &done_msg, bool queued) {
+        if (!queued) {
+            log_message(done_msg);
+            return;
+        }
+        if (!service_jobs_timer_->isActive()) {
+            service_jobs_timer_->start();
+        }
+    }
+
+    void poll_service_jobs() {
+        QList<ServiceJob> jobs;
+        int pending = 0;
+        QString err;
+        if (!backend_.read_service_jobs(jobs, pending, &err)) {
+            service_jobs_timer_->stop();
+            log_message("Service job status unavailable: " + err);
+            return;
+        }
+        for (const ServiceJob &job : jobs) {
+            if (!job.finished() || service_jobs_reported_.contains(job.id)) {
+                continue;
+            }
+            service_jobs_reported_.insert(job.id);
+            QString msg = QString("%1 %2: %3 (%4 ms)").arg(job.action, job.unit, job.state).arg(job.elapsed_ms);
+            if (job.state == "failed") {
+                show_error(QString("%1 %2 failed").arg(job.action, job.unit), job.result);
+            } else {
+                log_message(msg);
+            }
+        }
+        if (pending == 0) {
+            service_jobs_timer_->stop();
+        }
+    }
+
+    bool confirm_action(const QString &title, const QString &detail) {
+        QMessageBox box(this);
+        box.setWindowTitle(title);
+        box.setText(title);
+        box.setInformativeText(detail);
+        box.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+        box.setDefaultButton(QMessageBox::No);
+        return box.exec() == QMessageBox::Yes;
+    }
+
+    void show_error(const QString &title, const QString &detail) {
+        QMessageBox::critical(this, title, detail);
         log_message(title + ": " + detail);
     }
 
@@ -3086,6 +4144,32 @@ protected:
         header->addWidget(per_core_reset_btn_);
         outer_layout->addLayout(header);
 
+        auto *park_row = new QHBoxLayout();
+        park_row->setSpacing(spacing);
+        auto *park_label = new QLabel("Online cores:");
+        park_label->setToolTip("Takes the other core group offline through CPU hotplug. CPU0 always stays online. "
+                               "CPUs parked by the GUI come back when it exits.");
+        park_row->addWidget(park_label);
+        park_e_btn_ = new QPushButton("P only");
+        park_p_btn_ = new QPushButton("E only");
+        unpark_all_btn_ = new QPushButton("All");
+        park_row->addWidget(park_e_btn_);
+        park_row->addWidget(park_p_btn_);
+        park_row->addWidget(unpark_all_btn_);
+        park_row->addStretch();
+        outer_layout->addLayout(park_row);
+        connect(park_e_btn_, &QPushButton::clicked, this, [this]() { park_group("E"); });
+        connect(park_p_btn_, &QPushButton::clicked, this, [this]() { park_group("P"); });
+        connect(unpark_all_btn_, &QPushButton::clicked, this, [this]() {
+            QString err;
+            if (!backend_.unpark("ALL", &err)) {
+                show_error("Bring cores online failed", err);
+                return;
+            }
+            log_message("All cores online.");
+            refresh();
+        });
+
         per_core_grid_ = new QGridLayout();
         per_core_grid_->setSpacing(spacing);
         per_core_grid_->setVerticalSpacing(spacing);
@@ -3159,8 +4243,9 @@ protected:
         layout->addWidget(info);
 
         sensors_table_ = new QTableWidget();
-        sensors_table_->setColumnCount(7);
-        sensors_table_->setHorizontalHeaderLabels({"CPU", "Type", "Target", "Ratio", "Clock MHz", "Temp °C", "Throttle"});
+        sensors_table_->setColumnCount(9);
+        sensors_table_->setHorizontalHeaderLabels(
+            {"CPU", "Type", "Target", "Ratio", "Clock MHz", "Voltage", "Temp °C", "TjMax at PL2", "Throttle"});
         sensors_table_->horizontalHeader()->setStretchLastSection(true);
         sensors_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
         sensors_table_->setSelectionBehavior(QAbstractItemView::SelectRows);
@@ -3168,8 +4253,110 @@ protected:
         sensors_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
         layout->addWidget(sensors_table_, 1);
 
+        // Fitted from package power (powercap energy_uj) and coretemp; predicts for the PL1/PL2 in the Set fields.
+        thermal_label_ = new QLabel("Thermal model: waiting for samples");
+        thermal_label_->setWordWrap(true);
+        layout->addWidget(thermal_label_);
+
+        // Ratio against the VID each core reports; keep a reference, change the UV offset, and compare.
+        auto *vf_box = new QGroupBox("Voltage / frequency");
+        auto *vf_layout = new QVBoxLayout(vf_box);
+        vf_plot_ = new VfPlot();
+        vf_layout->addWidget(vf_plot_, 1);
+        auto *vf_buttons = new QHBoxLayout();
+        auto *vf_reference = new QPushButton("Keep as Reference");
+        auto *vf_clear = new QPushButton("Clear");
+        vf_buttons->addStretch();
+        vf_buttons->addWidget(vf_reference);
+        vf_buttons->addWidget(vf_clear);
+        vf_layout->addLayout(vf_buttons);
+        connect(vf_reference, &QPushButton::clicked, this, [this]() { vf_plot_->keep_reference(); });
+        connect(vf_clear, &QPushButton::clicked, this, [this]() { vf_plot_->clear(); });
+        layout->addWidget(vf_box, 1);
+
+        // Per-point offsets through the OC mailbox, so the high bins can take a deeper undervolt than the low ones.
+        auto *curve_box = new QGroupBox("V/F curve offsets");
+        auto *curve_layout = new QVBoxLayout(curve_box);
+        vf_curve_table_ = new QTableWidget();
+        vf_curve_table_->setColumnCount(3);
+        vf_curve_table_->setHorizontalHeaderLabels({"Point", "Ratio", "Offset"});
+        vf_curve_table_->horizontalHeader()->setStretchLastSection(true);
+        vf_curve_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        vf_curve_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        curve_layout->addWidget(vf_curve_table_);
+
+        auto *band_row = new QHBoxLayout();
+        vf_band_min_spin_ = new QSpinBox();
+        vf_band_min_spin_->setRange(1, 255);
+        vf_band_min_spin_->setPrefix("x");
+        vf_band_max_spin_ = new QSpinBox();
+        vf_band_max_spin_->setRange(1, 255);
+        vf_band_max_spin_->setPrefix("x");
+        vf_band_max_spin_->setValue(255);
+        vf_band_mv_spin_ = new QDoubleSpinBox();
+        vf_band_mv_spin_->setRange(-500.0, 500.0);
+        vf_band_mv_spin_->setDecimals(0);
+        vf_band_mv_spin_->setSuffix(" mV");
+        auto *band_btn = new QPushButton("Apply to Band");
+        band_row->addWidget(new QLabel("Ratios"));
+        band_row->addWidget(vf_band_min_spin_);
+        band_row->addWidget(new QLabel("to"));
+        band_row->addWidget(vf_band_max_spin_);
+        band_row->addWidget(vf_band_mv_spin_);
+        band_row->addWidget(band_btn);
+        band_row->addStretch();
+        curve_layout->addLayout(band_row);
+
+        auto *curve_buttons = new QHBoxLayout();
+        vf_curve_status_ = new QLabel("Not read");
+        auto *curve_read = new QPushButton("Read Curve");
+        auto *curve_apply = new QPushButton("Apply Offsets");
+        curve_buttons->addWidget(vf_curve_status_, 1);
+        curve_buttons->addWidget(curve_read);
+        curve_buttons->addWidget(curve_apply);
+        curve_layout->addLayout(curve_buttons);
+        connect(curve_read, &QPushButton::clicked, this, &MainWindow::read_vf_curve);
+        connect(curve_apply, &QPushButton::clicked, this, &MainWindow::apply_vf_point_offsets);
+        connect(band_btn, &QPushButton::clicked, this, &MainWindow::apply_vf_band_offset);
+        layout->addWidget(curve_box);
+
+        // Sampled by the helper every 100 ms, so turbo bursts between the 1 s sensor updates still count.
+        auto *residency_box = new QGroupBox("Residency");
+        auto *residency_layout = new QVBoxLayout(residency_box);
+        residency_table_ = new QTableWidget();
+        residency_table_->setColumnCount(5);
+        residency_table_->setHorizontalHeaderLabels({"CPU", "Type", "Most Time At", "Ratios", "Temperatures"});
+        residency_table_->horizontalHeader()->setStretchLastSection(true);
+        residency_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        residency_table_->setAlternatingRowColors(true);
+        residency_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        residency_layout->addWidget(residency_table_);
+        auto *residency_buttons = new QHBoxLayout();
+        residency_status_ = new QLabel("Not read");
+        auto *residency_refresh = new QPushButton("Refresh");
+        auto *residency_reset = new QPushButton("Reset");
+        residency_buttons->addWidget(residency_status_, 1);
+        residency_buttons->addWidget(residency_refresh);
+        residency_buttons->addWidget(residency_reset);
+        residency_layout->addLayout(residency_buttons);
+        connect(residency_refresh, &QPushButton::clicked, this, &MainWindow::update_residency);
+        connect(residency_reset, &QPushButton::clicked, this, &MainWindow::reset_residency);
+        layout->addWidget(residency_box);
+
         auto *footer = new QHBoxLayout();
+        // MSR_SMI_COUNT per interval; SMIs stall every core, so bursts show up as latency spikes.
+        smi_label_ = new QLabel("SMIs: -");
+        footer->addWidget(smi_label_);
         footer->addStretch();
+        // Adaptive: poll at the fastest interval while power, ratios or throttling move, back off to 2 s while idle.
+        sensor_adaptive_check_ = new QCheckBox("Adaptive rate, fastest");
+        sensor_fastest_spin_ = new QSpinBox();
+        sensor_fastest_spin_->setRange(LD_SAMPLER_MIN_MS, 1000);
+        sensor_fastest_spin_->setSingleStep(50);
+        sensor_fastest_spin_->setSuffix(" ms");
+        sensor_fastest_spin_->setValue(200);
+        footer->addWidget(sensor_adaptive_check_);
+        footer->addWidget(sensor_fastest_spin_);
         sensors_status_label_ = new QLabel("Waiting...");
         footer->addWidget(sensors_status_label_);
         layout->addLayout(footer);
@@ -3177,9 +4364,169 @@ protected:
         sensor_timer_ = new QTimer(this);
         sensor_timer_->setInterval(1000);
         connect(sensor_timer_, &QTimer::timeout, this, &MainWindow::update_sensors);
+        connect(sensor_adaptive_check_, &QCheckBox::toggled, this, [this]() {
+            sensor_fastest_spin_->setEnabled(sensor_adaptive_check_->isChecked());
+            restart_sensor_sampler();
+            save_preferences();
+        });
+        connect(sensor_fastest_spin_, QOverload<int>::of(&QSpinBox::valueChanged), this, [this]() {
+            restart_sensor_sampler();
+            save_preferences();
+        });
+        sensor_clock_.start();
+        restart_sensor_sampler();
+    }
+
+    // "x48 83%  x52 10%" for the largest bins; band_c > 0 labels the bins as temperature bands instead of ratios.
+    static QString residency_summary(QList<QPair<int, double>> bins, double total_s, int band_c, QString *tooltip) {
+        std::stable_sort(bins.begin(), bins.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+        QStringList parts;
+        QStringList all;
+        for (const auto &bin : bins) {
+            QString label = band_c > 0 ? QString("%1-%2 °C").arg(bin.first).arg(bin.first + band_c - 1)
+                                       : QString("x%1").arg(bin.first);
+            double pct = total_s > 0.0 ? 100.0 * bin.second / total_s : 0.0;
+            QString share = QString("%1%").arg(pct, 0, 'f', pct < 10.0 ? 1 : 0);
+            if (parts.size() < 4) {
+                parts.append(label + " " + share);
+            }
+            all.append(QString("%1: %2 s (%3)").arg(label).arg(bin.second, 0, 'f', 1).arg(share));
+        }
+        *tooltip = all.join('\n');
+        return parts.isEmpty() ? QString("-") : parts.join("  ");
+    }
+
+    void update_residency() {
+        if (!backend_ready_) {
+            residency_status_->setText("Backend not ready");
+            return;
+        }
+        QString err;
+        QList<CoreResidency> cores;
+        double elapsed_s = 0.0;
+        int band_c = 5;
+        if (!backend_.read_residency(cores, elapsed_s, band_c, &err)) {
+            residency_status_->setText("Read failed: " + err);
+            return;
+        }
+        residency_table_->setRowCount(cores.size());
+        for (int row = 0; row < cores.size(); ++row) {
+            const CoreResidency &r = cores[row];
+            QString ratio_tip;
+            QString temp_tip;
+            QString ratios = residency_summary(r.ratios, r.total_s, 0, &ratio_tip);
+            QString temps = residency_summary(r.temps, r.total_s, band_c, &temp_tip);
+            residency_table_->setItem(row, 0, new QTableWidgetItem(QString::number(r.cpu)));
+            residency_table_->setItem(row, 1, new QTableWidgetItem(QString(QChar(r.type))));
+            residency_table_->setItem(row, 2, new QTableWidgetItem(ratios.section("  ", 0, 0)));
+            auto *ratio_item = new QTableWidgetItem(ratios);
+            ratio_item->setToolTip(ratio_tip);
+            residency_table_->setItem(row, 3, ratio_item);
+            auto *temp_item = new QTableWidgetItem(temps);
+            temp_item->setToolTip(temp_tip);
+            residency_table_->setItem(row, 4, temp_item);
+        }
+        residency_status_->setText(QString("%1 s of samples, %2 °C bands").arg(elapsed_s, 0, 'f', 0).arg(band_c));
+    }
+
+    void reset_residency() {
+        QString err;
+        if (!backend_ready_ || !backend_.reset_residency(&err)) {
+            residency_status_->setText(backend_ready_ ? "Reset failed: " + err : QString("Backend not ready"));
+            return;
+        }
+        log_message("Residency histograms reset");
+        update_residency();
+    }
+
+    void read_vf_curve() {
+        if (!backend_ready_) {
+            vf_curve_status_->setText("Backend not ready");
+            return;
+        }
+        QString err;
+        bool supported = false;
+        if (!backend_.read_vf_curve(vf_curve_, supported, &err)) {
+            vf_curve_status_->setText("Read failed: " + err);
+            return;
+        }
+        vf_curve_table_->setRowCount(vf_curve_.size());
+        vf_curve_spins_.clear();
+        for (int row = 0; row < vf_curve_.size(); ++row) {
+            const VfCurvePoint &pt = vf_curve_[row];
+            vf_curve_table_->setItem(row, 0, new QTableWidgetItem(QString::number(pt.index)));
+            vf_curve_table_->setItem(row, 1, new QTableWidgetItem(QString("x%1").arg(pt.ratio)));
+            auto *spin = new QDoubleSpinBox();
+            spin->setRange(-500.0, 500.0);
+            spin->setDecimals(0);
+            spin->setSuffix(" mV");
+            spin->setValue(pt.offset_mv);
+            vf_curve_table_->setCellWidget(row, 2, spin);
+            vf_curve_spins_.append(spin);
+        }
+        vf_plot_->set_curve(vf_curve_);
+        vf_curve_status_->setText(supported ? QString("%1 points").arg(vf_curve_.size())
+                                            : "Per-point offsets not supported on this CPU");
+    }
+
+    void apply_vf_point_offsets() {
+        QStringList changes;
+        for (int row = 0; row < vf_curve_.size() && row < vf_curve_spins_.size(); ++row) {
+            if (std::fabs(vf_curve_spins_[row]->value() - vf_curve_[row].offset_mv) >= 0.5) {
+                changes << QString("Point %1 (x%2): %3 mV")
+                               .arg(vf_curve_[row].index)
+                               .arg(vf_curve_[row].ratio)
+                               .arg(vf_curve_spins_[row]->value(), 0, 'f', 0);
+            }
+        }
+        if (changes.isEmpty()) {
+            vf_curve_status_->setText("No offsets changed");
+            return;
+        }
+        if (!confirm_action("Set V/F point offsets?", changes.join('\n'))) {
+            return;
+        }
+        for (int row = 0; row < vf_curve_.size() && row < vf_curve_spins_.size(); ++row) {
+            double mv = vf_curve_spins_[row]->value();
+            if (std::fabs(mv - vf_curve_[row].offset_mv) < 0.5) {
+                continue;
+            }
+            QString err;
+            if (!backend_.set_vf_point_offset(vf_curve_[row].index, mv, &err)) {
+                show_error("Set V/F point offset failed", err);
+                break;
+            }
+            log_message(QString("Set V/F point %1 (x%2) offset %3 mV")
+                            .arg(vf_curve_[row].index)
+                            .arg(vf_curve_[row].ratio)
+                            .arg(mv, 0, 'f', 0));
+        }
+        read_vf_curve();
     }
 
-    void update_sensor_row(SensorRow &row, const CoreSensor *sensor) {
+    void apply_vf_band_offset() {
+        int min_ratio = vf_band_min_spin_->value();
+        int max_ratio = vf_band_max_spin_->value();
+        double mv = vf_band_mv_spin_->value();
+        if (min_ratio > max_ratio) {
+            show_error("Invalid ratio band", "The lower ratio is above the upper one.");
+            return;
+        }
+        QString detail = QString("Ratios x%1 to x%2: %3 mV").arg(min_ratio).arg(max_ratio).arg(mv, 0, 'f', 0);
+        if (!confirm_action("Set V/F band offset?", detail)) {
+            return;
+        }
+        QString err;
+        if (!backend_.set_vf_band_offset(min_ratio, max_ratio, mv, &err)) {
+            show_error("Set V/F band offset failed", err);
+        } else {
+            log_message("Set V/F band offset, " + detail);
+        }
+        read_vf_curve();
+    }
+
+    // Temperature in °C, or -1 when coretemp has none for this CPU. interval_s is the time since the previous update.
+    double update_sensor_row(SensorRow &row, const CoreSensor *sensor, double interval_s) {
         double mhz = read_current_mhz_for_cpu(row.cpu);
         if (mhz > 0.0) {
             row.freq_item->setText(QString::number(std::llround(mhz)));
@@ -3212,17 +4559,50 @@ protected:
         } else {
             row.temp_item->setText("-");
         }
+        double temp_c = temp_md > 0 ? temp_md / 1000.0 : -1.0;
 
         if (sensor) {
             row.type_item->setText(QString(sensor->type));
             row.ratio_item->setText(sensor->ratio_valid ? QString("x%1").arg(sensor->ratio) : "-");
-            if (sensor->thermal_valid) {
-                row.throttle_item->setText(thermal_status_summary(sensor->thermal));
-            } else {
-                row.throttle_item->setText("-");
+            row.volt_item->setText(sensor->volts_valid ? QString("%1 V").arg(sensor->volts, 0, 'f', 3) : "-");
+            QString text = sensor->thermal_valid ? thermal_status_summary(sensor->thermal) : QString("-");
+            // Events since the last update, so throttling between two polls still shows.
+            unsigned int both = sensor->throttle_have & row.throttle_prev_have;
+            if ((both & (1u << LD_THROTTLE_CORE_EVENTS)) &&
+                sensor->throttle[LD_THROTTLE_CORE_EVENTS] > row.throttle_prev[LD_THROTTLE_CORE_EVENTS]) {
+                text += QString(" +%1 events").arg(sensor->throttle[LD_THROTTLE_CORE_EVENTS] -
+                                                   row.throttle_prev[LD_THROTTLE_CORE_EVENTS]);
+                if ((both & (1u << LD_THROTTLE_CORE_MS)) &&
+                    sensor->throttle[LD_THROTTLE_CORE_MS] >= row.throttle_prev[LD_THROTTLE_CORE_MS]) {
+                    std::uint64_t ms = sensor->throttle[LD_THROTTLE_CORE_MS] - row.throttle_prev[LD_THROTTLE_CORE_MS];
+                    // The interval varies with the adaptive rate; the share of it is what compares across updates.
+                    if (interval_s > 0.0) {
+                        double pct = std::min(100.0, ms / (10.0 * interval_s));
+                        text += QString(" (%1 ms, %2%)").arg(ms).arg(pct, 0, 'f', 0);
+                    } else {
+                        text += QString(" (%1 ms)").arg(ms);
+                    }
+                }
             }
+            row.throttle_item->setText(text);
+            if (sensor->throttle_have & (1u << LD_THROTTLE_CORE_EVENTS)) {
+                QString tip = QString("Core throttle events: %1").arg(sensor->throttle[LD_THROTTLE_CORE_EVENTS]);
+                if (sensor->throttle_have & (1u << LD_THROTTLE_CORE_MS)) {
+                    tip += QString(", %1 ms throttled").arg(sensor->throttle[LD_THROTTLE_CORE_MS]);
+                }
+                if (sensor->throttle_have & (1u << LD_THROTTLE_PKG_EVENTS)) {
+                    tip += QString("\nPackage throttle events: %1").arg(sensor->throttle[LD_THROTTLE_PKG_EVENTS]);
+                }
+                if (sensor->throttle_have & (1u << LD_THROTTLE_PKG_MS)) {
+                    tip += QString(", %1 ms throttled").arg(sensor->throttle[LD_THROTTLE_PKG_MS]);
+                }
+                row.throttle_item->setToolTip(tip);
+            }
+            std::copy(std::begin(sensor->throttle), std::end(sensor->throttle), std::begin(row.throttle_prev));
+            row.throttle_prev_have = sensor->throttle_have;
         } else {
             row.ratio_item->setText("-");
+            row.volt_item->setText("-");
             row.throttle_item->setText("-");
         }
 
@@ -3233,6 +4613,7 @@ protected:
                 break;
             }
         }
+        return temp_c;
     }
 
     void refresh_sensor_table_structure() {
@@ -3246,6 +4627,10 @@ protected:
             logical = 1;
         }
 
+        // logical only counts online CPUs; parked ones keep their rows.
+        for (int cpu : known_offline_) {
+            logical = std::max(logical, cpu + 1);
+        }
         QList<int> cpus;
         for (int i = 0; i < logical; ++i) {
             if (QFile::exists(QString("/sys/devices/system/cpu/cpu%1").arg(i))) {
@@ -3267,16 +4652,21 @@ protected:
             row.target_item = new QTableWidgetItem("-");
             row.ratio_item = new QTableWidgetItem("-");
             row.freq_item = new QTableWidgetItem("-");
+            row.volt_item = new QTableWidgetItem("-");
             row.temp_item = new QTableWidgetItem("-");
+            row.tjmax_item = new QTableWidgetItem("-");
             row.throttle_item = new QTableWidgetItem("-");
+            ld_thermal_model_init(&row.thermal);
 
             sensors_table_->setItem(i, 0, new QTableWidgetItem(QString::number(cpu)));
             sensors_table_->setItem(i, 1, row.type_item);
             sensors_table_->setItem(i, 2, row.target_item);
             sensors_table_->setItem(i, 3, row.ratio_item);
             sensors_table_->setItem(i, 4, row.freq_item);
-            sensors_table_->setItem(i, 5, row.temp_item);
-            sensors_table_->setItem(i, 6, row.throttle_item);
+            sensors_table_->setItem(i, 5, row.volt_item);
+            sensors_table_->setItem(i, 6, row.temp_item);
+            sensors_table_->setItem(i, 7, row.tjmax_item);
+            sensors_table_->setItem(i, 8, row.throttle_item);
 
             for (int col = 0; col < sensors_table_->columnCount(); ++col) {
                 QTableWidgetItem *it = sensors_table_->item(i, col);
@@ -3290,16 +4680,57 @@ protected:
     }
 
     void maybe_start_sensor_timer() {
-        if (!sensor_timer_) {
+        if (!sensor_timer_ || !powercap_timer_ || !conflict_timer_ || !irq_timer_ || !cgroup_timer_) {
             return;
         }
-        bool should_run = isVisible() && !isMinimized() && tab_widget_ && tab_widget_->currentIndex() == 1;
+        bool shown = isVisible() && !isMinimized() && tab_widget_;
+        bool should_run = shown && tab_widget_->currentWidget() == sensors_tab_;
         if (should_run && !sensor_timer_->isActive()) {
+            restart_sensor_sampler();
             sensor_timer_->start();
             update_sensors();
         } else if (!should_run && sensor_timer_->isActive()) {
             sensor_timer_->stop();
         }
+
+        // Conflicts are sampled on every tab: a writer that fights the limits
+        // only shows up over time.
+        bool conflict_run = shown && backend_ready_;
+        if (conflict_run && !conflict_timer_->isActive()) {
+            conflict_timer_->start();
+            update_conflicts();
+        } else if (!conflict_run && conflict_timer_->isActive()) {
+            conflict_timer_->stop();
+        }
+
+        bool powercap_run = shown && tab_widget_->currentWidget() == powercap_tab_;
+        if (powercap_run && !powercap_timer_->isActive()) {
+            if (powercap_rows_.isEmpty()) {
+                refresh_powercap_table();
+            }
+            powercap_energy_.clear();
+            powercap_timer_->start();
+            update_powercap_power();
+        } else if (!powercap_run && powercap_timer_->isActive()) {
+            powercap_timer_->stop();
+        }
+
+        bool irq_run = shown && backend_ready_ && tab_widget_->currentWidget() == irq_tab_;
+        if (irq_run && !irq_timer_->isActive()) {
+            irq_timer_->start();
+            update_irqs();
+        } else if (!irq_run && irq_timer_->isActive()) {
+            irq_timer_->stop();
+        }
+
+        // Budgets keep running in the helper; the timer only refreshes the view.
+        bool cgroup_run = shown && backend_ready_ && tab_widget_->currentWidget() == cgroup_tab_;
+        if (cgroup_run && !cgroup_timer_->isActive()) {
+            cgroup_timer_->start();
+            update_cgroups();
+        } else if (!cgroup_run && cgroup_timer_->isActive()) {
+            cgroup_timer_->stop();
+        }
     }
 
     void apply_per_core_ratio(int cpu) {
@@ -3323,7 +4754,7 @@ protected:
 
     void apply_all_per_core_ratios() {
         for (const PerCoreRow &row : per_core_rows_) {
-            if (row.cpu >= 0 && row.target_spin) {
+            if (row.cpu >= 0 && row.online && row.target_spin) {
                 int ratio = row.target_spin->value();
                 QString err;
                 if (!backend_.set_cpu_ratio(row.cpu, ratio, &err)) {
@@ -3335,6 +4766,22 @@ protected:
         log_message("Applied per-core ratios.");
     }
 
+    void park_group(const QString &group) {
+        QString keep = group == "P" ? "E" : "P";
+        if (!confirm_action(QString("Take %1-cores offline?").arg(group),
+                            QString("Only %1-cores (and CPU0) stay online until you bring the others back.").arg(keep))) {
+            return;
+        }
+        QString err;
+        if (!backend_.park(group, &err)) {
+            show_error(QString("Park %1-cores failed").arg(group), err);
+            refresh();
+            return;
+        }
+        log_message(QString("Parked %1-cores.").arg(group));
+        refresh();
+    }
+
     void reset_per_core_ratios() {
         int p_default = p_ratio_spin_->value();
         int e_default = e_ratio_spin_->value();
@@ -3353,6 +4800,573 @@ protected:
         }
     }
 
+    void build_powercap_tab() {
+        powercap_tab_ = new QWidget();
+        auto *layout = new QVBoxLayout(powercap_tab_);
+        layout->setContentsMargins(12, 12, 12, 12);
+        layout->setSpacing(12);
+
+        auto *info = new QLabel("Kernel powercap zones (intel-rapl, intel-rapl-mmio). Power is sampled from energy_uj "
+                                "while this tab is visible and needs no MSR access.");
+        info->setWordWrap(true);
+        QFont info_font = info->font();
+        info_font.setItalic(true);
+        info->setFont(info_font);
+        layout->addWidget(info);
+
+        powercap_table_ = new QTableWidget();
+        powercap_table_->setColumnCount(7);
+        powercap_table_->setHorizontalHeaderLabels({"Zone", "Name", "Constraint", "Limit W", "Window s", "Max W", "Power W"});
+        powercap_table_->horizontalHeader()->setStretchLastSection(true);
+        powercap_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        powercap_table_->setSelectionBehavior(QAbstractItemView::SelectRows);
+        powercap_table_->setAlternatingRowColors(true);
+        powercap_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        layout->addWidget(powercap_table_, 1);
+
+        auto *footer = new QHBoxLayout();
+        auto *rescan_btn = new QPushButton("Rescan");
+        auto *apply_btn = new QPushButton("Apply changed limits");
+        footer->addWidget(rescan_btn);
+        footer->addWidget(apply_btn);
+        footer->addStretch();
+        powercap_status_label_ = new QLabel("Waiting...");
+        footer->addWidget(powercap_status_label_);
+        layout->addLayout(footer);
+
+        connect(rescan_btn, &QPushButton::clicked, this, &MainWindow::refresh_powercap_table);
+        connect(apply_btn, &QPushButton::clicked, this, &MainWindow::apply_powercap_limits);
+
+        powercap_timer_ = new QTimer(this);
+        powercap_timer_->setInterval(1000);
+        connect(powercap_timer_, &QTimer::timeout, this, &MainWindow::update_powercap_power);
+    }
+
+    void build_irq_tab() {
+        irq_tab_ = new QWidget();
+        auto *layout = new QVBoxLayout(irq_tab_);
+        layout->setContentsMargins(12, 12, 12, 12);
+        layout->setSpacing(12);
+
+        auto *info = new QLabel("Device interrupts from /proc/interrupts, sampled while this tab is visible. Steering "
+                                "moves the matching IRQs to a core class; the previous affinities are kept until "
+                                "Restore. Managed IRQs (NVMe, multi-queue NICs) cannot be moved and are skipped.");
+        info->setWordWrap(true);
+        QFont info_font = info->font();
+        info_font.setItalic(true);
+        info->setFont(info_font);
+        layout->addWidget(info);
+
+        irq_table_ = new QTableWidget();
+        irq_table_->setColumnCount(5);
+        irq_table_->setHorizontalHeaderLabels({"IRQ", "Name", "Affinity", "Rate /s", "On P-cores /s"});
+        irq_table_->horizontalHeader()->setStretchLastSection(true);
+        irq_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        irq_table_->verticalHeader()->setVisible(false);
+        irq_table_->setSelectionBehavior(QAbstractItemView::SelectRows);
+        irq_table_->setAlternatingRowColors(true);
+        irq_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        irq_table_->setSortingEnabled(true);
+        layout->addWidget(irq_table_, 1);
+
+        auto *footer = new QHBoxLayout();
+        irq_target_edit_ = new QLineEdit();
+        irq_target_edit_->setPlaceholderText("E");
+        irq_target_edit_->setToolTip("P, E, favored or a CPU list such as 8-15");
+        irq_target_edit_->setMaximumWidth(120);
+        irq_match_edit_ = new QLineEdit();
+        irq_match_edit_->setPlaceholderText("all");
+        irq_match_edit_->setToolTip("IRQ numbers or name substrings, separated by spaces");
+        auto *steer_btn = new QPushButton("Steer");
+        auto *restore_btn = new QPushButton("Restore");
+        footer->addWidget(new QLabel("Target"));
+        footer->addWidget(irq_target_edit_);
+        footer->addWidget(new QLabel("Match"));
+        footer->addWidget(irq_match_edit_, 1);
+        footer->addWidget(steer_btn);
+        footer->addWidget(restore_btn);
+        irq_status_label_ = new QLabel("Waiting...");
+        footer->addWidget(irq_status_label_);
+        layout->addLayout(footer);
+
+        connect(steer_btn, &QPushButton::clicked, this, [this]() { steer_irqs_internal(true); });
+        connect(restore_btn, &QPushButton::clicked, this, &MainWindow::restore_irqs);
+
+        irq_timer_ = new QTimer(this);
+        irq_timer_->setInterval(2000);
+        connect(irq_timer_, &QTimer::timeout, this, &MainWindow::update_irqs);
+    }
+
+    void update_irqs() {
+        QString err;
+        QList<IrqInfo> irqs;
+        bool irqbalance = false;
+        if (!backend_.read_irqs(irqs, irqbalance, &err)) {
+            irq_status_label_->setText("Read failed: " + err);
+            return;
+        }
+        auto number_item = [](double v, int decimals) {
+            auto *item = new QTableWidgetItem();
+            item->setData(Qt::DisplayRole, decimals > 0 ? QVariant(std::round(v * 10.0) / 10.0) : QVariant(std::llround(v)));
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            return item;
+        };
+        irq_table_->setSortingEnabled(false);
+        irq_table_->setRowCount(irqs.size());
+        for (int i = 0; i < irqs.size(); ++i) {
+            const IrqInfo &info = irqs[i];
+            irq_table_->setItem(i, 0, number_item(info.irq, 0));
+            irq_table_->setItem(i, 1, new QTableWidgetItem(info.name));
+            irq_table_->setItem(i, 2, new QTableWidgetItem(info.steered ? info.affinity + " (steered)" : info.affinity));
+            irq_table_->setItem(i, 3, number_item(info.rate, 1));
+            irq_table_->setItem(i, 4, number_item(info.p_rate, 1));
+        }
+        irq_table_->setSortingEnabled(true);
+        irq_status_label_->setText(irqbalance ? QString("%1 IRQs; irqbalance is running and will undo steering")
+                                                    .arg(irqs.size())
+                                              : QString("%1 IRQs").arg(irqs.size()));
+    }
+
+    bool steer_irqs_internal(bool interactive) {
+        QString target = irq_target_edit_->text().trimmed();
+        if (target.isEmpty()) {
+            target = "E";
+        }
+        QString match = irq_match_edit_->text().simplified();
+        if (interactive && !confirm_action(QString("Steer IRQs to %1?").arg(target),
+                                           QString("Matching: %1").arg(match.isEmpty() ? "all" : match))) {
+            return false;
+        }
+        QString err;
+        int steered = 0;
+        int skipped = 0;
+        if (!backend_.steer_irqs(target, match, steered, skipped, &err)) {
+            show_error("Steer IRQs failed", err);
+            return false;
+        }
+        log_message(QString("Steered %1 IRQs to %2 (%3 managed skipped).").arg(steered).arg(target).arg(skipped));
+        if (irq_timer_->isActive()) {
+            update_irqs();
+        }
+        return true;
+    }
+
+    void restore_irqs() {
+        QString err;
+        if (!backend_.restore_irqs(&err)) {
+            show_error("Restore IRQs failed", err);
+            return;
+        }
+        log_message("Restored IRQ affinities.");
+        if (irq_timer_->isActive()) {
+            update_irqs();
+        }
+    }
+
+    void build_energy_tab() {
+        energy_tab_ = new QWidget();
+        auto *layout = new QVBoxLayout(energy_tab_);
+        layout->setContentsMargins(12, 12, 12, 12);
+        layout->setSpacing(12);
+
+        auto *info = new QLabel("Package and DRAM energy recorded by the helper service (limits_helper --socket), "
+                                "charged to the profile that was applied at the time and kept across reboots. "
+                                "Weeks start on Monday.");
+        info->setWordWrap(true);
+        QFont info_font = info->font();
+        info_font.setItalic(true);
+        info->setFont(info_font);
+        layout->addWidget(info);
+
+        ledger_summary_label_ = new QLabel("-");
+        layout->addWidget(ledger_summary_label_);
+
+        ledger_profile_table_ = new QTableWidget();
+        ledger_profile_table_->setColumnCount(5);
+        ledger_profile_table_->setHorizontalHeaderLabels({"Profile", "Today Wh", "This Week Wh", "Last Week Wh", "Total kWh"});
+        ledger_profile_table_->horizontalHeader()->setStretchLastSection(true);
+        ledger_profile_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        ledger_profile_table_->verticalHeader()->setVisible(false);
+        ledger_profile_table_->setAlternatingRowColors(true);
+        ledger_profile_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        layout->addWidget(ledger_profile_table_, 1);
+
+        ledger_day_table_ = new QTableWidget();
+        ledger_day_table_->setColumnCount(2);
+        ledger_day_table_->setHorizontalHeaderLabels({"Date", "Energy Wh"});
+        ledger_day_table_->horizontalHeader()->setStretchLastSection(true);
+        ledger_day_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        ledger_day_table_->verticalHeader()->setVisible(false);
+        ledger_day_table_->setAlternatingRowColors(true);
+        ledger_day_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        layout->addWidget(ledger_day_table_, 1);
+
+        auto *footer = new QHBoxLayout();
+        ledger_status_label_ = new QLabel("Not read");
+        auto *refresh_btn = new QPushButton("Refresh");
+        footer->addWidget(ledger_status_label_, 1);
+        footer->addWidget(refresh_btn);
+        layout->addLayout(footer);
+        connect(refresh_btn, &QPushButton::clicked, this, &MainWindow::update_ledger);
+    }
+
+    void update_ledger() {
+        if (!backend_ready_) {
+            ledger_status_label_->setText("Backend not ready");
+            return;
+        }
+        QString err;
+        LedgerReport report;
+        if (!backend_.read_ledger(report, &err)) {
+            ledger_status_label_->setText("Read failed: " + err);
+            return;
+        }
+        auto wh = [](const double v[2]) { return QString::number(v[0] + v[1], 'f', 1); };
+        auto split = [](const double v[2], const QString &unit, int decimals) {
+            return QString("Package %1 %3, DRAM %2 %3").arg(v[0], 0, 'f', decimals).arg(v[1], 0, 'f', decimals).arg(unit);
+        };
+        const LedgerTotals &m = report.machine;
+        ledger_summary_label_->setText(QString("Today %1 Wh   This week %2 Wh   Last week %3 Wh   Total %4 kWh   "
+                                               "Active profile: %5")
+                                           .arg(wh(m.today_wh), wh(m.week_wh), wh(m.last_week_wh))
+                                           .arg(m.total_kwh[0] + m.total_kwh[1], 0, 'f', 3)
+                                           .arg(report.active_profile));
+        ledger_summary_label_->setToolTip(split(m.week_wh, "Wh", 1) + " this week" +
+                                          (report.dram ? QString() : QString("\nNo DRAM energy counter on this machine")));
+
+        ledger_profile_table_->setRowCount(report.profiles.size());
+        for (int row = 0; row < report.profiles.size(); ++row) {
+            const LedgerTotals &t = report.profiles[row];
+            auto *name = new QTableWidgetItem(t.name);
+            if (t.name == report.active_profile) {
+                QFont bold = name->font();
+                bold.setBold(true);
+                name->setFont(bold);
+            }
+            ledger_profile_table_->setItem(row, 0, name);
+            const double *cells[] = { t.today_wh, t.week_wh, t.last_week_wh };
+            for (int col = 0; col < 3; ++col) {
+                auto *item = new QTableWidgetItem(wh(cells[col]));
+                item->setToolTip(split(cells[col], "Wh", 1));
+                ledger_profile_table_->setItem(row, col + 1, item);
+            }
+            auto *total = new QTableWidgetItem(QString::number(t.total_kwh[0] + t.total_kwh[1], 'f', 3));
+            total->setToolTip(split(t.total_kwh, "kWh", 3));
+            ledger_profile_table_->setItem(row, 4, total);
+        }
+
+        ledger_day_table_->setRowCount(report.days.size());
+        for (int row = 0; row < report.days.size(); ++row) {
+            ledger_day_table_->setItem(row, 0, new QTableWidgetItem(report.days[row].first));
+            ledger_day_table_->setItem(row, 1, new QTableWidgetItem(QString::number(report.days[row].second, 'f', 1)));
+        }
+        ledger_status_label_->setText(report.recording ? QString("Recording")
+                                                       : QString("Not recording: start the limits_helper service "
+                                                                 "to keep the ledger; showing its last checkpoint"));
+    }
+
+    // The ledger takes [A-Za-z0-9._-]; the profile file's base name with anything else replaced.
+    static QString ledger_profile_name(const QString &path) {
+        QString name = QFileInfo(path).completeBaseName().left(47);
+        for (QChar &c : name) {
+            if (!(c.isLetterOrNumber() && c.unicode() < 128) && c != '.' && c != '_' && c != '-') {
+                c = '_';
+            }
+        }
+        return name.isEmpty() ? QString("default") : name;
+    }
+
+    void record_active_profile(const QString &path) {
+        QString err;
+        if (backend_ready_ && !backend_.set_profile(ledger_profile_name(path), &err)) {
+            log_message(QString("Energy ledger: could not switch profile: %1").arg(err));
+        }
+    }
+
+    void build_cgroup_tab() {
+        cgroup_tab_ = new QWidget();
+        auto *layout = new QVBoxLayout(cgroup_tab_);
+        layout->setContentsMargins(12, 12, 12, 12);
+        layout->setSpacing(12);
+
+        auto *info = new QLabel("Package power attributed to cgroups (v2): each cgroup's CPU time is charged at the "
+                                "energy per busy second of the cores it runs on. A budget is held by the helper with "
+                                "a feedback loop on cpu.max (quota) or on the ratio of the cgroup's cpuset cores "
+                                "(ratio; only for cgroups with cores of their own).");
+        info->setWordWrap(true);
+        QFont info_font = info->font();
+        info_font.setItalic(true);
+        info->setFont(info_font);
+        layout->addWidget(info);
+
+        cgroup_table_ = new QTableWidget();
+        cgroup_table_->setColumnCount(7);
+        cgroup_table_->setHorizontalHeaderLabels({"Cgroup", "CPUs", "Load", "Power W", "Budget W", "Mode", "Limit"});
+        cgroup_table_->horizontalHeader()->setStretchLastSection(true);
+        cgroup_table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+        cgroup_table_->verticalHeader()->setVisible(false);
+        cgroup_table_->setSelectionBehavior(QAbstractItemView::SelectRows);
+        cgroup_table_->setSelectionMode(QAbstractItemView::SingleSelection);
+        cgroup_table_->setAlternatingRowColors(true);
+        cgroup_table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        layout->addWidget(cgroup_table_, 1);
+
+        auto *footer = new QHBoxLayout();
+        cgroup_edit_ = new QLineEdit();
+        cgroup_edit_->setPlaceholderText("system.slice/foo.service");
+        cgroup_budget_spin_ = new QDoubleSpinBox();
+        cgroup_budget_spin_->setDecimals(1);
+        cgroup_budget_spin_->setRange(0.5, 1000.0);
+        cgroup_budget_spin_->setValue(15.0);
+        cgroup_budget_spin_->setSuffix(" W");
+        cgroup_mode_combo_ = new QComboBox();
+        cgroup_mode_combo_->addItem("cpu.max", "quota");
+        cgroup_mode_combo_->addItem("Core ratio", "ratio");
+        auto *set_btn = new QPushButton("Set budget");
+        auto *clear_btn = new QPushButton("Clear");
+        footer->addWidget(cgroup_edit_, 1);
+        footer->addWidget(cgroup_budget_spin_);
+        footer->addWidget(cgroup_mode_combo_);
+        footer->addWidget(set_btn);
+        footer->addWidget(clear_btn);
+        cgroup_status_label_ = new QLabel("Waiting...");
+        footer->addWidget(cgroup_status_label_);
+        layout->addLayout(footer);
+
+        connect(cgroup_table_, &QTableWidget::itemSelectionChanged, this, [this]() {
+            int row = cgroup_table_->currentRow();
+            QTableWidgetItem *item = row >= 0 ? cgroup_table_->item(row, 0) : nullptr;
+            if (item) {
+                cgroup_edit_->setText(item->text());
+            }
+        });
+        connect(set_btn, &QPushButton::clicked, this, &MainWindow::set_cgroup_budget);
+        connect(clear_btn, &QPushButton::clicked, this, [this]() {
+            QString cgroup = cgroup_edit_->text().trimmed();
+            if (cgroup.isEmpty()) {
+                return;
+            }
+            QString err;
+            if (!backend_.clear_cgroup_budget(cgroup, &err)) {
+                show_error("Clear cgroup budget failed", err);
+                return;
+            }
+            log_message(QString("Cleared the power budget of %1").arg(cgroup));
+            update_cgroups();
+        });
+
+        cgroup_timer_ = new QTimer(this);
+        cgroup_timer_->setInterval(1000);
+        connect(cgroup_timer_, &QTimer::timeout, this, &MainWindow::update_cgroups);
+    }
+
+    void update_cgroups() {
+        QString err;
+        QList<CgroupPower> groups;
+        double pkg_w = 0.0;
+        QString weight;
+        if (!backend_.read_cgroup_power(groups, pkg_w, weight, &err)) {
+            cgroup_status_label_->setText("Read failed: " + err);
+            return;
+        }
+        QString selected = cgroup_edit_->text().trimmed();
+        QSignalBlocker block(cgroup_table_);
+        cgroup_table_->setRowCount(groups.size());
+        for (int i = 0; i < groups.size(); ++i) {
+            const CgroupPower &g = groups[i];
+            bool budgeted = g.mode != "watch";
+            QStringList cells = {
+                g.cgroup,
+                QString::number(g.cpus),
+                g.valid ? QString::number(g.cpu_load, 'f', 2) : QString("-"),
+                g.valid ? QString::number(g.avg_w, 'f', 2) : QString("-"),
+                budgeted ? QString::number(g.budget_w, 'f', 1) : QString("-"),
+                budgeted ? g.mode : QString("-"),
+                g.error.isEmpty() ? g.limit : g.error,
+            };
+            for (int col = 0; col < cells.size(); ++col) {
+                auto *item = new QTableWidgetItem(cells[col]);
+                if (col > 0 && col < 5) {
+                    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+                }
+                if (budgeted && g.valid && col == 3 && g.avg_w > g.budget_w * 1.1) {
+                    item->setForeground(QBrush(QColor(200, 60, 60)));
+                }
+                cgroup_table_->setItem(i, col, item);
+            }
+            if (g.cgroup == selected) {
+                cgroup_table_->selectRow(i);
+            }
+        }
+        cgroup_status_label_->setText(QString("Package %1 W (%2 split)").arg(pkg_w, 0, 'f', 1).arg(weight));
+    }
+
+    void set_cgroup_budget() {
+        QString cgroup = cgroup_edit_->text().trimmed();
+        if (cgroup.isEmpty() || cgroup.contains(' ')) {
+            show_error("Set cgroup budget failed", "Enter a cgroup path relative to /sys/fs/cgroup.");
+            return;
+        }
+        double watts = cgroup_budget_spin_->value();
+        QString mode = cgroup_mode_combo_->currentData().toString();
+        QString err;
+        if (!backend_.set_cgroup_budget(cgroup, watts, mode, &err)) {
+            show_error("Set cgroup budget failed", err);
+            return;
+        }
+        log_message(QString("Holding %1 at %2 W via %3").arg(cgroup).arg(watts, 0, 'f', 1).arg(mode));
+        update_cgroups();
+    }
+
+    void refresh_powercap_table() {
+        if (!backend_ready_) {
+            powercap_status_label_->setText("Backend not ready");
+            return;
+        }
+        QString err;
+        QList<PowercapZone> zones;
+        if (!backend_.read_powercap(zones, &err)) {
+            powercap_status_label_->setText("Read failed: " + err);
+            return;
+        }
+
+        powercap_rows_.clear();
+        powercap_energy_.clear();
+        powercap_table_->setRowCount(0);
+        for (const PowercapZone &zone : zones) {
+            int count = std::max(1, static_cast<int>(zone.constraints.size()));
+            for (int j = 0; j < count; ++j) {
+                int row_idx = powercap_table_->rowCount();
+                powercap_table_->insertRow(row_idx);
+                QString zone_text = zone.parent.isEmpty() ? zone.id : QString("  ") + zone.id;
+                if (!zone.enabled) {
+                    zone_text += " (disabled)";
+                }
+                powercap_table_->setItem(row_idx, 0, new QTableWidgetItem(j == 0 ? zone_text : QString()));
+                powercap_table_->setItem(row_idx, 1, new QTableWidgetItem(j == 0 ? zone.name : QString()));
+
+                PowercapRow row;
+                row.zone_id = zone.id;
+                if (j < zone.constraints.size()) {
+                    const PowercapConstraint &c = zone.constraints[j];
+                    row.constraint = c.name;
+                    row.limit_uw = c.limit_uw;
+                    row.window_us = c.has_window ? c.window_us : 0;
+                    powercap_table_->setItem(row_idx, 2, new QTableWidgetItem(c.name));
+
+                    row.limit_spin = new QDoubleSpinBox();
+                    row.limit_spin->setDecimals(1);
+                    double max_w = c.has_max && c.max_uw > 0 ? c.max_uw / 1e6 : 4095.0;
+                    row.limit_spin->setRange(0.0, std::max(max_w, c.limit_uw / 1e6));
+                    row.limit_spin->setValue(c.limit_uw / 1e6);
+                    powercap_table_->setCellWidget(row_idx, 3, row.limit_spin);
+
+                    if (c.has_window) {
+                        row.window_spin = new QDoubleSpinBox();
+                        row.window_spin->setDecimals(4);
+                        row.window_spin->setRange(0.0001, 1000.0);
+                        row.window_spin->setValue(c.window_us / 1e6);
+                        powercap_table_->setCellWidget(row_idx, 4, row.window_spin);
+                    } else {
+                        powercap_table_->setItem(row_idx, 4, new QTableWidgetItem("-"));
+                    }
+                    powercap_table_->setItem(row_idx, 5, new QTableWidgetItem(
+                        c.has_max && c.max_uw > 0 ? QString::number(c.max_uw / 1e6, 'f', 1) : QString("-")));
+                } else {
+                    for (int col = 2; col < 6; ++col) {
+                        powercap_table_->setItem(row_idx, col, new QTableWidgetItem("-"));
+                    }
+                }
+                auto *power_item = new QTableWidgetItem(j == 0 ? QString("-") : QString());
+                powercap_table_->setItem(row_idx, 6, power_item);
+                row.power_item = j == 0 ? power_item : nullptr;
+                powercap_rows_.append(row);
+            }
+        }
+        powercap_status_label_->setText(QString("%1 zones").arg(zones.size()));
+    }
+
+    void apply_powercap_limits() {
+        QStringList changes;
+        QList<const PowercapRow *> changed;
+        for (const PowercapRow &row : powercap_rows_) {
+            if (!row.limit_spin) {
+                continue;
+            }
+            std::uint64_t limit_uw = static_cast<std::uint64_t>(std::llround(row.limit_spin->value() * 1e6));
+            std::uint64_t window_us =
+                row.window_spin ? static_cast<std::uint64_t>(std::llround(row.window_spin->value() * 1e6)) : 0;
+            // Spin boxes round to their decimals; only count edits beyond that.
+            bool limit_changed = std::llabs(static_cast<long long>(limit_uw - row.limit_uw)) >= 50000;
+            bool window_changed = row.window_spin && std::llabs(static_cast<long long>(window_us - row.window_us)) >= 50;
+            if (!limit_changed && !window_changed) {
+                continue;
+            }
+            changes << QString("%1 %2: %3 W -> %4 W%5")
+                           .arg(row.zone_id, row.constraint)
+                           .arg(row.limit_uw / 1e6, 0, 'f', 1)
+                           .arg(row.limit_spin->value(), 0, 'f', 1)
+                           .arg(window_changed ? QString(", window %1 s -> %2 s")
+                                                     .arg(row.window_us / 1e6)
+                                                     .arg(row.window_spin->value())
+                                               : QString());
+            changed.append(&row);
+        }
+        if (changed.isEmpty()) {
+            powercap_status_label_->setText("No changes");
+            return;
+        }
+        if (!confirm_action("Write powercap limits?", changes.join("\n"))) {
+            return;
+        }
+        for (const PowercapRow *row : changed) {
+            QString err;
+            std::uint64_t limit_uw = static_cast<std::uint64_t>(std::llround(row->limit_spin->value() * 1e6));
+            std::uint64_t window_us =
+                row->window_spin ? static_cast<std::uint64_t>(std::llround(row->window_spin->value() * 1e6)) : 0;
+            if (!backend_.write_powercap_zone(row->zone_id, row->constraint, limit_uw, window_us, &err)) {
+                show_error(QString("Powercap write %1 %2 failed").arg(row->zone_id, row->constraint), err);
+                break;
+            }
+        }
+        log_message("Powercap: " + changes.join("; "));
+        refresh_powercap_table();
+    }
+
+    void update_powercap_power() {
+        if (!backend_ready_ || powercap_rows_.isEmpty()) {
+            return;
+        }
+        QString err;
+        QList<PowercapEnergy> energy;
+        std::uint64_t t_ns = 0;
+        if (!backend_.read_powercap_energy(energy, t_ns, &err)) {
+            powercap_status_label_->setText("Read failed: " + err);
+            return;
+        }
+
+        QHash<QString, double> watts;
+        for (const PowercapEnergy &e : energy) {
+            if (!e.valid) {
+                continue;
+            }
+            auto prev = powercap_energy_.constFind(e.id);
+            if (prev != powercap_energy_.constEnd() && t_ns > powercap_energy_t_ns_) {
+                std::uint64_t delta = ld_powercap_energy_delta_uj(prev.value(), e.energy_uj, e.max_energy_range_uj);
+                watts.insert(e.id, delta / ((t_ns - powercap_energy_t_ns_) / 1e3));
+            }
+            powercap_energy_.insert(e.id, e.energy_uj);
+        }
+        powercap_energy_t_ns_ = t_ns;
+
+        for (PowercapRow &row : powercap_rows_) {
+            if (row.power_item) {
+                auto it = watts.constFind(row.zone_id);
+                row.power_item->setText(it != watts.constEnd() ? QString::number(it.value(), 'f', 2) : QString("-"));
+            }
+        }
+    }
+
     void update_sensors() {
         if (!backend_ready_) {
             sensors_status_label_->setText("Backend not ready");
@@ -3364,19 +5378,63 @@ protected:
 
         QString err;
         QList<CoreSensor> sensors;
-        if (!backend_.read_core_sensors(sensors, &err)) {
+        std::int64_t smi_count = -1;
+        if (!backend_.read_core_sensors(sensors, &err, &smi_count)) {
             sensors_status_label_->setText("Read failed: " + err);
             return;
         }
+        update_smi_label(smi_count);
 
         QHash<int, const CoreSensor *> by_cpu;
         for (const CoreSensor &s : sensors) {
             by_cpu.insert(s.cpu, &s);
+            if (s.ratio_valid && s.volts_valid) {
+                vf_plot_->add_point(s.ratio, s.volts, s.type);
+            }
+        }
+        vf_plot_->update();
+
+        double t_s = 0.0;
+        double pkg_w = sample_package_power(&t_s);
+        double tjmax = -1.0;
+        double pkg_temp = -1.0;
+        for (const HwmonTemp &t : coretemp_inputs_) {
+            if (t.label.startsWith("Package id 0", Qt::CaseInsensitive)) {
+                int md = read_temp_millidegrees(t.input_path);
+                int crit = read_temp_millidegrees(t.crit_path);
+                pkg_temp = md > 0 ? md / 1000.0 : -1.0;
+                tjmax = crit > 0 ? crit / 1000.0 : -1.0;
+                break;
+            }
+        }
+        if (pkg_w >= 0.0 && pkg_temp > 0.0) {
+            ld_thermal_model_update(&pkg_thermal_, t_s, pkg_temp, pkg_w);
+        }
+        double pl1_w = pl1_spin_->value();
+        double pl2_w = pl2_spin_->value();
+
+        double now_s = sensor_clock_.elapsed() / 1000.0;
+        ld_sampler_signals sig = sampler_signals(sensors, pkg_w);
+        double interval_s = 0.0;
+        int next_ms = ld_sampler_update(&sensor_sampler_, &sig, now_s, &interval_s);
+        if (sensor_adaptive_check_->isChecked()) {
+            sensor_timer_->setInterval(next_ms);
         }
 
         for (SensorRow &row : sensor_rows_) {
-            update_sensor_row(row, by_cpu.value(row.cpu, nullptr));
+            double temp_c = update_sensor_row(row, by_cpu.value(row.cpu, nullptr), interval_s);
+            if (pkg_w >= 0.0 && temp_c > 0.0) {
+                ld_thermal_model_update(&row.thermal, t_s, temp_c, pkg_w);
+            }
+            ld_thermal_params p;
+            if (temp_c <= 0.0 || tjmax <= 0.0 || ld_thermal_model_params(&row.thermal, &p) != 0) {
+                row.tjmax_item->setText("-");
+                continue;
+            }
+            double secs = ld_thermal_time_to_c(&p, temp_c, pl2_w, tjmax);
+            row.tjmax_item->setText(secs < 0.0 ? QString("never") : QString("%1 s").arg(std::lround(secs)));
         }
+        update_thermal_label(pkg_temp, tjmax, pl1_w, pl2_w);
 
         for (PerCoreRow &row : per_core_rows_) {
             const CoreSensor *s = by_cpu.value(row.cpu, nullptr);
@@ -3385,7 +5443,137 @@ protected:
             }
         }
 
-        sensors_status_label_->setText(QString("Updated %1 cores").arg(sensor_rows_.size()));
+        QString status = QString("Updated %1 cores").arg(sensor_rows_.size());
+        if (interval_s > 0.0) {
+            status += QString(", %1 s interval").arg(interval_s, 0, 'f', 2);
+        }
+        sensors_status_label_->setText(status);
+        sensors_status_label_->setToolTip(sensor_adaptive_check_->isChecked()
+                                              ? QString("%1 of %2 samples at the fastest rate")
+                                                    .arg(sensor_sampler_.fast_samples)
+                                                    .arg(sensor_sampler_.samples)
+                                              : QString());
+
+        // The histograms accumulate in the helper; the table only needs a refresh every few seconds.
+        if (residency_refreshed_s_ < 0.0 || now_s - residency_refreshed_s_ >= 5.0) {
+            residency_refreshed_s_ = now_s;
+            update_residency();
+        }
+    }
+
+    // Starts the interval over at the fastest rate (or the fixed 1 s), e.g. when the tab is shown again.
+    void restart_sensor_sampler() {
+        ld_sampler_init(&sensor_sampler_, sensor_fastest_spin_->value(), LD_SAMPLER_MAX_MS);
+        sensor_timer_->setInterval(sensor_adaptive_check_->isChecked() ? sensor_sampler_.interval_ms : 1000);
+    }
+
+    // What the adaptive sampler compares between two updates; pkg_w < 0 when package power is unknown.
+    static ld_sampler_signals sampler_signals(const QList<CoreSensor> &sensors, double pkg_w) {
+        ld_sampler_signals sig{};
+        sig.pkg_w = pkg_w;
+        sig.avg_ratio = -1.0;
+        sig.max_ratio = -1.0;
+        double ratio_sum = 0.0;
+        int ratios = 0;
+        bool have_pkg = false;
+        for (const CoreSensor &s : sensors) {
+            if (s.ratio_valid) {
+                ratio_sum += s.ratio;
+                ratios++;
+                sig.max_ratio = std::max(sig.max_ratio, static_cast<double>(s.ratio));
+            }
+            if (s.thermal_valid) {
+                sig.throttle_state |= s.thermal & LD_SAMPLER_THERM_MASK;
+            }
+            if (s.throttle_have & (1u << LD_THROTTLE_CORE_EVENTS)) {
+                sig.throttle_events += s.throttle[LD_THROTTLE_CORE_EVENTS];
+            }
+            if (!have_pkg && (s.throttle_have & (1u << LD_THROTTLE_PKG_EVENTS))) {
+                sig.throttle_events += s.throttle[LD_THROTTLE_PKG_EVENTS];
+                have_pkg = true;
+            }
+        }
+        if (ratios > 0) {
+            sig.avg_ratio = ratio_sum / ratios;
+        }
+        return sig;
+    }
+
+    // Package watts since the previous call from the powercap package zone; -1 on the first call or without one.
+    double sample_package_power(double *t_s) {
+        QString err;
+        QList<PowercapEnergy> energy;
+        std::uint64_t t_ns = 0;
+        if (!backend_.read_powercap_energy(energy, t_ns, &err)) {
+            return -1.0;
+        }
+        *t_s = t_ns / 1e9;
+        for (const PowercapEnergy &e : energy) {
+            if (!e.valid || !e.id.startsWith("intel-rapl:") || e.id.count(':') != 1) {
+                continue;
+            }
+            double watts = -1.0;
+            if (sensor_pkg_t_ns_ && t_ns > sensor_pkg_t_ns_) {
+                std::uint64_t delta = ld_powercap_energy_delta_uj(sensor_pkg_energy_uj_, e.energy_uj, e.max_energy_range_uj);
+                watts = delta / ((t_ns - sensor_pkg_t_ns_) / 1e3);
+            }
+            sensor_pkg_energy_uj_ = e.energy_uj;
+            sensor_pkg_t_ns_ = t_ns;
+            return watts;
+        }
+        return -1.0;
+    }
+
+    void update_smi_label(std::int64_t count) {
+        qint64 now_ms = QDateTime::currentMSecsSinceEpoch();
+        if (count < 0) {
+            smi_label_->setText("SMIs: MSR 0x34 unreadable");
+        } else if (sensor_smi_count_ >= 0 && now_ms > sensor_smi_ms_) {
+            // 32-bit counter; the cast handles the wrap.
+            std::uint32_t delta = static_cast<std::uint32_t>(count - sensor_smi_count_);
+            double rate = delta * 1000.0 / (now_ms - sensor_smi_ms_);
+            smi_label_->setText(QString("SMIs: %1/s (%2 this interval, %3 total)")
+                                    .arg(rate, 0, 'f', 1)
+                                    .arg(delta)
+                                    .arg(count));
+            if (delta > 0) {
+                sensor_smi_seen_ms_ = now_ms;
+            }
+            smi_label_->setToolTip(sensor_smi_seen_ms_ > 0
+                                       ? QString("Last SMI %1 s ago").arg((now_ms - sensor_smi_seen_ms_) / 1000)
+                                       : QString("No SMIs seen yet"));
+        }
+        sensor_smi_count_ = count;
+        sensor_smi_ms_ = now_ms;
+    }
+
+    void update_thermal_label(double pkg_temp, double tjmax, double pl1_w, double pl2_w) {
+        if (pkg_temp <= 0.0 || tjmax <= 0.0) {
+            thermal_label_->setText("Thermal model: no package temperature/TjMax from coretemp");
+            return;
+        }
+        ld_thermal_params p;
+        ld_thermal_prediction pred;
+        if (ld_thermal_model_params(&pkg_thermal_, &p) != 0 ||
+            ld_thermal_predict(&pkg_thermal_, pkg_temp, pl1_w, pl2_w, tjmax, &pred) != 0) {
+            thermal_label_->setText(QString("Thermal model: fitting (%1/%2 samples; needs a changing load)")
+                                        .arg(pkg_thermal_.samples)
+                                        .arg(LD_THERMAL_MIN_SAMPLES));
+            return;
+        }
+        QString pl2_text = pred.pl2_to_limit_s < 0.0
+                               ? QString("never reaches TjMax")
+                               : QString("reaches TjMax in %1 s").arg(std::lround(pred.pl2_to_limit_s));
+        thermal_label_->setText(QString("Thermal model: tau %1 s, %2 °C/W, ambient %3 °C. PL1 %4 W settles at %5 °C; "
+                                        "PL2 %6 W %7. Sustainable below TjMax: %8 W.")
+                                    .arg(p.tau_s, 0, 'f', 0)
+                                    .arg(p.r_c_per_w, 0, 'f', 2)
+                                    .arg(p.ambient_c, 0, 'f', 0)
+                                    .arg(pl1_w, 0, 'f', 0)
+                                    .arg(pred.steady_pl1_c, 0, 'f', 0)
+                                    .arg(pl2_w, 0, 'f', 0)
+                                    .arg(pl2_text)
+                                    .arg(pred.max_pl1_w, 0, 'f', 0));
     }
 
     HelperBackend backend_;
@@ -3420,6 +5608,7 @@ protected:
     QGridLayout *status_grid_ = nullptr;
     QLabel *unit_label_ = nullptr;
     QLineEdit *msr_raw_ = nullptr;
+    QLabel *limits_backend_ = nullptr;
     QLineEdit *mmio_raw_ = nullptr;
     QLabel *msr_pl1_ = nullptr;
     QLabel *msr_pl2_ = nullptr;
@@ -3451,6 +5640,14 @@ protected:
     QPushButton *core_uv_btn_ = nullptr;
     QPushButton *sync_msr_to_mmio_btn_ = nullptr;
     QPushButton *sync_mmio_to_msr_btn_ = nullptr;
+    QPushButton *stop_writers_btn_ = nullptr;
+    QLabel *conflict_label_ = nullptr;
+    QPushButton *stop_culprit_btn_ = nullptr;
+    QTimer *conflict_timer_ = nullptr;
+    QString conflict_culprit_;
+    QString conflict_logged_;
+    QTimer *service_jobs_timer_ = nullptr;
+    QSet<quint32> service_jobs_reported_;
     QPushButton *start_thermald_btn_ = nullptr;
     QPushButton *stop_thermald_btn_ = nullptr;
     QPushButton *disable_thermald_btn_ = nullptr;
@@ -3526,6 +5723,10 @@ protected:
     QGridLayout *per_core_grid_ = nullptr;
     QPushButton *per_core_apply_all_btn_ = nullptr;
     QPushButton *per_core_reset_btn_ = nullptr;
+    QPushButton *park_p_btn_ = nullptr;
+    QPushButton *park_e_btn_ = nullptr;
+    QPushButton *unpark_all_btn_ = nullptr;
+    QList<int> known_offline_;
     QList<PerCoreRow> per_core_rows_;
     bool per_core_rows_populated_ = false;
 
@@ -3535,6 +5736,62 @@ protected:
     QTimer *sensor_timer_ = nullptr;
     QList<SensorRow> sensor_rows_;
     QList<HwmonTemp> coretemp_inputs_;
+    QLabel *thermal_label_ = nullptr;
+    VfPlot *vf_plot_ = nullptr;
+    QTableWidget *vf_curve_table_ = nullptr;
+    QLabel *vf_curve_status_ = nullptr;
+    QSpinBox *vf_band_min_spin_ = nullptr;
+    QSpinBox *vf_band_max_spin_ = nullptr;
+    QDoubleSpinBox *vf_band_mv_spin_ = nullptr;
+    QList<VfCurvePoint> vf_curve_;
+    QList<QDoubleSpinBox *> vf_curve_spins_;
+    ld_thermal_model pkg_thermal_ = [] {
+        ld_thermal_model m;
+        ld_thermal_model_init(&m);
+        return m;
+    }();
+    std::uint64_t sensor_pkg_energy_uj_ = 0;
+    std::uint64_t sensor_pkg_t_ns_ = 0;
+    QTableWidget *residency_table_ = nullptr;
+    QLabel *residency_status_ = nullptr;
+    double residency_refreshed_s_ = -1.0;
+    QCheckBox *sensor_adaptive_check_ = nullptr;
+    QSpinBox *sensor_fastest_spin_ = nullptr;
+    ld_sampler sensor_sampler_{};
+    QElapsedTimer sensor_clock_;
+    QLabel *smi_label_ = nullptr;
+    std::int64_t sensor_smi_count_ = -1;
+    qint64 sensor_smi_ms_ = 0;
+    qint64 sensor_smi_seen_ms_ = 0;
+
+    QWidget *powercap_tab_ = nullptr;
+    QTableWidget *powercap_table_ = nullptr;
+    QLabel *powercap_status_label_ = nullptr;
+    QTimer *powercap_timer_ = nullptr;
+    QList<PowercapRow> powercap_rows_;
+    QHash<QString, std::uint64_t> powercap_energy_;
+    std::uint64_t powercap_energy_t_ns_ = 0;
+
+    QWidget *irq_tab_ = nullptr;
+    QTableWidget *irq_table_ = nullptr;
+    QLineEdit *irq_target_edit_ = nullptr;
+    QLineEdit *irq_match_edit_ = nullptr;
+    QLabel *irq_status_label_ = nullptr;
+    QTimer *irq_timer_ = nullptr;
+
+    QWidget *cgroup_tab_ = nullptr;
+    QTableWidget *cgroup_table_ = nullptr;
+    QLineEdit *cgroup_edit_ = nullptr;
+    QDoubleSpinBox *cgroup_budget_spin_ = nullptr;
+    QComboBox *cgroup_mode_combo_ = nullptr;
+    QLabel *cgroup_status_label_ = nullptr;
+    QTimer *cgroup_timer_ = nullptr;
+
+    QWidget *energy_tab_ = nullptr;
+    QLabel *ledger_summary_label_ = nullptr;
+    QTableWidget *ledger_profile_table_ = nullptr;
+    QTableWidget *ledger_day_table_ = nullptr;
+    QLabel *ledger_status_label_ = nullptr;
 
     bool loading_prefs_ = false;
     bool startup_guard_set_ = false;
@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/ld_core.h"
+#include "core/ld_regs.h"
+#include "core/ld_thermal.h"
+
+/*
+ * Offline what-if for PL1/PL2/tau: replays a recorded trace (ldctl record
+ * CSV) through the RAPL limiter and a thermal model under other limits.
+ *
+ * The limiter allows PL2 while the running average of package power (an
+ * exponential average with time constant tau) is below PL1, then holds
+ * PL1. Recorded power is taken as demand; rows the trace already spent at
+ * a PL1/PL2 limit are counted, because demand there was higher than what
+ * was recorded and the results for higher limits are lower bounds.
+ *
+ * The file is streamed, so memory does not grow with its length: one pass
+ * to fit the thermal model (skipped with --thermal or --no-thermal), one
+ * to simulate. Every candidate advances in the same loop over a
+ * structure-of-arrays state, so adding candidates costs little.
+ */
+
+#define MAX_CONFIGS 32
+#define DEFAULT_TAU_S 28.0
+#define DEFAULT_TJMAX_C 100.0
+/* Frequency is taken to scale with the cube root of power when a candidate clips it. */
+#define RATIO_POWER_EXP (1.0 / 3.0)
+
+static double sim_pl1[MAX_CONFIGS];
+static double sim_pl2[MAX_CONFIGS];
+static double sim_tau[MAX_CONFIGS];
+static double sim_alpha[MAX_CONFIGS];
+static double sim_avg[MAX_CONFIGS];
+static double sim_temp[MAX_CONFIGS];
+static double sim_peak[MAX_CONFIGS];
+static double sim_energy[MAX_CONFIGS];
+static double sim_clipped[MAX_CONFIGS];
+static double sim_throttled[MAX_CONFIGS];
+static double sim_thermal_s[MAX_CONFIGS];
+static double sim_ratio_s[MAX_CONFIGS];
+
+struct columns {
+    int t;
+    int interval;
+    int power;
+    int temp;
+    int core_temp;
+    int ratio;
+    int reasons;
+    int max;
+};
+
+struct trace_row {
+    double t;
+    double dt;
+    double power_w;
+    double temp_c;          /* < 0: not recorded */
+    double ratio;           /* < 0: not recorded */
+    uint32_t reasons;
+};
+
+static void json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char ch = (unsigned char)*s;
+        if (ch == '"' || ch == '\\') {
+            printf("\\%c", ch);
+        } else if (ch < 0x20) {
+            printf("\\u%04x", ch);
+        } else {
+            putchar(ch);
+        }
+    }
+    putchar('"');
+}
+
+static int json_error(const char *err) {
+    printf("{\"cmd\":\"rapl_sim\",\"ok\":false,\"error\":");
+    json_string(err);
+    printf("}\n");
+    return 1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage:\n"
+        "  %s [options] TRACE.csv PL1:PL2[:TAU] [PL1:PL2[:TAU]]...\n"
+        "\n"
+        "TRACE.csv is an ldctl record file (or any CSV with pkg_w and t_s or interval_s columns); '-' reads stdin.\n"
+        "Options:\n"
+        "  --tjmax C               temperature limit (default %.0f)\n"
+        "  --thermal TAU:R:AMB     thermal model instead of fitting one from the trace (needed for stdin)\n"
+        "  --no-thermal            power limits only\n"
+        "Prints one JSON object with throttled time, clipped energy and temperature peak per candidate.\n",
+        argv0, DEFAULT_TJMAX_C);
+}
+
+static int parse_triple(const char *s, double *a, double *b, double *c, int need_c) {
+    char *end = NULL;
+    *a = strtod(s, &end);
+    if (end == s || *end != ':') {
+        return 0;
+    }
+    s = end + 1;
+    *b = strtod(s, &end);
+    if (end == s) {
+        return 0;
+    }
+    if (*end == '\0') {
+        return !need_c;
+    }
+    if (*end != ':') {
+        return 0;
+    }
+    s = end + 1;
+    *c = strtod(s, &end);
+    return end != s && *end == '\0';
+}
+
+static int find_columns(char *header, struct columns *cols) {
+    memset(cols, -1, sizeof(*cols));
+    int idx = 0;
+    for (char *save = NULL, *tok = strtok_r(header, ",\r\n", &save); tok; tok = strtok_r(NULL, ",\r\n", &save), idx++) {
+        if (!strcmp(tok, "t_s")) {
+            cols->t = idx;
+        } else if (!strcmp(tok, "interval_s")) {
+            cols->interval = idx;
+        } else if (!strcmp(tok, "pkg_w")) {
+            cols->power = idx;
+        } else if (!strcmp(tok, "pkg_temp_c")) {
+            cols->temp = idx;
+        } else if (!strcmp(tok, "max_core_temp_c")) {
+            cols->core_temp = idx;
+        } else if (!strcmp(tok, "avg_ratio")) {
+            cols->ratio = idx;
+        } else if (!strcmp(tok, "limit_reasons")) {
+            cols->reasons = idx;
+        }
+    }
+    cols->max = idx;
+    return cols->power >= 0 && (cols->t >= 0 || cols->interval >= 0) ? 0 : -1;
+}
+
+/* Fields by index without splitting the line; only the wanted columns are converted. */
+static int parse_row(const char *line, const struct columns *cols, double prev_t, struct trace_row *row) {
+    double t = -1.0, dt = -1.0, temp = -1.0, core_temp = -1.0;
+    row->power_w = -1.0;
+    row->ratio = -1.0;
+    row->reasons = 0;
+    const char *p = line;
+    for (int idx = 0; idx < cols->max && *p; idx++) {
+        if (idx == cols->t) {
+            t = strtod(p, NULL);
+        } else if (idx == cols->interval) {
+            dt = strtod(p, NULL);
+        } else if (idx == cols->power) {
+            row->power_w = strtod(p, NULL);
+        } else if (idx == cols->temp) {
+            temp = strtod(p, NULL);
+        } else if (idx == cols->core_temp) {
+            core_temp = strtod(p, NULL);
+        } else if (idx == cols->ratio) {
+            row->ratio = strtod(p, NULL);
+        } else if (idx == cols->reasons) {
+            row->reasons = (uint32_t)strtoul(p, NULL, 0);
+        }
+        const char *comma = strchr(p, ',');
+        if (!comma) {
+            break;
+        }
+        p = comma + 1;
+    }
+    // Consecutive timestamps first: record --adaptive varies the interval from row to row, and differences of
+    // t_s add up to the exact trace length where the rounded interval_s column would drift.
+    if (t >= 0.0 && prev_t >= 0.0) {
+        dt = t - prev_t;
+    }
+    row->t = t;
+    row->dt = dt;
+    // ldctl writes -1 for an unreadable package sensor; the hottest core is the next best thing.
+    row->temp_c = temp > 0.0 ? temp : core_temp;
+    return row->power_w >= 0.0 ? 0 : -1;
+}
+
+struct trace {
+    FILE *f;
+    char *line;
+    size_t cap;
+    struct columns cols;
+    double prev_t;
+};
+
+static int trace_open(struct trace *tr, const char *path, char *err, size_t err_sz) {
+    memset(tr, 0, sizeof(*tr));
+    tr->f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!tr->f) {
+        snprintf(err, err_sz, "open %s failed: %s", path, strerror(errno));
+        return -1;
+    }
+    setvbuf(tr->f, NULL, _IOFBF, 1 << 20);
+    if (getline(&tr->line, &tr->cap, tr->f) <= 0 || find_columns(tr->line, &tr->cols) != 0) {
+        snprintf(err, err_sz, "%s: header needs pkg_w and t_s or interval_s", path);
+        return -1;
+    }
+    tr->prev_t = -1.0;
+    return 0;
+}
+
+/* 1 with a row, 0 at the end. Rows without a usable interval are skipped. */
+static int trace_next(struct trace *tr, struct trace_row *row) {
+    while (getline(&tr->line, &tr->cap, tr->f) > 0) {
+        if (parse_row(tr->line, &tr->cols, tr->prev_t, row) != 0) {
+            continue;
+        }
+        tr->prev_t = row->t;
+        if (row->dt > 0.0 && row->dt <= 60.0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int trace_rewind(struct trace *tr, char *err, size_t err_sz) {
+    if (fseek(tr->f, 0, SEEK_SET) != 0 || getline(&tr->line, &tr->cap, tr->f) <= 0) {
+        snprintf(err, err_sz, "cannot rewind the trace: %s", strerror(errno));
+        return -1;
+    }
+    tr->prev_t = -1.0;
+    return 0;
+}
+
+static void trace_close(struct trace *tr) {
+    if (tr->f && tr->f != stdin) {
+        fclose(tr->f);
+    }
+    free(tr->line);
+}
+
+int main(int argc, char **argv) {
+    double tjmax = DEFAULT_TJMAX_C;
+    struct ld_thermal_params thermal = { 0 };
+    int thermal_mode = 0;   /* 0 fit, 1 given, -1 off */
+    const char *path = NULL;
+    int n = 0;
+    char err[512];
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+            usage(argv[0]);
+            return 2;
+        } else if (!strcmp(argv[i], "--tjmax") && i + 1 < argc) {
+            char *end = NULL;
+            tjmax = strtod(argv[++i], &end);
+            if (*end || tjmax <= 0.0) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!strcmp(argv[i], "--thermal") && i + 1 < argc) {
+            if (!parse_triple(argv[++i], &thermal.tau_s, &thermal.r_c_per_w, &thermal.ambient_c, 1) ||
+                thermal.tau_s <= 0.0 || thermal.r_c_per_w <= 0.0) {
+                usage(argv[0]);
+                return 2;
+            }
+            thermal.valid = 1;
+            thermal_mode = 1;
+        } else if (!strcmp(argv[i], "--no-thermal")) {
+            thermal_mode = -1;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            double tau = DEFAULT_TAU_S;
+            if (n == MAX_CONFIGS || !parse_triple(argv[i], &sim_pl1[n], &sim_pl2[n], &tau, 0) || sim_pl1[n] <= 0.0 ||
+                sim_pl2[n] < sim_pl1[n] || tau <= 0.0) {
+                snprintf(err, sizeof(err), "bad candidate '%s' (PL1:PL2[:TAU], PL2 >= PL1, at most %d)", argv[i],
+                         MAX_CONFIGS);
+                return json_error(err);
+            }
+            sim_tau[n++] = tau;
+        }
+    }
+    if (!path || n == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (thermal_mode == 0 && !strcmp(path, "-")) {
+        return json_error("stdin cannot be read twice; pass --thermal TAU:R:AMB or --no-thermal");
+    }
+
+    struct trace tr;
+    if (trace_open(&tr, path, err, sizeof(err)) != 0) {
+        trace_close(&tr);
+        return json_error(err);
+    }
+    struct trace_row row;
+
+    double first_temp = -1.0;
+    if (thermal_mode == 0) {
+        struct ld_thermal_model model;
+        ld_thermal_model_init(&model);
+        double t = 0.0;
+        while (trace_next(&tr, &row)) {
+            t += row.dt;
+            if (row.temp_c > 0.0) {
+                ld_thermal_model_update(&model, t, row.temp_c, row.power_w);
+            }
+        }
+        if (ld_thermal_model_params(&model, &thermal) != 0) {
+            thermal_mode = -1;
+        }
+        if (trace_rewind(&tr, err, sizeof(err)) != 0) {
+            trace_close(&tr);
+            return json_error(err);
+        }
+    }
+
+    size_t rows = 0;
+    double duration = 0.0;
+    double energy = 0.0;
+    double peak = -1.0;
+    double limited_s = 0.0;
+    double ratio_s = 0.0;
+    int have_ratio = 0;
+    uint32_t power_limited = LD_FIELD_MASK(LD_PERF_LIMIT_PL1) | LD_FIELD_MASK(LD_PERF_LIMIT_PL2);
+    double last_dt = -1.0;
+    double beta = 0.0;
+    double hold_w = INFINITY;
+    if (thermal_mode >= 0) {
+        hold_w = (tjmax - thermal.ambient_c) / thermal.r_c_per_w;
+    }
+
+    while (trace_next(&tr, &row)) {
+        double dt = row.dt;
+        double demand = row.power_w;
+        if (rows == 0) {
+            first_temp = row.temp_c > 0.0 ? row.temp_c : thermal.ambient_c + thermal.r_c_per_w * demand;
+            for (int c = 0; c < n; c++) {
+                sim_avg[c] = demand < sim_pl1[c] ? demand : sim_pl1[c];
+                sim_temp[c] = first_temp;
+                sim_peak[c] = first_temp;
+            }
+        }
+        // Every row carries its own interval; the exponentials are recomputed only when it differs from the last
+        // one, which a fixed-rate trace mostly does not.
+        if (dt != last_dt) {
+            for (int c = 0; c < n; c++) {
+                sim_alpha[c] = 1.0 - exp(-dt / sim_tau[c]);
+            }
+            beta = thermal_mode >= 0 ? exp(-dt / thermal.tau_s) : 0.0;
+            last_dt = dt;
+        }
+        rows++;
+        duration += dt;
+        energy += demand * dt;
+        if (row.temp_c > peak) {
+            peak = row.temp_c;
+        }
+        if (row.reasons & power_limited) {
+            limited_s += dt;
+        }
+        if (row.ratio >= 0.0) {
+            have_ratio = 1;
+            ratio_s += row.ratio * dt;
+        }
+
+        for (int c = 0; c < n; c++) {
+            double cap = sim_avg[c] < sim_pl1[c] ? sim_pl2[c] : sim_pl1[c];
+            int hot = thermal_mode >= 0 && sim_temp[c] >= tjmax;
+            if (hot && hold_w < cap) {
+                cap = hold_w;
+            }
+            double p = demand < cap ? demand : cap;
+            double clipped = demand - p;
+            sim_energy[c] += p * dt;
+            sim_clipped[c] += clipped * dt;
+            sim_throttled[c] += clipped > 0.0 ? dt : 0.0;
+            sim_thermal_s[c] += hot ? dt : 0.0;
+            sim_avg[c] += (p - sim_avg[c]) * sim_alpha[c];
+            if (thermal_mode >= 0) {
+                double steady = thermal.ambient_c + thermal.r_c_per_w * p;
+                sim_temp[c] = steady + (sim_temp[c] - steady) * beta;
+                sim_peak[c] = sim_temp[c] > sim_peak[c] ? sim_temp[c] : sim_peak[c];
+            }
+            if (row.ratio >= 0.0) {
+                sim_ratio_s[c] += row.ratio * (clipped > 0.0 ? pow(p / demand, RATIO_POWER_EXP) : 1.0) * dt;
+            }
+        }
+    }
+    int read_failed = ferror(tr.f);
+    trace_close(&tr);
+    if (read_failed) {
+        return json_error("read error in the trace");
+    }
+    if (rows == 0) {
+        return json_error("no usable rows (pkg_w plus t_s or interval_s)");
+    }
+
+    printf("{\"cmd\":\"rapl_sim\",\"ok\":true,\"file\":");
+    json_string(path);
+    printf(",\"rows\":%zu,\"duration_s\":%.1f,\"energy_j\":%.1f,\"avg_w\":%.2f,\"limited_in_trace_s\":%.1f,", rows,
+           duration, energy, energy / duration, limited_s);
+    if (peak > 0.0) {
+        printf("\"peak_temp_c\":%.1f,", peak);
+    }
+    if (have_ratio) {
+        printf("\"mean_ratio\":%.2f,", ratio_s / duration);
+    }
+    printf("\"tjmax_c\":%.1f,\"thermal\":", tjmax);
+    if (thermal_mode >= 0) {
+        printf("{\"source\":\"%s\",\"tau_s\":%.1f,\"r_c_per_w\":%.3f,\"ambient_c\":%.1f}",
+               thermal_mode == 1 ? "given" : "fit", thermal.tau_s, thermal.r_c_per_w, thermal.ambient_c);
+    } else {
+        printf("null");
+    }
+    printf(",\"results\":[");
+    for (int c = 0; c < n; c++) {
+        printf("%s{\"pl1_w\":%.1f,\"pl2_w\":%.1f,\"tau_s\":%.1f,\"throttled_s\":%.1f,\"throttled_pct\":%.2f,"
+               "\"clipped_j\":%.1f,\"energy_j\":%.1f,\"avg_w\":%.2f",
+               c ? "," : "", sim_pl1[c], sim_pl2[c], sim_tau[c], sim_throttled[c], 100.0 * sim_throttled[c] / duration,
+               sim_clipped[c], sim_energy[c], sim_energy[c] / duration);
+        if (thermal_mode >= 0) {
+            printf(",\"peak_temp_c\":%.1f,\"at_tjmax_s\":%.1f", sim_peak[c], sim_thermal_s[c]);
+        }
+        if (have_ratio) {
+            printf(",\"mean_ratio\":%.2f", sim_ratio_s[c] / duration);
+        }
+        printf("}");
+    }
+    printf("]}\n");
+    return 0;
+}
@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+
+/*
+ * ld_cpu_set_online_at() against a scratch sysfs tree: cpuN/online are
+ * plain files, and a directory in place of one makes its open() fail
+ * partway through the batch.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ld_hotplug.h"
+
+static int failures;
+
+#define CHECK(cond)                                                                                               \
+    do {                                                                                                          \
+        if (!(cond)) {                                                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                              \
+            failures++;                                                                                           \
+        }                                                                                                         \
+    } while (0)
+
+static char root[64];
+
+static void make_cpu(int cpu, int as_dir) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/cpu%d", root, cpu);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/cpu%d/online", root, cpu);
+    if (as_dir) {
+        mkdir(path, 0755);
+        return;
+    }
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fputs("1\n", f);
+        fclose(f);
+    }
+}
+
+static char state_of(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/cpu%d/online", root, cpu);
+    FILE *f = fopen(path, "r");
+    int c = f ? fgetc(f) : EOF;
+    if (f) {
+        fclose(f);
+    }
+    return c == EOF ? '?' : (char)c;
+}
+
+static void cleanup(void) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "could not remove %s\n", root);
+    }
+}
+
+int main(void) {
+    snprintf(root, sizeof(root), "/tmp/ld_hotplug_test.XXXXXX");
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    // The helper's stdin is its command pipe; make sure fd 0 is open so a stray close(0) shows.
+    if (fcntl(0, F_GETFD) < 0 && open("/dev/null", O_RDONLY) != 0) {
+        perror("open /dev/null");
+        return 1;
+    }
+
+    struct ld_cpu_list cpus;
+    struct ld_cpu_list changed;
+    ld_cpu_list_init(&cpus);
+    ld_cpu_list_init(&changed);
+    char err[256] = { 0 };
+
+    // A whole batch goes offline; CPU0 is never touched.
+    for (int cpu = 0; cpu <= 4; cpu++) {
+        make_cpu(cpu, 0);
+        ld_cpu_list_add(&cpus, cpu);
+    }
+    CHECK(ld_cpu_set_online_at(root, &cpus, 0, &changed, err, sizeof(err)) == 0);
+    CHECK(changed.count == 4);
+    CHECK(state_of(0) == '1');
+    for (int cpu = 1; cpu <= 4; cpu++) {
+        CHECK(state_of(cpu) == '0');
+    }
+
+    // cpu7's online file cannot be opened: nothing is written, and no fd that was never opened is closed.
+    ld_cpu_list_free(&cpus);
+    ld_cpu_list_free(&changed);
+    ld_cpu_list_init(&cpus);
+    ld_cpu_list_init(&changed);
+    for (int cpu = 5; cpu <= 9; cpu++) {
+        make_cpu(cpu, cpu == 7);
+        ld_cpu_list_add(&cpus, cpu);
+    }
+    err[0] = '\0';
+    CHECK(ld_cpu_set_online_at(root, &cpus, 0, &changed, err, sizeof(err)) == -1);
+    CHECK(strstr(err, "cpu7/online") != NULL);
+    CHECK(changed.count == 0);
+    CHECK(state_of(5) == '1' && state_of(6) == '1' && state_of(8) == '1' && state_of(9) == '1');
+    CHECK(fcntl(0, F_GETFD) >= 0);
+
+    ld_cpu_list_free(&cpus);
+    ld_cpu_list_free(&changed);
+    cleanup();
+    if (failures) {
+        fprintf(stderr, "test_hotplug: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_hotplug: ok\n");
+    return 0;
+}
@@ -0,0 +1,277 @@
+#define _GNU_SOURCE
+
+/*
+ * ld_systemd against a mock manager: a forked peer on the other end of a
+ * socketpair plays the bus daemon and systemd, answering Hello, AddMatch,
+ * Subscribe and the unit calls and emitting JobRemoved, so submit/process/
+ * wait run over real D-Bus framing without a system bus.
+ *
+ * The peer exits non-zero when it saw an unexpected call or a Reload count
+ * other than one per enable/disable batch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ld_systemd.h"
+
+#define MANAGER_PATH "/org/freedesktop/systemd1"
+#define MANAGER_IFACE "org.freedesktop.systemd1.Manager"
+
+static int failures;
+
+#define CHECK(cond)                                                                                               \
+    do {                                                                                                          \
+        if (!(cond)) {                                                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                              \
+            failures++;                                                                                           \
+        }                                                                                                         \
+    } while (0)
+
+/* ---- mock peer ---- */
+
+struct peer {
+    struct ld_dbus bus;
+    uint32_t next_job;
+    int reloads;
+    int bad;
+};
+
+/* Reads the client's auth lines up to BEGIN, byte by byte so no message bytes are consumed. */
+static int peer_auth(int fd) {
+    char line[256];
+    size_t len = 0;
+    for (;;) {
+        char ch;
+        if (read(fd, &ch, 1) != 1) {
+            return -1;
+        }
+        if (ch == '\0' && len == 0) {
+            continue;
+        }
+        if (ch != '\n') {
+            if (len + 1 < sizeof(line)) {
+                line[len++] = ch;
+            }
+            continue;
+        }
+        line[len] = '\0';
+        len = 0;
+        if (strncmp(line, "AUTH EXTERNAL ", 14) == 0) {
+            static const char ok[] = "OK 0123456789abcdef0123456789abcdef\r\n";
+            if (write(fd, ok, sizeof(ok) - 1) != (ssize_t)(sizeof(ok) - 1)) {
+                return -1;
+            }
+        } else if (strncmp(line, "BEGIN", 5) == 0) {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+}
+
+static void peer_reply(struct peer *p, const struct ld_dbus_msg *call, const char *sig, const struct ld_dbus_buf *body) {
+    struct ld_dbus_out m = { LD_DBUS_METHOD_RETURN, 0, NULL, NULL, NULL, NULL, NULL, sig, call->serial };
+    if (ld_dbus_send(&p->bus, &m, body, NULL, NULL, 0) != 0) {
+        p->bad = 1;
+    }
+}
+
+static void peer_error(struct peer *p, const struct ld_dbus_msg *call, const char *name, const char *text) {
+    struct ld_dbus_buf body = { 0 };
+    ld_dbus_put_string(&body, text);
+    struct ld_dbus_out m = { LD_DBUS_ERROR, 0, NULL, NULL, NULL, NULL, name, "s", call->serial };
+    if (ld_dbus_send(&p->bus, &m, &body, NULL, NULL, 0) != 0) {
+        p->bad = 1;
+    }
+    ld_dbus_buf_free(&body);
+}
+
+static void peer_job_removed(struct peer *p, uint32_t id, const char *path, const char *unit, const char *result) {
+    struct ld_dbus_buf body = { 0 };
+    ld_dbus_put_u32(&body, id);
+    ld_dbus_put_string(&body, path);
+    ld_dbus_put_string(&body, unit);
+    ld_dbus_put_string(&body, result);
+    struct ld_dbus_out m = { LD_DBUS_SIGNAL, 0, NULL, MANAGER_PATH, MANAGER_IFACE, "JobRemoved", NULL, "uoss", 0 };
+    if (ld_dbus_send(&p->bus, &m, &body, NULL, NULL, 0) != 0) {
+        p->bad = 1;
+    }
+    ld_dbus_buf_free(&body);
+}
+
+/* StartUnit/StopUnit: a job object, finished right away; units named "fail-*" fail, "missing-*" do not exist. */
+static void peer_unit_job(struct peer *p, const struct ld_dbus_msg *call) {
+    struct ld_dbus_iter it = call->body;
+    const char *unit = NULL;
+    const char *mode = NULL;
+    if (!call->signature || strcmp(call->signature, "ss") != 0 || ld_dbus_get_string(&it, &unit) != 0 ||
+        ld_dbus_get_string(&it, &mode) != 0 || strcmp(mode, "replace") != 0) {
+        p->bad = 1;
+        return;
+    }
+    if (strncmp(unit, "missing-", 8) == 0) {
+        peer_error(p, call, "org.freedesktop.systemd1.NoSuchUnit", "Unit not loaded.");
+        return;
+    }
+    uint32_t id = p->next_job++;
+    char path[64];
+    snprintf(path, sizeof(path), MANAGER_PATH "/job/%u", id);
+    struct ld_dbus_buf body = { 0 };
+    ld_dbus_put_string(&body, path);
+    peer_reply(p, call, "o", &body);
+    ld_dbus_buf_free(&body);
+    peer_job_removed(p, id, path, unit, strncmp(unit, "fail-", 5) == 0 ? "failed" : "done");
+}
+
+static void peer_unit_files(struct peer *p, const struct ld_dbus_msg *call, int enable) {
+    struct ld_dbus_iter it = call->body;
+    size_t end = 0;
+    const char *unit = NULL;
+    if (!call->signature || strcmp(call->signature, enable ? "asbb" : "asb") != 0 ||
+        ld_dbus_array_enter(&it, 4, &end) != 0 || ld_dbus_get_string(&it, &unit) != 0 || it.pos != end) {
+        p->bad = 1;
+        return;
+    }
+    // carries_install_info, then an empty changes list.
+    struct ld_dbus_buf body = { 0 };
+    struct ld_dbus_array changes;
+    if (enable) {
+        ld_dbus_put_bool(&body, 1);
+    }
+    ld_dbus_array_begin(&body, 8, &changes);
+    ld_dbus_array_end(&body, &changes);
+    peer_reply(p, call, enable ? "ba(sss)" : "a(sss)", &body);
+    ld_dbus_buf_free(&body);
+}
+
+static int run_peer(int fd) {
+    struct peer p = { .next_job = 100 };
+    if (peer_auth(fd) != 0) {
+        return 2;
+    }
+    p.bus.fd = fd;
+    p.bus.next_serial = 1;
+    for (;;) {
+        struct ld_dbus_msg msg;
+        if (ld_dbus_read(&p.bus, &msg, -1, NULL, 0) != 1) {
+            break;  /* client closed its end */
+        }
+        const char *member = msg.member ? msg.member : "";
+        if (msg.type != LD_DBUS_METHOD_CALL) {
+            p.bad = 1;
+        } else if (strcmp(member, "Hello") == 0) {
+            struct ld_dbus_buf body = { 0 };
+            ld_dbus_put_string(&body, ":1.42");
+            peer_reply(&p, &msg, "s", &body);
+            ld_dbus_buf_free(&body);
+        } else if (strcmp(member, "AddMatch") == 0 || strcmp(member, "Subscribe") == 0) {
+            peer_reply(&p, &msg, NULL, NULL);
+        } else if (strcmp(member, "StartUnit") == 0 || strcmp(member, "StopUnit") == 0) {
+            peer_unit_job(&p, &msg);
+        } else if (strcmp(member, "EnableUnitFiles") == 0 || strcmp(member, "DisableUnitFiles") == 0) {
+            peer_unit_files(&p, &msg, member[0] == 'E');
+        } else if (strcmp(member, "Reload") == 0) {
+            p.reloads++;
+            peer_reply(&p, &msg, NULL, NULL);
+        } else {
+            fprintf(stderr, "mock bus: unexpected call %s\n", member);
+            p.bad = 1;
+        }
+        ld_dbus_msg_free(&msg);
+    }
+    if (p.reloads != 2) {
+        fprintf(stderr, "mock bus: %d Reload calls, want 2 (one per enable/disable batch)\n", p.reloads);
+        p.bad = 1;
+    }
+    ld_dbus_close(&p.bus);
+    return p.bad ? 1 : 0;
+}
+
+/* ---- client side ---- */
+
+static const struct ld_systemd_job *run_batch(struct ld_systemd *sd, const char *action, const char *const *units,
+                                              size_t count) {
+    uint32_t first_id = 0;
+    char err[256] = { 0 };
+    if (ld_systemd_submit(sd, action, units, count, &first_id, err, sizeof(err)) != 0) {
+        fprintf(stderr, "submit %s: %s\n", action, err);
+        failures++;
+        return NULL;
+    }
+    CHECK(ld_systemd_wait(sd, first_id, count, 2000, err, sizeof(err)) == 0);
+    return ld_systemd_job(sd, first_id);
+}
+
+static enum ld_systemd_state state_of(const struct ld_systemd *sd, const struct ld_systemd_job *first, size_t i) {
+    const struct ld_systemd_job *job = first ? ld_systemd_job(sd, first->id + (uint32_t)i) : NULL;
+    return job ? job->state : LD_SYSTEMD_QUEUED;
+}
+
+int main(void) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        _exit(run_peer(sv[1]));
+    }
+    close(sv[1]);
+
+    struct ld_systemd sd;
+    memset(&sd, 0, sizeof(sd));
+    char err[256] = { 0 };
+    if (ld_systemd_open_fd(&sd, sv[0], err, sizeof(err)) != 0) {
+        fprintf(stderr, "open: %s\n", err);
+        return 1;
+    }
+    CHECK(strcmp(sd.bus.unique_name, ":1.42") == 0);
+
+    // start: the job finishes on JobRemoved, with JobRemoved's result.
+    static const char *const start_units[] = { "a.service", "fail-b.service" };
+    const struct ld_systemd_job *job = run_batch(&sd, "start", start_units, 2);
+    CHECK(state_of(&sd, job, 0) == LD_SYSTEMD_DONE);
+    CHECK(state_of(&sd, job, 1) == LD_SYSTEMD_FAILED);
+    CHECK(job && strncmp(job->job_path, MANAGER_PATH "/job/", strlen(MANAGER_PATH "/job/")) == 0);
+
+    // stop of a unit that is not installed is skipped, not failed; the rest of the batch still runs.
+    static const char *const stop_units[] = { "missing-x.service", "c.service" };
+    job = run_batch(&sd, "stop", stop_units, 2);
+    CHECK(state_of(&sd, job, 0) == LD_SYSTEMD_SKIPPED);
+    CHECK(state_of(&sd, job, 1) == LD_SYSTEMD_DONE);
+
+    // Unit file changes finish after the batch's single Reload (the peer counts them).
+    static const char *const enable_units[] = { "x.service", "y.service", "z.service" };
+    job = run_batch(&sd, "enable", enable_units, 3);
+    for (size_t i = 0; i < 3; i++) {
+        CHECK(state_of(&sd, job, i) == LD_SYSTEMD_DONE);
+    }
+    static const char *const disable_units[] = { "x.service" };
+    job = run_batch(&sd, "disable", disable_units, 1);
+    CHECK(state_of(&sd, job, 0) == LD_SYSTEMD_DONE);
+
+    CHECK(ld_systemd_pending(&sd) == 0);
+    ld_systemd_close(&sd);
+
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    if (failures) {
+        fprintf(stderr, "test_systemd: %d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("test_systemd: ok\n");
+    return 0;
+}